@@ -1554,7 +1554,7 @@ struct ggml_tensor* sam_decode_mask_transformer_attn(
     K = ggml_cont(ctx0, ggml_permute(ctx0, K, 0, 2, 1, 3));
 
     V = ggml_reshape_4d(ctx0, Vcur, Vcur->ne[0]/n_head, n_head, Vcur->ne[1], Vcur->ne[2]);
-    V = ggml_cont(ctx0, ggml_permute(ctx0, V, 0, 2, 1, 3));
+    V = ggml_permute(ctx0, V, 0, 2, 1, 3);
 
     // Q * K
     struct ggml_tensor * KQ = ggml_mul_mat(ctx0, K, Q);
@@ -1563,7 +1563,7 @@ struct ggml_tensor* sam_decode_mask_transformer_attn(
 
     struct ggml_tensor * KQ_soft_max = ggml_soft_max_inplace(ctx0, KQ_scaled);
 
-    struct ggml_tensor * KQV = ggml_mul_mat(ctx0, KQ_soft_max, ggml_cont(ctx0, ggml_transpose(ctx0, V)));
+    struct ggml_tensor * KQV = ggml_mul_mat(ctx0, KQ_soft_max, ggml_transpose(ctx0, V));
 
     struct ggml_tensor * KQV_merged = ggml_cont(ctx0, ggml_transpose(ctx0, KQV));
     KQV_merged = ggml_cont(ctx0, ggml_permute(ctx0, KQV_merged, 0, 2, 1, 3));
@@ -34,6 +34,7 @@ struct conv2d_layer {
 struct yolo_model {
     int width = 416;
     int height = 416;
+    bool conv_direct = true; // ggml_conv_2d_direct instead of im2col + mul_mat
     std::vector<conv2d_layer> conv2d_layers;
     ggml_backend_t backend;
     ggml_backend_buffer_t buffer;
@@ -100,6 +101,8 @@ static bool load_model(const std::string & fname, yolo_model & model) {
         ggml_set_name(dst, name);
     }
     model.buffer = ggml_backend_alloc_ctx_tensors(model.ctx, model.backend);
+    // lets the backend cache the transformed weights, e.g. the Winograd transforms of the CPU backend
+    ggml_backend_buffer_set_usage(model.buffer, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
     // copy tensors from main memory to backend
     for (struct ggml_tensor * cur = ggml_get_first_tensor(model.ctx); cur != NULL; cur = ggml_get_next_tensor(model.ctx, cur)) {
         struct ggml_tensor * src = ggml_get_tensor(tmp_ctx, ggml_get_name(cur));
@@ -167,15 +170,18 @@ static bool load_alphabet(std::vector<yolo_image> & alphabet)
     return true;
 }
 
-static ggml_tensor * apply_conv2d(ggml_context * ctx, ggml_tensor * input, const conv2d_layer & layer)
+static ggml_tensor * apply_conv2d(ggml_context * ctx, ggml_tensor * input, const conv2d_layer & layer, bool direct)
 {
-    struct ggml_tensor * result = ggml_conv_2d(ctx, layer.weights, input, 1, 1, layer.padding, layer.padding, 1, 1);
+    struct ggml_tensor * result = direct ?
+        ggml_conv_2d_direct(ctx, layer.weights, input, 1, 1, layer.padding, layer.padding, 1, 1) :
+        ggml_conv_2d       (ctx, layer.weights, input, 1, 1, layer.padding, layer.padding, 1, 1);
     if (layer.batch_normalize) {
-        result = ggml_sub(ctx, result, ggml_repeat(ctx, layer.rolling_mean, result));
-        result = ggml_div(ctx, result, ggml_sqrt(ctx, ggml_repeat(ctx, layer.rolling_variance, result)));
-        result = ggml_mul(ctx, result, ggml_repeat(ctx, layer.scales, result));
+        // the per-channel parameters are broadcast over the feature map
+        result = ggml_sub(ctx, result, layer.rolling_mean);
+        result = ggml_div(ctx, result, ggml_sqrt(ctx, layer.rolling_variance));
+        result = ggml_mul(ctx, result, layer.scales);
     }
-    result = ggml_add(ctx, result, ggml_repeat(ctx, layer.biases, result));
+    result = ggml_add(ctx, result, layer.biases);
     if (layer.activate) {
         result = ggml_leaky_relu(ctx, result, 0.1f, true);
     }
@@ -395,53 +401,53 @@ static struct ggml_cgraph * build_graph(struct ggml_context * ctx_cgraph, const
 
     struct ggml_tensor * input = ggml_new_tensor_4d(ctx_cgraph, GGML_TYPE_F32, model.width, model.height, 3, 1);
     ggml_set_name(input, "input");
-    struct ggml_tensor * result = apply_conv2d(ctx_cgraph, input, model.conv2d_layers[0]);
+    struct ggml_tensor * result = apply_conv2d(ctx_cgraph, input, model.conv2d_layers[0], model.conv_direct);
     print_shape(0, result);
     result = ggml_pool_2d(ctx_cgraph, result, GGML_OP_POOL_MAX, 2, 2, 2, 2, 0, 0);
     print_shape(1, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[1]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[1], model.conv_direct);
     print_shape(2, result);
     result = ggml_pool_2d(ctx_cgraph, result, GGML_OP_POOL_MAX, 2, 2, 2, 2, 0, 0);
     print_shape(3, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[2]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[2], model.conv_direct);
     print_shape(4, result);
     result = ggml_pool_2d(ctx_cgraph, result, GGML_OP_POOL_MAX, 2, 2, 2, 2, 0, 0);
     print_shape(5, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[3]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[3], model.conv_direct);
     print_shape(6, result);
     result = ggml_pool_2d(ctx_cgraph, result, GGML_OP_POOL_MAX, 2, 2, 2, 2, 0, 0);
     print_shape(7, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[4]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[4], model.conv_direct);
     struct ggml_tensor * layer_8 = result;
     print_shape(8, result);
     result = ggml_pool_2d(ctx_cgraph, result, GGML_OP_POOL_MAX, 2, 2, 2, 2, 0, 0);
     print_shape(9, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[5]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[5], model.conv_direct);
     print_shape(10, result);
     result = ggml_pool_2d(ctx_cgraph, result, GGML_OP_POOL_MAX, 2, 2, 1, 1, 0.5, 0.5);
     print_shape(11, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[6]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[6], model.conv_direct);
     print_shape(12, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[7]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[7], model.conv_direct);
     struct ggml_tensor * layer_13 = result;
     print_shape(13, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[8]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[8], model.conv_direct);
     print_shape(14, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[9]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[9], model.conv_direct);
     struct ggml_tensor * layer_15 = result;
     ggml_set_output(layer_15);
     ggml_set_name(layer_15, "layer_15");
 
     print_shape(15, result);
-    result = apply_conv2d(ctx_cgraph, layer_13, model.conv2d_layers[10]);
+    result = apply_conv2d(ctx_cgraph, layer_13, model.conv2d_layers[10], model.conv_direct);
     print_shape(18, result);
     result = ggml_upscale(ctx_cgraph, result, 2, GGML_SCALE_MODE_NEAREST);
     print_shape(19, result);
     result = ggml_concat(ctx_cgraph, result, layer_8, 2);
     print_shape(20, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[11]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[11], model.conv_direct);
     print_shape(21, result);
-    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[12]);
+    result = apply_conv2d(ctx_cgraph, result, model.conv2d_layers[12], model.conv_direct);
     struct ggml_tensor * layer_22 = result;
     ggml_set_output(layer_22);
     ggml_set_name(layer_22, "layer_22");
@@ -485,6 +491,7 @@ struct yolo_params {
     std::string fname_out = "predictions.jpg";
     int         n_threads  = std::max(1U, std::thread::hardware_concurrency()/2);
     std::string device;
+    bool        conv_direct = true;
 };
 
 void yolo_print_usage(int argc, char ** argv, const yolo_params & params) {
@@ -498,6 +505,8 @@ void yolo_print_usage(int argc, char ** argv, const yolo_params & params) {
     fprintf(stderr, "  -m,  --model FNAME         model path (default: %s)\n", params.model.c_str());
     fprintf(stderr, "  -i,  --inp FNAME           input file (default: %s)\n", params.fname_inp.c_str());
     fprintf(stderr, "  -o,  --out FNAME           output file (default: %s)\n", params.fname_out.c_str());
+    fprintf(stderr, "  -cd, --conv-direct         use direct convolutions if the device supports them (default)\n");
+    fprintf(stderr, "  -ci, --conv-im2col         use im2col + mul_mat instead of direct convolutions\n");
     fprintf(stderr, "\n");
 }
 
@@ -541,6 +550,10 @@ bool yolo_params_parse(int argc, char ** argv, yolo_params & params) {
                 }
                 return false;
             }
+        } else if (arg == "-cd" || arg == "--conv-direct") {
+            params.conv_direct = true;
+        } else if (arg == "-ci" || arg == "--conv-im2col") {
+            params.conv_direct = false;
         } else if (arg == "-h" || arg == "--help") {
             yolo_print_usage(argc, argv, params);
             exit(0);
@@ -554,6 +567,15 @@ bool yolo_params_parse(int argc, char ** argv, yolo_params & params) {
     return true;
 }
 
+static bool backend_supports_graph(ggml_backend_t backend, struct ggml_cgraph * gf) {
+    for (int i = 0; i < ggml_graph_n_nodes(gf); i++) {
+        if (!ggml_backend_supports_op(backend, ggml_graph_node(gf, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static ggml_backend_t create_backend(const yolo_params & params) {
     ggml_backend_t backend = nullptr;
 
@@ -637,7 +659,15 @@ int main(int argc, char *argv[])
         /*.no_alloc   =*/ true, // the tensors will be allocated later by ggml_gallocr_alloc_graph()
     };
     struct ggml_context * ctx_cgraph = ggml_init(params0);
+    model.conv_direct = params.conv_direct;
     struct ggml_cgraph * gf = build_graph(ctx_cgraph, model);
+    if (model.conv_direct && !backend_supports_graph(model.backend, gf)) {
+        fprintf(stderr, "%s: %s does not support direct convolutions, using im2col + mul_mat\n", __func__, ggml_backend_name(model.backend));
+        ggml_free(ctx_cgraph);
+        ctx_cgraph = ggml_init(params0);
+        model.conv_direct = false;
+        gf = build_graph(ctx_cgraph, model);
+    }
 
     ggml_gallocr_t allocr = ggml_gallocr_new(ggml_backend_get_default_buffer_type(model.backend));
     ggml_gallocr_alloc_graph(allocr, gf);
@@ -7,6 +7,8 @@
 extern "C" {
 #endif
 
+    struct ggml_cpu_profile;
+
     // the compute plan that needs to be prepared for ggml_graph_compute()
     // since https://github.com/ggml-org/ggml/issues/287
     struct ggml_cplan {
@@ -19,6 +21,27 @@ extern "C" {
         // abort ggml_graph_compute when true
         ggml_abort_callback abort_callback;
         void *              abort_callback_data;
+
+        // dependency-aware scheduling: only synchronize the threads between nodes that depend on each other
+        // initialized from the threadpool params by ggml_graph_plan()
+        bool dep_sched;
+
+        // record the time of each node in the profile when not NULL, see ggml_cpu_profile_new()
+        struct ggml_cpu_profile * profile;
+
+        // tail of the work buffer that keeps the quantized src1 of a mul_mat for the next mul_mats with the same src1
+        // calculated by `ggml_graph_plan()`, included in work_size
+        size_t src1_cache_size;
+    };
+
+    // idle/wakeup statistics of the threadpool workers, summed over all workers
+    // not collected with OpenMP
+    struct ggml_threadpool_stats {
+        uint64_t n_spin;    // graphs picked up while spinning
+        uint64_t n_sleep;   // graphs picked up after sleeping
+        int64_t  t_wake_us; // total time from kickoff to the sleeping workers picking up the graph
+        int32_t  spin_us;   // current spin limit, adapted to the time between graphs
+        int64_t  gap_us;    // moving average of the time between graphs
     };
 
     // numa strategies
@@ -57,6 +80,41 @@ extern "C" {
     GGML_BACKEND_API int                           ggml_threadpool_get_n_threads (struct ggml_threadpool * threadpool);
     GGML_BACKEND_API void                          ggml_threadpool_pause         (struct ggml_threadpool * threadpool);
     GGML_BACKEND_API void                          ggml_threadpool_resume        (struct ggml_threadpool * threadpool);
+    // thread groups: compute independent graphs concurrently on disjoint workers of one threadpool
+    // the group takes params->n_threads workers of the threadpool with their CPU placement, the other parameters are taken from params
+    // the thread calling ggml_graph_compute() with the group takes the place of its first worker
+    // while the group exists, the threadpool only uses the workers below the ones taken by its groups
+    // groups must not be created or freed while the threadpool is computing a graph, free them with ggml_threadpool_free()
+    // returns NULL if the threadpool does not have enough free workers
+    GGML_BACKEND_API struct ggml_threadpool *      ggml_threadpool_new_group     (struct ggml_threadpool * threadpool, struct ggml_threadpool_params * params);
+
+    // must not be called while a graph is being computed on the threadpool
+    GGML_BACKEND_API void                          ggml_threadpool_get_stats     (struct ggml_threadpool * threadpool, struct ggml_threadpool_stats * stats);
+    GGML_BACKEND_API void                          ggml_threadpool_reset_stats   (struct ggml_threadpool * threadpool);
+
+    // autotuning of the number of threads and of the mul_mat chunk size for each (op, types, shape), off by default
+    // the first graphs time the nodes with different work splits, the best ones are used from then on
+    // the tuned settings are loaded from path if it exists, and saved to it by ggml_cpu_tune_save() (path can be NULL)
+    GGML_BACKEND_API bool ggml_cpu_tune_init(const char * path);
+    GGML_BACKEND_API bool ggml_cpu_tune_save(void);
+    GGML_BACKEND_API void ggml_cpu_tune_free(void);
+
+    // transforms of the weights cached by the CPU backend, e.g. the Winograd transforms of the conv_2d kernels
+    // only the tensors in buffers with GGML_BACKEND_BUFFER_USAGE_WEIGHTS are cached, by buffer, data address, type and shape
+    // the entries of a buffer are dropped when it is written through the backend API (ggml_backend_tensor_set, ...) or freed
+    // call this only after writing the data of a cached tensor directly through tensor->data (tensor NULL: all tensors)
+    GGML_BACKEND_API void ggml_cpu_weight_cache_invalidate(const struct ggml_tensor * tensor);
+
+    // profiling of the graphs computed with cplan.profile set: start and end time of each node on each thread
+    // and the time the threads wait in the barrier after it
+    // the profile grows with every graph until it is reset, it must not be shared by graphs computed concurrently
+    GGML_BACKEND_API struct ggml_cpu_profile * ggml_cpu_profile_new  (void);
+    GGML_BACKEND_API void                      ggml_cpu_profile_free (struct ggml_cpu_profile * prof);
+    GGML_BACKEND_API void                      ggml_cpu_profile_reset(struct ggml_cpu_profile * prof);
+    // write the events in the Chrome trace format, to be opened in chrome://tracing or https://ui.perfetto.dev
+    GGML_BACKEND_API bool                      ggml_cpu_profile_write_trace(const struct ggml_cpu_profile * prof, const char * fname);
+    // log the time, barrier wait and throughput of each op
+    GGML_BACKEND_API void                      ggml_cpu_profile_print(const struct ggml_cpu_profile * prof);
 
     // ggml_graph_plan() has to be called before ggml_graph_compute()
     // when plan.work_size > 0, caller must allocate memory for plan.work_data
@@ -130,6 +188,13 @@ extern "C" {
     GGML_BACKEND_API void ggml_backend_cpu_set_n_threads     (ggml_backend_t backend_cpu, int n_threads);
     GGML_BACKEND_API void ggml_backend_cpu_set_threadpool    (ggml_backend_t backend_cpu, ggml_threadpool_t threadpool);
     GGML_BACKEND_API void ggml_backend_cpu_set_abort_callback(ggml_backend_t backend_cpu, ggml_abort_callback abort_callback, void * abort_callback_data);
+    GGML_BACKEND_API void ggml_backend_cpu_set_profile       (ggml_backend_t backend_cpu, struct ggml_cpu_profile * profile);
+    // async mode: graph_compute and the async tensor copies are queued to a thread of the backend and return immediately
+    // wait with ggml_backend_synchronize() or with events before using the results or changing the inputs of the queued graphs
+    // the graphs are copied when queued and can be rebuilt by the caller right away
+    // errors of the queued graphs (e.g. GGML_STATUS_ABORTED) are returned by the next graph_compute
+    // the device does not report the async cap since its backends start in sync mode, the events are supported in both modes
+    GGML_BACKEND_API void ggml_backend_cpu_set_async         (ggml_backend_t backend_cpu, bool async);
 
     GGML_BACKEND_API ggml_backend_reg_t ggml_backend_cpu_reg(void);
 
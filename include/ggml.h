@@ -528,6 +528,7 @@ extern "C" {
         GGML_OP_ARANGE,
         GGML_OP_TIMESTEP_EMBEDDING,
         GGML_OP_ARGSORT,
+        GGML_OP_TOP_K,
         GGML_OP_LEAKY_RELU,
 
         GGML_OP_FLASH_ATTN_EXT,
@@ -2169,11 +2170,23 @@ extern "C" {
             float                 step);
 
     // top k elements per row
+    // view of a full descending argsort, supported by all backends that implement GGML_OP_ARGSORT
+    // ggml_top_k is kept on GGML_OP_ARGSORT because GGML_OP_TOP_K is only implemented by the CPU backend for now,
+    // graphs that select with it (e.g. MoE routing) would otherwise be split off the GPU backends
     GGML_API struct ggml_tensor * ggml_top_k(
             struct ggml_context * ctx,
             struct ggml_tensor  * a,
             int                   k);
 
+    // indices of the k largest elements per row, in descending order (ties by ascending index)
+    // same result as ggml_top_k, with partial selection instead of sorting the whole row (GGML_OP_TOP_K)
+    // check ggml_backend_supports_op before using it on a backend other than the CPU
+    // result: [k, ne1, ne2, ne3] of GGML_TYPE_I32
+    GGML_API struct ggml_tensor * ggml_argsort_top_k(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            int                   k);
+
 #define GGML_KQ_MASK_PAD 64
 
     // q:    [n_embd_k, n_batch,     n_head,    ne3 ]
@@ -2544,6 +2557,21 @@ extern "C" {
         GGML_SCHED_PRIO_REALTIME
     };
 
+    // threadpool barriers
+    enum ggml_barrier_type {
+        GGML_BARRIER_FLAT, // all threads arrive on a single counter
+        GGML_BARRIER_TREE, // combining tree following the NUMA node / L3 / core / SMT sibling topology
+    };
+
+    // threadpool placement policies, from the CPU topology (Linux only)
+    // each thread is bound to a single CPU, the CPUs are restricted to cpumask when it is set
+    enum ggml_cpu_placement {
+        GGML_CPU_PLACEMENT_NONE,    // use cpumask and strict_cpu
+        GGML_CPU_PLACEMENT_CORES,   // one thread per physical core, no SMT siblings
+        GGML_CPU_PLACEMENT_COMPACT, // fill the cores of an L3 domain (CCX) before the next one, SMT siblings last
+        GGML_CPU_PLACEMENT_SPREAD,  // round robin over the L3 domains
+    };
+
     // threadpool params
     // Use ggml_threadpool_params_default() or ggml_threadpool_params_init() to populate the defaults
     struct ggml_threadpool_params {
@@ -2553,6 +2581,9 @@ extern "C" {
         uint32_t            poll;                        // polling level (0 - no polling, 100 - aggressive polling)
         bool                strict_cpu;                  // strict cpu placement
         bool                paused;                      // start in paused state
+        bool                dep_sched;                   // skip barriers between independent graph nodes
+        enum ggml_barrier_type barrier;                  // barrier implementation (ignored with OpenMP)
+        enum ggml_cpu_placement placement;               // thread placement policy
     };
 
     struct ggml_threadpool;     // forward declaration, see ggml.c
@@ -63,6 +63,7 @@ extern "C" {
         void * context;
         size_t size;
         enum ggml_backend_buffer_usage usage;
+        uint64_t generation; // incremented by every write to the buffer through the backend API
     };
 
     GGML_API ggml_backend_buffer_t ggml_backend_buffer_init(
@@ -71,6 +72,13 @@ extern "C" {
                    void *                     context,
                    size_t                     size);
 
+    // called before a buffer is freed, e.g. by a backend that caches data derived from the tensors of the buffer
+    // together with the buffer generation, this tells the cache when its entries become stale
+    typedef void (*ggml_backend_buffer_free_hook_t)(ggml_backend_buffer_t buffer);
+
+    GGML_API void ggml_backend_buffer_add_free_hook   (ggml_backend_buffer_free_hook_t hook);
+    GGML_API void ggml_backend_buffer_remove_free_hook(ggml_backend_buffer_free_hook_t hook);
+
     // do not use directly, use ggml_backend_tensor_copy instead
     GGML_API bool ggml_backend_buffer_copy_tensor(const struct ggml_tensor * src, struct ggml_tensor * dst);
 
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <algorithm>
+#include <mutex>
 #include <vector>
 
 #ifdef __APPLE__
@@ -95,12 +96,27 @@ ggml_backend_buffer_t ggml_backend_buffer_init(
         /* .buft      = */ buft,
         /* .context   = */ context,
         /* .size      = */ size,
-        /* .usage     = */ GGML_BACKEND_BUFFER_USAGE_ANY
+        /* .usage     = */ GGML_BACKEND_BUFFER_USAGE_ANY,
+        /* .generation= */ 0,
     };
 
     return buffer;
 }
 
+static std::mutex                                   ggml_backend_buffer_free_hooks_mutex;
+static std::vector<ggml_backend_buffer_free_hook_t> ggml_backend_buffer_free_hooks;
+
+void ggml_backend_buffer_add_free_hook(ggml_backend_buffer_free_hook_t hook) {
+    std::lock_guard<std::mutex> lock(ggml_backend_buffer_free_hooks_mutex);
+    ggml_backend_buffer_free_hooks.push_back(hook);
+}
+
+void ggml_backend_buffer_remove_free_hook(ggml_backend_buffer_free_hook_t hook) {
+    std::lock_guard<std::mutex> lock(ggml_backend_buffer_free_hooks_mutex);
+    auto & hooks = ggml_backend_buffer_free_hooks;
+    hooks.erase(std::remove(hooks.begin(), hooks.end(), hook), hooks.end());
+}
+
 const char * ggml_backend_buffer_name(ggml_backend_buffer_t buffer) {
     return ggml_backend_buft_name(ggml_backend_buffer_get_type(buffer));
 }
@@ -110,6 +126,13 @@ void ggml_backend_buffer_free(ggml_backend_buffer_t buffer) {
         return;
     }
 
+    {
+        std::lock_guard<std::mutex> lock(ggml_backend_buffer_free_hooks_mutex);
+        for (auto hook : ggml_backend_buffer_free_hooks) {
+            hook(buffer);
+        }
+    }
+
     if (buffer->iface.free_buffer != NULL) {
         buffer->iface.free_buffer(buffer);
     }
@@ -151,6 +174,7 @@ void ggml_backend_buffer_clear(ggml_backend_buffer_t buffer, uint8_t value) {
         return;
     }
 
+    buffer->generation++;
     buffer->iface.clear(buffer, value);
 }
 
@@ -200,6 +224,7 @@ void ggml_backend_buffer_reset(ggml_backend_buffer_t buffer) {
 bool ggml_backend_buffer_copy_tensor(const struct ggml_tensor * src, struct ggml_tensor * dst) {
     ggml_backend_buffer_t dst_buf = dst->view_src ? dst->view_src->buffer : dst->buffer;
     if (dst_buf->iface.cpy_tensor) {
+        dst_buf->generation++;
         return dst_buf->iface.cpy_tensor(dst_buf, src, dst);
     }
     return false;
@@ -255,6 +280,10 @@ void ggml_backend_tensor_set_async(ggml_backend_t backend, struct ggml_tensor *
     if (backend->iface.set_tensor_async == NULL) {
         ggml_backend_tensor_set(tensor, data, offset, size);
     } else {
+        ggml_backend_buffer_t buf = tensor->view_src ? tensor->view_src->buffer : tensor->buffer;
+        if (buf != NULL) {
+            buf->generation++;
+        }
         backend->iface.set_tensor_async(backend, tensor, data, offset, size);
     }
 }
@@ -284,6 +313,7 @@ void ggml_backend_tensor_set(struct ggml_tensor * tensor, const void * data, siz
     GGML_ASSERT(tensor->data != NULL && "tensor not allocated");
     GGML_ASSERT(offset + size <= ggml_nbytes(tensor) && "tensor write out of bounds");
 
+    buf->generation++;
     buf->iface.set_tensor(buf, tensor, data, offset, size);
 }
 
@@ -315,6 +345,7 @@ void ggml_backend_tensor_memset(struct ggml_tensor * tensor, uint8_t value, size
     GGML_ASSERT(offset + size <= ggml_nbytes(tensor) && "tensor write out of bounds");
     GGML_ASSERT(buf->iface.memset_tensor != NULL && "memset not implemented by backend buffer");
 
+    buf->generation++;
     buf->iface.memset_tensor(buf, tensor, value, offset, size);
 }
 
@@ -341,6 +372,13 @@ void ggml_backend_graph_plan_free(ggml_backend_t backend, ggml_backend_graph_pla
     backend->iface.graph_plan_free(backend, plan);
 }
 
+void ggml_backend_graph_plan_update(ggml_backend_t backend, ggml_backend_graph_plan_t plan, struct ggml_cgraph * cgraph) {
+    GGML_ASSERT(backend);
+    GGML_ASSERT(backend->iface.graph_plan_update != NULL);
+
+    backend->iface.graph_plan_update(backend, plan, cgraph);
+}
+
 enum ggml_status ggml_backend_graph_plan_compute(ggml_backend_t backend, ggml_backend_graph_plan_t plan) {
     GGML_ASSERT(backend);
     GGML_ASSERT(backend->iface.graph_plan_compute != NULL);
@@ -414,6 +452,8 @@ void ggml_backend_tensor_copy_async(ggml_backend_t backend_src, ggml_backend_t b
     GGML_ASSERT(backend_dst);
     if (backend_dst->iface.cpy_tensor_async != NULL) {
         if (backend_dst->iface.cpy_tensor_async(backend_src, backend_dst, src, dst)) {
+            ggml_backend_buffer_t dst_buf = dst->view_src ? dst->view_src->buffer : dst->buffer;
+            dst_buf->generation++;
             return;
         }
     }
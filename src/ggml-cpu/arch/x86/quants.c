@@ -3818,3 +3818,73 @@ void ggml_vec_dot_iq4_xs_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const v
 #endif
 }
 
+
+#if defined(__AVX2__)
+// y[0..31] += d*x for the 32 int8 values of a block
+static inline void mad_i8_32(float * GGML_RESTRICT y, const __m256i x, const __m256 d) {
+    const __m128i lo = _mm256_castsi256_si128(x);
+    const __m128i hi = _mm256_extracti128_si256(x, 1);
+
+    const __m256 x0 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(lo));
+    const __m256 x1 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8)));
+    const __m256 x2 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(hi));
+    const __m256 x3 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8)));
+
+    _mm256_storeu_ps(y +  0, _mm256_fmadd_ps(d, x0, _mm256_loadu_ps(y +  0)));
+    _mm256_storeu_ps(y +  8, _mm256_fmadd_ps(d, x1, _mm256_loadu_ps(y +  8)));
+    _mm256_storeu_ps(y + 16, _mm256_fmadd_ps(d, x2, _mm256_loadu_ps(y + 16)));
+    _mm256_storeu_ps(y + 24, _mm256_fmadd_ps(d, x3, _mm256_loadu_ps(y + 24)));
+}
+#endif
+
+void ggml_vec_mad_q4_0(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v) {
+    const int qk = QK4_0;
+    const int nb = n / qk;
+
+    assert(n % qk == 0);
+
+    const block_q4_0 * GGML_RESTRICT x = vx;
+
+#if defined(__AVX2__)
+    const __m256i off = _mm256_set1_epi8(8);
+
+    for (int ib = 0; ib < nb; ++ib) {
+        const __m256 d = _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(x[ib].d)*v);
+
+        const __m256i qx = _mm256_sub_epi8(bytes_from_nibbles_32(x[ib].qs), off);
+
+        mad_i8_32(y + ib*qk, qx, d);
+    }
+#else
+    UNUSED(nb);
+    UNUSED(x);
+    ggml_vec_mad_q4_0_generic(n, y, vx, v);
+#endif
+}
+
+void ggml_vec_mad_q5_0(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v) {
+    const int qk = QK5_0;
+    const int nb = n / qk;
+
+    assert(n % qk == 0);
+
+    const block_q5_0 * GGML_RESTRICT x = vx;
+
+#if defined(__AVX2__)
+    for (int ib = 0; ib < nb; ++ib) {
+        const __m256 d = _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(x[ib].d)*v);
+
+        // same sign extension of the 5th bit as in ggml_vec_dot_q5_0_q8_0
+        __m256i qx = bytes_from_nibbles_32(x[ib].qs);
+        __m256i bxhi = bytes_from_bits_32(x[ib].qh);
+        bxhi = _mm256_andnot_si256(bxhi, _mm256_set1_epi8((char)0xF0));
+        qx = _mm256_or_si256(qx, bxhi);
+
+        mad_i8_32(y + ib*qk, qx, d);
+    }
+#else
+    UNUSED(nb);
+    UNUSED(x);
+    ggml_vec_mad_q5_0_generic(n, y, vx, v);
+#endif
+}
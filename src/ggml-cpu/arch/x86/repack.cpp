@@ -1938,6 +1938,246 @@ void ggml_gemv_q2_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 #endif
 }
 
+#if defined(__AVX2__)
+// The 8x4 layouts interleave the quants of 8 rows of src0 four bytes at a time, so that a 256 bit load holds
+// the same four bytes of the 8 rows and the four matching bytes of src1 are broadcast to all of them.
+// After the dot products each 32 bit lane holds the sum of one row, no shuffle is needed to reduce them.
+static inline __m256i bcast_i8x4(const int8_t * x) {
+    int32_t v;
+    memcpy(&v, x, sizeof(int32_t));
+    return _mm256_set1_epi32(v);
+}
+
+// unsigned 6 bit quants of plane p of the 4 bytes chunk c of half h of a block_q6_Kx8
+static inline __m256i q6_K_8x4_unpack(const block_q6_Kx8 * b, int h, int p, int c, __m128i shift) {
+    const __m256i m4 = _mm256_set1_epi8(0x0F);
+    const __m256i m2 = _mm256_set1_epi8(0x30);
+
+    const __m256i ql = _mm256_loadu_si256((const __m256i *)(b->ql + (h * 16 + c + (p & 1) * 8) * 32));
+    const __m256i qh = _mm256_loadu_si256((const __m256i *)(b->qh + (h * 8 + c) * 32));
+
+    const __m256i lo = p < 2 ? _mm256_and_si256(ql, m4) : _mm256_and_si256(_mm256_srli_epi16(ql, 4), m4);
+    const __m256i hi = _mm256_and_si256(_mm256_slli_epi16(_mm256_srl_epi16(qh, shift), 4), m2);
+
+    return _mm256_or_si256(lo, hi);
+}
+
+// unsigned 5 bit quants of the 4 bytes chunk c of sub-block sb of a block_q5_Kx8
+static inline __m256i q5_K_8x4_unpack(const block_q5_Kx8 * b, int sb, int c, __m128i shift) {
+    const __m256i m4 = _mm256_set1_epi8(0x0F);
+    const __m256i m1 = _mm256_set1_epi8(0x10);
+
+    const __m256i qs = _mm256_loadu_si256((const __m256i *)(b->qs + ((sb / 2) * 8 + c) * 32));
+    const __m256i qh = _mm256_loadu_si256((const __m256i *)(b->qh + c * 32));
+
+    const __m256i lo = sb % 2 == 0 ? _mm256_and_si256(qs, m4) : _mm256_and_si256(_mm256_srli_epi16(qs, 4), m4);
+    const __m256i hi = _mm256_and_si256(_mm256_slli_epi16(_mm256_srl_epi16(qh, shift), 4), m1);
+
+    return _mm256_or_si256(lo, hi);
+}
+
+// 6 bit scales and mins of the 8 sub-blocks of the 8 rows of a block_q5_Kx8, as in the q4_K dot product
+// sc[0] and mn[0] hold the sub-blocks 0 to 3 in the bytes of the lane of each row, sc[1] and mn[1] the sub-blocks 4 to 7
+static inline void q5_K_8x4_scales(const block_q5_Kx8 * b, __m256i * sc, __m256i * mn) {
+    const __m256i kmask1 = _mm256_set1_epi32(0x3f3f3f3f);
+    const __m256i kmask2 = _mm256_set1_epi32(0x0f0f0f0f);
+    const __m256i kmask3 = _mm256_set1_epi32(0x03030303);
+
+    const __m256i u0 = _mm256_loadu_si256((const __m256i *)(b->scales +  0));
+    const __m256i u1 = _mm256_loadu_si256((const __m256i *)(b->scales + 32));
+    const __m256i u2 = _mm256_loadu_si256((const __m256i *)(b->scales + 64));
+
+    sc[0] = _mm256_and_si256(u0, kmask1);
+    sc[1] = _mm256_or_si256(_mm256_and_si256(u2, kmask2), _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(u0, 6), kmask3), 4));
+    mn[0] = _mm256_and_si256(u1, kmask1);
+    mn[1] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(u2, 4), kmask2), _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(u1, 6), kmask3), 4));
+}
+
+// byte sb % 4 of the lanes of v
+static inline __m256i q5_K_8x4_scale(const __m256i * v, int sb) {
+    return _mm256_and_si256(_mm256_srl_epi32(v[sb / 4], _mm_cvtsi32_si128(8 * (sb % 4))), _mm256_set1_epi32(0xFF));
+}
+#endif
+
+void ggml_gemv_q8_0_8x4_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    const block_q8_0 * a_ptr = (const block_q8_0 *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+        __m256 acc = _mm256_setzero_ps();
+        for (int l = 0; l < nb; l++) {
+            __m256i sumi = _mm256_setzero_si256();
+            for (int k = 0; k < qk / 4; k++) {
+                const __m256i b = _mm256_loadu_si256((const __m256i *)(b_ptr[l].qs + k * 32));
+                sumi = mul_sum_i8_pairs_acc_int32x8(sumi, b, bcast_i8x4(a_ptr[l].qs + k * 4));
+            }
+            const __m256 d = _mm256_mul_ps(GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].d), _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(a_ptr[l].d)));
+            acc = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sumi), d, acc);
+        }
+        _mm256_storeu_ps(s + x * ncols_interleaved, acc);
+    }
+    return;
+#endif
+    ggml_gemv_q8_0_8x4_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemv_q5_K_8x4_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q5_Kx8 * b_ptr = (const block_q5_Kx8 *) vx + (x * nb);
+
+        __m256 acc = _mm256_setzero_ps();
+        for (int l = 0; l < nb; l++) {
+            __m256i sc[2];
+            __m256i mn[2];
+            q5_K_8x4_scales(&b_ptr[l], sc, mn);
+
+            __m256i sumi = _mm256_setzero_si256();
+            __m256i summ = _mm256_setzero_si256();
+            for (int sb = 0; sb < QK_K / 32; sb++) {
+                // bit sb of qh is the high bit of sub-block sb
+                const __m128i shift = _mm_cvtsi32_si128(sb);
+                const int8_t * a = a_ptr[l].qs + (sb / 2) * 64 + (sb % 2) * 32;
+
+                __m256i dot = _mm256_setzero_si256();
+                for (int c = 0; c < 8; c++) {
+                    dot = mul_sum_us8_pairs_acc_int32x8(dot, q5_K_8x4_unpack(&b_ptr[l], sb, c, shift), bcast_i8x4(a + c * 4));
+                }
+                sumi = _mm256_add_epi32(sumi, _mm256_mullo_epi32(dot, q5_K_8x4_scale(sc, sb)));
+
+                const int bsum = a_ptr[l].bsums[2 * sb] + a_ptr[l].bsums[2 * sb + 1];
+                summ = _mm256_add_epi32(summ, _mm256_mullo_epi32(q5_K_8x4_scale(mn, sb), _mm256_set1_epi32(bsum)));
+            }
+
+            const __m256 da   = _mm256_set1_ps(a_ptr[l].d);
+            const __m256 d    = _mm256_mul_ps(GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].d),    da);
+            const __m256 dmin = _mm256_mul_ps(GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].dmin), da);
+            acc = _mm256_fmadd_ps (_mm256_cvtepi32_ps(sumi), d,    acc);
+            acc = _mm256_fnmadd_ps(_mm256_cvtepi32_ps(summ), dmin, acc);
+        }
+        _mm256_storeu_ps(s + x * ncols_interleaved, acc);
+    }
+    return;
+#endif
+    ggml_gemv_q5_K_8x4_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemv_q6_K_8x4_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+
+        __m256 acc = _mm256_setzero_ps();
+        for (int l = 0; l < nb; l++) {
+            __m256i sumi = _mm256_setzero_si256();
+            // sub-block sb of 16 elements is chunks 4*q to 4*q + 3 of plane p of half h
+            for (int sb = 0; sb < QK_K / 16; sb++) {
+                const int h = sb / 8;
+                const int p = (sb % 8) / 2;
+                const int q = sb % 2;
+                const __m128i shift = _mm_cvtsi32_si128(2 * p);
+                const int8_t * a = a_ptr[l].qs + sb * 16;
+
+                // the quants are stored with an offset of 32
+                __m256i dot = _mm256_set1_epi32(-32 * a_ptr[l].bsums[sb]);
+                for (int c = 4 * q; c < 4 * q + 4; c++) {
+                    dot = mul_sum_us8_pairs_acc_int32x8(dot, q6_K_8x4_unpack(&b_ptr[l], h, p, c, shift), bcast_i8x4(a + (c % 4) * 4));
+                }
+                const __m256i sc = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(b_ptr[l].scales + sb * 8)));
+                sumi = _mm256_add_epi32(sumi, _mm256_mullo_epi32(dot, sc));
+            }
+
+            const __m256 d = _mm256_mul_ps(GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].d), _mm256_set1_ps(a_ptr[l].d));
+            acc = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sumi), d, acc);
+        }
+        _mm256_storeu_ps(s + x * ncols_interleaved, acc);
+    }
+    return;
+#endif
+    ggml_gemv_q6_K_8x4_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemv_iq4_xs_8x4_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    const __m256i values = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) kvalues_iq4nl));
+    const __m256i m4 = _mm256_set1_epi8(0x0F);
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_iq4_xsx8 * b_ptr = (const block_iq4_xsx8 *) vx + (x * nb);
+
+        __m256 acc = _mm256_setzero_ps();
+        for (int l = 0; l < nb; l++) {
+            // the scales of sub-block ib are in bits 4*ib of scales_l and 2*ib of scales_h
+            __m256i scales_l = _mm256_loadu_si256((const __m256i *) b_ptr[l].scales_l);
+            __m256i scales_h = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) b_ptr[l].scales_h));
+
+            __m256i sumi = _mm256_setzero_si256();
+            for (int ib = 0; ib < QK_K / 32; ib++) {
+                const int8_t * a = a_ptr[l].qs + ib * 32;
+
+                __m256i dot = _mm256_setzero_si256();
+                for (int c = 0; c < 4; c++) {
+                    const __m256i q  = _mm256_loadu_si256((const __m256i *)(b_ptr[l].qs + (ib * 4 + c) * 32));
+                    const __m256i q0 = _mm256_shuffle_epi8(values, _mm256_and_si256(q, m4));
+                    const __m256i q1 = _mm256_shuffle_epi8(values, _mm256_and_si256(_mm256_srli_epi16(q, 4), m4));
+                    dot = mul_sum_i8_pairs_acc_int32x8(dot, q0, bcast_i8x4(a + c * 4));
+                    dot = mul_sum_i8_pairs_acc_int32x8(dot, q1, bcast_i8x4(a + c * 4 + 16));
+                }
+
+                const __m256i ls = _mm256_or_si256(_mm256_and_si256(scales_l, _mm256_set1_epi32(0xF)),
+                                                   _mm256_slli_epi32(_mm256_and_si256(scales_h, _mm256_set1_epi32(3)), 4));
+                sumi = _mm256_add_epi32(sumi, _mm256_mullo_epi32(dot, _mm256_sub_epi32(ls, _mm256_set1_epi32(32))));
+
+                scales_l = _mm256_srli_epi32(scales_l, 4);
+                scales_h = _mm256_srli_epi32(scales_h, 2);
+            }
+
+            const __m256 d = _mm256_mul_ps(GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].d), _mm256_set1_ps(a_ptr[l].d));
+            acc = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sumi), d, acc);
+        }
+        _mm256_storeu_ps(s + x * ncols_interleaved, acc);
+    }
+    return;
+#endif
+    ggml_gemv_iq4_xs_8x4_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
 void ggml_gemm_q4_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
 #if defined(__AVX2__) || defined(__AVX512F__)
     {
@@ -6305,3 +6545,264 @@ void ggml_gemm_q2_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 
 #endif
 }
+
+void ggml_gemm_q8_0_8x4_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_0x4 * a_ptr = (const block_q8_0x4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+            __m256 acc[4];
+            for (int m = 0; m < 4; m++) {
+                acc[m] = _mm256_setzero_ps();
+            }
+            for (int l = 0; l < nb; l++) {
+                __m256i sumi[4];
+                for (int m = 0; m < 4; m++) {
+                    sumi[m] = _mm256_setzero_si256();
+                }
+                for (int k = 0; k < qk / 4; k++) {
+                    const __m256i b  = _mm256_loadu_si256((const __m256i *)(b_ptr[l].qs + k * 32));
+                    const __m256i ab = _mm256_sign_epi8(b, b);
+                    for (int m = 0; m < 4; m++) {
+                        sumi[m] = mul_sum_us8_pairs_acc_int32x8(sumi[m], ab, _mm256_sign_epi8(bcast_i8x4(a_ptr[l].qs + k * 16 + m * 4), b));
+                    }
+                }
+                const __m256 db = GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].d);
+                for (int m = 0; m < 4; m++) {
+                    const __m256 d = _mm256_mul_ps(db, _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(a_ptr[l].d[m])));
+                    acc[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sumi[m]), d, acc[m]);
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + (y * 4 + m) * bs + x * ncols_interleaved, acc[m]);
+            }
+        }
+    }
+    return;
+#endif
+    ggml_gemm_q8_0_8x4_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_q5_K_8x4_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q5_Kx8 * b_ptr = (const block_q5_Kx8 *) vx + (x * nb);
+
+            __m256 acc[4];
+            for (int m = 0; m < 4; m++) {
+                acc[m] = _mm256_setzero_ps();
+            }
+            for (int l = 0; l < nb; l++) {
+                __m256i sc[2];
+                __m256i mn[2];
+                q5_K_8x4_scales(&b_ptr[l], sc, mn);
+
+                __m256i sumi[4];
+                __m256i summ[4];
+                for (int m = 0; m < 4; m++) {
+                    sumi[m] = _mm256_setzero_si256();
+                    summ[m] = _mm256_setzero_si256();
+                }
+                for (int sb = 0; sb < QK_K / 32; sb++) {
+                    const __m128i shift = _mm_cvtsi32_si128(sb);
+                    // the activations of sub-block sb start at chunk 8*sb, the rows are interleaved four bytes at a time
+                    const int8_t * a = a_ptr[l].qs + ((sb / 2) * 16 + (sb % 2) * 8) * 16;
+
+                    __m256i dot[4];
+                    for (int m = 0; m < 4; m++) {
+                        dot[m] = _mm256_setzero_si256();
+                    }
+                    for (int c = 0; c < 8; c++) {
+                        const __m256i q = q5_K_8x4_unpack(&b_ptr[l], sb, c, shift);
+                        for (int m = 0; m < 4; m++) {
+                            dot[m] = mul_sum_us8_pairs_acc_int32x8(dot[m], q, bcast_i8x4(a + c * 16 + m * 4));
+                        }
+                    }
+
+                    const __m256i scale = q5_K_8x4_scale(sc, sb);
+                    const __m256i min   = q5_K_8x4_scale(mn, sb);
+                    // bsums of the groups of 16 2*sb and 2*sb + 1, laid out as in ggml_quantize_mat_q8_K_4x4
+                    const int16_t * bsums = a_ptr[l].bsums + (sb / 2) * 16 + (sb % 2) * 2;
+                    for (int m = 0; m < 4; m++) {
+                        sumi[m] = _mm256_add_epi32(sumi[m], _mm256_mullo_epi32(dot[m], scale));
+                        summ[m] = _mm256_add_epi32(summ[m], _mm256_mullo_epi32(min, _mm256_set1_epi32(bsums[m * 4] + bsums[m * 4 + 1])));
+                    }
+                }
+
+                const __m256 db   = GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].d);
+                const __m256 dmin = GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].dmin);
+                for (int m = 0; m < 4; m++) {
+                    const __m256 da = _mm256_set1_ps(a_ptr[l].d[m]);
+                    acc[m] = _mm256_fmadd_ps (_mm256_cvtepi32_ps(sumi[m]), _mm256_mul_ps(db,   da), acc[m]);
+                    acc[m] = _mm256_fnmadd_ps(_mm256_cvtepi32_ps(summ[m]), _mm256_mul_ps(dmin, da), acc[m]);
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + (y * 4 + m) * bs + x * ncols_interleaved, acc[m]);
+            }
+        }
+    }
+    return;
+#endif
+    ggml_gemm_q5_K_8x4_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_q6_K_8x4_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+
+            __m256 acc[4];
+            for (int m = 0; m < 4; m++) {
+                acc[m] = _mm256_setzero_ps();
+            }
+            for (int l = 0; l < nb; l++) {
+                __m256i sumi[4];
+                for (int m = 0; m < 4; m++) {
+                    sumi[m] = _mm256_setzero_si256();
+                }
+                for (int sb = 0; sb < QK_K / 16; sb++) {
+                    const int h = sb / 8;
+                    const int p = (sb % 8) / 2;
+                    const int q = sb % 2;
+                    const __m128i shift = _mm_cvtsi32_si128(2 * p);
+                    const int8_t * a = a_ptr[l].qs + sb * 64;
+                    // bsum of the group of 16 sb, laid out as in ggml_quantize_mat_q8_K_4x4
+                    const int16_t * bsums = a_ptr[l].bsums + (sb / 4) * 16 + sb % 4;
+
+                    __m256i dot[4];
+                    for (int m = 0; m < 4; m++) {
+                        dot[m] = _mm256_set1_epi32(-32 * bsums[m * 4]);
+                    }
+                    for (int c = 4 * q; c < 4 * q + 4; c++) {
+                        const __m256i v = q6_K_8x4_unpack(&b_ptr[l], h, p, c, shift);
+                        for (int m = 0; m < 4; m++) {
+                            dot[m] = mul_sum_us8_pairs_acc_int32x8(dot[m], v, bcast_i8x4(a + (c % 4) * 16 + m * 4));
+                        }
+                    }
+
+                    const __m256i sc = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(b_ptr[l].scales + sb * 8)));
+                    for (int m = 0; m < 4; m++) {
+                        sumi[m] = _mm256_add_epi32(sumi[m], _mm256_mullo_epi32(dot[m], sc));
+                    }
+                }
+
+                const __m256 db = GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].d);
+                for (int m = 0; m < 4; m++) {
+                    acc[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sumi[m]), _mm256_mul_ps(db, _mm256_set1_ps(a_ptr[l].d[m])), acc[m]);
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + (y * 4 + m) * bs + x * ncols_interleaved, acc[m]);
+            }
+        }
+    }
+    return;
+#endif
+    ggml_gemm_q6_K_8x4_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_iq4_xs_8x4_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    const __m256i values = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) kvalues_iq4nl));
+    const __m256i m4 = _mm256_set1_epi8(0x0F);
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_iq4_xsx8 * b_ptr = (const block_iq4_xsx8 *) vx + (x * nb);
+
+            __m256 acc[4];
+            for (int m = 0; m < 4; m++) {
+                acc[m] = _mm256_setzero_ps();
+            }
+            for (int l = 0; l < nb; l++) {
+                __m256i scales_l = _mm256_loadu_si256((const __m256i *) b_ptr[l].scales_l);
+                __m256i scales_h = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) b_ptr[l].scales_h));
+
+                __m256i sumi[4];
+                for (int m = 0; m < 4; m++) {
+                    sumi[m] = _mm256_setzero_si256();
+                }
+                for (int ib = 0; ib < QK_K / 32; ib++) {
+                    const int8_t * a = a_ptr[l].qs + ib * 128;
+
+                    __m256i dot[4];
+                    for (int m = 0; m < 4; m++) {
+                        dot[m] = _mm256_setzero_si256();
+                    }
+                    for (int c = 0; c < 4; c++) {
+                        const __m256i q  = _mm256_loadu_si256((const __m256i *)(b_ptr[l].qs + (ib * 4 + c) * 32));
+                        const __m256i q0 = _mm256_shuffle_epi8(values, _mm256_and_si256(q, m4));
+                        const __m256i q1 = _mm256_shuffle_epi8(values, _mm256_and_si256(_mm256_srli_epi16(q, 4), m4));
+                        const __m256i a0 = _mm256_sign_epi8(q0, q0);
+                        const __m256i a1 = _mm256_sign_epi8(q1, q1);
+                        for (int m = 0; m < 4; m++) {
+                            dot[m] = mul_sum_us8_pairs_acc_int32x8(dot[m], a0, _mm256_sign_epi8(bcast_i8x4(a + c * 16 + m * 4),      q0));
+                            dot[m] = mul_sum_us8_pairs_acc_int32x8(dot[m], a1, _mm256_sign_epi8(bcast_i8x4(a + c * 16 + m * 4 + 64), q1));
+                        }
+                    }
+
+                    const __m256i ls = _mm256_or_si256(_mm256_and_si256(scales_l, _mm256_set1_epi32(0xF)),
+                                                       _mm256_slli_epi32(_mm256_and_si256(scales_h, _mm256_set1_epi32(3)), 4));
+                    const __m256i sc = _mm256_sub_epi32(ls, _mm256_set1_epi32(32));
+                    for (int m = 0; m < 4; m++) {
+                        sumi[m] = _mm256_add_epi32(sumi[m], _mm256_mullo_epi32(dot[m], sc));
+                    }
+
+                    scales_l = _mm256_srli_epi32(scales_l, 4);
+                    scales_h = _mm256_srli_epi32(scales_h, 2);
+                }
+
+                const __m256 db = GGML_F32Cx8_LOAD((const ggml_fp16_t *) b_ptr[l].d);
+                for (int m = 0; m < 4; m++) {
+                    acc[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sumi[m]), _mm256_mul_ps(db, _mm256_set1_ps(a_ptr[l].d[m])), acc[m]);
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + (y * 4 + m) * bs + x * ncols_interleaved, acc[m]);
+            }
+        }
+    }
+    return;
+#endif
+    ggml_gemm_iq4_xs_8x4_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
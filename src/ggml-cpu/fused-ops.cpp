@@ -0,0 +1,336 @@
+#include "fused-ops.h"
+
+#include "unary-ops.h"
+#include "vec.h"
+
+#include <algorithm>
+
+// elements of a row that go through all the nodes of a chain before moving on, so that they stay in the L1 cache
+// a multiple of the SIMD steps of the vec functions, which then split the rows in the same way as the unfused ops
+#define GGML_FUSED_CHAIN_BLOCK 1024
+
+static bool ggml_fused_is_f32_rows(const ggml_tensor * t) {
+    return t->type == GGML_TYPE_F32 && t->nb[0] == sizeof(float);
+}
+
+// the source of a binary node that is not prev
+static const ggml_tensor * ggml_fused_operand(const ggml_tensor * node, const ggml_tensor * prev) {
+    return node->src[0] == prev ? node->src[1] : node->src[0];
+}
+
+// the operand is broadcast over the rows of node, either with full rows or with one value per row
+static bool ggml_fused_operand_ok(const ggml_tensor * src, const ggml_tensor * node) {
+    return ggml_fused_is_f32_rows(src) && (src->ne[0] == node->ne[0] || src->ne[0] == 1) && ggml_can_repeat(src, node);
+}
+
+// nodes with one source that are computed element by element
+static bool ggml_fused_is_unary(const ggml_tensor * node) {
+    switch (node->op) {
+        case GGML_OP_SCALE:
+        case GGML_OP_LEAKY_RELU:
+            return true;
+        case GGML_OP_UNARY:
+            switch (ggml_get_unary_op(node)) {
+                case GGML_UNARY_OP_GELU:
+                case GGML_UNARY_OP_GELU_ERF:
+                case GGML_UNARY_OP_GELU_QUICK:
+                case GGML_UNARY_OP_SILU:
+                    return true;
+                default:
+                    return ggml_compute_unary_row_f32(node, 0, nullptr, nullptr);
+            }
+        default:
+            return ggml_compute_unary_row_f32(node, 0, nullptr, nullptr);
+    }
+}
+
+bool ggml_fused_chain_can_start(const ggml_tensor * node) {
+    const ggml_tensor * src0 = node->src[0];
+
+    if (src0 == nullptr || !ggml_fused_is_f32_rows(node) || !ggml_fused_is_f32_rows(src0) || !ggml_are_same_shape(src0, node)) {
+        return false;
+    }
+
+    switch (node->op) {
+        case GGML_OP_NORM:
+        case GGML_OP_RMS_NORM:
+            return true;
+        case GGML_OP_ADD:
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+            return ggml_fused_operand_ok(node->src[1], node);
+        default:
+            return ggml_fused_is_unary(node);
+    }
+}
+
+bool ggml_fused_chain_can_append(const ggml_tensor * prev, const ggml_tensor * node) {
+    if (!ggml_fused_is_f32_rows(node) || !ggml_are_same_shape(prev, node)) {
+        return false;
+    }
+
+    switch (node->op) {
+        case GGML_OP_ADD:
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+            {
+                if ((node->src[0] == prev) == (node->src[1] == prev)) {
+                    return false;
+                }
+                return ggml_fused_operand_ok(ggml_fused_operand(node, prev), node);
+            }
+        case GGML_OP_SOFT_MAX:
+            {
+                // the rows are complete once the soft_max is reached, it ends the chain
+                const ggml_tensor * mask = node->src[1];
+
+                float max_bias;
+                memcpy(&max_bias, (const float *) node->op_params + 1, sizeof(float));
+
+                return node->src[0] == prev && node->src[2] == nullptr && max_bias == 0.0f &&
+                    (mask == nullptr || ((mask->type == GGML_TYPE_F32 || mask->type == GGML_TYPE_F16) &&
+                                         mask->nb[0] == ggml_type_size(mask->type)));
+            }
+        default:
+            return node->src[0] == prev && ggml_fused_is_unary(node);
+    }
+}
+
+// norm or rms_norm of a row, same steps as ggml_compute_forward_norm_f32 and ggml_compute_forward_rms_norm_f32
+static void ggml_fused_norm_row(const ggml_tensor * norm, int64_t n, float * y, const float * x) {
+    float eps;
+    memcpy(&eps, norm->op_params, sizeof(float));
+
+    GGML_ASSERT(eps >= 0.0f);
+
+    float scale;
+
+    if (norm->op == GGML_OP_NORM) {
+        float sum = 0.0;
+        ggml_vec_sum_f32(n, &sum, x);
+        float mean = sum/n;
+
+        float variance = 0;
+
+#ifdef GGML_USE_ACCELERATE
+        mean = -mean;
+        vDSP_vsadd(x, 1, &mean, y, 1, n);
+        vDSP_measqv(y, 1, &variance, n);
+#else
+        variance = ggml_vec_cvar_f32(n, y, x, mean);
+#endif //GGML_USE_ACCELERATE
+
+        scale = 1.0f/sqrtf(variance + eps);
+    } else {
+        ggml_float sum = 0.0;
+        for (int64_t i = 0; i < n; i++) {
+            sum += (ggml_float)(x[i] * x[i]);
+        }
+
+        const float mean = sum/n;
+
+        if (y != x) {
+            memcpy(y, x, n * sizeof(float));
+        }
+
+        scale = 1.0f/sqrtf(mean + eps);
+    }
+
+    ggml_vec_scale_f32(n, y, scale);
+}
+
+// soft_max of a row in place, same steps as ggml_compute_forward_soft_max_f32 without ALiBi and sinks
+static void ggml_fused_soft_max_row(const ggml_tensor * node, int64_t n, float * y, int64_t i1, int64_t i2, int64_t i3) {
+    const ggml_tensor * mask = node->src[1];
+
+    float scale;
+    memcpy(&scale, (const float *) node->op_params + 0, sizeof(float));
+
+    const float slope = 1.0f;
+
+    ggml_vec_scale_f32(n, y, scale);
+
+    if (mask) {
+        // broadcast the mask across rows
+        const char * mp = (const char *) mask->data + i1*mask->nb[1] + (i2 % mask->ne[2])*mask->nb[2] + (i3 % mask->ne[3])*mask->nb[3];
+
+        if (mask->type == GGML_TYPE_F16) {
+            for (int64_t i = 0; i < n; ++i) {
+                y[i] += slope*GGML_CPU_FP16_TO_FP32(((const ggml_fp16_t *) mp)[i]);
+            }
+        } else {
+            for (int64_t i = 0; i < n; ++i) {
+                y[i] += slope*((const float *) mp)[i];
+            }
+        }
+    }
+
+    float max = -INFINITY;
+    ggml_vec_max_f32(n, &max, y);
+
+    ggml_float sum = ggml_vec_soft_max_f32(n, y, y, max);
+    assert(sum > 0.0);
+
+    sum = 1.0/sum;
+    ggml_vec_scale_f32(n, y, sum);
+}
+
+// y = node(x) for the n elements of row (i1, i2, i3) starting at i0, prev is the previous node of the chain
+// x is either the input of the chain or y itself
+static void ggml_fused_apply(
+        const ggml_tensor * node,
+        const ggml_tensor * prev,
+        int64_t n, float * y, const float * x,
+        int64_t i0, int64_t i1, int64_t i2, int64_t i3) {
+
+    switch (node->op) {
+        case GGML_OP_ADD:
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+            {
+                // the first node of a chain reads its input from src[0]
+                const ggml_tensor * src = prev ? ggml_fused_operand(node, prev) : node->src[1];
+                const bool          rev = src == node->src[0];
+
+                const float * w = (const float *) ((const char *) src->data + (i1 % src->ne[1])*src->nb[1] + (i2 % src->ne[2])*src->nb[2] + (i3 % src->ne[3])*src->nb[3]);
+
+                if (src->ne[0] == node->ne[0]) {
+                    const float * a = rev ? w + i0 : x;
+                    const float * b = rev ? x : w + i0;
+
+                    switch (node->op) {
+                        case GGML_OP_ADD: ggml_vec_add_f32(n, y, a, b); break;
+                        case GGML_OP_SUB: ggml_vec_sub_f32(n, y, a, b); break;
+                        case GGML_OP_MUL: ggml_vec_mul_f32(n, y, a, b); break;
+                        case GGML_OP_DIV: ggml_vec_div_f32(n, y, a, b); break;
+                        default: GGML_ABORT("fatal error");
+                    }
+                } else {
+                    // one value per row, the other source has the shape of node
+                    GGML_ASSERT(!rev);
+
+                    const float v = w[0];
+
+                    switch (node->op) {
+                        case GGML_OP_ADD: for (int64_t i = 0; i < n; ++i) y[i] = x[i] + v; break;
+                        case GGML_OP_SUB: for (int64_t i = 0; i < n; ++i) y[i] = x[i] - v; break;
+                        case GGML_OP_MUL: for (int64_t i = 0; i < n; ++i) y[i] = x[i] * v; break;
+                        case GGML_OP_DIV: for (int64_t i = 0; i < n; ++i) y[i] = x[i] / v; break;
+                        default: GGML_ABORT("fatal error");
+                    }
+                }
+            } break;
+        case GGML_OP_SCALE:
+            {
+                float s;
+                float b;
+                memcpy(&s, (const float *) node->op_params + 0, sizeof(float));
+                memcpy(&b, (const float *) node->op_params + 1, sizeof(float));
+
+                if (b == 0.0f) {
+                    if (y != x) {
+                        memcpy(y, x, n * sizeof(float));
+                    }
+                    ggml_vec_scale_f32(n, y, s);
+                } else {
+                    ggml_vec_mad1_f32(n, y, x, s, b);
+                }
+            } break;
+        case GGML_OP_LEAKY_RELU:
+            {
+                float negative_slope;
+                memcpy(&negative_slope, node->op_params, sizeof(float));
+
+                ggml_vec_leaky_relu_f32(n, y, x, negative_slope);
+            } break;
+        case GGML_OP_UNARY:
+            {
+                switch (ggml_get_unary_op(node)) {
+                    case GGML_UNARY_OP_GELU:       ggml_vec_gelu_f32      (n, y, x); break;
+                    case GGML_UNARY_OP_GELU_ERF:   ggml_vec_gelu_erf_f32  (n, y, x); break;
+                    case GGML_UNARY_OP_GELU_QUICK: ggml_vec_gelu_quick_f32(n, y, x); break;
+                    case GGML_UNARY_OP_SILU:       ggml_vec_silu_f32      (n, y, x); break;
+                    default:
+                        {
+                            const bool ok = ggml_compute_unary_row_f32(node, n, y, x);
+                            GGML_ASSERT(ok);
+                        }
+                }
+            } break;
+        default:
+            {
+                const bool ok = ggml_compute_unary_row_f32(node, n, y, x);
+                GGML_ASSERT(ok);
+            }
+    }
+}
+
+void ggml_compute_forward_fused_chain(const ggml_compute_params * params, ggml_tensor * const * nodes, int n_nodes) {
+    GGML_ASSERT(n_nodes >= 2 && n_nodes <= GGML_FUSED_CHAIN_MAX);
+
+    const ggml_tensor * head = nodes[0];
+    const ggml_tensor * src0 = head->src[0]; // input of the chain
+          ggml_tensor * dst  = nodes[n_nodes - 1];
+
+    GGML_ASSERT(ggml_are_same_shape(src0, dst));
+    GGML_ASSERT(src0->nb[0] == sizeof(float) && dst->nb[0] == sizeof(float));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    GGML_TENSOR_UNARY_OP_LOCALS
+
+    // norm and soft_max need whole rows, they can only be the first and the last node
+    const bool norm     = head->op == GGML_OP_NORM || head->op == GGML_OP_RMS_NORM;
+    const bool soft_max = dst->op  == GGML_OP_SOFT_MAX;
+
+    const int k0 = norm     ? 1           : 0;
+    const int k1 = soft_max ? n_nodes - 1 : n_nodes;
+
+    // the threads split the rows, or blocks of the rows when there is no row op
+    const int64_t nblk = norm || soft_max ? 1 : (ne00 + GGML_FUSED_CHAIN_BLOCK - 1)/GGML_FUSED_CHAIN_BLOCK;
+
+    const int64_t nr  = ne01*ne02*ne03;
+    const int64_t nu  = nr*nblk;
+    const int64_t du  = (nu + nth - 1)/nth;
+    const int64_t iu0 = du*ith;
+    const int64_t iu1 = MIN(iu0 + du, nu);
+
+    for (int64_t iu = iu0; iu < iu1; ++iu) {
+        const int64_t ir = iu/nblk;
+        const int64_t ib = iu%nblk;
+
+        const int64_t i03 = ir/(ne02*ne01);
+        const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+        const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+        const float * x = (const float *) ((const char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+              float * y = (float       *) ((char       *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
+
+        const int64_t j0 = ib*GGML_FUSED_CHAIN_BLOCK;
+        const int64_t j1 = nblk == 1 ? ne00 : MIN(j0 + GGML_FUSED_CHAIN_BLOCK, ne00);
+
+        if (norm) {
+            ggml_fused_norm_row(head, ne00, y, x);
+            x = y;
+        }
+
+        for (int64_t j = j0; j < j1; j += GGML_FUSED_CHAIN_BLOCK) {
+            const int64_t n = MIN(GGML_FUSED_CHAIN_BLOCK, j1 - j);
+
+            const float * xj = x + j;
+
+            for (int k = k0; k < k1; ++k) {
+                ggml_fused_apply(nodes[k], k > 0 ? nodes[k - 1] : nullptr, n, y + j, xj, j, i01, i02, i03);
+                xj = y + j;
+            }
+        }
+
+        if (soft_max) {
+            ggml_fused_soft_max_row(dst, ne00, y, i01, i02, i03);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+
+//
+// fused elementwise chains
+//
+// a chain is a head node followed by nodes that each consume the result of the previous one, e.g.
+// scale -> add -> soft_max, add -> gelu, mul -> silu or norm -> mul -> add
+// the chains are found by ggml_cpu_graph_fuse() in ggml-cpu.c and computed in one pass over the rows of the last node
+//
+
+// max number of nodes in a chain
+#define GGML_FUSED_CHAIN_MAX 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// true if node can start a chain
+bool ggml_fused_chain_can_start(const struct ggml_tensor * node);
+
+// true if node can follow prev, the last node of a chain
+bool ggml_fused_chain_can_append(const struct ggml_tensor * prev, const struct ggml_tensor * node);
+
+// compute the n_nodes nodes of a chain, only the result of the last node is written
+void ggml_compute_forward_fused_chain(const struct ggml_compute_params * params, struct ggml_tensor * const * nodes, int n_nodes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,6 +15,12 @@
 extern "C" {
 #endif
 
+// autotuned work split of a node, see ggml_cpu_tune_init()
+struct ggml_tune_choice {
+    int nth;        // number of threads doing the work
+    int chunk_size; // mul_mat chunk size, 0 for the default heuristic
+};
+
 struct ggml_compute_params {
     // ith = thread index, nth = number of threads
     int ith, nth;
@@ -24,6 +30,13 @@ struct ggml_compute_params {
     void * wdata;
 
     struct ggml_threadpool * threadpool;
+
+    // autotuned work split of the current node, NULL if not tuned
+    const struct ggml_tune_choice * tune;
+
+    // src1 of the current mul_mat in vec_dot_type, shared with other mul_mats, NULL if not shared
+    void * src1_cache;
+    bool   src1_cache_valid; // src1_cache was already written by a previous mul_mat
 };
 
 
@@ -519,6 +532,12 @@ void ggml_barrier(struct ggml_threadpool * tp);
 void ggml_threadpool_chunk_set(struct ggml_threadpool * tp, int value);
 int  ggml_threadpool_chunk_add(struct ggml_threadpool * tp, int value);
 
+// per-thread chunk ranges with work stealing
+// ggml_threadpool_chunks_reset() splits n_chunks in contiguous ranges over the threads, it must be called by a single thread before a barrier
+// ggml_threadpool_chunk_next() returns the next chunk from the thread's own range, or one stolen from another thread, or -1 when done
+void ggml_threadpool_chunks_reset(struct ggml_threadpool * tp, int nth, int n_chunks);
+int  ggml_threadpool_chunk_next  (struct ggml_threadpool * tp, int ith, int nth);
+
 #ifdef __cplusplus
 }
 #endif
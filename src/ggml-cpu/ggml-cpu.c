@@ -13,6 +13,7 @@
 #include "binary-ops.h"
 #include "vec.h"
 #include "ops.h"
+#include "fused-ops.h"
 #include "ggml.h"
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
@@ -36,6 +37,7 @@
 #include <signal.h>
 #if defined(__gnu_linux__)
 #include <syscall.h>
+#include <linux/futex.h>
 #endif
 
 #ifdef GGML_USE_OPENMP
@@ -59,6 +61,12 @@
 #define GGML_CACHE_ALIGN __attribute__((aligned(GGML_CACHE_LINE)))
 #endif
 
+#if defined(_MSC_VER)
+#define GGML_THREAD_LOCAL __declspec(thread)
+#else
+#define GGML_THREAD_LOCAL _Thread_local
+#endif
+
 #if defined(__has_feature)
 #if __has_feature(thread_sanitizer)
 #define GGML_TSAN_ENABLED 1
@@ -466,19 +474,90 @@ struct ggml_threadpool {
     int32_t      prio;        // Scheduling priority
     uint32_t     poll;        // Polling level (0 - no polling)
 
+    // idle workers spin for up to spin_us, then sleep until wake_seq changes
+    atomic_int   spin_us;     // adapted to the gap between graphs, see ggml_threadpool_update_spin()
+    atomic_int   GGML_CACHE_ALIGN wake_seq;
+    atomic_int   GGML_CACHE_ALIGN n_sleeping;
+    int64_t      t_kickoff_us; // start of the current graph
+    int64_t      t_done_us;    // end of the previous graph
+    int64_t      gap_us;       // moving average of the time between graphs
+    bool         dep_sched;   // Dependency-aware scheduling
+
+    uint8_t    * node_sync;   // [n_nodes] barrier needed before node i (dep_sched only)
+    int          node_sync_size;
+    bool         sync_active; // node_sync was computed for the current graph
+
+    // fused chains, see ggml_cpu_graph_fuse()
+    int32_t            * node_fuse;      // [n_nodes] GGML_CPU_FUSE_NONE, GGML_CPU_FUSE_SKIP or the offset of the chain in fuse_nodes
+    struct ggml_tensor ** fuse_nodes;    // [2*n_nodes] the nodes of each chain followed by NULL
+    int                  node_fuse_size;
+    bool                 fuse_active;    // node_fuse is used by the current graph
+
+    // mul_mats sharing their quantized src1, see ggml_cpu_graph_src1_cache()
+    uint8_t    * node_src1;   // [n_nodes] GGML_CPU_SRC1_NONE, GGML_CPU_SRC1_STORE or GGML_CPU_SRC1_LOAD
+    int          node_src1_size;
+    bool         src1_active; // node_src1 is used by the current graph
+
+    // autotuning, see ggml_cpu_tune_init()
+    struct ggml_tune_choice * node_tune;   // [n_nodes] work split of each node
+    struct ggml_tune_node   * tune_nodes;  // [n_nodes] search state of each node
+    int                       node_tune_size;
+    bool                      tune_active; // node_tune is used by the current graph
+    bool                      tune_timing; // the nodes of the current graph are timed
+
+    enum ggml_barrier_type     barrier;
+    struct ggml_barrier_node * barrier_nodes;     // [n_threads_max] combining tree (GGML_BARRIER_TREE only), at most n_threads_max - 1 inner nodes
+    int                        barrier_n_threads; // number of threads the tree was built for
+
+    // workers ordered by cache domain, the mul_mat chunks are split in this order, see ggml_threadpool_chunks_reset()
+    int * chunk_order;
+    bool  chunk_domains; // the workers are in more than one cache domain
+
+    // thread groups, see ggml_threadpool_new_group()
+    struct ggml_threadpool * parent;          // threadpool lending its workers to this group, NULL if not a group
+    int                      group_first;     // first worker of the parent used by the group
+    atomic_int               n_attached;      // lent workers that have not returned to the parent yet
+    int                      n_groups;        // number of groups using the workers of this threadpool
+    int                      n_threads_avail; // leading workers that are not lent to a group
+    bool                     warn_avail;      // warn once about graphs that ask for more than n_threads_avail threads
+
     enum ggml_status ec;
 };
 
+// node of the combining tree barrier
+struct ggml_barrier_node {
+    atomic_int GGML_CACHE_ALIGN n_arrived;
+    int n_children;
+    int parent; // -1 for the root
+};
+
 // Per-thread state
 struct ggml_compute_state {
 #ifndef GGML_USE_OPENMP
     ggml_thread_t thrd;
     int  last_graph;
     bool pending;
+
+    atomic_int n_group; // incremented when the worker is lent to a thread group
+    int        last_group;
 #endif
     bool cpumask[GGML_MAX_N_THREADS];
     struct ggml_threadpool * threadpool;
     int ith;
+
+    struct ggml_threadpool * group; // thread group using this worker, NULL if none
+
+    int barrier_leaf; // first node of the barrier tree this thread arrives at
+    int domain;       // cache domain, see ggml_thread_cache_domain()
+
+    // idle/wakeup statistics, see ggml_threadpool_get_stats()
+    uint64_t n_spin;
+    uint64_t n_sleep;
+    int64_t  t_wake_us;
+
+    // chunks of the current op owned by this thread, see ggml_threadpool_chunk_next()
+    atomic_int GGML_CACHE_ALIGN chunk_next;
+    int                         chunk_end;
 };
 
 // Helpers for polling loops
@@ -498,17 +577,14 @@ static inline void ggml_thread_cpu_relax(void) {;}
 // NUMA support
 //
 
-#define GGML_NUMA_MAX_NODES 8
-#define GGML_NUMA_MAX_CPUS 512
-
 struct ggml_numa_node {
-    uint32_t cpus[GGML_NUMA_MAX_CPUS]; // hardware threads on this node
+    uint32_t * cpus; // hardware threads on this node
     uint32_t n_cpus;
 };
 
 struct ggml_numa_nodes {
     enum ggml_numa_strategy numa_strategy;
-    struct ggml_numa_node nodes[GGML_NUMA_MAX_NODES];
+    struct ggml_numa_node * nodes;
     uint32_t n_nodes;
     uint32_t total_cpus; // hardware threads on system
     uint32_t current_node; // node on which main process is execting
@@ -519,16 +595,76 @@ struct ggml_numa_nodes {
 #endif
 };
 
+//
+// CPU topology
+//
+
+struct ggml_cpu_topo_cpu {
+    bool allowed; // in the affinity mask of the process when the topology was read
+    int  node;    // NUMA node
+    int  core;    // physical core, shared by the SMT siblings, -1 if the CPU is offline
+    int  smt;     // index of the CPU among the siblings of its core
+    int  l3;      // L3 cache domain (CCX), the NUMA node when the L3 is not reported
+};
+
+struct ggml_cpu_topo {
+    bool init;
+    struct ggml_cpu_topo_cpu * cpus; // indexed by CPU id
+    int n_cpus;
+    int n_cores;
+    int n_l3;
+};
+
 //
 // ggml state
 //
 
 struct ggml_state {
     struct ggml_numa_nodes numa;
+    struct ggml_cpu_topo   topo;
 };
 
 static struct ggml_state g_state = {0};
 
+#ifndef GGML_USE_OPENMP
+// leaf of the barrier tree of the calling thread, set for each graph by ggml_graph_compute_thread
+static GGML_THREAD_LOCAL int ggml_barrier_leaf = -1;
+
+// the last thread to arrive at a node moves up to its parent, the last one to arrive at the root releases everyone
+// each counter is only shared by the few threads (or subtrees) below it, instead of all the threads in the pool
+static void ggml_barrier_tree(struct ggml_threadpool * tp) {
+    int n_passed = atomic_load_explicit(&tp->n_barrier_passed, memory_order_relaxed);
+
+    for (int i = ggml_barrier_leaf; i >= 0; ) {
+        struct ggml_barrier_node * node = &tp->barrier_nodes[i];
+
+        // enter node (full seq-cst fence)
+        if (atomic_fetch_add_explicit(&node->n_arrived, 1, memory_order_seq_cst) != node->n_children - 1) {
+            // wait for other threads
+            while (atomic_load_explicit(&tp->n_barrier_passed, memory_order_relaxed) == n_passed) {
+                ggml_thread_cpu_relax();
+            }
+
+            // exit barrier (full seq-cst fence)
+            #ifdef GGML_TSAN_ENABLED
+            atomic_fetch_add_explicit(&tp->n_barrier_passed, 0, memory_order_seq_cst);
+            #else
+            atomic_thread_fence(memory_order_seq_cst);
+            #endif
+            return;
+        }
+
+        // last thread at this node
+        atomic_store_explicit(&node->n_arrived, 0, memory_order_relaxed);
+
+        i = node->parent;
+    }
+
+    // exit barrier (full seq-cst fence)
+    atomic_fetch_add_explicit(&tp->n_barrier_passed, 1, memory_order_seq_cst);
+}
+#endif
+
 void ggml_barrier(struct ggml_threadpool * tp) {
     int n_threads = atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed);
     if (n_threads == 1) {
@@ -538,6 +674,11 @@ void ggml_barrier(struct ggml_threadpool * tp) {
 #ifdef GGML_USE_OPENMP
     #pragma omp barrier
 #else
+    if (tp->barrier == GGML_BARRIER_TREE) {
+        ggml_barrier_tree(tp);
+        return;
+    }
+
     int n_passed = atomic_load_explicit(&tp->n_barrier_passed, memory_order_relaxed);
 
     // enter barrier (full seq-cst fence)
@@ -575,6 +716,72 @@ int ggml_threadpool_chunk_add(struct ggml_threadpool * tp, int value) {
     return atomic_fetch_add_explicit(&tp->current_chunk, value, memory_order_relaxed);
 }
 
+// NUMA node that a thread is bound to by set_numa_thread_affinity()
+static int ggml_thread_numa_node(int ith) {
+    if (ggml_is_numa() && g_state.numa.numa_strategy == GGML_NUMA_STRATEGY_DISTRIBUTE) {
+        return ith % g_state.numa.n_nodes;
+    }
+    return 0;
+}
+
+void ggml_threadpool_chunks_reset(struct ggml_threadpool * tp, int nth, int n_chunks) {
+    // the threads of a cache domain get neighbouring ranges, they share the rows of src1 and the output
+    for (int i = 0, k = 0; i < tp->n_threads_max; i++) {
+        const int j = tp->chunk_order[i];
+        if (j >= nth) {
+            continue;
+        }
+
+        struct ggml_compute_state * state = &tp->workers[j];
+
+        atomic_store_explicit(&state->chunk_next, (int) (((int64_t) n_chunks*k)/nth), memory_order_relaxed);
+        state->chunk_end = (int) (((int64_t) n_chunks*(k + 1))/nth);
+        k++;
+    }
+}
+
+static inline int ggml_threadpool_chunk_take(struct ggml_compute_state * state) {
+    // cheap check first, to avoid writing to the cache line of other threads when there is nothing left
+    if (atomic_load_explicit(&state->chunk_next, memory_order_relaxed) >= state->chunk_end) {
+        return -1;
+    }
+
+    const int chunk = atomic_fetch_add_explicit(&state->chunk_next, 1, memory_order_relaxed);
+
+    return chunk < state->chunk_end ? chunk : -1;
+}
+
+int ggml_threadpool_chunk_next(struct ggml_threadpool * tp, int ith, int nth) {
+    int chunk = ggml_threadpool_chunk_take(&tp->workers[ith]);
+    if (chunk >= 0) {
+        return chunk;
+    }
+
+    // steal from the threads in the same cache domain first, then from the rest
+    const int domain = tp->workers[ith].domain;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int k = 1; k < nth; k++) {
+            const int j = (ith + k) % nth;
+
+            if ((tp->workers[j].domain == domain) != (pass == 0)) {
+                continue;
+            }
+
+            chunk = ggml_threadpool_chunk_take(&tp->workers[j]);
+            if (chunk >= 0) {
+                return chunk;
+            }
+        }
+
+        if (!tp->chunk_domains) {
+            break;
+        }
+    }
+
+    return -1;
+}
+
 #if defined(__gnu_linux__)
 static cpu_set_t ggml_get_numa_affinity(void) {
     cpu_set_t cpuset;
@@ -610,7 +817,7 @@ void ggml_numa_init(enum ggml_numa_strategy numa_flag) {
     g_state.numa.cpuset = ggml_get_numa_affinity();
 
     // enumerate nodes
-    while (g_state.numa.n_nodes < GGML_NUMA_MAX_NODES) {
+    while (true) {
         rv = snprintf(path, sizeof(path), "/sys/devices/system/node/node%u", g_state.numa.n_nodes);
         GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
         if (stat(path, &st) != 0) { break; }
@@ -618,7 +825,7 @@ void ggml_numa_init(enum ggml_numa_strategy numa_flag) {
     }
 
     // enumerate CPUs
-    while (g_state.numa.total_cpus < GGML_NUMA_MAX_CPUS) {
+    while (true) {
         rv = snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", g_state.numa.total_cpus);
         GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
         if (stat(path, &st) != 0) { break; }
@@ -647,10 +854,15 @@ void ggml_numa_init(enum ggml_numa_strategy numa_flag) {
 
     GGML_PRINT_DEBUG("found our process on numa node %u, CPU %u\n", g_state.numa.current_node, current_cpu);
 
+    g_state.numa.nodes = calloc(g_state.numa.n_nodes, sizeof(struct ggml_numa_node));
+    GGML_ASSERT(g_state.numa.nodes);
+
     for (uint32_t n = 0; n < g_state.numa.n_nodes; ++n) {
         struct ggml_numa_node * node = &g_state.numa.nodes[n];
         GGML_PRINT_DEBUG("CPUs on node %u:", n);
+        node->cpus   = malloc(g_state.numa.total_cpus*sizeof(uint32_t));
         node->n_cpus = 0;
+        GGML_ASSERT(node->cpus);
         for (uint32_t c = 0; c < g_state.numa.total_cpus; ++c) {
             rv = snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpu%u", n, c);
             GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
@@ -682,6 +894,309 @@ bool ggml_is_numa(void) {
     return g_state.numa.n_nodes > 1;
 }
 
+#if defined(__gnu_linux__)
+static bool ggml_sysfs_read_int(const char * path, int * value) {
+    FILE * f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    const bool ok = fscanf(f, "%d", value) == 1;
+    fclose(f);
+    return ok;
+}
+
+// parse a CPU list such as "0-3,8,10-11", returns the number of CPUs
+static int ggml_sysfs_read_cpulist(const char * path, int * cpus, int n_max) {
+    FILE * f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    int n = 0;
+    int first;
+    while (fscanf(f, "%d", &first) == 1) {
+        int last = first;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &last) != 1) {
+                break;
+            }
+            c = fgetc(f);
+        }
+        for (int cpu = first; cpu <= last && n < n_max; cpu++) {
+            cpus[n++] = cpu;
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    fclose(f);
+
+    return n;
+}
+
+// read the NUMA nodes, the SMT siblings and the L3 cache domains of the CPUs from sysfs
+static void ggml_cpu_topo_init(struct ggml_cpu_topo * topo) {
+    struct stat st;
+    char path[256];
+    int rv;
+
+    int n_cpus = 0;
+    while (true) {
+        rv = snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", n_cpus);
+        GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
+        if (stat(path, &st) != 0) { break; }
+        ++n_cpus;
+    }
+
+    if (n_cpus == 0) {
+        return;
+    }
+
+    topo->cpus = malloc(n_cpus*sizeof(struct ggml_cpu_topo_cpu));
+    GGML_ASSERT(topo->cpus);
+    topo->n_cpus = n_cpus;
+
+    // read before any threadpool binds the main thread to a single CPU
+    cpu_set_t cpuset;
+    const bool has_cpuset = sched_getaffinity(0, sizeof(cpuset), &cpuset) == 0;
+
+    for (int cpu = 0; cpu < n_cpus; cpu++) {
+        const bool allowed = !has_cpuset || cpu >= CPU_SETSIZE || CPU_ISSET(cpu, &cpuset);
+        topo->cpus[cpu] = (struct ggml_cpu_topo_cpu) { allowed, 0, -1, 0, -1 };
+    }
+
+    int * list      = malloc(n_cpus*sizeof(int));
+    int * core_of   = malloc(n_cpus*sizeof(int)); // core of the first sibling
+    int * l3_first  = malloc(n_cpus*sizeof(int)); // first CPU of each L3 domain
+    int * node_l3   = NULL;                       // L3 domain standing for a NUMA node without L3 information
+    GGML_ASSERT(list && core_of && l3_first);
+
+    for (int cpu = 0; cpu < n_cpus; cpu++) {
+        core_of[cpu] = -1;
+    }
+
+    for (int node = 0; ; node++) {
+        rv = snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
+        if (stat(path, &st) != 0) { break; }
+
+        const int n = ggml_sysfs_read_cpulist(path, list, n_cpus);
+        for (int i = 0; i < n; i++) {
+            if (list[i] < n_cpus) {
+                topo->cpus[list[i]].node = node;
+            }
+        }
+    }
+
+    for (int cpu = 0; cpu < n_cpus; cpu++) {
+        struct ggml_cpu_topo_cpu * tc = &topo->cpus[cpu];
+
+        // cpu0 usually has no online file
+        int online = 1;
+        rv = snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+        GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
+        if (ggml_sysfs_read_int(path, &online) && !online) {
+            continue;
+        }
+
+        rv = snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+        GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
+        int n = ggml_sysfs_read_cpulist(path, list, n_cpus);
+        if (n == 0 || list[0] >= n_cpus) {
+            list[0] = cpu;
+            n = 1;
+        }
+        for (int i = 0; i < n; i++) {
+            if (list[i] == cpu) {
+                tc->smt = i;
+            }
+        }
+        if (core_of[list[0]] < 0) {
+            core_of[list[0]] = topo->n_cores++;
+        }
+        tc->core = core_of[list[0]];
+
+        // the L3 is identified by the first CPU that shares it
+        for (int idx = 0; ; idx++) {
+            int level;
+            rv = snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, idx);
+            GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
+            if (!ggml_sysfs_read_int(path, &level)) {
+                break;
+            }
+            if (level != 3) {
+                continue;
+            }
+
+            rv = snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, idx);
+            GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
+            if (ggml_sysfs_read_cpulist(path, list, n_cpus) > 0) {
+                int l3 = 0;
+                while (l3 < topo->n_l3 && l3_first[l3] != list[0]) {
+                    l3++;
+                }
+                if (l3 == topo->n_l3) {
+                    l3_first[topo->n_l3++] = list[0];
+                }
+                tc->l3 = l3;
+            }
+            break;
+        }
+    }
+
+    // without L3 information, the NUMA nodes are the cache domains
+    for (int cpu = 0; cpu < n_cpus; cpu++) {
+        struct ggml_cpu_topo_cpu * tc = &topo->cpus[cpu];
+        if (tc->core < 0 || tc->l3 >= 0) {
+            continue;
+        }
+        if (node_l3 == NULL) {
+            node_l3 = malloc(n_cpus*sizeof(int));
+            GGML_ASSERT(node_l3);
+            for (int i = 0; i < n_cpus; i++) {
+                node_l3[i] = -1;
+            }
+        }
+        const int node = MIN(tc->node, n_cpus - 1);
+        if (node_l3[node] < 0) {
+            node_l3[node] = topo->n_l3++;
+        }
+        tc->l3 = node_l3[node];
+    }
+
+    GGML_PRINT_DEBUG("found %d CPUs, %d cores, %d L3 domains\n", n_cpus, topo->n_cores, topo->n_l3);
+
+    free(node_l3);
+    free(l3_first);
+    free(core_of);
+    free(list);
+}
+#else
+static void ggml_cpu_topo_init(struct ggml_cpu_topo * topo) {
+    // TODO: topology of other platforms
+    UNUSED(topo);
+}
+#endif
+
+static const struct ggml_cpu_topo * ggml_cpu_topo_get(void) {
+    ggml_critical_section_start();
+    if (!g_state.topo.init) {
+        ggml_cpu_topo_init(&g_state.topo);
+        g_state.topo.init = true;
+    }
+    ggml_critical_section_end();
+
+    return &g_state.topo;
+}
+
+// the single CPU a thread is bound to, -1 if it may run on several CPUs
+static int ggml_thread_cpumask_cpu(const bool * mask) {
+    int cpu = -1;
+    for (int c = 0; c < GGML_MAX_N_THREADS; c++) {
+        if (mask[c]) {
+            if (cpu >= 0) {
+                return -1;
+            }
+            cpu = c;
+        }
+    }
+    return cpu;
+}
+
+// cache domain of a thread, used to keep the mul_mat chunks of threads that share an L3 together
+// the L3 domain of the CPUs the thread is bound to, otherwise its NUMA node
+static int ggml_thread_cache_domain(const struct ggml_cpu_topo * topo, const bool * mask, int ith) {
+    int l3 = -1;
+    for (int c = 0; c < GGML_MAX_N_THREADS && c < topo->n_cpus; c++) {
+        if (!mask[c]) {
+            continue;
+        }
+        if (topo->cpus[c].l3 < 0 || (l3 >= 0 && topo->cpus[c].l3 != l3)) {
+            l3 = -1;
+            break;
+        }
+        l3 = topo->cpus[c].l3;
+    }
+
+    return l3 >= 0 ? l3 : topo->n_l3 + ggml_thread_numa_node(ith);
+}
+
+struct ggml_cpu_place_item {
+    int cpu;
+    int key[3];
+};
+
+static int ggml_cpu_place_item_cmp(const void * a, const void * b) {
+    const struct ggml_cpu_place_item * ia = a;
+    const struct ggml_cpu_place_item * ib = b;
+
+    for (int k = 0; k < 3; k++) {
+        if (ia->key[k] != ib->key[k]) {
+            return ia->key[k] < ib->key[k] ? -1 : 1;
+        }
+    }
+    return ia->cpu - ib->cpu;
+}
+
+// order in which the allowed CPUs are given to the threads, returns the number of CPUs
+static int ggml_cpu_topo_place(const struct ggml_cpu_topo * topo, enum ggml_cpu_placement placement, const bool * allowed, int * order) {
+    const int n_cpus = MIN(topo->n_cpus, GGML_MAX_N_THREADS);
+
+    struct ggml_cpu_place_item * items = malloc(MAX(n_cpus, 1)*sizeof(struct ggml_cpu_place_item));
+    GGML_ASSERT(items);
+
+    // the physical cores of each L3 domain first, then their SMT siblings
+    int n = 0;
+    for (int cpu = 0; cpu < n_cpus; cpu++) {
+        const struct ggml_cpu_topo_cpu * tc = &topo->cpus[cpu];
+        if (allowed[cpu] && tc->allowed && tc->core >= 0) {
+            items[n++] = (struct ggml_cpu_place_item) { cpu, { tc->l3, tc->smt, tc->core } };
+        }
+    }
+    qsort(items, n, sizeof(struct ggml_cpu_place_item), ggml_cpu_place_item_cmp);
+
+    switch (placement) {
+        case GGML_CPU_PLACEMENT_CORES:
+            {
+                // one CPU of each core
+                int n_out = 0;
+                for (int i = 0; i < n; i++) {
+                    bool taken = false;
+                    for (int k = 0; k < n_out && !taken; k++) {
+                        taken = topo->cpus[items[k].cpu].core == topo->cpus[items[i].cpu].core;
+                    }
+                    if (!taken) {
+                        items[n_out++] = items[i];
+                    }
+                }
+                n = n_out;
+            } break;
+        case GGML_CPU_PLACEMENT_SPREAD:
+            {
+                // round robin over the L3 domains
+                for (int i = 0, rank = 0; i < n; i++) {
+                    rank = i > 0 && items[i].key[0] == items[i - 1].key[0] ? rank + 1 : 0;
+                    items[i].key[1] = items[i].key[0];
+                    items[i].key[0] = rank;
+                    items[i].key[2] = 0;
+                }
+                qsort(items, n, sizeof(struct ggml_cpu_place_item), ggml_cpu_place_item_cmp);
+            } break;
+        case GGML_CPU_PLACEMENT_COMPACT:
+        default:
+            break;
+    }
+
+    for (int i = 0; i < n; i++) {
+        order[i] = items[i].cpu;
+    }
+
+    free(items);
+
+    return n;
+}
+
 #if defined(__ARM_ARCH)
 
 #if defined(__linux__) && defined(__aarch64__)
@@ -1117,6 +1632,44 @@ void ggml_set_f32_nd(const struct ggml_tensor * tensor, int i0, int i1, int i2,
 
 // ggml_compute_forward_mul_mat
 
+// a permuted src0 is gathered by blocks of rows, a chunk uses its block for up to GGML_MUL_MAT_SRC0_PACK_COLS columns
+// of src1, see ggml_compute_forward_mul_mat_one_chunk()
+#define GGML_MUL_MAT_SRC0_PACK_ROWS 16
+#define GGML_MUL_MAT_SRC0_PACK_COLS 1024
+
+// a permuted src1 is gathered by tiles of rows x elements, the elements are converted to vec_dot_type at once
+// and must be a multiple of all block sizes
+#define GGML_MUL_MAT_SRC1_GATHER_ROWS 32
+#define GGML_MUL_MAT_SRC1_GATHER      256
+
+// src1 is converted to vec_dot_type in the work buffer, also when it has that type already but is permuted
+static bool ggml_mul_mat_src1_packed(const struct ggml_tensor * src0, const struct ggml_tensor * src1) {
+    return src1->type != type_traits_cpu[src0->type].vec_dot_type || src1->nb[0] != ggml_type_size(src1->type);
+}
+
+// src0 is permuted, its rows are gathered by blocks in the work buffer of each thread
+static bool ggml_mul_mat_src0_packed(const struct ggml_tensor * src0) {
+    return src0->nb[0] != ggml_type_size(src0->type);
+}
+
+static size_t ggml_mul_mat_src0_pack_stride(const struct ggml_tensor * src0) {
+    return GGML_PAD(GGML_MUL_MAT_SRC0_PACK_ROWS*ggml_row_size(src0->type, src0->ne[0]), CACHE_LINE_SIZE);
+}
+
+// copy n elements of size ts (2 or 4) that are nb bytes apart
+static inline void ggml_mul_mat_gather(void * GGML_RESTRICT dst, const char * GGML_RESTRICT src, int64_t n, size_t nb, size_t ts) {
+    if (ts == sizeof(uint32_t)) {
+        for (int64_t i = 0; i < n; ++i) {
+            ((uint32_t *) dst)[i] = *(const uint32_t *) (src + i*nb);
+        }
+    } else {
+        GGML_ASSERT(ts == sizeof(uint16_t));
+        for (int64_t i = 0; i < n; ++i) {
+            ((uint16_t *) dst)[i] = *(const uint16_t *) (src + i*nb);
+        }
+    }
+}
+
 static void ggml_compute_forward_mul_mat_one_chunk(
     const struct ggml_compute_params * params,
     struct ggml_tensor * dst,
@@ -1125,14 +1678,16 @@ static void ggml_compute_forward_mul_mat_one_chunk(
     const int64_t ir0_start,
     const int64_t ir0_end,
     const int64_t ir1_start,
-    const int64_t ir1_end) {
+    const int64_t ir1_end,
+    char * src0_pack) {
 
     const struct ggml_tensor * src0 = dst->src[0];
     const struct ggml_tensor * src1 = dst->src[1];
 
     GGML_TENSOR_BINARY_OP_LOCALS
 
-    const bool src1_cont = ggml_is_contiguous(src1);
+    const bool src1_cont   = ggml_is_contiguous(src1);
+    const bool src1_packed = ggml_mul_mat_src1_packed(src0, src1);
 
     ggml_vec_dot_t const vec_dot      = type_traits_cpu[type].vec_dot;
     enum ggml_type const vec_dot_type = type_traits_cpu[type].vec_dot_type;
@@ -1148,7 +1703,7 @@ static void ggml_compute_forward_mul_mat_one_chunk(
         return;
     }
 
-    const void * wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
+    const void * wdata = !src1_packed ? src1->data : params->src1_cache ? params->src1_cache : params->wdata;
     const size_t row_size = ggml_row_size(vec_dot_type, ne10);
 
     assert(ne12 % ne02 == 0);
@@ -1156,14 +1711,25 @@ static void ggml_compute_forward_mul_mat_one_chunk(
 
     // block-tiling attempt
     const int64_t blck_0 = 16;
-    const int64_t blck_1 = 16;
+    // a packed block of src0 rows goes through all the columns of the chunk, so that it is packed once per matrix
+    const int64_t blck_1 = src0_pack ? MAX(ir1_end - ir1_start, 1) : 16;
+
+    const size_t src1_col_stride = src1_cont || src1_packed ? row_size : nb11;
 
-    const size_t src1_col_stride = src1_cont || src1->type != vec_dot_type ? row_size : nb11;
+    // a permuted src0 is read from the rows gathered in src0_pack
+    const size_t src0_pack_row = ggml_row_size(type, ne00);
+    const size_t src0_row_stride = src0_pack ? src0_pack_row : nb01;
+
+    int64_t pack_ir0 = -1;
+    int64_t pack_i02 = -1;
+    int64_t pack_i03 = -1;
 
     // attempt to reduce false-sharing (does not seem to make a difference)
     // 16 * 2, accounting for mmla kernels
     float tmp[32];
 
+    assert(blck_0 <= GGML_MUL_MAT_SRC0_PACK_ROWS);
+
     for (int64_t iir1 = ir1_start; iir1 < ir1_end; iir1 += blck_1) {
         for (int64_t iir0 = ir0_start; iir0 < ir0_end; iir0 += blck_0) {
             for (int64_t ir1 = iir1; ir1 < iir1 + blck_1 && ir1 < ir1_end; ir1 += num_rows_per_vec_dot) {
@@ -1181,12 +1747,31 @@ static void ggml_compute_forward_mul_mat_one_chunk(
 
                 const char * src0_row = (const char*)src0->data + (0 + i02 * nb02 + i03 * nb03);
 
+                // first row of the block at src0_row
+                int64_t ir0_base = 0;
+
+                if (src0_pack) {
+                    const int64_t ir0_end_blck = MIN(iir0 + blck_0, ir0_end);
+
+                    if (iir0 != pack_ir0 || i02 != pack_i02 || i03 != pack_i03) {
+                        for (int64_t ir0 = iir0; ir0 < ir0_end_blck; ++ir0) {
+                            ggml_mul_mat_gather(src0_pack + (ir0 - iir0)*src0_pack_row, src0_row + ir0*nb01, ne00, nb00, ggml_type_size(type));
+                        }
+                        pack_ir0 = iir0;
+                        pack_i02 = i02;
+                        pack_i03 = i03;
+                    }
+
+                    src0_row = src0_pack;
+                    ir0_base = iir0;
+                }
+
                 // desc: when src1 is not a contiguous memory block we have to calculate the offset using the strides
                 //       if it is, then we have either copied the data to params->wdata and made it contiguous or we are using
                 //       the original src1 data pointer, so we should index using the indices directly
                 // TODO: this is a bit of a hack, we should probably have a better way to handle this
                 const char * src1_col = (const char*)wdata +
-                    (src1_cont || src1->type != vec_dot_type
+                    (src1_cont || src1_packed
                         ? (i11 + i12 * ne11 + i13 * ne12 * ne11) * row_size
                         : (i11 * nb11 + i12 * nb12 + i13 * nb13));
                 float * dst_col = (float*)((char*)dst->data + (i1 * nb1 + i2 * nb2 + i3 * nb3));
@@ -1196,7 +1781,7 @@ static void ggml_compute_forward_mul_mat_one_chunk(
                 //}
 
                 for (int64_t ir0 = iir0; ir0 < iir0 + blck_0 && ir0 < ir0_end; ir0 += num_rows_per_vec_dot) {
-                    vec_dot(ne00, &tmp[ir0 - iir0], (num_rows_per_vec_dot > 1 ? 16 : 0), src0_row + ir0 * nb01, (num_rows_per_vec_dot > 1 ? nb01 : 0), src1_col, (num_rows_per_vec_dot > 1 ? src1_col_stride : 0), num_rows_per_vec_dot);
+                    vec_dot(ne00, &tmp[ir0 - iir0], (num_rows_per_vec_dot > 1 ? 16 : 0), src0_row + (ir0 - ir0_base) * src0_row_stride, (num_rows_per_vec_dot > 1 ? src0_row_stride : 0), src1_col, (num_rows_per_vec_dot > 1 ? src1_col_stride : 0), num_rows_per_vec_dot);
                 }
 
                 for (int cn = 0; cn < num_rows_per_vec_dot; ++cn) {
@@ -1207,32 +1792,142 @@ static void ggml_compute_forward_mul_mat_one_chunk(
     }
 }
 
-void ggml_compute_forward_mul_mat(
-        const struct ggml_compute_params * params,
-              struct ggml_tensor * dst) {
+// split-K: a mul_mat with a single src1 column (token generation) and too few src0 rows to keep all the threads busy
+// splits the reduction dimension across the threads instead of the src0 rows
+#define GGML_MUL_MAT_SPLIT_K_MAX_ROWS  16  // src0 rows per thread below which the reduction dimension is split
+#define GGML_MUL_MAT_SPLIT_K_MIN_K    512  // min. part of the reduction dimension per thread
+#define GGML_MUL_MAT_SPLIT_K_PREFETCH   4  // src0 rows prefetched ahead
+
+#if defined(__GNUC__)
+#define GGML_CPU_PREFETCH(p) __builtin_prefetch((p), 0, 0)
+#else
+#define GGML_CPU_PREFETCH(p) ((void) (p))
+#endif
 
+static bool ggml_mul_mat_use_split_k(const struct ggml_tensor * dst, int nth) {
     const struct ggml_tensor * src0 = dst->src[0];
-    const struct ggml_tensor * src1 = dst->src[1];
 
-    GGML_TENSOR_BINARY_OP_LOCALS
+    return nth > 1 && ggml_nrows(dst) == 1 && !ggml_mul_mat_src0_packed(src0) &&
+        dst->ne[0] < (int64_t) nth*GGML_MUL_MAT_SPLIT_K_MAX_ROWS &&
+        src0->ne[0] >= (int64_t) nth*GGML_MUL_MAT_SPLIT_K_MIN_K;
+}
 
-    const int ith = params->ith;
-    const int nth = params->nth;
+static bool ggml_cpu_in_wdata(const struct ggml_compute_params * params, const void * ptr) {
+    const char * p = (const char *) ptr;
+    const char * w = (const char *) params->wdata;
 
-    enum ggml_type           const vec_dot_type         = type_traits_cpu[src0->type].vec_dot_type;
-    ggml_from_float_t        const from_float           = type_traits_cpu[vec_dot_type].from_float;
-    int64_t                  const vec_dot_num_rows     = type_traits_cpu[src0->type].nrows;
+    return w != NULL && p >= w && p < w + params->wsize;
+}
 
-    GGML_ASSERT(ne0 == ne01);
-    GGML_ASSERT(ne1 == ne11);
-    GGML_ASSERT(ne2 == ne12);
-    GGML_ASSERT(ne3 == ne13);
+// partial sums of one thread, padded to a cache line
+static size_t ggml_mul_mat_split_k_stride(const struct ggml_tensor * dst) {
+    return GGML_PAD(dst->ne[0]*sizeof(float), CACHE_LINE_SIZE);
+}
 
-    // we don't support permuted src0 or src1
-    GGML_ASSERT(nb00 == ggml_type_size(src0->type));
-    GGML_ASSERT(nb10 == ggml_type_size(src1->type));
+// each thread computes the partial dot products of all the src0 rows over its part of the reduction dimension,
+// then each thread sums the partials of its own range of rows pairwise
+static void ggml_compute_forward_mul_mat_split_k(
+    const struct ggml_compute_params * params,
+    struct ggml_tensor * dst,
+    const void * wdata,
+    char * partials,
+    const int nth_work) {
 
-    // dst cannot be transposed or permuted
+    const struct ggml_tensor * src0 = dst->src[0];
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    ggml_vec_dot_t const vec_dot      = type_traits_cpu[src0->type].vec_dot;
+    enum ggml_type const vec_dot_type = type_traits_cpu[src0->type].vec_dot_type;
+
+    const int64_t nr0  = dst->ne[0];
+    const size_t  nb01 = src0->nb[1];
+
+    const size_t stride = ggml_mul_mat_split_k_stride(dst);
+
+    if (ith < nth_work) {
+        // split on block boundaries, the vec_dot kernels work on whole blocks
+        const int64_t nb  = src0->ne[0]/ggml_blck_size(src0->type);
+        const int64_t ib0 = (nb*ith)/nth_work;
+        const int64_t ib1 = (nb*(ith + 1))/nth_work;
+
+        const int    n     = (int) ((ib1 - ib0)*ggml_blck_size(src0->type));
+        const size_t slice = (ib1 - ib0)*ggml_type_size(src0->type);
+
+        const char * x = (const char *) src0->data + ib0*ggml_type_size(src0->type);
+        const char * y = (const char *) wdata      + ib0*ggml_type_size(vec_dot_type);
+
+        float * s = (float *) (partials + ith*stride);
+
+        // the parts of the rows are too short for the hardware prefetcher to pick them up
+        for (int64_t ir0 = 0; ir0 < MIN(GGML_MUL_MAT_SPLIT_K_PREFETCH, nr0); ir0++) {
+            for (size_t off = 0; off < slice; off += CACHE_LINE_SIZE) {
+                GGML_CPU_PREFETCH(x + ir0*nb01 + off);
+            }
+        }
+
+        for (int64_t ir0 = 0; ir0 < nr0; ir0++) {
+            if (ir0 + GGML_MUL_MAT_SPLIT_K_PREFETCH < nr0) {
+                const char * next = x + (ir0 + GGML_MUL_MAT_SPLIT_K_PREFETCH)*nb01;
+                for (size_t off = 0; off < slice; off += CACHE_LINE_SIZE) {
+                    GGML_CPU_PREFETCH(next + off);
+                }
+            }
+            vec_dot(n, &s[ir0], 0, x + ir0*nb01, 0, y, 0, 1);
+        }
+    }
+
+    ggml_barrier(params->threadpool);
+
+    const int64_t dr  = (nr0 + nth - 1)/nth;
+    const int64_t ir0 = MIN(dr*ith, nr0);
+    const int64_t ir1 = MIN(ir0 + dr, nr0);
+
+    if (ir0 >= ir1) {
+        return;
+    }
+
+    // tree reduction of the partials, the threads work on disjoint rows so it needs no more barriers
+    for (int step = 1; step < nth_work; step *= 2) {
+        for (int t = 0; t + step < nth_work; t += 2*step) {
+            float       * a = (float *) (partials + t*stride)          + ir0;
+            const float * b = (float *) (partials + (t + step)*stride) + ir0;
+            ggml_vec_add_f32((int) (ir1 - ir0), a, a, b);
+        }
+    }
+
+    memcpy((float *) dst->data + ir0, (float *) partials + ir0, (ir1 - ir0)*sizeof(float));
+}
+
+void ggml_compute_forward_mul_mat(
+        const struct ggml_compute_params * params,
+              struct ggml_tensor * dst) {
+
+    const struct ggml_tensor * src0 = dst->src[0];
+    const struct ggml_tensor * src1 = dst->src[1];
+
+    GGML_TENSOR_BINARY_OP_LOCALS
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    enum ggml_type           const vec_dot_type         = type_traits_cpu[src0->type].vec_dot_type;
+    ggml_from_float_t        const from_float           = type_traits_cpu[vec_dot_type].from_float;
+    int64_t                  const vec_dot_num_rows     = type_traits_cpu[src0->type].nrows;
+
+    GGML_ASSERT(ne0 == ne01);
+    GGML_ASSERT(ne1 == ne11);
+    GGML_ASSERT(ne2 == ne12);
+    GGML_ASSERT(ne3 == ne13);
+
+    // a permuted src1 is gathered while it is converted to vec_dot_type, a permuted src0 by blocks of rows in the chunks
+    const bool src0_packed = ggml_mul_mat_src0_packed(src0);
+    const bool src1_packed = ggml_mul_mat_src1_packed(src0, src1);
+
+    GGML_ASSERT(!src0_packed || src0->type == GGML_TYPE_F32 || src0->type == GGML_TYPE_F16 || src0->type == GGML_TYPE_BF16);
+
+    // dst cannot be transposed or permuted
     GGML_ASSERT(nb0 == sizeof(float));
     GGML_ASSERT(nb0 <= nb1);
     GGML_ASSERT(nb1 <= nb2);
@@ -1249,7 +1944,8 @@ void ggml_compute_forward_mul_mat(
 
     const bool src1_cont = ggml_is_contiguous(src1);
 
-    if (src1_cont) {
+    // a shared src1 is always quantized, the next mul_mats rely on it
+    if (src1_cont && !src0_packed && params->src1_cache == NULL) {
         for (int64_t i13 = 0; i13 < ne13; i13++)
             for (int64_t i12 = 0; i12 < ne12; i12++)
                 if (!llamafile_sgemm(params,
@@ -1269,15 +1965,94 @@ void ggml_compute_forward_mul_mat(
 UseGgmlGemm1:;
 #endif
 
-    if (src1->type != vec_dot_type) {
-        char * wdata = params->wdata;
+    // src1 in vec_dot_type, possibly shared with other mul_mats, see ggml_cpu_graph_src1_cache()
+    char * wdata_src1 = params->src1_cache ? (char *) params->src1_cache : (char *) params->wdata;
+
+    if (src1_packed && nb10 != ggml_type_size(src1->type) && !params->src1_cache_valid) {
+        char * wdata = wdata_src1;
+
+        const size_t  nbw1 = ggml_row_size(vec_dot_type, ne10);
+        const size_t  ts   = ggml_type_size(src1->type);
+        const int64_t bs   = ggml_blck_size(vec_dot_type);
+
+        assert(params->src1_cache || params->wsize >= ne13*ne12*ne11*nbw1);
+        GGML_ASSERT(src1->type == vec_dot_type || src1->type == GGML_TYPE_F32);
+        static_assert(GGML_MUL_MAT_SRC1_GATHER % QK_K == 0, "the gathered elements must be whole blocks");
+
+        // permuted src1, each thread gathers tiles of GGML_MUL_MAT_SRC1_GATHER_ROWS rows x GGML_MUL_MAT_SRC1_GATHER elements,
+        // the rows of a tile follow dim d, the one src1 is contiguous along if any, and are gathered with the tiled
+        // transposes of ggml_compute_forward_dup()
+        const int64_t ne1x[4] = { ne10, ne11, ne12, ne13 };
+        const size_t  nb1x[4] = { nb10, nb11, nb12, nb13 };
+        const int64_t nrw [4] = { 0, 1, ne11, ne11*ne12 }; // rows in wdata between two indices of a dim
+
+        int d = 1;
+        for (int i = 1; i < 4; ++i) {
+            if (ne1x[i] > 1 && nb1x[i] == ts) {
+                d = i;
+                break;
+            }
+        }
+        const bool transposed = nb1x[d] == ts;
+
+        // the other two dims
+        const int e = d == 1 ? 2 : 1;
+        const int f = d == 3 ? 2 : 3;
+
+        const int64_t ng  = (ne1x[d] + GGML_MUL_MAT_SRC1_GATHER_ROWS - 1)/GGML_MUL_MAT_SRC1_GATHER_ROWS;
+        const int64_t nr  = ng*ne1x[e]*ne1x[f];
+        const int64_t dr  = (nr + nth - 1)/nth;
+        const int64_t ir0 = MIN(dr*ith, nr);
+        const int64_t ir1 = MIN(ir0 + dr, nr);
+
+        const size_t ldw = nrw[d]*nbw1;
+
+        float tmp[GGML_MUL_MAT_SRC1_GATHER_ROWS*GGML_MUL_MAT_SRC1_GATHER];
+
+        for (int64_t ir = ir0; ir < ir1; ++ir) {
+            const int64_t i_f = ir/(ne1x[e]*ng);
+            const int64_t i_e = (ir - i_f*ne1x[e]*ng)/ng;
+            const int64_t i_d = (ir - i_f*ne1x[e]*ng - i_e*ng)*GGML_MUL_MAT_SRC1_GATHER_ROWS;
+            const int64_t nrows = MIN(GGML_MUL_MAT_SRC1_GATHER_ROWS, ne1x[d] - i_d);
+
+            const char * src1_tile  = (const char *) src1->data + i_d*nb1x[d] + i_e*nb1x[e] + i_f*nb1x[f];
+                  char * wdata_tile = wdata + (i_d*nrw[d] + i_e*nrw[e] + i_f*nrw[f])*nbw1;
+
+            for (int64_t i10 = 0; i10 < ne10; i10 += GGML_MUL_MAT_SRC1_GATHER) {
+                const int64_t n = MIN(GGML_MUL_MAT_SRC1_GATHER, ne10 - i10);
+
+                if (src1->type == vec_dot_type) {
+                    if (transposed) {
+                        ggml_cpu_transpose_tile(src1_tile + i10*nb10, nb10, wdata_tile + i10*ts, ldw, nrows, n, ts);
+                    } else {
+                        for (int64_t r = 0; r < nrows; ++r) {
+                            ggml_mul_mat_gather(wdata_tile + r*ldw + i10*ts, src1_tile + r*nb1x[d] + i10*nb10, n, nb10, ts);
+                        }
+                    }
+                    continue;
+                }
+
+                if (transposed) {
+                    ggml_cpu_transpose_tile(src1_tile + i10*nb10, nb10, tmp, GGML_MUL_MAT_SRC1_GATHER*sizeof(float), nrows, n, ts);
+                } else {
+                    for (int64_t r = 0; r < nrows; ++r) {
+                        ggml_mul_mat_gather(tmp + r*GGML_MUL_MAT_SRC1_GATHER, src1_tile + r*nb1x[d] + i10*nb10, n, nb10, ts);
+                    }
+                }
+                for (int64_t r = 0; r < nrows; ++r) {
+                    from_float(tmp + r*GGML_MUL_MAT_SRC1_GATHER, wdata_tile + r*ldw + (i10/bs)*ggml_type_size(vec_dot_type), n);
+                }
+            }
+        }
+    } else if (src1_packed && !params->src1_cache_valid) {
+        char * wdata = wdata_src1;
 
         const size_t nbw0 = ggml_type_size(vec_dot_type);
         const size_t nbw1 = ggml_row_size(vec_dot_type, ne10);
         const size_t nbw2 = nbw1*ne11;
         const size_t nbw3 = nbw2*ne12;
 
-        assert(params->wsize >= ne13*nbw3);
+        assert(params->src1_cache || params->wsize >= ne13*nbw3);
         GGML_ASSERT(src1->type == GGML_TYPE_F32);
 
     #if 0
@@ -1306,16 +2081,76 @@ UseGgmlGemm1:;
     #endif
     }
 
-    if (ith == 0) {
-        // Every thread starts at ith, so the first unprocessed chunk is nth.  This save a bit of coordination right at the start.
-        atomic_store_explicit(&params->threadpool->current_chunk, nth, memory_order_relaxed);
+    // This is the size of the first dimension of the result, so we can iterate that way. (see the ASSERT above, these are the same numbers)
+    const int64_t nr0 = ne0;
+
+    // This is the size of the rest of the dimensions of the result
+    const int64_t nr1 = ne1 * ne2 * ne3;
+
+    // Now select a reasonable chunk size.
+    int chunk_size = 16;
+
+    // We need to step up the size if it's small
+    if (nr0 == 1 || nr1 == 1) {
+        chunk_size = 64;
+    }
+
+    // all the threads convert src1 and go through the barrier, but the autotuner can give the chunks to fewer threads
+    int nth_work = nth;
+
+    if (params->tune) {
+        nth_work = MIN(nth, params->tune->nth);
+        if (params->tune->chunk_size > 0) {
+            chunk_size = params->tune->chunk_size;
+        }
+    }
+
+    // distribute the work across the inner or outer loop based on which one is larger
+    // The number of chunks in the 0/1 dim.
+    // CEIL(nr0/chunk_size)
+    int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
+    int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+
+    // If the chunking is poor for the number of threads on this setup, scrap the whole plan.  Re-chunk it by thread.
+    //   Chunking by thread used to be forced on NUMA systems as well (see https://github.com/ggml-org/llama.cpp/pull/6915),
+    //   but each thread now starts on its own contiguous range of chunks and only steals from the other threads
+    //   (same node first) once it runs out, so the fine-grained chunks keep their locality.
+    if (nchunk0 * nchunk1 < nth_work * 4) {
+        // distribute the thread work across the inner or outer loop based on which one is larger
+        nchunk0 = nr0 > nr1 ? nth_work : 1; // parallelize by src0 rows
+        nchunk1 = nr0 > nr1 ? 1 : nth_work; // parallelize by src1 rows
+    }
+
+    // a chunk packs its block of rows of a permuted src0 once and uses it for GGML_MUL_MAT_SRC0_PACK_COLS columns of src1
+    if (src0_packed) {
+        nchunk0 = (nr0 + GGML_MUL_MAT_SRC0_PACK_ROWS - 1)/GGML_MUL_MAT_SRC0_PACK_ROWS;
+        nchunk1 = (nr1 + GGML_MUL_MAT_SRC0_PACK_COLS - 1)/GGML_MUL_MAT_SRC0_PACK_COLS;
+    }
+
+    // the partial sums of split-K or the packed src0 rows follow src1 in the work buffer, see ggml_graph_plan()
+    const size_t wsize_src1 = src1_packed && params->src1_cache == NULL ?
+        GGML_PAD(ggml_row_size(vec_dot_type, ggml_nelements(src1)), CACHE_LINE_SIZE) : 0;
+
+    // the nested mul_mats of the convolutions read their operands from the work buffer, the partial sums would overwrite them
+    const bool split_k = ggml_mul_mat_use_split_k(dst, nth_work) &&
+        !ggml_cpu_in_wdata(params, src0->data) && !ggml_cpu_in_wdata(params, src1->data) &&
+        params->wsize >= wsize_src1 + nth_work*ggml_mul_mat_split_k_stride(dst);
+
+    if (ith == 0 && !split_k) {
+        ggml_threadpool_chunks_reset(params->threadpool, nth_work, nchunk0 * nchunk1);
     }
 
     ggml_barrier(params->threadpool);
 
+    if (split_k) {
+        ggml_compute_forward_mul_mat_split_k(params, dst,
+            !src1_packed ? src1->data : wdata_src1, (char *) params->wdata + wsize_src1, nth_work);
+        return;
+    }
+
 #if GGML_USE_LLAMAFILE
-    if (src1->type != vec_dot_type) {
-        const void* wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
+    if (src1_packed && !src0_packed) {
+        const void* wdata = wdata_src1;
         const size_t row_size = ggml_row_size(vec_dot_type, ne10);
 
         for (int64_t i13 = 0; i13 < ne13; i13++)
@@ -1337,43 +2172,19 @@ UseGgmlGemm1:;
 UseGgmlGemm2:;
 #endif
 
-    // This is the size of the first dimension of the result, so we can iterate that way. (see the ASSERT above, these are the same numbers)
-    const int64_t nr0 = ne0;
-
-    // This is the size of the rest of the dimensions of the result
-    const int64_t nr1 = ne1 * ne2 * ne3;
-
-    // Now select a reasonable chunk size.
-    int chunk_size = 16;
-
-    // We need to step up the size if it's small
-    if (nr0 == 1 || nr1 == 1) {
-        chunk_size = 64;
-    }
-
-    // distribute the work across the inner or outer loop based on which one is larger
-    // The number of chunks in the 0/1 dim.
-    // CEIL(nr0/chunk_size)
-    int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
-    int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
-
-    // If the chunking is poor for the number of threads on this setup, scrap the whole plan.  Re-chunk it by thread.
-    //   Also, chunking by thread was measured to have perform better on NUMA systems.  See https://github.com/ggml-org/llama.cpp/pull/6915
-    //   In theory, chunking should be just as useful on NUMA and non NUMA systems, but testing disagreed with that.
-    if (nchunk0 * nchunk1 < nth * 4 || ggml_is_numa()) {
-        // distribute the thread work across the inner or outer loop based on which one is larger
-        nchunk0 = nr0 > nr1 ? nth : 1; // parallelize by src0 rows
-        nchunk1 = nr0 > nr1 ? 1 : nth; // parallelize by src1 rows
-    }
-
     // The number of elements in each chunk
     const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
     const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
 
-    // The first chunk comes from our thread_id, the rest will get auto-assigned.
-    int current_chunk = ith;
+    int current_chunk;
+
+    if (ith >= nth_work) {
+        return;
+    }
+
+    char * src0_pack = src0_packed ? (char *) params->wdata + wsize_src1 + ith*ggml_mul_mat_src0_pack_stride(src0) : NULL;
 
-    while (current_chunk < nchunk0 * nchunk1) {
+    while ((current_chunk = ggml_threadpool_chunk_next(params->threadpool, ith, nth_work)) >= 0) {
         const int64_t ith0 = current_chunk % nchunk0;
         const int64_t ith1 = current_chunk / nchunk0;
 
@@ -1391,85 +2202,119 @@ UseGgmlGemm2:;
         if ((nr0 % 2 != 0) || (ne11 % 2 != 0) || ((ir0_end - ir0_start) % 2 != 0) || ((ir1_end - ir1_start) % 2 != 0)) {
             num_rows_per_vec_dot = 1;
         }
-        ggml_compute_forward_mul_mat_one_chunk(params, dst, src0->type, num_rows_per_vec_dot, ir0_start, ir0_end, ir1_start, ir1_end);
-
-        if (nth >= nchunk0 * nchunk1) {
-            break;
-        }
-
-        current_chunk = atomic_fetch_add_explicit(&params->threadpool->current_chunk, 1, memory_order_relaxed);
+        ggml_compute_forward_mul_mat_one_chunk(params, dst, src0->type, num_rows_per_vec_dot, ir0_start, ir0_end, ir1_start, ir1_end, src0_pack);
     }
 }
 
 // ggml_compute_forward_mul_mat_id
 
-#define MMID_MATRIX_ROW(row_id, i1) matrix_rows[(row_id)*ids->ne[0]*ids->ne[1] + (i1)]
-
 struct mmid_row_mapping {
     int32_t i1;
     int32_t i2;
 };
 
+// work split of the rows of one matrix, see ggml_mul_mat_id_chunks()
+struct mmid_matrix_chunks {
+    int64_t nchunk0;
+    int64_t dr0;
+    int64_t dr1;
+};
+
+// one matrix of src0 by the rows of src1 grouped for it, as a dense matrix product
 static void ggml_compute_forward_mul_mat_id_one_chunk(
     struct ggml_tensor * dst,
     const struct ggml_tensor * src0,
-    const struct ggml_tensor * src1,
-    const struct ggml_tensor * ids,
-    const int64_t cur_a,
+    const char * src0_cur,
+    const char * src1_cur,
+    const struct mmid_row_mapping * rows,
+    const size_t row_size,
+    const int64_t num_rows_per_vec_dot,
     const int64_t ir0_start,
     const int64_t ir0_end,
     const int64_t ir1_start,
-    const int64_t ir1_end,
-    const char * src0_cur,
-    const struct mmid_row_mapping * matrix_rows,
-    const size_t row_size,
-    const bool src1_cont,
-    const void * wdata) {
-
-    GGML_TENSOR_BINARY_OP_LOCALS
+    const int64_t ir1_end) {
 
     const enum ggml_type type = src0->type;
 
-    ggml_vec_dot_t    const vec_dot      = type_traits_cpu[type].vec_dot;
-    enum ggml_type    const vec_dot_type = type_traits_cpu[type].vec_dot_type;
+    ggml_vec_dot_t const vec_dot = type_traits_cpu[type].vec_dot;
+
+    const int64_t ne00 = src0->ne[0];
+    const size_t  nb01 = src0->nb[1];
+    const size_t  nb1  = dst->nb[1];
+    const size_t  nb2  = dst->nb[2];
 
     const int64_t blck_0 = 16;
     const int64_t blck_1 = 16;
 
-    float tmp[16];
+    // 16 * 2, accounting for mmla kernels
+    float tmp[32];
 
-    for (int64_t iir1 = ir1_start; iir1 < ir1_end; iir1 += blck_1) {
-        for (int64_t iir0 = ir0_start; iir0 < ir0_end; iir0 += blck_0) {
-            for (int64_t ir1 = iir1; ir1 < iir1 + blck_1 && ir1 < ir1_end; ++ir1) {
-                const int64_t _i12 = ir1; // logical row index for this expert
+    // a block of rows of src0 stays in cache while it goes through all the rows of src1 of the chunk
+    for (int64_t iir0 = ir0_start; iir0 < ir0_end; iir0 += blck_0) {
+        for (int64_t iir1 = ir1_start; iir1 < ir1_end; iir1 += blck_1) {
+            for (int64_t ir1 = iir1; ir1 < iir1 + blck_1 && ir1 < ir1_end; ir1 += num_rows_per_vec_dot) {
+                const char * src1_col = src1_cur + ir1*row_size;
 
-                struct mmid_row_mapping row_mapping = MMID_MATRIX_ROW(cur_a, _i12);
-                const int id       = row_mapping.i1; // selected expert index
+                for (int64_t ir0 = iir0; ir0 < iir0 + blck_0 && ir0 < ir0_end; ir0 += num_rows_per_vec_dot) {
+                    vec_dot(ne00, &tmp[ir0 - iir0], (num_rows_per_vec_dot > 1 ? 16 : 0), src0_cur + ir0*nb01, (num_rows_per_vec_dot > 1 ? nb01 : 0), src1_col, (num_rows_per_vec_dot > 1 ? row_size : 0), num_rows_per_vec_dot);
+                }
 
-                const int64_t  i11 = id % ne11;
-                const int64_t  i12 = row_mapping.i2; // row index in src1
+                for (int cn = 0; cn < num_rows_per_vec_dot; ++cn) {
+                    // i1 is the selected expert index, i2 the row in src1
+                    const struct mmid_row_mapping row_mapping = rows[ir1 + cn];
 
-                const int64_t  i1 = id;  // selected expert index
-                const int64_t  i2 = i12; // row
+                    float * dst_col = (float *) ((char *) dst->data + (row_mapping.i1*nb1 + row_mapping.i2*nb2));
 
-                // desc: when src1 is not a contiguous memory block we have to calculate the offset using the strides
-                //       if it is, then we have either copied the data to params->wdata and made it contiguous or we are using
-                //       the original src1 data pointer, so we should index using the indices directly
-                // TODO: this is a bit of a hack, we should probably have a better way to handle this
-                const char * src1_col = (const char *) wdata +
-                    (src1_cont || src1->type != vec_dot_type
-                    ? (i11      + i12*ne11)*row_size
-                    : (i11*nb11 + i12*nb12));
+                    memcpy(&dst_col[iir0], tmp + (cn * 16), (MIN(iir0 + blck_0, ir0_end) - iir0)*sizeof(float));
+                }
+            }
+        }
+    }
+}
 
-                float * dst_col = (float *) ((char *) dst->data + (i1*nb1 + i2*nb2));
+// split the rows of the matrices in chunks of about the same amount of work, rows of src0 times rows of src1
+// a matrix with few rows of src1 gets few large chunks and a matrix with many rows gets many, so that the threads are
+// balanced by the number of rows of each matrix; src1 is split only when a chunk of 16 rows of src0 would still be
+// too large, so that a row of src0 is read by a single thread
+static void ggml_mul_mat_id_chunks(int64_t nr0, const int64_t * row_offs, int n_as, int nth, struct mmid_matrix_chunks * chunks, int64_t * chunk_offs) {
+    const int64_t n_rows = row_offs[n_as];
 
-                for (int64_t ir0 = iir0; ir0 < iir0 + blck_0 && ir0 < ir0_end; ++ir0) {
-                    vec_dot(ne00, &tmp[ir0 - iir0], 0, src0_cur + ir0*nb01, 0, src1_col, 0, 1);
-                }
+#if defined(__aarch64__)
+    // disable for ARM: one chunk per thread along the larger dimension of each matrix, as before the work-based split
+    // the work-based split has not been measured on ARM
+    const bool chunk_by_thread = true;
+#else
+    const bool chunk_by_thread = false;
+#endif // defined(__aarch64__)
 
-                memcpy(&dst_col[iir0], tmp, (MIN(iir0 + blck_0, ir0_end) - iir0)*sizeof(float));
-            }
+    // work of a chunk, at least 16 rows by 16 rows
+    const int64_t work = MAX(nr0*n_rows/(4*nth), 16*16);
+
+    chunk_offs[0] = 0;
+    for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+        const int64_t nr1 = row_offs[cur_a + 1] - row_offs[cur_a];
+
+        struct mmid_matrix_chunks * c = &chunks[cur_a];
+
+        if (nr1 == 0) {
+            c->nchunk0 = 0;
+            c->dr0     = nr0;
+            c->dr1     = 0;
+        } else if (chunk_by_thread) {
+            c->dr0 = nr0 > nr1 ? (nr0 + nth - 1)/nth : nr0;
+            c->dr1 = nr0 > nr1 ? nr1 : (nr1 + nth - 1)/nth;
+
+            c->nchunk0 = (nr0 + c->dr0 - 1)/c->dr0;
+        } else {
+            c->dr0 = MIN(GGML_PAD(MAX(work/nr1, 16), 16), nr0);
+            c->dr1 = nr1*c->dr0 > 2*work ? MIN(GGML_PAD(MAX(work/c->dr0, 16), 16), nr1) : nr1;
+
+            c->nchunk0 = (nr0 + c->dr0 - 1)/c->dr0;
         }
+
+        const int64_t nchunk1 = c->dr1 > 0 ? (nr1 + c->dr1 - 1)/c->dr1 : 0;
+
+        chunk_offs[cur_a + 1] = chunk_offs[cur_a] + c->nchunk0*nchunk1;
     }
 }
 
@@ -1481,6 +2326,8 @@ static void * incr_ptr_aligned(void ** p, size_t size, size_t align) {
     return ptr;
 }
 
+// the rows of src1 are sorted by matrix and converted to vec_dot_type into a dense block per matrix,
+// then each matrix is computed as a regular matrix product in chunks sized by its number of rows
 static void ggml_compute_forward_mul_mat_id(
         const struct ggml_compute_params * params,
               struct ggml_tensor * dst) {
@@ -1496,10 +2343,9 @@ static void ggml_compute_forward_mul_mat_id(
 
     const enum ggml_type type = src0->type;
 
-    const bool src1_cont = ggml_is_contiguous(src1);
-
-    enum ggml_type    const vec_dot_type    = type_traits_cpu[type].vec_dot_type;
-    ggml_from_float_t const from_float      = type_traits_cpu[vec_dot_type].from_float;
+    enum ggml_type    const vec_dot_type     = type_traits_cpu[type].vec_dot_type;
+    ggml_from_float_t const from_float       = type_traits_cpu[vec_dot_type].from_float;
+    int64_t           const vec_dot_num_rows = type_traits_cpu[type].nrows;
 
     // we don't support permuted src0 or src1
     GGML_ASSERT(nb00 == ggml_type_size(type));
@@ -1511,153 +2357,154 @@ static void ggml_compute_forward_mul_mat_id(
     GGML_ASSERT(nb1 <= nb2);
     GGML_ASSERT(nb2 <= nb3);
 
+    GGML_ASSERT(src1->type == vec_dot_type || src1->type == GGML_TYPE_F32);
+
     // row groups
     const int n_ids = ids->ne[0]; // n_expert_used
     const int n_as  = ne02;       // n_expert
 
+    const int64_t n_rows   = ids->ne[0]*ids->ne[1];
+    const size_t  row_size = ggml_row_size(vec_dot_type, ne10);
+
     void * wdata_cur = params->wdata;
 
-    if (src1->type != vec_dot_type) {
-        incr_ptr_aligned(&wdata_cur, ggml_row_size(vec_dot_type, ggml_nelements(src1)), sizeof(int64_t));
-    }
+    char * wdata = // [n_rows] rows of src1 in vec_dot_type, sorted by matrix
+        incr_ptr_aligned(&wdata_cur, n_rows*row_size, sizeof(int64_t));
 
     int64_t * matrix_row_counts = // [n_as]
         incr_ptr_aligned(&wdata_cur, n_as*sizeof(int64_t), sizeof(int64_t));
 
-    struct mmid_row_mapping * matrix_rows = // [n_as][ids->ne[0]*ids->ne[1]]
-        incr_ptr_aligned(&wdata_cur, n_as*ids->ne[0]*ids->ne[1]*sizeof(struct mmid_row_mapping), sizeof(int64_t));
-
-    char (*atomic_current_chunk)[CACHE_LINE_SIZE] = // [n_as]
-        incr_ptr_aligned(&wdata_cur, CACHE_LINE_SIZE * n_as, CACHE_LINE_SIZE);
+    int64_t * matrix_row_offs = // [n_as + 1]
+        incr_ptr_aligned(&wdata_cur, (n_as + 1)*sizeof(int64_t), sizeof(int64_t));
 
-    GGML_ASSERT(params->wsize >= (size_t)((char *) wdata_cur - (char *) params->wdata));
+    struct mmid_row_mapping * matrix_rows = // [n_rows]
+        incr_ptr_aligned(&wdata_cur, n_rows*sizeof(struct mmid_row_mapping), sizeof(int64_t));
 
-    if (src1->type != vec_dot_type) {
-        char * wdata = params->wdata;
+    struct mmid_matrix_chunks * matrix_chunks = // [n_as]
+        incr_ptr_aligned(&wdata_cur, n_as*sizeof(struct mmid_matrix_chunks), sizeof(int64_t));
 
-        const size_t nbw0 = ggml_type_size(vec_dot_type);
-        const size_t nbw1 = ggml_row_size(vec_dot_type, ne10);
-        const size_t nbw2 = nbw1*ne11;
-        const size_t nbw3 = nbw2*ne12;
+    int64_t * matrix_chunk_offs = // [n_as + 1]
+        incr_ptr_aligned(&wdata_cur, (n_as + 1)*sizeof(int64_t), sizeof(int64_t));
 
-        assert(params->wsize >= ne13*nbw3);
-        GGML_ASSERT(src1->type == GGML_TYPE_F32);
+    GGML_ASSERT(params->wsize >= (size_t)((char *) wdata_cur - (char *) params->wdata));
 
-#if 0
-        for (int64_t i13 = 0; i13 < ne13; ++i13) {
-            for (int64_t i12 = ith; i12 < ne12; i12 += nth) {
-                for (int64_t i11 = 0; i11 < ne11; ++i11) {
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1),
-                               ne10);
-                }
-            }
-        }
-#else
-        for (int64_t i13 = 0; i13 < ne13; ++i13) {
-            for (int64_t i12 = 0; i12 < ne12; ++i12) {
-                for (int64_t i11 = 0; i11 < ne11; ++i11) {
-                    size_t bs = ggml_blck_size(vec_dot_type);
-                    int64_t ne10_block_start = (ith * ne10/bs) / nth;
-                    int64_t ne10_block_end   = ((ith + 1) * ne10/bs) / nth;
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11 + ne10_block_start*bs*nb10),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1 + ne10_block_start*nbw0),
-                               (ne10_block_end - ne10_block_start) * bs);
-                }
-            }
-        }
-#endif
-    }
+    const int64_t nr0 = ne01;
 
     if (ith == 0) {
-        // initialize matrix_row_counts
+        // count the rows of each src0 matrix
         memset(matrix_row_counts, 0, n_as*sizeof(int64_t));
 
-        // group rows by src0 matrix
         for (int64_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
             for (int id = 0; id < n_ids; ++id) {
                 const int32_t i02 = *(const int32_t *) ((const char *) ids->data + iid1*ids->nb[1] + id*ids->nb[0]);
 
                 assert(i02 >= 0 && i02 < n_as);
 
-                MMID_MATRIX_ROW(i02, matrix_row_counts[i02]) = (struct mmid_row_mapping) {id, iid1};
                 matrix_row_counts[i02] += 1;
             }
         }
-    }
 
-    // reset current_chunk
-    for (int cur_a = ith; cur_a < n_as; cur_a += nth) {
-        atomic_int * current_chunk_ctr = (atomic_int *)(atomic_current_chunk + cur_a);
-        *current_chunk_ctr = nth;
+        matrix_row_offs[0] = 0;
+        for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+            matrix_row_offs[cur_a + 1] = matrix_row_offs[cur_a] + matrix_row_counts[cur_a];
+            matrix_row_counts[cur_a]   = 0;
+        }
+
+        // group rows by src0 matrix
+        for (int64_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
+            for (int id = 0; id < n_ids; ++id) {
+                const int32_t i02 = *(const int32_t *) ((const char *) ids->data + iid1*ids->nb[1] + id*ids->nb[0]);
+
+                matrix_rows[matrix_row_offs[i02] + matrix_row_counts[i02]++] = (struct mmid_row_mapping) {id, iid1};
+            }
+        }
+
+        // the chunks of all matrices are numbered consecutively, so that the threads can move between matrices
+        // without synchronizing and a thread mostly works on the same few matrices
+        ggml_mul_mat_id_chunks(nr0, matrix_row_offs, n_as, nth, matrix_chunks, matrix_chunk_offs);
+
+        ggml_threadpool_chunks_reset(params->threadpool, nth, (int) matrix_chunk_offs[n_as]);
     }
 
     ggml_barrier(params->threadpool);
 
-    for (int cur_a = 0; cur_a < n_as; ++cur_a) {
-        const int64_t cne1 = matrix_row_counts[cur_a];
+    // gather the rows of src1 in the order of matrix_rows, converted to vec_dot_type
+    {
+        const size_t bs  = ggml_blck_size(vec_dot_type);
+        const size_t nbw0 = ggml_type_size(vec_dot_type);
 
-        if (cne1 == 0) {
-            continue;
-        }
+        // whole rows per thread when there are enough of them, parts of every row otherwise
+        const bool split_rows = n_rows >= nth;
 
-        const char * src0_cur = (const char *) src0->data + cur_a * nb02;
-        const void * wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
-        const size_t row_size = ggml_row_size(vec_dot_type, ne10);
+        const int64_t ne10_block_start = split_rows ? 0         : (ith * ne10/bs) / nth;
+        const int64_t ne10_block_end   = split_rows ? ne10/bs   : ((ith + 1) * ne10/bs) / nth;
 
-        const int64_t nr0 = ne01;
-        const int64_t nr1 = cne1;
+        for (int64_t j = split_rows ? ith : 0; j < n_rows; j += split_rows ? nth : 1) {
+            const struct mmid_row_mapping row_mapping = matrix_rows[j];
 
-        int chunk_size = 16;
-        if (nr0 == 1 || nr1 == 1) {
-            chunk_size = 64;
-        }
+            const int64_t i11 = row_mapping.i1 % ne11;
+            const int64_t i12 = row_mapping.i2;
 
-#if defined(__aarch64__)
-        // disable for ARM
-        const bool disable_chunking = true;
-#else
-        // disable for NUMA
-        const bool disable_chunking = ggml_is_numa();
-#endif // defined(__aarch64__)
+            const char * src1_row = (const char *) src1->data + i12*nb12 + i11*nb11 + ne10_block_start*bs*nb10;
+            char       * wdata_row = wdata + j*row_size + ne10_block_start*nbw0;
+
+            if (src1->type == vec_dot_type) {
+                memcpy(wdata_row, src1_row, (ne10_block_end - ne10_block_start)*nbw0);
+            } else {
+                from_float((const float *) src1_row, wdata_row, (ne10_block_end - ne10_block_start) * bs);
+            }
+        }
+    }
 
-        int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
-        int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+    ggml_barrier(params->threadpool);
 
-        if (nchunk0 * nchunk1 < nth * 4 || disable_chunking) {
-            nchunk0 = nr0 > nr1 ? nth : 1;
-            nchunk1 = nr0 > nr1 ? 1 : nth;
+    int current_chunk;
+
+    while ((current_chunk = ggml_threadpool_chunk_next(params->threadpool, ith, nth)) >= 0) {
+        // find the matrix of this chunk
+        int lo = 0;
+        int hi = n_as;
+        while (hi - lo > 1) {
+            const int mid = (lo + hi)/2;
+            if (matrix_chunk_offs[mid] <= current_chunk) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
         }
 
-        const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
-        const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
+        const int cur_a = lo;
 
-        int current_chunk = ith;
+        const struct mmid_matrix_chunks * c = &matrix_chunks[cur_a];
 
-        atomic_int * current_chunk_ctr = (atomic_int *)(atomic_current_chunk + cur_a);
+        const int64_t nr1 = matrix_row_offs[cur_a + 1] - matrix_row_offs[cur_a];
 
-        while (current_chunk < nchunk0 * nchunk1) {
-            const int64_t ith0 = current_chunk % nchunk0;
-            const int64_t ith1 = current_chunk / nchunk0;
+        const int64_t chunk = current_chunk - matrix_chunk_offs[cur_a];
 
-            const int64_t ir0_start = dr0 * ith0;
-            const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
+        const int64_t ith0 = chunk % c->nchunk0;
+        const int64_t ith1 = chunk / c->nchunk0;
 
-            const int64_t ir1_start = dr1 * ith1;
-            const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
+        const int64_t ir0_start = c->dr0 * ith0;
+        const int64_t ir0_end = MIN(ir0_start + c->dr0, nr0);
 
-            ggml_compute_forward_mul_mat_id_one_chunk(
-                dst, src0, src1, ids, cur_a,
-                ir0_start, ir0_end, ir1_start, ir1_end,
-                src0_cur, matrix_rows, row_size, src1_cont, wdata
-            );
+        const int64_t ir1_start = c->dr1 * ith1;
+        const int64_t ir1_end = MIN(ir1_start + c->dr1, nr1);
 
-            if (nth >= nchunk0 * nchunk1) {
-                break;
-            }
+        // mmla kernels process 2 rows of src0 and src1 at a time
+        int64_t num_rows_per_vec_dot = vec_dot_num_rows;
 
-            current_chunk = atomic_fetch_add_explicit(current_chunk_ctr, 1, memory_order_relaxed);
+        if ((nr0 % 2 != 0) || ((ir0_end - ir0_start) % 2 != 0) || ((ir1_end - ir1_start) % 2 != 0)) {
+            num_rows_per_vec_dot = 1;
         }
+
+        ggml_compute_forward_mul_mat_id_one_chunk(
+            dst, src0,
+            (const char *) src0->data + cur_a*nb02,
+            wdata + matrix_row_offs[cur_a]*row_size,
+            matrix_rows + matrix_row_offs[cur_a],
+            row_size, num_rows_per_vec_dot,
+            ir0_start, ir0_end, ir1_start, ir1_end
+        );
     }
 }
 
@@ -1944,6 +2791,10 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
             {
                 ggml_compute_forward_argsort(params, tensor);
             } break;
+        case GGML_OP_TOP_K:
+            {
+                ggml_compute_forward_top_k(params, tensor);
+            } break;
         case GGML_OP_LEAKY_RELU:
             {
                 ggml_compute_forward_leaky_relu(params, tensor);
@@ -2279,6 +3130,9 @@ static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
             } break;
         case GGML_OP_POOL_1D:
         case GGML_OP_POOL_2D:
+            {
+                n_tasks = n_threads;
+            } break;
         case GGML_OP_POOL_2D_BACK:
             {
                 n_tasks = 1;
@@ -2290,6 +3144,7 @@ static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
         case GGML_OP_ARANGE:
         case GGML_OP_TIMESTEP_EMBEDDING:
         case GGML_OP_ARGSORT:
+        case GGML_OP_TOP_K:
         case GGML_OP_FLASH_ATTN_EXT:
         case GGML_OP_FLASH_ATTN_BACK:
         case GGML_OP_SSM_CONV:
@@ -2379,6 +3234,9 @@ static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
 }
 
 static thread_ret_t ggml_graph_compute_secondary_thread(void* data);
+#ifndef GGML_USE_OPENMP
+static void ggml_threadpool_wake(struct ggml_threadpool * threadpool);
+#endif
 
 #if defined(_WIN32)
 #include "windows.h"
@@ -2598,11 +3456,42 @@ static void ggml_thread_cpumask_next(const bool * global_mask, bool * local_mask
     }
 }
 
+// give the workers of a thread group back to its parent
+static void ggml_threadpool_release_group(struct ggml_threadpool * group) {
+    struct ggml_threadpool * parent = group->parent;
+
+#ifndef GGML_USE_OPENMP
+    // the group has been stopped, wait for the lent workers to leave it
+    while (atomic_load_explicit(&group->n_attached, memory_order_acquire) > 0) {
+        sched_yield();
+    }
+#endif
+
+    ggml_critical_section_start();
+
+    for (int j = group->group_first; j < group->group_first + group->n_threads_max; j++) {
+        parent->workers[j].group = NULL;
+    }
+    parent->n_groups--;
+
+    parent->n_threads_avail = parent->n_threads_max;
+    for (int j = 1; j < parent->n_threads_max; j++) {
+        if (parent->workers[j].group) {
+            parent->n_threads_avail = j;
+            break;
+        }
+    }
+
+    ggml_critical_section_end();
+}
+
 void ggml_threadpool_free(struct ggml_threadpool* threadpool) {
     if (!threadpool) return;
 
     const int n_threads = threadpool->n_threads_max;
 
+    GGML_ASSERT(threadpool->n_groups == 0 && "thread groups must be freed before their threadpool");
+
 #ifndef GGML_USE_OPENMP
     struct ggml_compute_state* workers = threadpool->workers;
 
@@ -2612,18 +3501,37 @@ void ggml_threadpool_free(struct ggml_threadpool* threadpool) {
     threadpool->pause = false;
 
     ggml_cond_broadcast(&threadpool->cond);
+    ggml_threadpool_wake(threadpool);
     ggml_mutex_unlock(&threadpool->mutex);
 
-    for (int j = 1; j < n_threads; j++) {
-        int32_t rc = ggml_thread_join(workers[j].thrd, NULL);
-        GGML_ASSERT(rc == GGML_EXIT_SUCCESS || rc == GGML_EXIT_ABORTED);
-        UNUSED(rc);
+    if (threadpool->parent == NULL) {
+        for (int j = 1; j < n_threads; j++) {
+            int32_t rc = ggml_thread_join(workers[j].thrd, NULL);
+            GGML_ASSERT(rc == GGML_EXIT_SUCCESS || rc == GGML_EXIT_ABORTED);
+            UNUSED(rc);
+        }
     }
 
     ggml_mutex_destroy(&threadpool->mutex);
     ggml_cond_destroy(&threadpool->cond);
+
+    if (threadpool->barrier_nodes) {
+        ggml_aligned_free(threadpool->barrier_nodes, sizeof(struct ggml_barrier_node) * n_threads);
+    }
 #endif // GGML_USE_OPENMP
 
+    if (threadpool->parent) {
+        ggml_threadpool_release_group(threadpool);
+    }
+
+    free(threadpool->node_sync);
+    free(threadpool->node_fuse);
+    free(threadpool->fuse_nodes);
+    free(threadpool->node_src1);
+    free(threadpool->node_tune);
+    free(threadpool->tune_nodes);
+    free(threadpool->chunk_order);
+
     const size_t workers_size = sizeof(struct ggml_compute_state) * n_threads;
     ggml_aligned_free(threadpool->workers, workers_size);
     ggml_aligned_free(threadpool, sizeof(struct ggml_threadpool));
@@ -2668,6 +3576,454 @@ void ggml_threadpool_resume(struct ggml_threadpool * threadpool) {
 #endif
 }
 
+void ggml_threadpool_get_stats(struct ggml_threadpool * threadpool, struct ggml_threadpool_stats * stats) {
+    memset(stats, 0, sizeof(*stats));
+#ifndef GGML_USE_OPENMP
+    for (int j = 1; j < threadpool->n_threads_max; j++) {
+        const struct ggml_compute_state * state = &threadpool->workers[j];
+        stats->n_spin    += state->n_spin;
+        stats->n_sleep   += state->n_sleep;
+        stats->t_wake_us += state->t_wake_us;
+    }
+    stats->spin_us = atomic_load_explicit(&threadpool->spin_us, memory_order_relaxed);
+    stats->gap_us  = threadpool->gap_us;
+#else
+    UNUSED(threadpool);
+#endif
+}
+
+void ggml_threadpool_reset_stats(struct ggml_threadpool * threadpool) {
+#ifndef GGML_USE_OPENMP
+    for (int j = 1; j < threadpool->n_threads_max; j++) {
+        struct ggml_compute_state * state = &threadpool->workers[j];
+        state->n_spin    = 0;
+        state->n_sleep   = 0;
+        state->t_wake_us = 0;
+    }
+#else
+    UNUSED(threadpool);
+#endif
+}
+
+//
+// autotuning of the work split per (op, types, shape)
+//
+// the first graphs time each tuned node with a number of candidate splits: the number of threads halved down to 1,
+// then, for mul_mat, a few chunk sizes with the best number of threads
+// the best split of each key is used from then on, and can be saved to a file that the next processes load
+//
+
+#define GGML_TUNE_SAMPLES 4 // graphs timed per candidate
+
+static const int ggml_tune_chunk_sizes[] = { 16, 64, 256 };
+
+struct ggml_tune_entry {
+    uint64_t key;        // 0 for an empty slot
+    int32_t  nth;        // best number of threads
+    int32_t  chunk_size; // best mul_mat chunk size, 0 for the default heuristic
+    int32_t  cand;       // candidate being timed, -1 once tuned
+    int32_t  n_samples;  // graphs that timed the candidate
+    int32_t  stamp;      // last graph that timed the candidate
+    int64_t  t_cand;     // total time of the candidate
+    int64_t  t_best;     // total time of the best candidate
+};
+
+// per node state of the current graph
+struct ggml_tune_node {
+    uint64_t key;  // 0 if the node is not tuned
+    int32_t  cand; // candidate used by the node, -1 if tuned
+    int64_t  t;    // time of the node, -1 if not computed
+};
+
+static struct {
+    struct ggml_tune_entry * entries; // open addressing hash table, NULL when autotuning is disabled
+    size_t                   size;    // power of 2
+    size_t                   n;
+    int32_t                  stamp;
+    char                   * path;
+} g_tune = { NULL, 0, 0, 0, NULL };
+
+static atomic_int g_tune_enabled = 0; // checked without taking the lock
+
+// ops that split their work by ith/nth without synchronizing the threads, so that the extra threads can skip them
+// mul_mat is handled by its chunk scheduler
+static bool ggml_tune_op_supported(const struct ggml_tensor * node) {
+    if (ggml_is_empty(node)) {
+        return false;
+    }
+
+    switch (node->op) {
+        case GGML_OP_DUP:
+        case GGML_OP_ADD:
+        case GGML_OP_ADD_ID:
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+        case GGML_OP_SQR:
+        case GGML_OP_SQRT:
+        case GGML_OP_LOG:
+        case GGML_OP_SIN:
+        case GGML_OP_COS:
+        case GGML_OP_SUM_ROWS:
+        case GGML_OP_MEAN:
+        case GGML_OP_ARGMAX:
+        case GGML_OP_REPEAT:
+        case GGML_OP_CONCAT:
+        case GGML_OP_NORM:
+        case GGML_OP_RMS_NORM:
+        case GGML_OP_L2_NORM:
+        case GGML_OP_MUL_MAT:
+        case GGML_OP_SCALE:
+        case GGML_OP_CPY:
+        case GGML_OP_CONT:
+        case GGML_OP_GET_ROWS:
+        case GGML_OP_SET_ROWS:
+        case GGML_OP_SOFT_MAX:
+        case GGML_OP_ROPE:
+        case GGML_OP_CLAMP:
+        case GGML_OP_UNARY:
+        case GGML_OP_GLU:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static uint64_t ggml_tune_hash(uint64_t h, int64_t v) {
+    // FNV-1a
+    for (int i = 0; i < 8; i++) {
+        h ^= (uint64_t) (v >> (8*i)) & 0xff;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// shapes are bucketed to the next power of 2, so that e.g. close batch sizes share their tuning
+static int64_t ggml_tune_bucket(int64_t x) {
+    int64_t b = 16;
+    if (x <= b) {
+        return x;
+    }
+    while (b < x) {
+        b *= 2;
+    }
+    return b;
+}
+
+static uint64_t ggml_tune_key(const struct ggml_tensor * node, int n_threads) {
+    const struct ggml_tensor * src0 = node->src[0];
+    const struct ggml_tensor * src1 = node->src[1];
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    h = ggml_tune_hash(h, node->op);
+    h = ggml_tune_hash(h, node->op == GGML_OP_UNARY || node->op == GGML_OP_GLU ? ggml_get_op_params_i32(node, 0) : 0);
+    h = ggml_tune_hash(h, n_threads);
+    h = ggml_tune_hash(h, node->type);
+    h = ggml_tune_hash(h, src0 ? (int64_t) src0->type : -1);
+    h = ggml_tune_hash(h, src1 ? (int64_t) src1->type : -1);
+    h = ggml_tune_hash(h, ggml_tune_bucket(node->ne[0]));
+    h = ggml_tune_hash(h, ggml_tune_bucket(ggml_nrows(node)));
+    h = ggml_tune_hash(h, src0 ? ggml_tune_bucket(src0->ne[0]) : 0);
+
+    return h ? h : 1;
+}
+
+static struct ggml_tune_entry * ggml_tune_find(uint64_t key, bool insert) {
+    if (insert && 2*(g_tune.n + 1) > g_tune.size) {
+        // grow the table
+        struct ggml_tune_entry * old      = g_tune.entries;
+        const size_t             old_size = g_tune.size;
+
+        g_tune.size    = MAX(2*old_size, 256);
+        g_tune.entries = calloc(g_tune.size, sizeof(struct ggml_tune_entry));
+        GGML_ASSERT(g_tune.entries);
+
+        for (size_t i = 0; i < old_size; i++) {
+            if (old[i].key) {
+                size_t j = old[i].key & (g_tune.size - 1);
+                while (g_tune.entries[j].key) {
+                    j = (j + 1) & (g_tune.size - 1);
+                }
+                g_tune.entries[j] = old[i];
+            }
+        }
+
+        free(old);
+    }
+
+    size_t j = key & (g_tune.size - 1);
+    while (g_tune.entries[j].key && g_tune.entries[j].key != key) {
+        j = (j + 1) & (g_tune.size - 1);
+    }
+
+    struct ggml_tune_entry * e = &g_tune.entries[j];
+
+    if (e->key == 0) {
+        if (!insert) {
+            return NULL;
+        }
+        memset(e, 0, sizeof(*e));
+        e->key = key;
+        g_tune.n++;
+    }
+
+    return e;
+}
+
+static int ggml_tune_n_thread_cands(int n_threads) {
+    int n = 0;
+    for (int nth = n_threads; nth >= 1; nth /= 2) {
+        n++;
+    }
+    return n;
+}
+
+static int ggml_tune_n_cands(const struct ggml_tensor * node, int n_threads) {
+    return ggml_tune_n_thread_cands(n_threads) + (node->op == GGML_OP_MUL_MAT ? (int) (sizeof(ggml_tune_chunk_sizes)/sizeof(int)) : 0);
+}
+
+static struct ggml_tune_choice ggml_tune_cand(const struct ggml_tune_entry * e, int cand, int n_threads) {
+    const int n_thread_cands = ggml_tune_n_thread_cands(n_threads);
+
+    struct ggml_tune_choice choice;
+    if (cand < n_thread_cands) {
+        choice.nth        = n_threads >> cand;
+        choice.chunk_size = 0;
+    } else {
+        choice.nth        = e->nth;
+        choice.chunk_size = ggml_tune_chunk_sizes[cand - n_thread_cands];
+    }
+    return choice;
+}
+
+bool ggml_cpu_tune_init(const char * path) {
+    ggml_cpu_tune_free();
+
+    ggml_critical_section_start();
+
+    g_tune.size    = 256;
+    g_tune.n       = 0;
+    g_tune.entries = calloc(g_tune.size, sizeof(struct ggml_tune_entry));
+    g_tune.path    = NULL;
+    GGML_ASSERT(g_tune.entries);
+
+    if (path) {
+        g_tune.path = malloc(strlen(path) + 1);
+        GGML_ASSERT(g_tune.path);
+        strcpy(g_tune.path, path);
+    }
+
+    bool ok = true;
+
+    FILE * f = path ? ggml_fopen(path, "r") : NULL;
+    if (f) {
+        int version = 0;
+        if (fscanf(f, "ggml-cpu-tune %d", &version) != 1 || version != 1) {
+            GGML_LOG_WARN("%s: ignoring %s: unknown format\n", __func__, path);
+            ok = false;
+        } else {
+            unsigned long long key;
+            int nth;
+            int chunk_size;
+            while (fscanf(f, "%llx %d %d", &key, &nth, &chunk_size) == 3) {
+                struct ggml_tune_entry * e = ggml_tune_find(key ? key : 1, true);
+                e->nth        = nth;
+                e->chunk_size = chunk_size;
+                e->cand       = -1;
+            }
+        }
+        fclose(f);
+    }
+
+    atomic_store_explicit(&g_tune_enabled, 1, memory_order_relaxed);
+
+    ggml_critical_section_end();
+
+    return ok;
+}
+
+bool ggml_cpu_tune_save(void) {
+    ggml_critical_section_start();
+
+    bool ok = false;
+
+    FILE * f = g_tune.path ? ggml_fopen(g_tune.path, "w") : NULL;
+    if (f) {
+        fprintf(f, "ggml-cpu-tune 1\n");
+        for (size_t i = 0; i < g_tune.size; i++) {
+            const struct ggml_tune_entry * e = &g_tune.entries[i];
+            if (e->key && e->cand < 0) {
+                fprintf(f, "%016llx %d %d\n", (unsigned long long) e->key, e->nth, e->chunk_size);
+            }
+        }
+        ok = fclose(f) == 0;
+    }
+
+    ggml_critical_section_end();
+
+    return ok;
+}
+
+void ggml_cpu_tune_free(void) {
+    ggml_critical_section_start();
+
+    atomic_store_explicit(&g_tune_enabled, 0, memory_order_relaxed);
+
+    free(g_tune.entries);
+    free(g_tune.path);
+    g_tune.entries = NULL;
+    g_tune.path    = NULL;
+    g_tune.size    = 0;
+    g_tune.n       = 0;
+
+    ggml_critical_section_end();
+}
+
+// pick the work split of the nodes of the graph, returns true if some nodes are tuned
+static bool ggml_cpu_tune_begin(struct ggml_threadpool * tp, const struct ggml_cgraph * cgraph, int n_threads) {
+    tp->tune_active = false;
+    tp->tune_timing = false;
+
+    if (n_threads < 2 || !atomic_load_explicit(&g_tune_enabled, memory_order_relaxed)) {
+        return false;
+    }
+
+    if (tp->node_tune_size < cgraph->n_nodes) {
+        free(tp->node_tune);
+        free(tp->tune_nodes);
+        tp->node_tune      = malloc(sizeof(struct ggml_tune_choice) * cgraph->n_nodes);
+        tp->tune_nodes     = malloc(sizeof(struct ggml_tune_node)   * cgraph->n_nodes);
+        tp->node_tune_size = cgraph->n_nodes;
+        GGML_ASSERT(tp->node_tune && tp->tune_nodes);
+    }
+
+    ggml_critical_section_start();
+
+    if (g_tune.entries == NULL) {
+        ggml_critical_section_end();
+        return false;
+    }
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        struct ggml_tune_choice * choice = &tp->node_tune[i];
+        struct ggml_tune_node   * tn     = &tp->tune_nodes[i];
+
+        choice->nth        = 0;
+        choice->chunk_size = 0;
+        tn->key            = 0;
+        tn->cand           = -1;
+        tn->t              = -1;
+
+        if (!ggml_tune_op_supported(node)) {
+            continue;
+        }
+
+        const struct ggml_tune_entry * e = ggml_tune_find(ggml_tune_key(node, n_threads), true);
+
+        tn->key  = e->key;
+        tn->cand = e->cand;
+
+        if (e->cand < 0) {
+            choice->nth        = e->nth;
+            choice->chunk_size = e->chunk_size;
+        } else {
+            *choice = ggml_tune_cand(e, e->cand, n_threads);
+            tp->tune_timing = true;
+        }
+
+        tp->tune_active = true;
+    }
+
+    ggml_critical_section_end();
+
+    return tp->tune_active;
+}
+
+// account the times of the nodes to their candidates, and move on to the next candidates
+static void ggml_cpu_tune_end(struct ggml_threadpool * tp, const struct ggml_cgraph * cgraph, int n_threads) {
+    ggml_critical_section_start();
+
+    if (g_tune.entries == NULL) {
+        ggml_critical_section_end();
+        return;
+    }
+
+    const int32_t stamp = ++g_tune.stamp;
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tune_node * tn = &tp->tune_nodes[i];
+        if (tn->key == 0 || tn->cand < 0 || tn->t < 0) {
+            continue;
+        }
+
+        struct ggml_tune_entry * e = ggml_tune_find(tn->key, false);
+        if (e == NULL || e->cand != tn->cand) {
+            // timed by another graph in the meantime
+            continue;
+        }
+
+        e->t_cand += tn->t;
+        if (e->stamp != stamp) {
+            e->stamp = stamp;
+            e->n_samples++;
+        }
+    }
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tune_node * tn = &tp->tune_nodes[i];
+        if (tn->key == 0 || tn->cand < 0) {
+            continue;
+        }
+
+        struct ggml_tune_entry * e = ggml_tune_find(tn->key, false);
+        if (e == NULL || e->cand != tn->cand || e->n_samples < GGML_TUNE_SAMPLES) {
+            continue;
+        }
+
+        const struct ggml_tune_choice choice = ggml_tune_cand(e, e->cand, n_threads);
+        const int n_thread_cands = ggml_tune_n_thread_cands(n_threads);
+
+        if (e->cand == 0 || e->t_cand < e->t_best) {
+            e->t_best     = e->t_cand;
+            e->nth        = choice.nth;
+            e->chunk_size = choice.chunk_size;
+        } else if (e->cand < n_thread_cands && e->t_cand > 2*e->t_best) {
+            // fewer threads will not do better, go on with the chunk sizes
+            e->cand = n_thread_cands - 1;
+        }
+
+        e->cand++;
+        e->n_samples = 0;
+        e->t_cand    = 0;
+
+        if (e->cand >= ggml_tune_n_cands(cgraph->nodes[i], n_threads)) {
+            e->cand = -1;
+        }
+    }
+
+    ggml_critical_section_end();
+}
+
+// a mul_mat computed by ggml_compute_forward_mul_mat that quantizes src1, the converted src1 can be shared with other mul_mats
+static bool ggml_cpu_src1_cacheable(const struct ggml_tensor * node, int n_threads) {
+    if (node->op != GGML_OP_MUL_MAT) {
+        return false;
+    }
+
+    const enum ggml_type vec_dot_type = type_traits_cpu[node->src[0]->type].vec_dot_type;
+
+    if (node->src[1]->type != GGML_TYPE_F32 || !ggml_is_quantized(vec_dot_type)) {
+        return false;
+    }
+
+    // the extra buffer types convert src1 to their own layouts
+    size_t size = 0;
+    return !ggml_cpu_extra_work_size(n_threads, node, &size);
+}
+
 struct ggml_cplan ggml_graph_plan(
           const struct ggml_cgraph * cgraph,
                                int   n_threads,
@@ -2681,6 +4037,11 @@ struct ggml_cplan ggml_graph_plan(
     }
 
     size_t work_size = 0;
+    size_t src1_cache_size = 0;
+
+    // the last mul_mats whose src1 can be cached, see ggml_cpu_graph_src1_cache()
+    const struct ggml_tensor * src1_prev[8] = { NULL };
+    int n_src1_prev = 0;
 
     struct ggml_cplan cplan;
     memset(&cplan, 0, sizeof(struct ggml_cplan));
@@ -2734,9 +4095,29 @@ struct ggml_cplan ggml_graph_plan(
                     {
                         const enum ggml_type vec_dot_type = type_traits_cpu[node->src[0]->type].vec_dot_type;
 
-                        if (node->src[1]->type != vec_dot_type) {
+                        if (ggml_mul_mat_src1_packed(node->src[0], node->src[1])) {
                             cur = ggml_row_size(vec_dot_type, ggml_nelements(node->src[1]));
                         }
+
+                        if (ggml_cpu_src1_cacheable(node, n_threads)) {
+                            for (int j = 0; j < MIN(n_src1_prev, 8); j++) {
+                                const struct ggml_tensor * prev = src1_prev[j];
+                                if (prev->src[1] == node->src[1] && type_traits_cpu[prev->src[0]->type].vec_dot_type == vec_dot_type) {
+                                    src1_cache_size = MAX(src1_cache_size, cur);
+                                }
+                            }
+                            src1_prev[n_src1_prev++ % 8] = node;
+                        }
+
+                        // partial sums of split-K
+                        if (ggml_mul_mat_use_split_k(node, n_tasks)) {
+                            cur = GGML_PAD(cur, CACHE_LINE_SIZE) + n_tasks*ggml_mul_mat_split_k_stride(node);
+                        }
+
+                        // rows of a permuted src0
+                        if (ggml_mul_mat_src0_packed(node->src[0])) {
+                            cur = GGML_PAD(cur, CACHE_LINE_SIZE) + n_tasks*ggml_mul_mat_src0_pack_stride(node->src[0]);
+                        }
                     } break;
                 case GGML_OP_MUL_MAT_ID:
                     {
@@ -2746,16 +4127,19 @@ struct ggml_cplan ggml_graph_plan(
                         const struct ggml_tensor * ids = node->src[2];
                         const enum ggml_type vec_dot_type = type_traits_cpu[src0->type].vec_dot_type;
                         const int n_as = src0->ne[2];
-                        // src1
-                        if (src1->type != vec_dot_type) {
-                            cur += ggml_row_size(vec_dot_type, ggml_nelements(src1)) + sizeof(int64_t);
-                        }
+                        const int64_t n_rows = ids->ne[0]*ids->ne[1];
+                        // src1, gathered by matrix
+                        cur += n_rows*ggml_row_size(vec_dot_type, src1->ne[0]) + sizeof(int64_t);
                         // matrix_row_counts
                         cur += n_as * sizeof(int64_t) + sizeof(int64_t);
+                        // matrix_row_offs
+                        cur += (n_as + 1)*sizeof(int64_t) + sizeof(int64_t);
                         // matrix_rows
-                        cur += n_as*ids->ne[0]*ids->ne[1]*sizeof(struct mmid_row_mapping) + sizeof(int64_t);
-                        // atomic_current_chunk
-                        cur += CACHE_LINE_SIZE*n_as + CACHE_LINE_SIZE;
+                        cur += n_rows*sizeof(struct mmid_row_mapping) + sizeof(int64_t);
+                        // matrix_chunks
+                        cur += n_as*sizeof(struct mmid_matrix_chunks) + sizeof(int64_t);
+                        // matrix_chunk_offs
+                        cur += (n_as + 1)*sizeof(int64_t) + sizeof(int64_t);
                     } break;
                 case GGML_OP_OUT_PROD:
                     {
@@ -2795,17 +4179,37 @@ struct ggml_cplan ggml_graph_plan(
                         }
                     } break;
                 case GGML_OP_CONV_2D:
+                    {
+                        cur = ggml_compute_forward_conv_2d_work_size(node, n_tasks);
+                    } break;
                 case GGML_OP_CONV_3D:
                     {
                         cur = GGML_IM2COL_WORK_SIZE;
                     } break;
-                case GGML_OP_CONV_TRANSPOSE_2D:
+                case GGML_OP_SSM_SCAN:
+                case GGML_OP_RWKV_WKV6:
+                case GGML_OP_GATED_LINEAR_ATTN:
                     {
-                        const int64_t ne00 = node->src[0]->ne[0]; // W
-                        const int64_t ne01 = node->src[0]->ne[1]; // H
-                        const int64_t ne02 = node->src[0]->ne[2]; // Channels Out
-                        const int64_t ne03 = node->src[0]->ne[3]; // Channels In
-
+                        cur = ggml_compute_forward_scan_work_size(node, n_tasks);
+                    } break;
+                case GGML_OP_POOL_1D:
+                    {
+                        if (node->src[0]->type == GGML_TYPE_F16) {
+                            cur = ggml_type_size(GGML_TYPE_F32) * node->src[0]->ne[0] * n_tasks;
+                        }
+                    } break;
+                case GGML_OP_POOL_2D:
+                    {
+                        // vertical accumulator + F16 conversion row
+                        cur = 2 * ggml_type_size(GGML_TYPE_F32) * node->src[0]->ne[0] * n_tasks;
+                    } break;
+                case GGML_OP_CONV_TRANSPOSE_2D:
+                    {
+                        const int64_t ne00 = node->src[0]->ne[0]; // W
+                        const int64_t ne01 = node->src[0]->ne[1]; // H
+                        const int64_t ne02 = node->src[0]->ne[2]; // Channels Out
+                        const int64_t ne03 = node->src[0]->ne[3]; // Channels In
+
                         const int64_t ne10 = node->src[1]->ne[0]; // W
                         const int64_t ne11 = node->src[1]->ne[1]; // H
                         const int64_t ne12 = node->src[1]->ne[2]; // Channels In
@@ -2813,12 +4217,27 @@ struct ggml_cplan ggml_graph_plan(
                         cur += sizeof(ggml_fp16_t)*ne00*ne01*ne02*ne03;
                         cur += sizeof(ggml_fp16_t)*ne10*ne11*ne12;
                     } break;
+                case GGML_OP_ARGSORT:
+                case GGML_OP_TOP_K:
+                    {
+                        const int64_t ne00 = node->src[0]->ne[0];
+                        const int64_t nr   = ggml_nrows(node->src[0]);
+
+                        // (key, index) pairs: 2 rows per thread, or 2 rows shared by all threads for the long rows
+                        cur = sizeof(uint64_t)*2*ne00*MIN(nr, n_tasks);
+                        // 2048 bucket histogram per thread for the shared radix sort
+                        cur = MAX(cur, sizeof(uint64_t)*2*ne00 + sizeof(uint32_t)*2048*n_tasks);
+                        if (node->op == GGML_OP_TOP_K) {
+                            // candidates of each thread
+                            cur = MAX(cur, sizeof(uint64_t)*(ne00 + node->ne[0]*n_tasks));
+                        }
+                    } break;
                 case GGML_OP_FLASH_ATTN_EXT:
                     {
                         const int64_t ne10 = node->src[1]->ne[0]; // DK
                         const int64_t ne20 = node->src[2]->ne[0]; // DV
 
-                        cur = sizeof(float)*(1*ne10 + 2*ne20)*n_tasks; // 1x head size K + 2x head size V (per thread)
+                        cur = sizeof(float)*GGML_FA_WORK_SIZE(ne10, ne20)*n_tasks;
                     } break;
                 case GGML_OP_FLASH_ATTN_BACK:
                     {
@@ -2857,49 +4276,859 @@ struct ggml_cplan ggml_graph_plan(
         work_size += CACHE_LINE_SIZE*(n_threads);
     }
 
-    cplan.threadpool = threadpool;
-    cplan.n_threads  = MIN(max_tasks, n_threads);
-    cplan.work_size  = work_size;
-    cplan.work_data  = NULL;
+    // the src1 cache follows the work buffer of the nodes
+    if (src1_cache_size > 0) {
+        work_size = GGML_PAD(work_size, CACHE_LINE_SIZE) + src1_cache_size;
+    }
+
+    cplan.threadpool      = threadpool;
+    cplan.n_threads       = MIN(max_tasks, n_threads);
+    cplan.work_size       = work_size;
+    cplan.work_data       = NULL;
+    cplan.dep_sched       = threadpool ? threadpool->dep_sched : false;
+    cplan.src1_cache_size = src1_cache_size;
 
     return cplan;
 }
 
+//
+// dependency-aware scheduling
+//
+// the nodes are split into consecutive groups of mutually independent nodes
+// the threads execute all nodes of a group back-to-back and synchronize only between groups
+//
+
+// max number of nodes in a group - bounds the cost of the dependency check
+#define GGML_DEP_SCHED_MAX_GROUP 64
+
+// nodes that do not compute anything on the CPU
+static bool ggml_graph_node_is_noop(const struct ggml_tensor * node) {
+    switch (node->op) {
+        case GGML_OP_NONE:
+        case GGML_OP_RESHAPE:
+        case GGML_OP_VIEW:
+        case GGML_OP_PERMUTE:
+        case GGML_OP_TRANSPOSE:
+            return true;
+        default:
+            return ggml_is_empty(node);
+    }
+}
+
+// nodes that share the work buffer or the chunk counter between threads, or that write outside of dst
+// these are never grouped with each other
+static bool ggml_graph_node_is_exclusive(const struct ggml_tensor * node) {
+    switch (node->op) {
+        case GGML_OP_MUL_MAT:
+        case GGML_OP_MUL_MAT_ID:
+        case GGML_OP_OUT_PROD:
+        case GGML_OP_COUNT_EQUAL:
+        case GGML_OP_CONV_TRANSPOSE_1D:
+        case GGML_OP_CONV_TRANSPOSE_2D:
+        case GGML_OP_CONV_2D:
+        case GGML_OP_CONV_3D:
+        case GGML_OP_ARGSORT:
+        case GGML_OP_TOP_K:
+        case GGML_OP_FLASH_ATTN_BACK:
+        case GGML_OP_CROSS_ENTROPY_LOSS:
+        case GGML_OP_CROSS_ENTROPY_LOSS_BACK:
+        case GGML_OP_OPT_STEP_ADAMW:
+        case GGML_OP_OPT_STEP_SGD:
+        case GGML_OP_CUSTOM:
+        case GGML_OP_MAP_CUSTOM1:
+        case GGML_OP_MAP_CUSTOM2:
+        case GGML_OP_MAP_CUSTOM3:
+            return true;
+        case GGML_OP_SSM_SCAN:
+        case GGML_OP_RWKV_WKV6:
+        case GGML_OP_GATED_LINEAR_ATTN:
+            // the chunked scans of long sequences share the states of their segments
+            return ggml_compute_forward_scan_work_size(node, 1) > 0;
+        default:
+            return false;
+    }
+}
+
+// nodes that keep per-thread scratch rows in the work buffer, see ggml_graph_plan()
+// these can be grouped with each other, but not with an exclusive node, which uses the whole buffer
+static bool ggml_graph_node_uses_wdata(const struct ggml_tensor * node) {
+    switch (node->op) {
+        case GGML_OP_CPY:
+        case GGML_OP_DUP:
+            return ggml_is_quantized(node->type) || (node->src[1] && node->src[0]->type != node->src[1]->type);
+        case GGML_OP_ADD:
+        case GGML_OP_ADD_ID:
+        case GGML_OP_ADD1:
+        case GGML_OP_ACC:
+            return ggml_is_quantized(node->src[0]->type);
+        case GGML_OP_POOL_1D:
+            return node->src[0]->type == GGML_TYPE_F16;
+        case GGML_OP_SOFT_MAX:
+        case GGML_OP_ROPE:
+        case GGML_OP_ROPE_BACK:
+        case GGML_OP_POOL_2D:
+        case GGML_OP_FLASH_ATTN_EXT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool ggml_graph_tensors_overlap(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    if (a == NULL || b == NULL || a->data == NULL || b->data == NULL) {
+        return false;
+    }
+
+    const char * a0 = (const char *) a->data;
+    const char * b0 = (const char *) b->data;
+
+    return a0 < b0 + ggml_nbytes(b) && b0 < a0 + ggml_nbytes(a);
+}
+
+// true if node b has to wait for node a to finish
+static bool ggml_graph_nodes_depend(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    if (ggml_graph_node_is_exclusive(a) && (ggml_graph_node_is_exclusive(b) || ggml_graph_node_uses_wdata(b))) {
+        return true;
+    }
+    if (ggml_graph_node_uses_wdata(a) && ggml_graph_node_is_exclusive(b)) {
+        return true;
+    }
+
+    // write after write
+    if (ggml_graph_tensors_overlap(a, b)) {
+        return true;
+    }
+
+    for (int i = 0; i < GGML_MAX_SRC; i++) {
+        // read after write
+        if (ggml_graph_tensors_overlap(a, b->src[i])) {
+            return true;
+        }
+        // write after read
+        if (ggml_graph_tensors_overlap(a->src[i], b)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//
+// node fusion
+//
+// chains of elementwise nodes that are computed by a single kernel, e.g. scale -> add -> soft_max or norm -> mul -> add
+// the graph is not modified, a chain is computed at its last node and the threads skip its other nodes
+// see fused-ops.h for the nodes that can be fused
+//
+
+static bool g_fusion_disabled = false; // GGML_CPU_DISABLE_FUSION, read by ggml_cpu_init()
+
+#define GGML_CPU_FUSE_NONE (-1) // the node is computed on its own
+#define GGML_CPU_FUSE_SKIP (-2) // the node is computed by the chain of a later node
+                                // otherwise the node is the last node of a chain, at this offset in fuse_nodes
+
+// max distance between two consecutive nodes of a chain
+#define GGML_CPU_FUSE_WINDOW 16
+
+// true if computing node can change one of the tensors read by a chain
+static bool ggml_cpu_fuse_hazard(const struct ggml_tensor * node, const struct ggml_tensor * const * inputs, int n_inputs) {
+    if (ggml_graph_node_is_noop(node)) {
+        return false;
+    }
+
+    if (ggml_graph_node_is_exclusive(node)) {
+        return true;
+    }
+
+    for (int i = 0; i < n_inputs; i++) {
+        if (ggml_graph_tensors_overlap(node, inputs[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool ggml_cpu_fuse_uses(const struct ggml_tensor * node, const struct ggml_tensor * src) {
+    for (int i = 0; i < GGML_MAX_SRC; i++) {
+        if (node->src[i] == src) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the chain that starts at node i, returns its number of nodes (0 if there is no chain) and their indices in idx
+// the nodes of a chain need not be consecutive: the nodes in between are computed before the chain,
+// which is only done if they do not write the tensors read by the chain up to that point
+static int ggml_cpu_fuse_chain(const struct ggml_cgraph * cgraph, const int32_t * node_fuse, int i, int * idx) {
+    const struct ggml_tensor * head = cgraph->nodes[i];
+
+    if (!ggml_fused_chain_can_start(head)) {
+        return 0;
+    }
+
+    const struct ggml_tensor * inputs[GGML_FUSED_CHAIN_MAX*GGML_MAX_SRC];
+    int n_inputs = 0;
+
+    for (int s = 0; s < GGML_MAX_SRC && head->src[s]; s++) {
+        inputs[n_inputs++] = head->src[s];
+    }
+
+    idx[0] = i;
+    int n = 1;
+
+    while (n < GGML_FUSED_CHAIN_MAX) {
+        const int p = idx[n - 1];
+        const struct ggml_tensor * prev = cgraph->nodes[p];
+
+        // the intermediate results are never written, so they cannot be used by other nodes
+        if (prev->op == GGML_OP_SOFT_MAX || !ggml_node_has_n_uses(cgraph, p, 1)) {
+            break;
+        }
+
+        int c = -1;
+        for (int j = p + 1; j < cgraph->n_nodes && j <= p + GGML_CPU_FUSE_WINDOW; j++) {
+            if (ggml_cpu_fuse_uses(cgraph->nodes[j], prev)) {
+                c = j;
+                break;
+            }
+            if (ggml_cpu_fuse_hazard(cgraph->nodes[j], inputs, n_inputs)) {
+                break;
+            }
+        }
+
+        if (c < 0 || node_fuse[c] != GGML_CPU_FUSE_NONE || !ggml_fused_chain_can_append(prev, cgraph->nodes[c])) {
+            break;
+        }
+
+        const struct ggml_tensor * next = cgraph->nodes[c];
+        for (int s = 0; s < GGML_MAX_SRC && next->src[s]; s++) {
+            if (next->src[s] != prev) {
+                inputs[n_inputs++] = next->src[s];
+            }
+        }
+
+        idx[n++] = c;
+    }
+
+    // the result is written while the inputs are read, only the input of the first node can be updated in place
+    for (; n >= 2; n--) {
+        const struct ggml_tensor * dst = cgraph->nodes[idx[n - 1]];
+
+        bool ok = true;
+        for (int k = 0; k < n && ok; k++) {
+            const struct ggml_tensor * node = cgraph->nodes[idx[k]];
+
+            for (int s = 0; s < GGML_MAX_SRC && node->src[s] && ok; s++) {
+                const struct ggml_tensor * src = node->src[s];
+
+                if (k > 0 && src == cgraph->nodes[idx[k - 1]]) {
+                    continue;
+                }
+
+                if (k == 0 && s == 0 && src->data == dst->data &&
+                        src->nb[1] == dst->nb[1] && src->nb[2] == dst->nb[2] && src->nb[3] == dst->nb[3]) {
+                    continue;
+                }
+
+                ok = !ggml_graph_tensors_overlap(src, dst);
+            }
+        }
+
+        if (ok) {
+            break;
+        }
+    }
+
+    return n >= 2 ? n : 0;
+}
+
+// find the chains of the graph, fills node_fuse and fuse_nodes
+static void ggml_cpu_graph_fuse(struct ggml_threadpool * tp, const struct ggml_cgraph * cgraph) {
+    tp->fuse_active = false;
+
+    // the nodes are timed one by one while autotuning
+    if (g_fusion_disabled || tp->tune_timing) {
+        return;
+    }
+
+    // the use counts are needed to know if the intermediate results can be skipped
+    // they are not kept in the graph copies of the async backend
+    if (cgraph->use_counts == NULL || cgraph->visited_hash_set.size == 0) {
+        return;
+    }
+
+    if (tp->node_fuse_size < cgraph->n_nodes) {
+        free(tp->node_fuse);
+        free(tp->fuse_nodes);
+        tp->node_fuse      = malloc(sizeof(int32_t) * cgraph->n_nodes);
+        tp->fuse_nodes     = malloc(sizeof(struct ggml_tensor *) * 2 * cgraph->n_nodes); // each chain has 2 or more nodes and a NULL
+        tp->node_fuse_size = cgraph->n_nodes;
+        GGML_ASSERT(tp->node_fuse && tp->fuse_nodes);
+    }
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        tp->node_fuse[i] = GGML_CPU_FUSE_NONE;
+    }
+
+    int n_fuse_nodes = 0;
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        if (tp->node_fuse[i] != GGML_CPU_FUSE_NONE) {
+            continue;
+        }
+
+        int idx[GGML_FUSED_CHAIN_MAX];
+        const int n = ggml_cpu_fuse_chain(cgraph, tp->node_fuse, i, idx);
+
+        if (n == 0) {
+            continue;
+        }
+
+        for (int k = 0; k < n - 1; k++) {
+            tp->node_fuse[idx[k]] = GGML_CPU_FUSE_SKIP;
+        }
+        tp->node_fuse[idx[n - 1]] = n_fuse_nodes;
+
+        for (int k = 0; k < n; k++) {
+            tp->fuse_nodes[n_fuse_nodes++] = cgraph->nodes[idx[k]];
+        }
+        tp->fuse_nodes[n_fuse_nodes++] = NULL;
+
+        tp->fuse_active = true;
+    }
+}
+
+static int ggml_cpu_fuse_chain_len(struct ggml_tensor * const * chain) {
+    int n = 0;
+    while (chain[n]) {
+        n++;
+    }
+    return n;
+}
+
+//
+// src1 cache
+//
+// mul_mats that share src1, e.g. the Q, K and V projections or the gate and up projections of an FFN,
+// quantize it only once: the first one stores it at the end of the work buffer, the next ones load it from there
+//
+
+#define GGML_CPU_SRC1_NONE  0 // src1 is quantized into the work buffer of the node
+#define GGML_CPU_SRC1_STORE 1 // src1 is quantized into the src1 cache
+#define GGML_CPU_SRC1_LOAD  2 // src1 is already in the src1 cache
+
+// find the mul_mats that share src1, fills node_src1
+static void ggml_cpu_graph_src1_cache(struct ggml_threadpool * tp, const struct ggml_cgraph * cgraph, const struct ggml_cplan * cplan) {
+    tp->src1_active = false;
+
+    if (cplan->src1_cache_size == 0) {
+        return;
+    }
+
+    if (tp->node_src1_size < cgraph->n_nodes) {
+        free(tp->node_src1);
+        tp->node_src1      = malloc(cgraph->n_nodes);
+        tp->node_src1_size = cgraph->n_nodes;
+        GGML_ASSERT(tp->node_src1);
+    }
+
+    // the mul_mat that quantized the src1 in the cache, or would have if there was a next one
+    int store = -1;
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        tp->node_src1[i] = GGML_CPU_SRC1_NONE;
+
+        if (ggml_cpu_src1_cacheable(node, cplan->n_threads)) {
+            const enum ggml_type vec_dot_type = type_traits_cpu[node->src[0]->type].vec_dot_type;
+
+            if (ggml_row_size(vec_dot_type, ggml_nelements(node->src[1])) > cplan->src1_cache_size) {
+                continue;
+            }
+
+            const struct ggml_tensor * prev = store >= 0 ? cgraph->nodes[store] : NULL;
+
+            if (prev && prev->src[1] == node->src[1] && type_traits_cpu[prev->src[0]->type].vec_dot_type == vec_dot_type) {
+                tp->node_src1[store] = GGML_CPU_SRC1_STORE;
+                tp->node_src1[i]     = GGML_CPU_SRC1_LOAD;
+                tp->src1_active      = true;
+            } else {
+                store = i;
+            }
+            continue;
+        }
+
+        // src1 must not change between the mul_mats
+        if (store >= 0 && !ggml_graph_node_is_noop(node) &&
+                ((ggml_graph_node_is_exclusive(node) && node->op != GGML_OP_MUL_MAT && node->op != GGML_OP_MUL_MAT_ID) ||
+                 ggml_graph_tensors_overlap(node, cgraph->nodes[store]->src[1]))) {
+            store = -1;
+        }
+    }
+}
+
+static void ggml_graph_compute_deps(const struct ggml_cgraph * cgraph, struct ggml_threadpool * tp) {
+    if (tp->node_sync_size < cgraph->n_nodes) {
+        free(tp->node_sync);
+        tp->node_sync      = malloc(cgraph->n_nodes);
+        tp->node_sync_size = cgraph->n_nodes;
+        GGML_ASSERT(tp->node_sync);
+    }
+
+    const int32_t * node_fuse = tp->fuse_active ? tp->node_fuse : NULL;
+
+    const struct ggml_tensor * group[GGML_DEP_SCHED_MAX_GROUP];
+    int n_group = 0;
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        tp->node_sync[i] = 0;
+
+        if (ggml_graph_node_is_noop(node) || (node_fuse && node_fuse[i] == GGML_CPU_FUSE_SKIP)) {
+            continue;
+        }
+
+        // a fused chain reads and writes the tensors of all of its nodes
+        struct ggml_tensor * const * chain = node_fuse && node_fuse[i] >= 0 ? tp->fuse_nodes + node_fuse[i] : &cgraph->nodes[i];
+        const int n_chain = node_fuse && node_fuse[i] >= 0 ? ggml_cpu_fuse_chain_len(chain) : 1;
+
+        bool sync = n_group + n_chain > GGML_DEP_SCHED_MAX_GROUP;
+        for (int j = 0; j < n_group && !sync; j++) {
+            for (int k = 0; k < n_chain && !sync; k++) {
+                sync = ggml_graph_nodes_depend(group[j], chain[k]);
+            }
+        }
+
+        if (sync) {
+            tp->node_sync[i] = 1;
+            n_group = 0;
+        }
+
+        for (int k = 0; k < n_chain; k++) {
+            group[n_group++] = chain[k];
+        }
+    }
+}
+
+//
+// profiling: per node and thread timestamps, see ggml_cpu_profile_new()
+//
+
+// a node computed by a thread
+struct ggml_cpu_profile_event {
+    int32_t node;   // index in ggml_cpu_profile::nodes
+    int64_t t_start;
+    int64_t t_end;  // end of the computation
+    int64_t t_sync; // end of the barrier that follows the node, t_end if there is none
+};
+
+struct ggml_cpu_profile_node {
+    const char * desc; // ggml_op_desc()
+    char         name[GGML_MAX_NAME];
+    int32_t      graph;
+    int64_t      flops;
+    int64_t      bytes;
+};
+
+struct ggml_cpu_profile_thread {
+    struct ggml_cpu_profile_event * events;
+    int n_events;
+    int n_events_max;
+};
+
+struct ggml_cpu_profile {
+    struct ggml_cpu_profile_node * nodes;
+    int n_nodes;
+    int n_nodes_max;
+
+    int n_graphs;
+    int node_base; // first node of the graph being computed
+
+    int64_t t_origin;
+
+    struct ggml_cpu_profile_thread threads[GGML_MAX_N_THREADS];
+};
+
+static int64_t ggml_cpu_profile_time_ns(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER t;
+    LARGE_INTEGER f;
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&f);
+    return (int64_t) ((double) t.QuadPart * 1e9 / (double) f.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec*1000000000 + (int64_t) ts.tv_nsec;
+#endif
+}
+
+// rough operation count of a node, the number of elements of the result for the ops that are not listed
+static int64_t ggml_cpu_profile_flops(const struct ggml_tensor * node) {
+    const struct ggml_tensor * src0 = node->src[0];
+    const struct ggml_tensor * src1 = node->src[1];
+
+    switch (node->op) {
+        case GGML_OP_MUL_MAT:
+            return 2*src0->ne[0]*ggml_nelements(node);
+        case GGML_OP_MUL_MAT_ID:
+            return 2*src0->ne[0]*src0->ne[1]*node->src[2]->ne[0]*node->src[2]->ne[1];
+        case GGML_OP_OUT_PROD:
+            return 2*src0->ne[1]*ggml_nelements(node);
+        case GGML_OP_FLASH_ATTN_EXT:
+            // Q*K^T and softmax(.)*V
+            return 2*ggml_nelements(src0)*src1->ne[1] + 2*ggml_nelements(node)*src1->ne[1];
+        default:
+            return ggml_nelements(node);
+    }
+}
+
+static int64_t ggml_cpu_profile_bytes(const struct ggml_tensor * node) {
+    int64_t bytes = ggml_nbytes(node);
+    for (int j = 0; j < GGML_MAX_SRC; j++) {
+        if (node->src[j]) {
+            bytes += ggml_nbytes(node->src[j]);
+        }
+    }
+    return bytes;
+}
+
+// record the nodes of a new graph and make room for the events of all the threads, before the threads start
+static void ggml_cpu_profile_begin(struct ggml_cpu_profile * prof, const struct ggml_cgraph * cgraph, int n_threads) {
+    if (prof->n_nodes + cgraph->n_nodes > prof->n_nodes_max) {
+        prof->n_nodes_max = MAX(2*prof->n_nodes_max, prof->n_nodes + cgraph->n_nodes);
+        prof->nodes = realloc(prof->nodes, sizeof(struct ggml_cpu_profile_node)*prof->n_nodes_max);
+        GGML_ASSERT(prof->nodes);
+    }
+
+    prof->node_base = prof->n_nodes;
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        struct ggml_cpu_profile_node * pn = &prof->nodes[prof->n_nodes++];
+        pn->desc  = ggml_op_desc(node);
+        pn->graph = prof->n_graphs;
+        pn->flops = ggml_cpu_profile_flops(node);
+        pn->bytes = ggml_cpu_profile_bytes(node);
+        memcpy(pn->name, node->name, sizeof(pn->name));
+    }
+
+    for (int j = 0; j < n_threads; j++) {
+        struct ggml_cpu_profile_thread * th = &prof->threads[j];
+        if (th->n_events + cgraph->n_nodes > th->n_events_max) {
+            th->n_events_max = MAX(2*th->n_events_max, th->n_events + cgraph->n_nodes);
+            th->events = realloc(th->events, sizeof(struct ggml_cpu_profile_event)*th->n_events_max);
+            GGML_ASSERT(th->events);
+        }
+    }
+
+    prof->n_graphs++;
+}
+
+static inline void ggml_cpu_profile_record(struct ggml_cpu_profile * prof, int ith, int node_n, int64_t t_start, int64_t t_end, int64_t t_sync) {
+    struct ggml_cpu_profile_thread * th = &prof->threads[ith];
+
+    struct ggml_cpu_profile_event * ev = &th->events[th->n_events++];
+    ev->node    = prof->node_base + node_n;
+    ev->t_start = t_start;
+    ev->t_end   = t_end;
+    ev->t_sync  = t_sync;
+}
+
+struct ggml_cpu_profile * ggml_cpu_profile_new(void) {
+    struct ggml_cpu_profile * prof = calloc(1, sizeof(struct ggml_cpu_profile));
+    GGML_ASSERT(prof);
+    prof->t_origin = ggml_cpu_profile_time_ns();
+    return prof;
+}
+
+void ggml_cpu_profile_free(struct ggml_cpu_profile * prof) {
+    if (!prof) {
+        return;
+    }
+    for (int j = 0; j < GGML_MAX_N_THREADS; j++) {
+        free(prof->threads[j].events);
+    }
+    free(prof->nodes);
+    free(prof);
+}
+
+void ggml_cpu_profile_reset(struct ggml_cpu_profile * prof) {
+    for (int j = 0; j < GGML_MAX_N_THREADS; j++) {
+        prof->threads[j].n_events = 0;
+    }
+    prof->n_nodes  = 0;
+    prof->n_graphs = 0;
+    prof->t_origin = ggml_cpu_profile_time_ns();
+}
+
+static void ggml_cpu_profile_write_str(FILE * f, const char * str) {
+    fputc('"', f);
+    for (const char * c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', f);
+            fputc(*c, f);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(f, "\\u%04x", *c);
+        } else {
+            fputc(*c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+bool ggml_cpu_profile_write_trace(const struct ggml_cpu_profile * prof, const char * fname) {
+    FILE * f = ggml_fopen(fname, "w");
+    if (!f) {
+        GGML_LOG_ERROR("%s: failed to open %s\n", __func__, fname);
+        return false;
+    }
+
+    // https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    bool first = true;
+
+    for (int j = 0; j < GGML_MAX_N_THREADS; j++) {
+        const struct ggml_cpu_profile_thread * th = &prof->threads[j];
+
+        for (int k = 0; k < th->n_events; k++) {
+            const struct ggml_cpu_profile_event * ev = &th->events[k];
+            const struct ggml_cpu_profile_node  * pn = &prof->nodes[ev->node];
+
+            fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+            ggml_cpu_profile_write_str(f, pn->desc);
+            fprintf(f, ",\"cat\":\"compute\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"tensor\":",
+                    j, (ev->t_start - prof->t_origin)/1e3, (ev->t_end - ev->t_start)/1e3);
+            ggml_cpu_profile_write_str(f, pn->name);
+            fprintf(f, ",\"graph\":%d,\"flops\":%" PRId64 ",\"bytes\":%" PRId64 "}}", pn->graph, pn->flops, pn->bytes);
+
+            if (ev->t_sync > ev->t_end) {
+                fprintf(f, ",\n{\"name\":\"barrier\",\"cat\":\"sync\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        j, (ev->t_end - prof->t_origin)/1e3, (ev->t_sync - ev->t_end)/1e3);
+            }
+
+            first = false;
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) == 0;
+}
+
+void ggml_cpu_profile_print(const struct ggml_cpu_profile * prof) {
+    // time of each node, from the first thread starting it to the last one leaving the barrier after it
+    struct node_time {
+        int64_t t_start;
+        int64_t t_sync;
+        int64_t t_wait; // total barrier wait of the threads
+        int     n_threads;
+    };
+
+    struct node_time * nt = calloc(MAX(prof->n_nodes, 1), sizeof(struct node_time));
+    GGML_ASSERT(nt);
+
+    for (int j = 0; j < GGML_MAX_N_THREADS; j++) {
+        const struct ggml_cpu_profile_thread * th = &prof->threads[j];
+
+        for (int k = 0; k < th->n_events; k++) {
+            const struct ggml_cpu_profile_event * ev = &th->events[k];
+            struct node_time * t = &nt[ev->node];
+
+            t->t_start = t->n_threads == 0 ? ev->t_start : MIN(t->t_start, ev->t_start);
+            t->t_sync  = t->n_threads == 0 ? ev->t_sync  : MAX(t->t_sync,  ev->t_sync);
+            t->t_wait += ev->t_sync - ev->t_end;
+            t->n_threads++;
+        }
+    }
+
+    // aggregate by op
+    struct op_time {
+        const char * desc;
+        int     n;
+        int64_t t;
+        int64_t t_wait; // average over the threads
+        int64_t flops;
+        int64_t bytes;
+    };
+
+    struct op_time ops[GGML_OP_COUNT + GGML_UNARY_OP_COUNT + GGML_GLU_OP_COUNT];
+    int     n_ops   = 0;
+    int64_t t_total = 0;
+
+    for (int i = 0; i < prof->n_nodes; i++) {
+        const struct node_time * t = &nt[i];
+        if (t->n_threads == 0) {
+            continue;
+        }
+
+        const struct ggml_cpu_profile_node * pn = &prof->nodes[i];
+
+        int k = 0;
+        while (k < n_ops && ops[k].desc != pn->desc) {
+            k++;
+        }
+        if (k == n_ops) {
+            memset(&ops[k], 0, sizeof(ops[k]));
+            ops[k].desc = pn->desc;
+            n_ops++;
+        }
+
+        ops[k].n      += 1;
+        ops[k].t      += t->t_sync - t->t_start;
+        ops[k].t_wait += t->t_wait / t->n_threads;
+        ops[k].flops  += pn->flops;
+        ops[k].bytes  += pn->bytes;
+
+        t_total += t->t_sync - t->t_start;
+    }
+
+    free(nt);
+
+    GGML_LOG_INFO("%s: %d graphs, %.3f ms in the nodes\n", __func__, prof->n_graphs, t_total/1e6);
+    GGML_LOG_INFO("%-16s %8s %12s %7s %12s %10s %10s\n", "op", "count", "time (us)", "time %", "barrier (us)", "GFLOP/s", "GB/s");
+
+    for (int k = 0; k < n_ops; k++) {
+        const struct op_time * op = &ops[k];
+        const double t = MAX(op->t, 1);
+        GGML_LOG_INFO("%-16s %8d %12.1f %6.2f%% %12.1f %10.2f %10.2f\n", op->desc, op->n, op->t/1e3, 100.0*op->t/MAX(t_total, 1),
+                op->t_wait/1e3, op->flops/t, op->bytes/t);
+    }
+}
+
 static thread_ret_t ggml_graph_compute_thread(void * data) {
     struct ggml_compute_state * state = (struct ggml_compute_state *) data;
     struct ggml_threadpool    * tp    = state->threadpool;
 
-    const struct ggml_cgraph * cgraph = tp->cgraph;
-    const struct ggml_cplan  * cplan  = tp->cplan;
+    const struct ggml_cgraph * cgraph = tp->cgraph;
+    const struct ggml_cplan  * cplan  = tp->cplan;
+
+    set_numa_thread_affinity(state->ith);
+
+#ifndef GGML_USE_OPENMP
+    ggml_barrier_leaf = state->barrier_leaf;
+#endif
+
+    struct ggml_compute_params params = {
+        /*.ith       =*/ state->ith,
+        /*.nth       =*/ atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed),
+        /*.wsize     =*/ cplan->work_size - cplan->src1_cache_size,
+        /*.wdata     =*/ cplan->work_data,
+        /*.threadpool=*/ tp,
+        /*.tune      =*/ NULL,
+        /*.src1_cache=*/ NULL,
+        /*.src1_cache_valid=*/ false,
+    };
+
+    // mul_mats sharing their quantized src1, see ggml_cpu_graph_src1_cache()
+    const uint8_t * node_src1  = tp->src1_active ? tp->node_src1 : NULL;
+    void          * src1_cache = (char *) cplan->work_data + cplan->work_size - cplan->src1_cache_size;
+
+    // with dependency-aware scheduling the threads only meet at the barriers computed by ggml_graph_compute_deps
+    // the autotuner needs a barrier after every node to time them
+    const uint8_t * node_sync = tp->sync_active && !tp->tune_timing ? tp->node_sync : NULL;
+
+    // fused chains, see ggml_cpu_graph_fuse()
+    const int32_t * node_fuse = tp->fuse_active ? tp->node_fuse : NULL;
+
+    const struct ggml_tune_choice * node_tune = tp->tune_active ? tp->node_tune : NULL;
+    const bool timing = tp->tune_timing && state->ith == 0;
+    const int  nth    = params.nth;
+
+    int64_t t_node = 0;
+
+    struct ggml_cpu_profile * prof = cplan->profile;
+
+    int64_t t_prof_start = 0;
+    int64_t t_prof_end   = 0;
+    bool    prof_last    = false;
+
+    for (int node_n = 0; node_n < cgraph->n_nodes && atomic_load_explicit(&tp->abort, memory_order_relaxed) != node_n; node_n++) {
+        struct ggml_tensor * node = cgraph->nodes[node_n];
+
+        params.nth  = nth;
+        params.tune = NULL;
+
+        params.src1_cache       = node_src1 && node_src1[node_n] != GGML_CPU_SRC1_NONE ? src1_cache : NULL;
+        params.src1_cache_valid = node_src1 && node_src1[node_n] == GGML_CPU_SRC1_LOAD;
+
+        if (node_tune && node_tune[node_n].nth > 0) {
+            params.tune = &node_tune[node_n];
+            // mul_mat needs all the threads for its barrier, it hands out its chunks to tune->nth threads only
+            if (node->op != GGML_OP_MUL_MAT) {
+                params.nth = MIN(nth, params.tune->nth);
+            }
+        }
+
+        if (timing) {
+            t_node = ggml_time_us();
+        }
+
+        if (prof) {
+            t_prof_start = ggml_cpu_profile_time_ns();
+        }
 
-    set_numa_thread_affinity(state->ith);
+        const int32_t fuse = node_fuse ? node_fuse[node_n] : GGML_CPU_FUSE_NONE;
 
-    struct ggml_compute_params params = {
-        /*.ith       =*/ state->ith,
-        /*.nth       =*/ atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed),
-        /*.wsize     =*/ cplan->work_size,
-        /*.wdata     =*/ cplan->work_data,
-        /*.threadpool=*/ tp,
-    };
+        if (params.ith < params.nth) {
+            if (fuse >= 0) {
+                struct ggml_tensor * const * chain = tp->fuse_nodes + fuse;
+                ggml_compute_forward_fused_chain(&params, chain, ggml_cpu_fuse_chain_len(chain));
+            } else if (fuse == GGML_CPU_FUSE_NONE) {
+                ggml_compute_forward(&params, node);
+            }
+        }
 
-    for (int node_n = 0; node_n < cgraph->n_nodes && atomic_load_explicit(&tp->abort, memory_order_relaxed) != node_n; node_n++) {
-        struct ggml_tensor * node = cgraph->nodes[node_n];
+        if (prof) {
+            t_prof_end = ggml_cpu_profile_time_ns();
+        }
 
-        ggml_compute_forward(&params, node);
+        const bool last = node_n + 1 == cgraph->n_nodes;
+        // nothing is written by the nodes that are skipped, they need no barrier of their own
+        const bool sync = !last && (node_sync ? node_sync[node_n + 1] : fuse != GGML_CPU_FUSE_SKIP);
 
-        if (state->ith == 0 && cplan->abort_callback &&
+        // the abort flag can only be observed consistently by all threads right after a barrier
+        if (state->ith == 0 && (sync || last) && cplan->abort_callback &&
                 cplan->abort_callback(cplan->abort_callback_data)) {
             atomic_store_explicit(&tp->abort, node_n + 1, memory_order_relaxed);
             tp->ec    = GGML_STATUS_ABORTED;
         }
 
-        if (node_n + 1 < cgraph->n_nodes) {
+        if (sync) {
             ggml_barrier(state->threadpool);
         }
+
+        if (timing) {
+            tp->tune_nodes[node_n].t = ggml_time_us() - t_node;
+        }
+
+        if (prof) {
+            if (last) {
+                prof_last = true;
+            } else {
+                ggml_cpu_profile_record(prof, state->ith, node_n, t_prof_start, t_prof_end, sync ? ggml_cpu_profile_time_ns() : t_prof_end);
+            }
+        }
     }
 
     ggml_barrier(state->threadpool);
 
+    if (prof && prof_last) {
+        // include the wait for the other threads in the last node
+        ggml_cpu_profile_record(prof, state->ith, cgraph->n_nodes - 1, t_prof_start, t_prof_end, ggml_cpu_profile_time_ns());
+    }
+
+    if (timing && cgraph->n_nodes > 0) {
+        // include the wait for the other threads in the time of the last node
+        tp->tune_nodes[cgraph->n_nodes - 1].t = ggml_time_us() - t_node;
+    }
+
     return 0;
 }
 
@@ -2912,12 +5141,19 @@ static inline bool ggml_graph_compute_thread_active(struct ggml_compute_state *
     return (state->ith < n_threads);
 }
 
+// check if the worker has been lent to a thread group
+static inline bool ggml_graph_compute_group_changed(struct ggml_compute_state * state) {
+    return atomic_load_explicit(&state->n_group, memory_order_relaxed) != state->last_group;
+}
+
 // check if thread is ready to proceed (exit from polling or sleeping)
 static inline bool ggml_graph_compute_thread_ready(struct ggml_compute_state * state) {
     struct ggml_threadpool * threadpool = state->threadpool;
 
     if (state->pending || threadpool->stop || threadpool->pause) { return true; }
 
+    if (ggml_graph_compute_group_changed(state)) { return true; }
+
     // check for new graph/work
     int new_graph = atomic_load_explicit(&threadpool->n_graph, memory_order_relaxed);
     if (new_graph != state->last_graph) {
@@ -2947,26 +5183,67 @@ static inline bool ggml_graph_compute_poll_for_work(struct ggml_compute_state *
         return state->pending;
     }
 
-    // This seems to make 0 ... 100 a decent range for polling level across modern processors.
-    // Perhaps, we can adjust it dynamically based on load and things.
-    const uint64_t n_rounds = 1024UL * 128 * threadpool->poll;
+    const int64_t spin_us = atomic_load_explicit(&threadpool->spin_us, memory_order_relaxed);
+    if (spin_us <= 0) {
+        return ggml_graph_compute_thread_ready(state);
+    }
+
+    const int64_t t_start = ggml_time_us();
 
-    for (uint64_t i=0; !ggml_graph_compute_thread_ready(state) && i < n_rounds; i++) {
+    for (uint64_t i = 0; !ggml_graph_compute_thread_ready(state); i++) {
         // No new work. Keep polling.
         ggml_thread_cpu_relax();
+
+        if ((i & 1023) == 1023 && ggml_time_us() - t_start >= spin_us) {
+            break;
+        }
     }
 
     return state->pending;
 }
 
-static inline bool ggml_graph_compute_check_for_work(struct ggml_compute_state * state) {
-    struct ggml_threadpool * threadpool = state->threadpool;
+#if defined(__gnu_linux__)
+static void ggml_futex_wait(atomic_int * addr, int val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
 
-    if (ggml_graph_compute_poll_for_work(state)) {
-        ggml_graph_compute_thread_sync(state);
-        return state->pending;
+static void ggml_futex_wake(atomic_int * addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+// wake up the sleeping workers - must be called after updating the state they are waiting on
+static void ggml_threadpool_wake(struct ggml_threadpool * threadpool) {
+#if defined(__gnu_linux__)
+    atomic_fetch_add_explicit(&threadpool->wake_seq, 1, memory_order_seq_cst);
+
+    // skip the syscall when all workers are spinning
+    if (atomic_load_explicit(&threadpool->n_sleeping, memory_order_seq_cst) > 0) {
+        ggml_futex_wake(&threadpool->wake_seq);
     }
+#else
+    // the workers wait on the condition variable, which the callers broadcast with the mutex held
+    UNUSED(threadpool);
+#endif
+}
 
+static inline void ggml_graph_compute_wait_for_work(struct ggml_compute_state * state) {
+    struct ggml_threadpool * threadpool = state->threadpool;
+
+#if defined(__gnu_linux__)
+    // announce the sleeper before reading wake_seq, so that ggml_threadpool_wake() cannot miss it
+    atomic_fetch_add_explicit(&threadpool->n_sleeping, 1, memory_order_seq_cst);
+    while (true) {
+        const int seq = atomic_load_explicit(&threadpool->wake_seq, memory_order_seq_cst);
+        if (ggml_graph_compute_thread_ready(state)) {
+            break;
+        }
+        // No new work. Wait for the signal.
+        GGML_PRINT_DEBUG("thread #%d waiting for work (sleeping)\n", state->ith);
+        ggml_futex_wait(&threadpool->wake_seq, seq);
+    }
+    atomic_fetch_sub_explicit(&threadpool->n_sleeping, 1, memory_order_seq_cst);
+#else
     ggml_mutex_lock_shared(&threadpool->mutex);
     while (!ggml_graph_compute_thread_ready(state)) {
         // No new work. Wait for the signal.
@@ -2974,25 +5251,55 @@ static inline bool ggml_graph_compute_check_for_work(struct ggml_compute_state *
         ggml_cond_wait(&threadpool->cond, &threadpool->mutex);
     }
     ggml_mutex_unlock_shared(&threadpool->mutex);
-
-    return state->pending;
+#endif
 }
 
-static thread_ret_t ggml_graph_compute_secondary_thread(void* data) {
-    struct ggml_compute_state * state = (struct ggml_compute_state *) data;
+static inline bool ggml_graph_compute_check_for_work(struct ggml_compute_state * state) {
     struct ggml_threadpool * threadpool = state->threadpool;
 
-    ggml_thread_apply_priority(threadpool->prio);
-    if (ggml_thread_cpumask_is_valid(state->cpumask)) {
-        ggml_thread_apply_affinity(state->cpumask);
+    if (ggml_graph_compute_poll_for_work(state)) {
+        ggml_graph_compute_thread_sync(state);
+        state->n_spin += state->pending && !threadpool->stop && !threadpool->pause;
+        return state->pending;
+    }
+
+    ggml_graph_compute_wait_for_work(state);
+
+    if (state->pending) {
+        state->n_sleep   += 1;
+        state->t_wake_us += ggml_time_us() - threadpool->t_kickoff_us;
     }
 
+    return state->pending;
+}
+
+static void ggml_graph_compute_worker(struct ggml_compute_state * state);
+
+// compute the graphs of the thread group that the worker has been lent to, until the group is freed
+static void ggml_graph_compute_group_worker(struct ggml_compute_state * state) {
+    struct ggml_threadpool * group = state->group;
+    GGML_ASSERT(group != NULL);
+
+    ggml_thread_apply_priority(group->prio);
+
+    ggml_graph_compute_worker(&group->workers[state->ith - group->group_first]);
+
+    ggml_thread_apply_priority(state->threadpool->prio);
+
+    // last access to the group
+    atomic_fetch_sub_explicit(&group->n_attached, 1, memory_order_release);
+}
+
+// compute the graphs of the threadpool until it is stopped
+static void ggml_graph_compute_worker(struct ggml_compute_state * state) {
+    struct ggml_threadpool * threadpool = state->threadpool;
+
     while (true) {
         // Check if we need to sleep
-        while (threadpool->pause) {
+        while (threadpool->pause && !ggml_graph_compute_group_changed(state)) {
             GGML_PRINT_DEBUG("thread #%d inside pause loop\n", state->ith);
             ggml_mutex_lock_shared(&threadpool->mutex);
-            if (threadpool->pause) {
+            if (threadpool->pause && !ggml_graph_compute_group_changed(state)) {
                 ggml_cond_wait(&threadpool->cond, &threadpool->mutex);
             }
             GGML_PRINT_DEBUG("thread #%d resuming after wait\n", state->ith);
@@ -3002,6 +5309,15 @@ static thread_ret_t ggml_graph_compute_secondary_thread(void* data) {
         // This needs to be checked for after the cond_wait
         if (threadpool->stop) break;
 
+        // Check if the worker has been lent to a thread group
+        const int n_group = atomic_load_explicit(&state->n_group, memory_order_acquire);
+        if (n_group != state->last_group) {
+            state->last_group = n_group;
+
+            ggml_graph_compute_group_worker(state);
+            continue;
+        }
+
         // Check if there is new work
         // The main thread is the only one that can dispatch new work
 
@@ -3012,13 +5328,207 @@ static thread_ret_t ggml_graph_compute_secondary_thread(void* data) {
             ggml_graph_compute_thread(state);
         }
     }
+}
+
+static thread_ret_t ggml_graph_compute_secondary_thread(void* data) {
+    struct ggml_compute_state * state = (struct ggml_compute_state *) data;
+    struct ggml_threadpool * threadpool = state->threadpool;
+
+    ggml_thread_apply_priority(threadpool->prio);
+    if (ggml_thread_cpumask_is_valid(state->cpumask)) {
+        ggml_thread_apply_affinity(state->cpumask);
+    }
+
+    ggml_graph_compute_worker(state);
 
     return (thread_ret_t) 0;
 }
 
+// barrier tree construction
+
+// max number of subtrees joined at a node, above the SMT sibling level
+#define GGML_BARRIER_FANIN 4
+
+struct ggml_barrier_item {
+    int idx;  // barrier node, or -(ith + 1) for a thread
+    int node; // NUMA node, -1 after merging different nodes
+    int l3;   // L3 cache domain, -1 if unknown or after merging different domains
+    int core; // physical core, -1 if unknown or after merging different cores
+};
+
+static int ggml_barrier_item_cmp(const void * a, const void * b) {
+    const struct ggml_barrier_item * ia = a;
+    const struct ggml_barrier_item * ib = b;
+
+    if (ia->node != ib->node) { return ia->node < ib->node ? -1 : 1; }
+    if (ia->l3   != ib->l3  ) { return ia->l3   < ib->l3   ? -1 : 1; }
+    if (ia->core != ib->core) { return ia->core < ib->core ? -1 : 1; }
+
+    return ia->idx > ib->idx ? -1 : (ia->idx < ib->idx ? 1 : 0);
+}
+
+enum ggml_barrier_level {
+    GGML_BARRIER_LEVEL_SMT,  // threads on the same physical core
+    GGML_BARRIER_LEVEL_L3,   // subtrees sharing an L3 cache
+    GGML_BARRIER_LEVEL_NUMA, // subtrees on the same NUMA node
+    GGML_BARRIER_LEVEL_ANY,
+};
+
+// join consecutive items into new barrier nodes, returns the new number of items
+static int ggml_barrier_tree_level(struct ggml_threadpool * tp, struct ggml_barrier_item * items, int n, int * n_nodes, enum ggml_barrier_level level) {
+    int n_out = 0;
+
+    for (int i = 0; i < n; ) {
+        int j = i + 1;
+        for (; j < n; j++) {
+            if (level == GGML_BARRIER_LEVEL_SMT) {
+                if (items[j].node != items[i].node || items[j].core < 0 || items[j].core != items[i].core) {
+                    break;
+                }
+            } else if (level == GGML_BARRIER_LEVEL_L3) {
+                if (j - i == GGML_BARRIER_FANIN || items[j].node != items[i].node || items[j].l3 < 0 || items[j].l3 != items[i].l3) {
+                    break;
+                }
+            } else {
+                if (j - i == GGML_BARRIER_FANIN || (level == GGML_BARRIER_LEVEL_NUMA && items[j].node != items[i].node)) {
+                    break;
+                }
+            }
+        }
+
+        if (j - i == 1) {
+            items[n_out++] = items[i++];
+            continue;
+        }
+
+        const int idx = (*n_nodes)++;
+
+        struct ggml_barrier_node * node = &tp->barrier_nodes[idx];
+        atomic_store_explicit(&node->n_arrived, 0, memory_order_relaxed);
+        node->n_children = j - i;
+        node->parent     = -1;
+
+        struct ggml_barrier_item item = { idx, items[i].node, items[i].l3, items[i].core };
+
+        for (int k = i; k < j; k++) {
+            if (items[k].idx < 0) {
+                tp->workers[-items[k].idx - 1].barrier_leaf = idx;
+            } else {
+                tp->barrier_nodes[items[k].idx].parent = idx;
+            }
+
+            if (items[k].node != item.node) { item.node = -1; }
+            if (items[k].l3   != item.l3  ) { item.l3   = -1; }
+            if (items[k].core != item.core) { item.core = -1; }
+        }
+
+        items[n_out++] = item;
+
+        i = j;
+    }
+
+    return n_out;
+}
+
+// build a tree for the first n_threads threads: SMT siblings first, then the cores of each L3 domain,
+// then the domains of each NUMA node, then the nodes
+// must not be called while the workers are processing a graph
+static void ggml_barrier_tree_build(struct ggml_threadpool * tp, int n_threads) {
+    const struct ggml_cpu_topo * topo = ggml_cpu_topo_get();
+
+    struct ggml_barrier_item * items = malloc(n_threads*sizeof(struct ggml_barrier_item));
+    GGML_ASSERT(items);
+
+    for (int j = 0; j < n_threads; j++) {
+        struct ggml_compute_state * state = &tp->workers[j];
+
+        // the location is known only for threads bound to a single CPU
+        const int cpu = ggml_thread_cpumask_cpu(state->cpumask);
+
+        items[j].idx  = -(j + 1);
+        items[j].node = ggml_thread_numa_node(j);
+        items[j].l3   = -1;
+        items[j].core = -1;
+
+        if (cpu >= 0 && cpu < topo->n_cpus && topo->cpus[cpu].core >= 0) {
+            items[j].node = topo->cpus[cpu].node;
+            items[j].l3   = topo->cpus[cpu].l3;
+            items[j].core = topo->cpus[cpu].core;
+        }
+
+        state->barrier_leaf = -1;
+    }
+
+    qsort(items, n_threads, sizeof(struct ggml_barrier_item), ggml_barrier_item_cmp);
+
+    int n_nodes = 0;
+    int n = n_threads;
+
+    n = ggml_barrier_tree_level(tp, items, n, &n_nodes, GGML_BARRIER_LEVEL_SMT);
+
+    for (int n_prev = -1; n != n_prev; ) {
+        n_prev = n;
+        n = ggml_barrier_tree_level(tp, items, n, &n_nodes, GGML_BARRIER_LEVEL_L3);
+    }
+
+    for (int n_prev = -1; n != n_prev; ) {
+        n_prev = n;
+        n = ggml_barrier_tree_level(tp, items, n, &n_nodes, GGML_BARRIER_LEVEL_NUMA);
+    }
+
+    while (n > 1) {
+        n = ggml_barrier_tree_level(tp, items, n, &n_nodes, GGML_BARRIER_LEVEL_ANY);
+    }
+
+    GGML_ASSERT(n_nodes <= tp->n_threads_max);
+
+    tp->barrier_n_threads = n_threads;
+
+    free(items);
+}
+
+// max time that idle workers spin for, per polling level
+#define GGML_SPIN_US_PER_POLL 100
+// min time that idle workers spin for, unless polling is disabled
+#define GGML_SPIN_US_MIN      50
+
+// learn how long the workers should spin from the time between the previous graphs
+// spin a bit longer than the expected gap, so that back-to-back graphs (e.g. decode loops) find the workers awake,
+// but give the CPUs back right away when the gap is longer than the polling level allows
+static void ggml_threadpool_update_spin(struct ggml_threadpool * threadpool, int64_t t_now) {
+    if (threadpool->t_done_us > 0) {
+        const int64_t gap = t_now - threadpool->t_done_us;
+        threadpool->gap_us = threadpool->gap_us > 0 ? (3*threadpool->gap_us + gap)/4 : gap;
+    }
+
+    const int64_t max_us = (int64_t) threadpool->poll * GGML_SPIN_US_PER_POLL;
+
+    int64_t spin_us = 0;
+    if (max_us > 0) {
+        spin_us = 2*threadpool->gap_us <= max_us ? MAX(2*threadpool->gap_us, GGML_SPIN_US_MIN) : GGML_SPIN_US_MIN;
+    }
+
+    atomic_store_explicit(&threadpool->spin_us, (int) spin_us, memory_order_relaxed);
+}
+
 // Start processing new graph
 static void ggml_graph_compute_kickoff(struct ggml_threadpool * threadpool, int n_threads)
 {
+    threadpool->t_kickoff_us = ggml_time_us();
+
+    ggml_threadpool_update_spin(threadpool, threadpool->t_kickoff_us);
+
+#if defined(__gnu_linux__)
+    // the workers sleep on a futex, the mutex is only needed for resuming a paused threadpool
+    if (!threadpool->pause) {
+        atomic_store_explicit(&threadpool->n_threads_cur, n_threads, memory_order_relaxed);
+        atomic_fetch_add_explicit(&threadpool->n_graph, 1, memory_order_seq_cst);
+
+        ggml_threadpool_wake(threadpool);
+        return;
+    }
+#endif
+
     // Always take the mutex here because the worker threads are doing hybrid poll/wait
 
     ggml_mutex_lock(&threadpool->mutex);
@@ -3045,15 +5555,89 @@ static void ggml_graph_compute_kickoff(struct ggml_threadpool * threadpool, int
        ggml_cond_broadcast(&threadpool->cond);
     }
 
+    ggml_threadpool_wake(threadpool);
+
     ggml_mutex_unlock(&threadpool->mutex);
 }
 
 #endif // GGML_USE_OPENMP
 
+// bind each worker to a single CPU in the order of the placement policy, the main thread takes the first one
+// the CPUs are restricted to tpp->cpumask when it is set
+static bool ggml_threadpool_place(const struct ggml_threadpool_params * tpp, struct ggml_compute_state * workers) {
+    if (tpp->placement == GGML_CPU_PLACEMENT_NONE) {
+        return false;
+    }
+
+    const struct ggml_cpu_topo * topo = ggml_cpu_topo_get();
+
+    bool allowed[GGML_MAX_N_THREADS];
+    if (ggml_thread_cpumask_is_valid(tpp->cpumask)) {
+        memcpy(allowed, tpp->cpumask, sizeof(allowed));
+    } else {
+        memset(allowed, 1, sizeof(allowed));
+    }
+
+    int * order = malloc(GGML_MAX_N_THREADS*sizeof(int));
+    GGML_ASSERT(order);
+
+    const int n = ggml_cpu_topo_place(topo, tpp->placement, allowed, order);
+    if (n == 0) {
+        GGML_LOG_WARN("%s: the CPU topology is not available, ignoring the thread placement\n", __func__);
+        free(order);
+        return false;
+    }
+    if (n < tpp->n_threads) {
+        GGML_LOG_WARN("%s: %d threads placed on %d CPUs, some CPUs run several threads\n", __func__, tpp->n_threads, n);
+    }
+
+    for (int j = 0; j < tpp->n_threads; j++) {
+        memset(workers[j].cpumask, 0, sizeof(workers[j].cpumask));
+        workers[j].cpumask[order[j % n]] = true;
+    }
+
+    free(order);
+
+    return true;
+}
+
+// cache domain of each worker, and the order of the workers by domain for splitting the chunks
+// groups are created under the critical section, they take the domains of the parent's workers
+static void ggml_threadpool_init_domains(struct ggml_threadpool * threadpool) {
+    const int n_threads = threadpool->n_threads_max;
+
+    struct ggml_compute_state * workers = threadpool->workers;
+    struct ggml_threadpool    * parent  = threadpool->parent;
+
+    const struct ggml_cpu_topo * topo = parent ? NULL : ggml_cpu_topo_get();
+
+    threadpool->chunk_order   = malloc(n_threads*sizeof(int));
+    threadpool->chunk_domains = false;
+    GGML_ASSERT(threadpool->chunk_order);
+
+    for (int j = 0; j < n_threads; j++) {
+        if (parent) {
+            workers[j].domain = parent->workers[threadpool->group_first + j].domain;
+        } else {
+            workers[j].domain = ggml_thread_cache_domain(topo, workers[j].cpumask, j);
+        }
+        threadpool->chunk_domains = threadpool->chunk_domains || workers[j].domain != workers[0].domain;
+
+        // stable insertion by domain
+        int i = j;
+        for (; i > 0 && workers[threadpool->chunk_order[i - 1]].domain > workers[j].domain; i--) {
+            threadpool->chunk_order[i] = threadpool->chunk_order[i - 1];
+        }
+        threadpool->chunk_order[i] = j;
+    }
+}
+
 static struct ggml_threadpool * ggml_threadpool_new_impl(
     struct ggml_threadpool_params * tpp,
                struct ggml_cgraph * cgraph,
-                struct ggml_cplan * cplan) {
+                struct ggml_cplan * cplan,
+           struct ggml_threadpool * parent,
+                              int   first) {
 
     struct ggml_threadpool * threadpool =
         ggml_aligned_malloc(sizeof(struct ggml_threadpool));
@@ -3072,6 +5656,39 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
         threadpool->n_threads_cur    = tpp->n_threads;
         threadpool->poll             = tpp->poll;
         threadpool->prio             = tpp->prio;
+        threadpool->spin_us          = 0;
+        threadpool->wake_seq         = 0;
+        threadpool->n_sleeping       = 0;
+        threadpool->t_kickoff_us     = 0;
+        threadpool->t_done_us        = 0;
+        threadpool->gap_us           = 0;
+        threadpool->dep_sched        = tpp->dep_sched;
+        threadpool->node_sync        = NULL;
+        threadpool->node_sync_size   = 0;
+        threadpool->sync_active      = false;
+        threadpool->node_fuse        = NULL;
+        threadpool->fuse_nodes       = NULL;
+        threadpool->node_fuse_size   = 0;
+        threadpool->fuse_active      = false;
+        threadpool->node_src1        = NULL;
+        threadpool->node_src1_size   = 0;
+        threadpool->src1_active      = false;
+        threadpool->node_tune        = NULL;
+        threadpool->tune_nodes       = NULL;
+        threadpool->node_tune_size   = 0;
+        threadpool->tune_active      = false;
+        threadpool->tune_timing      = false;
+        threadpool->barrier          = tpp->barrier;
+        threadpool->barrier_nodes    = NULL;
+        threadpool->barrier_n_threads = 0;
+        threadpool->chunk_order      = NULL;
+        threadpool->chunk_domains    = false;
+        threadpool->parent           = parent;
+        threadpool->group_first      = first;
+        threadpool->n_attached       = parent ? tpp->n_threads - 1 : 0;
+        threadpool->n_groups         = 0;
+        threadpool->n_threads_avail  = tpp->n_threads;
+        threadpool->warn_avail       = false;
         threadpool->ec               = GGML_STATUS_SUCCESS;
     }
 
@@ -3081,8 +5698,9 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
 
     memset(workers, 0, workers_size);
     for (int j = 0; j < tpp->n_threads; j++) {
-        workers[j].threadpool = threadpool;
-        workers[j].ith        = j;
+        workers[j].threadpool   = threadpool;
+        workers[j].ith          = j;
+        workers[j].barrier_leaf = -1;
     }
 
     threadpool->workers = workers;
@@ -3090,27 +5708,53 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
 #ifdef GGML_USE_OPENMP
     int32_t cpumask_iter = 0;
 
-    // Compute CPU masks for each thread
-    for (int j = 0; j < tpp->n_threads; j++) {
-        ggml_thread_cpumask_next(tpp->cpumask, workers[j].cpumask, tpp->strict_cpu, &cpumask_iter);
+    // Compute CPU masks for each thread, groups use the placement of the workers they take from the parent
+    if (parent || !ggml_threadpool_place(tpp, workers)) {
+        for (int j = 0; j < tpp->n_threads; j++) {
+            if (parent) {
+                memcpy(workers[j].cpumask, parent->workers[first + j].cpumask, sizeof(workers[j].cpumask));
+            } else {
+                ggml_thread_cpumask_next(tpp->cpumask, workers[j].cpumask, tpp->strict_cpu, &cpumask_iter);
+            }
+        }
     }
+
+    ggml_threadpool_init_domains(threadpool);
 #else // GGML_USE_OPENMP
     ggml_mutex_init(&threadpool->mutex);
     ggml_cond_init(&threadpool->cond);
 
+    if (threadpool->barrier == GGML_BARRIER_TREE) {
+        threadpool->barrier_nodes = ggml_aligned_malloc(sizeof(struct ggml_barrier_node) * tpp->n_threads);
+    }
+
     // Spin the threads for all workers, and update CPU placements.
     // Place the main thread last (towards the higher numbered CPU cores).
 
+    // Thread groups do not have threads of their own, see ggml_threadpool_new_group()
+
     int32_t cpumask_iter = 0;
 
-    for (int j = 1; j < tpp->n_threads; j++) {
-        ggml_thread_cpumask_next(tpp->cpumask, workers[j].cpumask, tpp->strict_cpu, &cpumask_iter);
+    if (parent) {
+        for (int j = 0; j < tpp->n_threads; j++) {
+            memcpy(workers[j].cpumask, parent->workers[first + j].cpumask, sizeof(workers[j].cpumask));
+        }
+    } else if (!ggml_threadpool_place(tpp, workers)) {
+        for (int j = 1; j < tpp->n_threads; j++) {
+            ggml_thread_cpumask_next(tpp->cpumask, workers[j].cpumask, tpp->strict_cpu, &cpumask_iter);
+        }
 
-        int32_t rc = ggml_thread_create(&workers[j].thrd, NULL, ggml_graph_compute_secondary_thread, &workers[j]);
-        GGML_ASSERT(rc == 0);
+        ggml_thread_cpumask_next(tpp->cpumask, workers[0].cpumask, tpp->strict_cpu, &cpumask_iter);
     }
 
-    ggml_thread_cpumask_next(tpp->cpumask, workers[0].cpumask, tpp->strict_cpu, &cpumask_iter);
+    ggml_threadpool_init_domains(threadpool);
+
+    if (!parent) {
+        for (int j = 1; j < tpp->n_threads; j++) {
+            int32_t rc = ggml_thread_create(&workers[j].thrd, NULL, ggml_graph_compute_secondary_thread, &workers[j]);
+            GGML_ASSERT(rc == 0);
+        }
+    }
 
     if (!threadpool->pause) {
         // Update main thread prio and affinity at the start, otherwise we'll do it in resume
@@ -3125,7 +5769,59 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
 }
 
 struct ggml_threadpool * ggml_threadpool_new(struct ggml_threadpool_params * tpp) {
-    return ggml_threadpool_new_impl(tpp, NULL, NULL);
+    return ggml_threadpool_new_impl(tpp, NULL, NULL, NULL, 0);
+}
+
+struct ggml_threadpool * ggml_threadpool_new_group(struct ggml_threadpool * threadpool, struct ggml_threadpool_params * tpp) {
+    GGML_ASSERT(threadpool->parent == NULL && "thread groups cannot be nested");
+
+    const int n_threads = tpp->n_threads;
+    GGML_ASSERT(n_threads > 0);
+
+    ggml_critical_section_start();
+
+    // the worker 0 is the thread calling ggml_graph_compute() with the threadpool, take the free workers from the top
+    int first = -1;
+    for (int j = threadpool->n_threads_max - n_threads; j >= 1 && first < 0; j--) {
+        bool free = true;
+        for (int k = j; k < j + n_threads && free; k++) {
+            free = threadpool->workers[k].group == NULL;
+        }
+        if (free) {
+            first = j;
+        }
+    }
+
+    if (first < 0) {
+        ggml_critical_section_end();
+        GGML_LOG_ERROR("%s: not enough free threads in the threadpool for a group of %d threads\n", __func__, n_threads);
+        return NULL;
+    }
+
+    struct ggml_threadpool * group = ggml_threadpool_new_impl(tpp, NULL, NULL, threadpool, first);
+
+    for (int k = first; k < first + n_threads; k++) {
+        threadpool->workers[k].group = group;
+    }
+    threadpool->n_groups++;
+    threadpool->n_threads_avail = MIN(threadpool->n_threads_avail, first);
+    threadpool->warn_avail      = true;
+
+    ggml_critical_section_end();
+
+#ifndef GGML_USE_OPENMP
+    // hand the workers over to the group
+    // the worker `first` stays idle, it is replaced by the thread calling ggml_graph_compute() with the group
+    ggml_mutex_lock(&threadpool->mutex);
+    for (int k = first + 1; k < first + n_threads; k++) {
+        atomic_fetch_add_explicit(&threadpool->workers[k].n_group, 1, memory_order_seq_cst);
+    }
+    ggml_cond_broadcast(&threadpool->cond);
+    ggml_threadpool_wake(threadpool);
+    ggml_mutex_unlock(&threadpool->mutex);
+#endif
+
+    return group;
 }
 
 enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cplan * cplan) {
@@ -3145,7 +5841,7 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
         disposable_threadpool = true;
 
         struct ggml_threadpool_params ttp = ggml_threadpool_params_default(n_threads);
-        threadpool = ggml_threadpool_new_impl(&ttp, cgraph, cplan);
+        threadpool = ggml_threadpool_new_impl(&ttp, cgraph, cplan, NULL, 0);
     } else {
         // Reset some of the parameters that need resetting
         // No worker threads should be accessing the parameters below at this stage
@@ -3156,6 +5852,33 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
         threadpool->ec               = GGML_STATUS_SUCCESS;
     }
 
+    if (threadpool->n_groups > 0 && n_threads > threadpool->n_threads_avail) {
+        if (threadpool->warn_avail) {
+            GGML_LOG_WARN("cplan requested more threads (%d) than available (%d) - the other threads are used by thread groups\n",
+                    n_threads, threadpool->n_threads_avail);
+            threadpool->warn_avail = false;
+        }
+        n_threads = threadpool->n_threads_avail;
+    }
+
+    ggml_cpu_tune_begin(threadpool, cgraph, n_threads);
+
+    ggml_cpu_graph_fuse(threadpool, cgraph);
+    ggml_cpu_graph_src1_cache(threadpool, cgraph, cplan);
+
+    // a single thread needs no barriers, node_sync may be left over from a previous graph
+    threadpool->sync_active = cplan->dep_sched && n_threads > 1;
+    if (threadpool->sync_active) {
+        ggml_graph_compute_deps(cgraph, threadpool);
+    }
+
+    if (cplan->profile) {
+        GGML_ASSERT(n_threads <= GGML_MAX_N_THREADS);
+        ggml_cpu_profile_begin(cplan->profile, cgraph, n_threads);
+    }
+
+    const int n_threads_tune = n_threads;
+
 #ifdef GGML_USE_OPENMP
     if (n_threads > 1) {
         #pragma omp parallel num_threads(n_threads)
@@ -3186,13 +5909,23 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
         n_threads = threadpool->n_threads_max;
     }
 
+    if (threadpool->barrier == GGML_BARRIER_TREE && threadpool->barrier_n_threads != n_threads && n_threads > 1) {
+        ggml_barrier_tree_build(threadpool, n_threads);
+    }
+
     // Kick all threads to start the new graph
     ggml_graph_compute_kickoff(threadpool, n_threads);
 
     // This is a work thread too
     ggml_graph_compute_thread(&threadpool->workers[0]);
+
+    threadpool->t_done_us = ggml_time_us();
 #endif
 
+    if (threadpool->tune_timing && threadpool->ec == GGML_STATUS_SUCCESS) {
+        ggml_cpu_tune_end(threadpool, cgraph, n_threads_tune);
+    }
+
     // don't leave affinity set on the main thread
     clear_numa_thread_affinity();
 
@@ -3578,6 +6311,8 @@ void ggml_cpu_init(void) {
         ggml_init_arm_arch_features();
 #endif
 
+        g_fusion_disabled = getenv("GGML_CPU_DISABLE_FUSION") != NULL;
+
         is_first_call = false;
     }
 
@@ -7,7 +7,12 @@
 #include "amx/amx.h"
 
 #include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #ifdef GGML_USE_CPU_HBM
@@ -94,8 +99,180 @@ static bool ggml_backend_cpu_is_extra_buffer_type(ggml_backend_buffer_type_t buf
     return false;
 }
 
+// CPU backend - plan reuse
+//
+// decode loops build the same graph for every token: the nodes are new tensors, but their ops, types, shapes
+// and strides do not change, and neither do the number of tasks and the work size computed by ggml_graph_plan()
+// the tensors shared between the mul_mats for the src1 cache may change, the cache is assigned at every compute
+// and only used by the mul_mats whose src1 fits in the cache size of the plan
+
+#define GGML_CPU_PLAN_N_SRC 3 // the plan does not look further than src[2]
+
+// the properties of a node that the number of tasks and the work size of ggml_graph_plan() depend on
+struct ggml_backend_cpu_node_props {
+    ggml_op   op;
+    ggml_type type;
+    int64_t   ne[GGML_MAX_DIMS];
+    int32_t   op_params[GGML_MAX_OP_PARAMS / sizeof(int32_t)];
+
+    ggml_type                  src_type [GGML_CPU_PLAN_N_SRC];
+    int64_t                    src_ne   [GGML_CPU_PLAN_N_SRC][GGML_MAX_DIMS];
+    size_t                     src_nb   [GGML_CPU_PLAN_N_SRC][GGML_MAX_DIMS]; // permuted mul_mat operands are packed in the work buffer
+    ggml_backend_buffer_type_t src_buft [GGML_CPU_PLAN_N_SRC]; // extra buffer types compute their own work size
+    ggml_backend_buffer_usage  src_usage[GGML_CPU_PLAN_N_SRC]; // the transforms of the weights are cached outside of the work buffer
+    void *                     src_extra[GGML_CPU_PLAN_N_SRC];
+};
+
+static void ggml_backend_cpu_node_props_set(ggml_backend_cpu_node_props & props, const ggml_tensor * node) {
+    props.op   = node->op;
+    props.type = node->type;
+    memcpy(props.ne,        node->ne,        sizeof(props.ne));
+    memcpy(props.op_params, node->op_params, sizeof(props.op_params));
+
+    for (int j = 0; j < GGML_CPU_PLAN_N_SRC; j++) {
+        const ggml_tensor * src = node->src[j];
+
+        props.src_type[j]  = src ? src->type : GGML_TYPE_COUNT;
+        props.src_buft[j]  = src && src->buffer ? src->buffer->buft : nullptr;
+        props.src_usage[j] = src && src->buffer ? ggml_backend_buffer_get_usage(src->buffer) : GGML_BACKEND_BUFFER_USAGE_ANY;
+        props.src_extra[j] = src ? src->extra : nullptr;
+        if (src) {
+            memcpy(props.src_ne[j], src->ne, sizeof(props.src_ne[j]));
+            memcpy(props.src_nb[j], src->nb, sizeof(props.src_nb[j]));
+        } else {
+            memset(props.src_ne[j], 0, sizeof(props.src_ne[j]));
+            memset(props.src_nb[j], 0, sizeof(props.src_nb[j]));
+        }
+    }
+}
+
+static bool ggml_backend_cpu_node_props_match(const ggml_backend_cpu_node_props & props, const ggml_tensor * node) {
+    if (props.op != node->op || props.type != node->type ||
+        memcmp(props.ne,        node->ne,        sizeof(props.ne))        != 0 ||
+        memcmp(props.op_params, node->op_params, sizeof(props.op_params)) != 0) {
+        return false;
+    }
+
+    for (int j = 0; j < GGML_CPU_PLAN_N_SRC; j++) {
+        const ggml_tensor * src = node->src[j];
+
+        if (src == nullptr) {
+            if (props.src_type[j] != GGML_TYPE_COUNT) {
+                return false;
+            }
+            continue;
+        }
+
+        if (props.src_type[j]  != src->type ||
+            props.src_buft[j]  != (src->buffer ? src->buffer->buft : nullptr) ||
+            props.src_usage[j] != (src->buffer ? ggml_backend_buffer_get_usage(src->buffer) : GGML_BACKEND_BUFFER_USAGE_ANY) ||
+            props.src_extra[j] != src->extra ||
+            memcmp(props.src_ne[j], src->ne, sizeof(props.src_ne[j])) != 0 ||
+            memcmp(props.src_nb[j], src->nb, sizeof(props.src_nb[j])) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void ggml_backend_cpu_graph_props_set(std::vector<ggml_backend_cpu_node_props> & props, const ggml_cgraph * cgraph) {
+    props.resize(cgraph->n_nodes);
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        ggml_backend_cpu_node_props_set(props[i], cgraph->nodes[i]);
+    }
+}
+
+// true if a plan made for the graph that the props were taken from is valid for cgraph
+static bool ggml_backend_cpu_graph_props_match(const std::vector<ggml_backend_cpu_node_props> & props, const ggml_cgraph * cgraph) {
+    if ((int) props.size() != cgraph->n_nodes) {
+        return false;
+    }
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        if (!ggml_backend_cpu_node_props_match(props[i], cgraph->nodes[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// CPU backend - events
+
+// an event completes when the work queued before its last record has been computed
+struct ggml_backend_cpu_event {
+    std::mutex              mutex;
+    std::condition_variable cv;
+    uint64_t                n_recorded = 0;
+    uint64_t                n_done     = 0;
+};
+
+static bool ggml_backend_cpu_event_is_cpu(ggml_backend_event_t event) {
+    return ggml_backend_dev_backend_reg(event->device) == ggml_backend_cpu_reg();
+}
+
+static void ggml_backend_cpu_event_complete(ggml_backend_event_t event, uint64_t value) {
+    auto * ev = (ggml_backend_cpu_event *) event->context;
+
+    std::lock_guard<std::mutex> lock(ev->mutex);
+    ev->n_done = std::max(ev->n_done, value);
+    ev->cv.notify_all();
+}
+
+// wait for the record number value, or for an event of another device
+static void ggml_backend_cpu_event_wait_value(ggml_backend_event_t event, uint64_t value) {
+    if (!ggml_backend_cpu_event_is_cpu(event)) {
+        ggml_backend_event_synchronize(event);
+        return;
+    }
+
+    auto * ev = (ggml_backend_cpu_event *) event->context;
+
+    std::unique_lock<std::mutex> lock(ev->mutex);
+    ev->cv.wait(lock, [&] { return ev->n_done >= value; });
+}
+
+static uint64_t ggml_backend_cpu_event_last(ggml_backend_event_t event) {
+    if (!ggml_backend_cpu_event_is_cpu(event)) {
+        return 0;
+    }
+
+    auto * ev = (ggml_backend_cpu_event *) event->context;
+
+    std::lock_guard<std::mutex> lock(ev->mutex);
+    return ev->n_recorded;
+}
+
 // CPU backend - backend (stream)
 
+// work queued on an async backend, computed in order by the thread of the backend
+struct ggml_backend_cpu_task {
+    enum type {
+        COMPUTE,
+        SET_TENSOR,
+        GET_TENSOR,
+        EVENT_RECORD,
+        EVENT_WAIT,
+    };
+
+    type kind;
+
+    // COMPUTE: copy of the graph and its tensors, the caller may build the next graph in the same memory meanwhile
+    struct ggml_cgraph         graph;
+    std::vector<ggml_tensor>   tensors;
+    std::vector<ggml_tensor *> nodes;
+
+    // SET_TENSOR, GET_TENSOR
+    ggml_tensor  tensor;
+    const void * src;
+    void *       dst;
+    size_t       offset;
+    size_t       size;
+
+    // EVENT_RECORD, EVENT_WAIT
+    ggml_backend_event_t event;
+    uint64_t             value;
+};
+
 struct ggml_backend_cpu_context {
     int                 n_threads;
     ggml_threadpool_t   threadpool;
@@ -105,8 +282,135 @@ struct ggml_backend_cpu_context {
 
     ggml_abort_callback abort_callback;
     void *              abort_callback_data;
+
+    struct ggml_cpu_profile * profile;
+
+    // plan of the last graph, reused while the graphs keep the same structure
+    bool                                     cplan_valid;
+    struct ggml_cplan                        cplan;
+    std::vector<ggml_backend_cpu_node_props> cplan_props;
+
+    // async mode, see ggml_backend_cpu_set_async()
+    bool                              async = false;
+    std::thread                       thread;
+    std::mutex                        mutex;
+    std::condition_variable           cv_queue; // work queued or stop
+    std::condition_variable           cv_done;  // queue empty
+    std::deque<ggml_backend_cpu_task> queue;    // the front task is being computed
+    bool                              stop         = false;
+    enum ggml_status                  async_status = GGML_STATUS_SUCCESS; // first error of the queued graphs
+
+    std::unordered_map<const ggml_tensor *, int> copy_index;
 };
 
+static enum ggml_status ggml_backend_cpu_graph_compute_impl(struct ggml_backend_cpu_context * cpu_ctx, struct ggml_cgraph * cgraph);
+
+static void ggml_backend_cpu_task_run(struct ggml_backend_cpu_context * cpu_ctx, ggml_backend_cpu_task & task) {
+    switch (task.kind) {
+        case ggml_backend_cpu_task::COMPUTE:
+            {
+                const enum ggml_status ec = ggml_backend_cpu_graph_compute_impl(cpu_ctx, &task.graph);
+                if (ec != GGML_STATUS_SUCCESS) {
+                    std::lock_guard<std::mutex> lock(cpu_ctx->mutex);
+                    if (cpu_ctx->async_status == GGML_STATUS_SUCCESS) {
+                        cpu_ctx->async_status = ec;
+                    }
+                }
+            } break;
+        case ggml_backend_cpu_task::SET_TENSOR:
+            ggml_backend_tensor_set(&task.tensor, task.src, task.offset, task.size);
+            break;
+        case ggml_backend_cpu_task::GET_TENSOR:
+            ggml_backend_tensor_get(&task.tensor, task.dst, task.offset, task.size);
+            break;
+        case ggml_backend_cpu_task::EVENT_RECORD:
+            ggml_backend_cpu_event_complete(task.event, task.value);
+            break;
+        case ggml_backend_cpu_task::EVENT_WAIT:
+            ggml_backend_cpu_event_wait_value(task.event, task.value);
+            break;
+    }
+}
+
+static void ggml_backend_cpu_async_thread(struct ggml_backend_cpu_context * cpu_ctx) {
+    std::unique_lock<std::mutex> lock(cpu_ctx->mutex);
+
+    while (true) {
+        cpu_ctx->cv_queue.wait(lock, [&] { return cpu_ctx->stop || !cpu_ctx->queue.empty(); });
+        if (cpu_ctx->queue.empty()) {
+            break;
+        }
+
+        lock.unlock();
+        ggml_backend_cpu_task_run(cpu_ctx, cpu_ctx->queue.front());
+        lock.lock();
+
+        cpu_ctx->queue.pop_front();
+        if (cpu_ctx->queue.empty()) {
+            cpu_ctx->cv_done.notify_all();
+        }
+    }
+}
+
+static void ggml_backend_cpu_push(struct ggml_backend_cpu_context * cpu_ctx, ggml_backend_cpu_task && task) {
+    std::lock_guard<std::mutex> lock(cpu_ctx->mutex);
+    cpu_ctx->queue.push_back(std::move(task));
+    cpu_ctx->cv_queue.notify_one();
+}
+
+static void ggml_backend_cpu_sync(struct ggml_backend_cpu_context * cpu_ctx) {
+    if (!cpu_ctx->async) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(cpu_ctx->mutex);
+    cpu_ctx->cv_done.wait(lock, [&] { return cpu_ctx->queue.empty(); });
+}
+
+// copy the nodes of the graph and their sources, the sources of the copies point to the copies
+static void ggml_backend_cpu_graph_copy(struct ggml_backend_cpu_context * cpu_ctx, const struct ggml_cgraph * cgraph, ggml_backend_cpu_task & task) {
+    auto & index = cpu_ctx->copy_index;
+    index.clear();
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const ggml_tensor * node = cgraph->nodes[i];
+        index.emplace(node, (int) index.size());
+        for (int j = 0; j < GGML_MAX_SRC; j++) {
+            if (node->src[j]) {
+                index.emplace(node->src[j], (int) index.size());
+            }
+        }
+    }
+
+    task.tensors.resize(index.size());
+    for (const auto & it : index) {
+        task.tensors[it.second] = *it.first;
+    }
+
+    for (auto & t : task.tensors) {
+        for (int j = 0; j < GGML_MAX_SRC; j++) {
+            auto it = t.src[j] ? index.find(t.src[j]) : index.end();
+            if (it != index.end()) {
+                t.src[j] = &task.tensors[it->second];
+            }
+        }
+    }
+
+    task.nodes.resize(cgraph->n_nodes);
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        task.nodes[i] = &task.tensors[index.at(cgraph->nodes[i])];
+    }
+
+    task.graph = *cgraph;
+    task.graph.n_leafs          = 0;
+    task.graph.nodes            = task.nodes.data();
+    task.graph.grads            = NULL;
+    task.graph.grad_accs        = NULL;
+    task.graph.leafs            = NULL;
+    task.graph.use_counts       = NULL;
+    task.graph.visited_hash_set = { 0, NULL, NULL };
+}
+
 static const char * ggml_backend_cpu_get_name(ggml_backend_t backend) {
     return "CPU";
 
@@ -115,6 +419,7 @@ static const char * ggml_backend_cpu_get_name(ggml_backend_t backend) {
 
 static void ggml_backend_cpu_free(ggml_backend_t backend) {
     struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+    ggml_backend_cpu_set_async(backend, false);
     delete[] cpu_ctx->work_data;
     delete cpu_ctx;
     delete backend;
@@ -123,6 +428,9 @@ static void ggml_backend_cpu_free(ggml_backend_t backend) {
 struct ggml_backend_plan_cpu {
     struct ggml_cplan cplan;
     struct ggml_cgraph cgraph;
+
+    size_t work_size; // size of cplan.work_data
+    std::vector<ggml_backend_cpu_node_props> props;
 };
 
 static ggml_backend_graph_plan_t ggml_backend_cpu_graph_plan_create(ggml_backend_t backend, const struct ggml_cgraph * cgraph) {
@@ -132,6 +440,8 @@ static ggml_backend_graph_plan_t ggml_backend_cpu_graph_plan_create(ggml_backend
 
     cpu_plan->cplan = ggml_graph_plan(cgraph, cpu_ctx->n_threads, cpu_ctx->threadpool);
     cpu_plan->cgraph = *cgraph; // FIXME: deep copy
+    cpu_plan->work_size = cpu_plan->cplan.work_size;
+    ggml_backend_cpu_graph_props_set(cpu_plan->props, cgraph);
 
     if (cpu_plan->cplan.work_size > 0) {
         cpu_plan->cplan.work_data = new uint8_t[cpu_plan->cplan.work_size];
@@ -143,6 +453,7 @@ static ggml_backend_graph_plan_t ggml_backend_cpu_graph_plan_create(ggml_backend
 
     cpu_plan->cplan.abort_callback      = cpu_ctx->abort_callback;
     cpu_plan->cplan.abort_callback_data = cpu_ctx->abort_callback_data;
+    cpu_plan->cplan.profile             = cpu_ctx->profile;
 
     return cpu_plan;
 }
@@ -156,18 +467,53 @@ static void ggml_backend_cpu_graph_plan_free(ggml_backend_t backend, ggml_backen
     GGML_UNUSED(backend);
 }
 
-static enum ggml_status ggml_backend_cpu_graph_plan_compute(ggml_backend_t backend, ggml_backend_graph_plan_t plan) {
+static void ggml_backend_cpu_graph_plan_update(ggml_backend_t backend, ggml_backend_graph_plan_t plan, const struct ggml_cgraph * cgraph) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
     struct ggml_backend_plan_cpu * cpu_plan = (struct ggml_backend_plan_cpu *)plan;
 
-    return ggml_graph_compute(&cpu_plan->cgraph, &cpu_plan->cplan);
+    cpu_plan->cgraph = *cgraph; // FIXME: deep copy
 
-    GGML_UNUSED(backend);
+    if (ggml_backend_cpu_graph_props_match(cpu_plan->props, cgraph)) {
+        return;
+    }
+
+    // the structure changed, plan again and keep the work buffer if it is large enough
+    uint8_t * work_data = cpu_plan->cplan.work_data;
+
+    cpu_plan->cplan = ggml_graph_plan(cgraph, cpu_ctx->n_threads, cpu_ctx->threadpool);
+    cpu_plan->cplan.work_data = work_data;
+    ggml_backend_cpu_graph_props_set(cpu_plan->props, cgraph);
+
+    if (cpu_plan->work_size < cpu_plan->cplan.work_size) {
+        delete[] cpu_plan->cplan.work_data;
+        cpu_plan->cplan.work_data = new uint8_t[cpu_plan->cplan.work_size];
+        cpu_plan->work_size = cpu_plan->cplan.work_size;
+    }
+
+    cpu_plan->cplan.abort_callback      = cpu_ctx->abort_callback;
+    cpu_plan->cplan.abort_callback_data = cpu_ctx->abort_callback_data;
+    cpu_plan->cplan.profile             = cpu_ctx->profile;
 }
 
-static enum ggml_status ggml_backend_cpu_graph_compute(ggml_backend_t backend, struct ggml_cgraph * cgraph) {
+static enum ggml_status ggml_backend_cpu_graph_plan_compute(ggml_backend_t backend, ggml_backend_graph_plan_t plan) {
     struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+    struct ggml_backend_plan_cpu * cpu_plan = (struct ggml_backend_plan_cpu *)plan;
+
+    // plans are computed synchronously, after the queued graphs
+    ggml_backend_cpu_sync(cpu_ctx);
+
+    return ggml_graph_compute(&cpu_plan->cgraph, &cpu_plan->cplan);
+}
 
-    struct ggml_cplan cplan = ggml_graph_plan(cgraph, cpu_ctx->n_threads, cpu_ctx->threadpool);
+static enum ggml_status ggml_backend_cpu_graph_compute_impl(struct ggml_backend_cpu_context * cpu_ctx, struct ggml_cgraph * cgraph) {
+    // the graph has the same structure as the previous one in decode loops, skip planning
+    if (!cpu_ctx->cplan_valid || !ggml_backend_cpu_graph_props_match(cpu_ctx->cplan_props, cgraph)) {
+        cpu_ctx->cplan = ggml_graph_plan(cgraph, cpu_ctx->n_threads, cpu_ctx->threadpool);
+        ggml_backend_cpu_graph_props_set(cpu_ctx->cplan_props, cgraph);
+        cpu_ctx->cplan_valid = true;
+    }
+
+    struct ggml_cplan cplan = cpu_ctx->cplan;
 
     if (cpu_ctx->work_size < cplan.work_size) {
         delete[] cpu_ctx->work_data;
@@ -182,24 +528,131 @@ static enum ggml_status ggml_backend_cpu_graph_compute(ggml_backend_t backend, s
 
     cplan.abort_callback      = cpu_ctx->abort_callback;
     cplan.abort_callback_data = cpu_ctx->abort_callback_data;
+    cplan.profile             = cpu_ctx->profile;
 
     return ggml_graph_compute(cgraph, &cplan);
 }
 
+static enum ggml_status ggml_backend_cpu_graph_compute(ggml_backend_t backend, struct ggml_cgraph * cgraph) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+
+    if (!cpu_ctx->async) {
+        return ggml_backend_cpu_graph_compute_impl(cpu_ctx, cgraph);
+    }
+
+    ggml_backend_cpu_task task;
+    task.kind = ggml_backend_cpu_task::COMPUTE;
+    ggml_backend_cpu_graph_copy(cpu_ctx, cgraph, task);
+
+    ggml_backend_cpu_push(cpu_ctx, std::move(task));
+
+    // errors of the graphs queued before are reported here
+    std::lock_guard<std::mutex> lock(cpu_ctx->mutex);
+    const enum ggml_status ec = cpu_ctx->async_status;
+    cpu_ctx->async_status = GGML_STATUS_SUCCESS;
+
+    return ec;
+}
+
+static void ggml_backend_cpu_set_tensor_async(ggml_backend_t backend, struct ggml_tensor * tensor, const void * data, size_t offset, size_t size) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+
+    if (!cpu_ctx->async) {
+        ggml_backend_tensor_set(tensor, data, offset, size);
+        return;
+    }
+
+    ggml_backend_cpu_task task;
+    task.kind   = ggml_backend_cpu_task::SET_TENSOR;
+    task.tensor = *tensor;
+    task.src    = data;
+    task.offset = offset;
+    task.size   = size;
+
+    ggml_backend_cpu_push(cpu_ctx, std::move(task));
+}
+
+static void ggml_backend_cpu_get_tensor_async(ggml_backend_t backend, const struct ggml_tensor * tensor, void * data, size_t offset, size_t size) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+
+    if (!cpu_ctx->async) {
+        ggml_backend_tensor_get(tensor, data, offset, size);
+        return;
+    }
+
+    ggml_backend_cpu_task task;
+    task.kind   = ggml_backend_cpu_task::GET_TENSOR;
+    task.tensor = *tensor;
+    task.dst    = data;
+    task.offset = offset;
+    task.size   = size;
+
+    ggml_backend_cpu_push(cpu_ctx, std::move(task));
+}
+
+static void ggml_backend_cpu_synchronize(ggml_backend_t backend) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+
+    ggml_backend_cpu_sync(cpu_ctx);
+}
+
+static void ggml_backend_cpu_event_record(ggml_backend_t backend, ggml_backend_event_t event) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+
+    auto * ev = (ggml_backend_cpu_event *) event->context;
+
+    uint64_t value;
+    {
+        std::lock_guard<std::mutex> lock(ev->mutex);
+        value = ++ev->n_recorded;
+    }
+
+    if (!cpu_ctx->async) {
+        ggml_backend_cpu_event_complete(event, value);
+        return;
+    }
+
+    ggml_backend_cpu_task task;
+    task.kind  = ggml_backend_cpu_task::EVENT_RECORD;
+    task.event = event;
+    task.value = value;
+
+    ggml_backend_cpu_push(cpu_ctx, std::move(task));
+}
+
+static void ggml_backend_cpu_event_wait(ggml_backend_t backend, ggml_backend_event_t event) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
+
+    // the work queued after this waits for the records made before it
+    const uint64_t value = ggml_backend_cpu_event_last(event);
+
+    if (!cpu_ctx->async) {
+        ggml_backend_cpu_event_wait_value(event, value);
+        return;
+    }
+
+    ggml_backend_cpu_task task;
+    task.kind  = ggml_backend_cpu_task::EVENT_WAIT;
+    task.event = event;
+    task.value = value;
+
+    ggml_backend_cpu_push(cpu_ctx, std::move(task));
+}
+
 static const struct ggml_backend_i ggml_backend_cpu_i = {
     /* .get_name                = */ ggml_backend_cpu_get_name,
     /* .free                    = */ ggml_backend_cpu_free,
-    /* .set_tensor_async        = */ NULL,
-    /* .get_tensor_async        = */ NULL,
+    /* .set_tensor_async        = */ ggml_backend_cpu_set_tensor_async,
+    /* .get_tensor_async        = */ ggml_backend_cpu_get_tensor_async,
     /* .cpy_tensor_async        = */ NULL,
-    /* .synchronize             = */ NULL,
+    /* .synchronize             = */ ggml_backend_cpu_synchronize,
     /* .graph_plan_create       = */ ggml_backend_cpu_graph_plan_create,
     /* .graph_plan_free         = */ ggml_backend_cpu_graph_plan_free,
-    /* .graph_plan_update       = */ NULL,
+    /* .graph_plan_update       = */ ggml_backend_cpu_graph_plan_update,
     /* .graph_plan_compute      = */ ggml_backend_cpu_graph_plan_compute,
     /* .graph_compute           = */ ggml_backend_cpu_graph_compute,
-    /* .event_record            = */ NULL,
-    /* .event_wait              = */ NULL,
+    /* .event_record            = */ ggml_backend_cpu_event_record,
+    /* .event_wait              = */ ggml_backend_cpu_event_wait,
     /* .graph_optimize          = */ NULL,
 };
 
@@ -223,6 +676,8 @@ ggml_backend_t ggml_backend_cpu_init(void) {
     ctx->work_size           = 0;
     ctx->abort_callback      = NULL;
     ctx->abort_callback_data = NULL;
+    ctx->profile             = NULL;
+    ctx->cplan_valid         = false;
 
     ggml_backend_t cpu_backend = new ggml_backend {
         /* .guid    = */ ggml_backend_cpu_guid(),
@@ -247,29 +702,67 @@ void ggml_backend_cpu_set_n_threads(ggml_backend_t backend_cpu, int n_threads) {
     GGML_ASSERT(ggml_backend_is_cpu(backend_cpu));
 
     struct ggml_backend_cpu_context * ctx = (struct ggml_backend_cpu_context *)backend_cpu->context;
-    ctx->n_threads = n_threads;
+    ggml_backend_cpu_sync(ctx);
+    ctx->n_threads   = n_threads;
+    ctx->cplan_valid = false;
 }
 
 void ggml_backend_cpu_set_threadpool(ggml_backend_t backend_cpu, ggml_threadpool_t threadpool) {
     GGML_ASSERT(ggml_backend_is_cpu(backend_cpu));
 
     struct ggml_backend_cpu_context * ctx = (struct ggml_backend_cpu_context *)backend_cpu->context;
+    ggml_backend_cpu_sync(ctx);
 
     if (ctx->threadpool && ctx->threadpool != threadpool) {
         // already had a different threadpool, pause/suspend it before switching
         ggml_threadpool_pause(ctx->threadpool);
     }
-    ctx->threadpool = threadpool;
+    ctx->threadpool  = threadpool;
+    ctx->cplan_valid = false;
 }
 
 void ggml_backend_cpu_set_abort_callback(ggml_backend_t backend_cpu, ggml_abort_callback abort_callback, void * abort_callback_data) {
     GGML_ASSERT(ggml_backend_is_cpu(backend_cpu));
 
     struct ggml_backend_cpu_context * ctx = (struct ggml_backend_cpu_context *)backend_cpu->context;
+    ggml_backend_cpu_sync(ctx);
     ctx->abort_callback = abort_callback;
     ctx->abort_callback_data = abort_callback_data;
 }
 
+void ggml_backend_cpu_set_profile(ggml_backend_t backend_cpu, struct ggml_cpu_profile * profile) {
+    GGML_ASSERT(ggml_backend_is_cpu(backend_cpu));
+
+    struct ggml_backend_cpu_context * ctx = (struct ggml_backend_cpu_context *)backend_cpu->context;
+    ggml_backend_cpu_sync(ctx);
+    ctx->profile = profile;
+}
+
+void ggml_backend_cpu_set_async(ggml_backend_t backend_cpu, bool async) {
+    GGML_ASSERT(ggml_backend_is_cpu(backend_cpu));
+
+    struct ggml_backend_cpu_context * ctx = (struct ggml_backend_cpu_context *)backend_cpu->context;
+    if (ctx->async == async) {
+        return;
+    }
+
+    if (async) {
+        ctx->stop   = false;
+        ctx->thread = std::thread(ggml_backend_cpu_async_thread, ctx);
+        ctx->async  = true;
+        return;
+    }
+
+    // compute the queued work before stopping
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        ctx->stop = true;
+        ctx->cv_queue.notify_one();
+    }
+    ctx->thread.join();
+    ctx->async = false;
+}
+
 // CPU backend - device
 
 struct ggml_backend_cpu_device_context {
@@ -378,11 +871,14 @@ static void ggml_backend_cpu_device_get_props(ggml_backend_dev_t dev, struct ggm
     props->description = ggml_backend_cpu_device_get_description(dev);
     props->type        = ggml_backend_cpu_device_get_type(dev);
     ggml_backend_cpu_device_get_memory(dev, &props->memory_free, &props->memory_total);
+    // the backends of the device are synchronous until they are switched to async mode with ggml_backend_cpu_set_async()
+    // the events work in both modes: in sync mode the work before a record has already been computed when it returns,
+    // so the record completes the event right away and a wait only waits for the events of other devices
     props->caps = {
         /* .async                 = */ false,
         /* .host_buffer           = */ false,
         /* .buffer_from_host_ptr  = */ true,
-        /* .events                = */ false,
+        /* .events                = */ true,
     };
 }
 
@@ -464,6 +960,26 @@ static bool ggml_backend_cpu_device_supports_buft(ggml_backend_dev_t dev, ggml_b
     GGML_UNUSED(dev);
 }
 
+static ggml_backend_event_t ggml_backend_cpu_device_event_new(ggml_backend_dev_t dev) {
+    return new ggml_backend_event {
+        /* .device  = */ dev,
+        /* .context = */ new ggml_backend_cpu_event,
+    };
+}
+
+static void ggml_backend_cpu_device_event_free(ggml_backend_dev_t dev, ggml_backend_event_t event) {
+    delete (ggml_backend_cpu_event *) event->context;
+    delete event;
+
+    GGML_UNUSED(dev);
+}
+
+static void ggml_backend_cpu_device_event_synchronize(ggml_backend_dev_t dev, ggml_backend_event_t event) {
+    ggml_backend_cpu_event_wait_value(event, ggml_backend_cpu_event_last(event));
+
+    GGML_UNUSED(dev);
+}
+
 static const struct ggml_backend_device_i ggml_backend_cpu_device_i = {
     /* .get_name             = */ ggml_backend_cpu_device_get_name,
     /* .get_description      = */ ggml_backend_cpu_device_get_description,
@@ -477,9 +993,9 @@ static const struct ggml_backend_device_i ggml_backend_cpu_device_i = {
     /* .supports_op          = */ ggml_backend_cpu_device_supports_op,
     /* .supports_buft        = */ ggml_backend_cpu_device_supports_buft,
     /* .offload_op           = */ NULL,
-    /* .event_new            = */ NULL,
-    /* .event_free           = */ NULL,
-    /* .event_synchronize    = */ NULL,
+    /* .event_new            = */ ggml_backend_cpu_device_event_new,
+    /* .event_free           = */ ggml_backend_cpu_device_event_free,
+    /* .event_synchronize    = */ ggml_backend_cpu_device_event_synchronize,
 };
 
 // CPU backend - backend (reg)
@@ -650,6 +1166,9 @@ static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const ch
     if (strcmp(name, "ggml_threadpool_free") == 0) {
         return (void *)ggml_threadpool_free;
     }
+    if (strcmp(name, "ggml_backend_cpu_set_async") == 0) {
+        return (void *)ggml_backend_cpu_set_async;
+    }
     if (strcmp(name, "ggml_backend_cpu_set_threadpool") == 0) {
         return (void *)ggml_backend_cpu_set_threadpool;
     }
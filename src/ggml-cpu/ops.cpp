@@ -2,13 +2,18 @@
 
 #include "ggml-cpu.h"
 #include "ggml-impl.h"
+#include "ggml-backend-impl.h"
 #include "binary-ops.h"
 #include "ggml.h"
 #include "unary-ops.h"
 #include "vec.h"
+#include "quants.h"
 
 #include <float.h>
 #include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 // ggml_compute_forward_dup
 
@@ -521,12 +526,302 @@ static void ggml_compute_forward_dup_from_q(
     }
 }
 
+// tiled transposes
+//
+// a copy where src0 is contiguous along one dim and dst along another one, e.g. ggml_cont(ggml_transpose(x)) or a
+// permute that moves dim 0, is done by tiles of GGML_TRANSPOSE_TILE x GGML_TRANSPOSE_TILE elements so that both the
+// reads and the writes stay in the cache, instead of element by element with strided reads
+
+#define GGML_TRANSPOSE_TILE 32
+
+// outputs of at least this size are written with non-temporal stores, they would only evict the inputs from the cache
+#define GGML_TRANSPOSE_NT_MIN (64ull*1024*1024)
+
+#if defined(__AVX__)
+// 8x8 block of 32-bit elements, transposed in registers
+static inline void ggml_transpose_8x8_b32(const char * s, size_t ls, char * d, size_t ld, bool nt) {
+    __m256 r[8];
+    for (int k = 0; k < 8; ++k) {
+        r[k] = _mm256_loadu_ps((const float *) (s + k*ls));
+    }
+
+    const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    const __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+    const __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+    const __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    const __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+    const __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+    const __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+    const __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+    const __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+    r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+    r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+    r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+    r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+    r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+    r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+    r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+
+    if (nt) {
+        for (int k = 0; k < 8; ++k) {
+            _mm256_stream_ps((float *) (d + k*ld), r[k]);
+        }
+    } else {
+        for (int k = 0; k < 8; ++k) {
+            _mm256_storeu_ps((float *) (d + k*ld), r[k]);
+        }
+    }
+}
+#endif
+
+#if defined(__SSE2__)
+// 8x8 block of 16-bit elements, transposed in registers
+static inline void ggml_transpose_8x8_b16(const char * s, size_t ls, char * d, size_t ld, bool nt) {
+    __m128i r[8];
+    for (int k = 0; k < 8; ++k) {
+        r[k] = _mm_loadu_si128((const __m128i *) (s + k*ls));
+    }
+
+    const __m128i t0 = _mm_unpacklo_epi16(r[0], r[1]);
+    const __m128i t1 = _mm_unpackhi_epi16(r[0], r[1]);
+    const __m128i t2 = _mm_unpacklo_epi16(r[2], r[3]);
+    const __m128i t3 = _mm_unpackhi_epi16(r[2], r[3]);
+    const __m128i t4 = _mm_unpacklo_epi16(r[4], r[5]);
+    const __m128i t5 = _mm_unpackhi_epi16(r[4], r[5]);
+    const __m128i t6 = _mm_unpacklo_epi16(r[6], r[7]);
+    const __m128i t7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+    const __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+    const __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+    const __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+    const __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+    const __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+    const __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+    const __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+    const __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+    r[0] = _mm_unpacklo_epi64(u0, u4);
+    r[1] = _mm_unpackhi_epi64(u0, u4);
+    r[2] = _mm_unpacklo_epi64(u1, u5);
+    r[3] = _mm_unpackhi_epi64(u1, u5);
+    r[4] = _mm_unpacklo_epi64(u2, u6);
+    r[5] = _mm_unpackhi_epi64(u2, u6);
+    r[6] = _mm_unpacklo_epi64(u3, u7);
+    r[7] = _mm_unpackhi_epi64(u3, u7);
+
+    if (nt) {
+        for (int k = 0; k < 8; ++k) {
+            _mm_stream_si128((__m128i *) (d + k*ld), r[k]);
+        }
+    } else {
+        for (int k = 0; k < 8; ++k) {
+            _mm_storeu_si128((__m128i *) (d + k*ld), r[k]);
+        }
+    }
+}
+#endif
+
+// d[ia*ld + ib] = s[ib*ls + ia] for an na x nb tile, ls and ld in bytes
+template<typename src_t, typename dst_t>
+static void ggml_transpose_tile(const char * s, size_t ls, char * d, size_t ld, int64_t na, int64_t nb, bool nt) {
+    // part done with the 8x8 blocks
+    int64_t na8 = 0;
+    int64_t nb8 = 0;
+
+    if constexpr (std::is_same_v<src_t, dst_t>) {
+#if defined(__AVX__)
+        if constexpr (sizeof(src_t) == 4) {
+            na8 = na & ~7;
+            nb8 = nb & ~7;
+            for (int64_t ia = 0; ia < na8; ia += 8) {
+                for (int64_t ib = 0; ib < nb8; ib += 8) {
+                    ggml_transpose_8x8_b32(s + ib*ls + ia*4, ls, d + ia*ld + ib*4, ld, nt);
+                }
+            }
+        }
+#endif
+#if defined(__SSE2__)
+        if constexpr (sizeof(src_t) == 2) {
+            na8 = na & ~7;
+            nb8 = nb & ~7;
+            for (int64_t ia = 0; ia < na8; ia += 8) {
+                for (int64_t ib = 0; ib < nb8; ib += 8) {
+                    ggml_transpose_8x8_b16(s + ib*ls + ia*2, ls, d + ia*ld + ib*2, ld, nt);
+                }
+            }
+        }
+#endif
+    }
+    GGML_UNUSED(nt);
+
+    for (int64_t ia = 0; ia < na; ++ia) {
+        dst_t * d_row = (dst_t *) (d + ia*ld);
+        for (int64_t ib = ia < na8 ? nb8 : 0; ib < nb; ++ib) {
+            const src_t x = *(const src_t *) (s + ib*ls + ia*sizeof(src_t));
+            if constexpr (std::is_same_v<src_t, dst_t>) {
+                d_row[ib] = x;
+            } else {
+                d_row[ib] = type_conversion_table<dst_t>::from_f32(type_conversion_table<src_t>::to_f32(x));
+            }
+        }
+    }
+}
+
+void ggml_cpu_transpose_tile(const void * s, size_t ls, void * d, size_t ld, int64_t na, int64_t nb, size_t ts) {
+    switch (ts) {
+        case 4: ggml_transpose_tile<uint32_t, uint32_t>((const char *) s, ls, (char *) d, ld, na, nb, false); break;
+        case 2: ggml_transpose_tile<uint16_t, uint16_t>((const char *) s, ls, (char *) d, ld, na, nb, false); break;
+        default: GGML_ABORT("unsupported element size %zu", ts);
+    }
+}
+
+// dims a and b of a transposed copy: src0 is contiguous along a and dst along b
+static bool ggml_dup_transposed_dims(const ggml_tensor * src0, const ggml_tensor * dst, int & a, int & b) {
+    if (!ggml_are_same_shape(src0, dst)) {
+        return false;
+    }
+
+    a = -1;
+    b = -1;
+    for (int i = 0; i < GGML_MAX_DIMS; ++i) {
+        if (src0->ne[i] > 1 && src0->nb[i] == ggml_type_size(src0->type) && a < 0) {
+            a = i;
+        }
+        if (dst->ne[i] > 1 && dst->nb[i] == ggml_type_size(dst->type) && b < 0) {
+            b = i;
+        }
+    }
+
+    // narrow transposes are fine with the row loops
+    return a >= 0 && b >= 0 && a != b && src0->ne[a] >= 8 && src0->ne[b] >= 8;
+}
+
+template<typename src_t, typename dst_t>
+static void ggml_compute_forward_dup_tiled(
+        const ggml_compute_params * params,
+        ggml_tensor * dst, int a, int b) {
+
+    const ggml_tensor * src0 = dst->src[0];
+
+    // the other two dims
+    int c = -1;
+    int e = -1;
+    for (int i = 0; i < GGML_MAX_DIMS; ++i) {
+        if (i != a && i != b) {
+            if (c < 0) {
+                c = i;
+            } else {
+                e = i;
+            }
+        }
+    }
+
+    const int64_t na = src0->ne[a];
+    const int64_t nb = src0->ne[b];
+    const int64_t n_c = src0->ne[c];
+    const int64_t n_e = src0->ne[e];
+
+    const int64_t nta = (na + GGML_TRANSPOSE_TILE - 1)/GGML_TRANSPOSE_TILE;
+    const int64_t ntb = (nb + GGML_TRANSPOSE_TILE - 1)/GGML_TRANSPOSE_TILE;
+
+    // the aligned blocks of a large output are streamed to memory
+    bool nt = false;
+#if defined(__SSE2__)
+    if (std::is_same_v<src_t, dst_t> && ggml_nbytes(dst) >= GGML_TRANSPOSE_NT_MIN) {
+        const size_t align = sizeof(dst_t) == 4 ? 32 : 16;
+        nt = (uintptr_t) dst->data % align == 0;
+        for (int i = 0; i < GGML_MAX_DIMS; ++i) {
+            nt = nt && (i == b || dst->nb[i] % align == 0);
+        }
+    }
+#endif
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    // parallelize by tiles
+    const int64_t n_tiles = nta*ntb*n_c*n_e;
+    const int64_t dt = (n_tiles + nth - 1)/nth;
+    const int64_t it0 = dt*ith;
+    const int64_t it1 = MIN(it0 + dt, n_tiles);
+
+    for (int64_t it = it0; it < it1; ++it) {
+        // consecutive tiles of a thread are consecutive in dst
+        const int64_t itb = it % ntb;
+        const int64_t ita = (it/ntb) % nta;
+        const int64_t ic  = (it/(ntb*nta)) % n_c;
+        const int64_t ie  = it/(ntb*nta*n_c);
+
+        const int64_t ia0 = ita*GGML_TRANSPOSE_TILE;
+        const int64_t ib0 = itb*GGML_TRANSPOSE_TILE;
+
+        const char * s = (const char *) src0->data + ia0*src0->nb[a] + ib0*src0->nb[b] + ic*src0->nb[c] + ie*src0->nb[e];
+              char * d = (char *)        dst->data + ia0*dst->nb[a]  + ib0*dst->nb[b]  + ic*dst->nb[c]  + ie*dst->nb[e];
+
+        ggml_transpose_tile<src_t, dst_t>(s, src0->nb[b], d, dst->nb[a],
+                MIN(GGML_TRANSPOSE_TILE, na - ia0), MIN(GGML_TRANSPOSE_TILE, nb - ib0), nt);
+    }
+
+#if defined(__SSE2__)
+    if (nt) {
+        _mm_sfence();
+    }
+#endif
+}
+
+// true if the copy was done as a tiled transpose
+static bool ggml_compute_forward_dup_transpose(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+
+    int a;
+    int b;
+    if (!ggml_dup_transposed_dims(src0, dst, a, b)) {
+        return false;
+    }
+
+    const ggml_type st = src0->type;
+    const ggml_type dt = dst->type;
+
+    if (st == dt) {
+        switch (ggml_type_size(st)) {
+            case 4: ggml_compute_forward_dup_tiled<uint32_t, uint32_t>(params, dst, a, b); return true;
+            case 2: ggml_compute_forward_dup_tiled<uint16_t, uint16_t>(params, dst, a, b); return true;
+            default: return false;
+        }
+    }
+
+    /**/ if (st == GGML_TYPE_F32  && dt == GGML_TYPE_F16)  ggml_compute_forward_dup_tiled<float, ggml_fp16_t>(params, dst, a, b);
+    else if (st == GGML_TYPE_F16  && dt == GGML_TYPE_F32)  ggml_compute_forward_dup_tiled<ggml_fp16_t, float>(params, dst, a, b);
+    else if (st == GGML_TYPE_F32  && dt == GGML_TYPE_BF16) ggml_compute_forward_dup_tiled<float, ggml_bf16_t>(params, dst, a, b);
+    else if (st == GGML_TYPE_BF16 && dt == GGML_TYPE_F32)  ggml_compute_forward_dup_tiled<ggml_bf16_t, float>(params, dst, a, b);
+    else return false;
+
+    return true;
+}
+
 void ggml_compute_forward_dup(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
 
     const ggml_tensor * src0 = dst->src[0];
 
+    if (ggml_compute_forward_dup_transpose(params, dst)) {
+        return;
+    }
+
     if (src0->type == dst->type) {
         ggml_compute_forward_dup_bytes(params, dst);
         return;
@@ -4758,31 +5053,33 @@ static void ggml_compute_forward_set_rows_f32(
     const int ith = params->ith;
     const int nth = params->nth;
 
-    // rows per thread
-    const int64_t dr = (nr + nth - 1)/nth;
+    // rows per thread, over the rows of all the streams so that a few tokens still use all the threads
+    const int64_t nr_all = nr*ne02*ne03;
+    const int64_t dr = (nr_all + nth - 1)/nth;
 
     // row range for this thread
     const int64_t ir0 = dr*ith;
-    const int64_t ir1 = std::min(ir0 + dr, nr);
+    const int64_t ir1 = std::min(ir0 + dr, nr_all);
 
     ggml_from_float_t const from_float = ggml_get_type_traits_cpu(dst->type)->from_float;
 
-    for (int64_t i03 = 0; i03 < ne03; ++i03) {
-        for (int64_t i02 = 0; i02 < ne02; ++i02) {
-            for (int64_t i = ir0; i < ir1; ++i) {
-                const int64_t i12 = i03%ne12;
-                const int64_t i11 = i02%ne11;
-                const int64_t i10 = i;
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        const int64_t i03 = ir/(ne02*nr);
+        const int64_t i02 = (ir - i03*ne02*nr)/nr;
+        const int64_t i   = ir - i03*ne02*nr - i02*nr;
 
-                const int64_t i1 = *(idx_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+        const int64_t i12 = i03%ne12;
+        const int64_t i11 = i02%ne11;
+        const int64_t i10 = i;
 
-                GGML_ASSERT(i1 >= 0 && i1 < ne1);
+        const int64_t i1 = *(idx_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-                from_float(
-                        (const float *) ((char *) src0->data +  i*nb01 + i02*nb02 + i03*nb03),
-                                        ((char *)  dst->data + i1*nb1  + i02*nb2  + i03*nb3), nc);
-            }
-        }
+        GGML_ASSERT(i1 >= 0 && i1 < ne1);
+
+        // quantized destinations (e.g. a Q8_0/Q4_0 KV cache) are written directly by from_float
+        from_float(
+                (const float *) ((char *) src0->data +  i*nb01 + i02*nb02 + i03*nb03),
+                                ((char *)  dst->data + i1*nb1  + i02*nb2  + i03*nb3), nc);
     }
 }
 
@@ -6617,42 +6914,44 @@ void ggml_compute_forward_im2col_3d(
     }
 }
 
+// c[i, m, n] = a[i, m, k] * b[i, n, k]^T for i < n_mat, the matrices of a, b and c are consecutive
+// ldc is the row stride of c in floats
 static void ggml_call_mul_mat(ggml_type type, const ggml_compute_params * params, int64_t m, int64_t n, int64_t k,
-                              void * a, void * b, float * c) {
+                              void * a, void * b, float * c, int64_t ldc, int64_t n_mat) {
     const ggml_type_traits * traits = ggml_get_type_traits(type);
     struct ggml_tensor src1 = {};
     src1.type  = type;
     src1.ne[0] = k;
     src1.ne[1] = m;
-    src1.ne[2] = 1;
+    src1.ne[2] = n_mat;
     src1.ne[3] = 1;
     src1.nb[0] = traits->type_size;
     src1.nb[1] = k * traits->type_size;
-    src1.nb[2] = src1.nb[1];
-    src1.nb[3] = src1.nb[2];
+    src1.nb[2] = src1.nb[1] * m;
+    src1.nb[3] = src1.nb[2] * n_mat;
     src1.data  = a;
 
     struct ggml_tensor src0 = {};
     src0.type  = type;
     src0.ne[0] = k;
     src0.ne[1] = n;
-    src0.ne[2] = 1;
+    src0.ne[2] = n_mat;
     src0.ne[3] = 1;
     src0.nb[0] = traits->type_size;
     src0.nb[1] = k * traits->type_size;
-    src0.nb[2] = src0.nb[1];
-    src0.nb[3] = src0.nb[2];
+    src0.nb[2] = src0.nb[1] * n;
+    src0.nb[3] = src0.nb[2] * n_mat;
     src0.data  = b;
 
     struct ggml_tensor dst = {};
     dst.ne[0] = n;
     dst.ne[1] = m;
-    dst.ne[2] = 1;
+    dst.ne[2] = n_mat;
     dst.ne[3] = 1;
     dst.nb[0] = sizeof(float);
-    dst.nb[1] = n * sizeof(float);
-    dst.nb[2] = dst.nb[1];
-    dst.nb[3] = dst.nb[2];
+    dst.nb[1] = ldc * sizeof(float);
+    dst.nb[2] = dst.nb[1] * m;
+    dst.nb[3] = dst.nb[2] * n_mat;
     dst.data  = c;
     dst.src[0] = &src0;
     dst.src[1] = &src1;
@@ -6662,6 +6961,63 @@ static void ggml_call_mul_mat(ggml_type type, const ggml_compute_params * params
 
 // ggml_compute_forward_conv_2d
 
+// output pixels per tile of the implicit GEMM: about 256 KiB of packed patches per thread, at least 64
+static int64_t ggml_conv_2d_tile_n(size_t row_size, int n_threads) {
+    const int64_t n = (int64_t) ((size_t) n_threads * 256 * 1024 / row_size);
+    return std::max(n, (int64_t) 64);
+}
+
+// im2col of a single output pixel, in the (IC, KH, KW) order of the kernel rows
+template <typename T>
+static void ggml_conv_2d_pack_patch(T * dst_row, const ggml_tensor * src, const char * src_base, int64_t dst_x, int64_t dst_y,
+                                    int64_t knl_w, int64_t knl_h, int32_t stride_x, int32_t stride_y,
+                                    int32_t pad_x, int32_t pad_y, int32_t dilation_x, int32_t dilation_y) {
+    const int64_t c_in  = src->ne[2];
+    const int64_t src_w = src->ne[0];
+    const int64_t src_h = src->ne[1];
+
+    const int64_t sx0 = dst_x*stride_x - pad_x;
+    const int64_t sy0 = dst_y*stride_y - pad_y;
+
+    // range of kx inside of the input row
+    int64_t kx0 = 0;
+    int64_t kx1 = knl_w;
+    while (kx0 < knl_w && sx0 + kx0*dilation_x < 0) {
+        kx0++;
+    }
+    while (kx1 > kx0 && sx0 + (kx1 - 1)*dilation_x >= src_w) {
+        kx1--;
+    }
+
+    for (int64_t ic = 0; ic < c_in; ++ic) {
+        for (int64_t ky = 0; ky < knl_h; ++ky) {
+            T * out = dst_row + (ic*knl_h + ky)*knl_w;
+
+            const int64_t sy = sy0 + ky*dilation_y;
+            if (sy < 0 || sy >= src_h) {
+                for (int64_t kx = 0; kx < knl_w; ++kx) {
+                    out[kx] = type_conversion_table<T>::from_f32(0.0f);
+                }
+                continue;
+            }
+
+            const char * src_row = src_base + sy*src->nb[1] + ic*src->nb[2];
+
+            for (int64_t kx = 0; kx < kx0; ++kx) {
+                out[kx] = type_conversion_table<T>::from_f32(0.0f);
+            }
+            for (int64_t kx = kx0; kx < kx1; ++kx) {
+                out[kx] = type_conversion_table<T>::from_f32(*(const float *) (src_row + (sx0 + kx*dilation_x)*src->nb[0]));
+            }
+            for (int64_t kx = kx1; kx < knl_w; ++kx) {
+                out[kx] = type_conversion_table<T>::from_f32(0.0f);
+            }
+        }
+    }
+}
+
+// implicit GEMM: the output pixels are processed in tiles, all threads pack the patches of a tile into the work
+// buffer and multiply them with the kernel, the result [OC, tile] is written directly to the OC planes of dst
 static void ggml_compute_forward_conv_2d_impl(const ggml_compute_params * params,
                                               const ggml_tensor *         kernel,  // [KW, KH, IC, OC]
                                               const ggml_tensor *         src,     // [W, H, C, N]
@@ -6672,8 +7028,6 @@ static void ggml_compute_forward_conv_2d_impl(const ggml_compute_params * params
     GGML_ASSERT(kernel_type == GGML_TYPE_F16 || kernel_type == GGML_TYPE_F32);
     GGML_ASSERT(kernel->type == kernel_type);
 
-    const ggml_type_traits * traits = ggml_get_type_traits(kernel_type);
-
     const int32_t stride_x   = dst->op_params[0];
     const int32_t stride_y   = dst->op_params[1];
     const int32_t pad_x      = dst->op_params[2];
@@ -6685,202 +7039,593 @@ static void ggml_compute_forward_conv_2d_impl(const ggml_compute_params * params
     const int64_t c_out = kernel->ne[3];
     GGML_ASSERT(c_in == kernel->ne[2]);
 
-    const int64_t src_w = src->ne[0];
-    const int64_t src_h = src->ne[1];
     const int64_t knl_w = kernel->ne[0];
     const int64_t knl_h = kernel->ne[1];
     const int64_t dst_w = dst->ne[0];
     const int64_t dst_h = dst->ne[1];
 
-    const float * src_data = (float *) src->data;
-    void  * knl_data       = kernel->data;
-    float * dst_data       = (float *) dst->data;
+    // the pixels of an OC plane are the columns of the GEMM output
+    GGML_ASSERT(dst->nb[0] == sizeof(float));
+    GGML_ASSERT(dst->nb[1] == dst_w*sizeof(float));
+    GGML_ASSERT(dst->nb[2] % sizeof(float) == 0);
 
-    const int64_t knl_n           = knl_w * knl_h * c_in;
-    const int64_t patch_total     = dst->ne[3] * dst_w * dst_h;
+    const int64_t knl_n    = knl_w * knl_h * c_in;
+    const size_t  row_size = ggml_row_size(kernel_type, knl_n);
+    const int64_t pix_n    = dst_w * dst_h;
 
-    const int64_t space_per_patch   = knl_n * traits->type_size + c_out * sizeof(float);
-    const int64_t batch_size        = params->wsize / space_per_patch;
-    const int64_t patches_per_batch = batch_size > 8 ? (batch_size / 8) * 8 : batch_size;
-    const int64_t batch_n           = (patch_total + patches_per_batch - 1) / patches_per_batch;
+    const int64_t tile_n = std::min(std::min(ggml_conv_2d_tile_n(row_size, params->nth), pix_n), (int64_t) (params->wsize / row_size));
+    GGML_ASSERT(tile_n > 0);
 
-    GGML_ASSERT(patches_per_batch > 0 && batch_size >= 1);
+    char * tmp = (char *) params->wdata;
 
-    void * tmp = params->wdata;
+    for (int64_t in = 0; in < dst->ne[3]; ++in) {
+        const char * src_base = (const char *) src->data + in*src->nb[3];
+        float      * dst_base = (float *) ((char *) dst->data + in*dst->nb[3]);
 
-    for (int64_t batch_i = 0; batch_i < batch_n; ++batch_i) {
+        for (int64_t p0 = 0; p0 < pix_n; p0 += tile_n) {
+            const int64_t np = std::min(tile_n, pix_n - p0);
 
-        const int64_t patch_start_batch = batch_i * patches_per_batch;
-        const int64_t patch_end_batch   = std::min(patch_start_batch + patches_per_batch,
-                                              patch_total);
-        const int64_t patch_n           = patch_end_batch - patch_start_batch;
+            // pack the patches of the tile
+            const int64_t dp = (np + params->nth - 1) / params->nth;
+            const int64_t i0 = std::min(params->ith * dp, np);
+            const int64_t i1 = std::min(i0 + dp, np);
 
-        const int64_t patch_per_thread  = (patch_n + params->nth - 1) / params->nth;
-        const int64_t patch_start       = patch_start_batch + params->ith * patch_per_thread;
-        const int64_t patch_end         = std::min(patch_start + patch_per_thread, patch_end_batch);
+            for (int64_t i = i0; i < i1; ++i) {
+                const int64_t dst_y = (p0 + i) / dst_w;
+                const int64_t dst_x = (p0 + i) % dst_w;
 
-        //im2col for a patch
-        for (int64_t p = patch_start; p < patch_end; ++p) {
-            const int64_t  batch_n     =  p / (dst_w * dst_h);
-            const int64_t  src_x       = (p / dst_w) % dst_h;
-            const int64_t  src_y       =  p % dst_w;
+                if (kernel_type == GGML_TYPE_F16) {
+                    ggml_conv_2d_pack_patch((ggml_fp16_t *) (tmp + i*row_size), src, src_base, dst_x, dst_y,
+                            knl_w, knl_h, stride_x, stride_y, pad_x, pad_y, dilation_x, dilation_y);
+                } else {
+                    ggml_conv_2d_pack_patch((float *) (tmp + i*row_size), src, src_base, dst_x, dst_y,
+                            knl_w, knl_h, stride_x, stride_y, pad_x, pad_y, dilation_x, dilation_y);
+                }
+            }
 
-            const float * src_base = (const float *)((const char *)src_data + batch_n * src->nb[3]);
-            char *        dst_row  = (char *) tmp + (p % patches_per_batch) * knl_n * traits->type_size;
+            ggml_barrier(params->threadpool);
 
-            for (int64_t ic = 0; ic < c_in; ++ic) {
-                for (int64_t ky = 0; ky < knl_h; ++ky) {
-                    for (int64_t kx = 0; kx < knl_w; ++kx) {
-                        const int64_t sy = src_x * stride_y + ky * dilation_y - pad_y;
-                        const int64_t sx = src_y * stride_x + kx * dilation_x - pad_x;
+            // GEMM: kernel[c_out, knl_n] x patches[np, knl_n]^T = dst[c_out, np]
+            ggml_call_mul_mat(kernel_type, params, c_out, np, knl_n, kernel->data, tmp, dst_base + p0, dst->nb[2] / sizeof(float), 1);
 
-                        int64_t dst_idx = ic * (knl_h * knl_w) + ky * knl_w + kx;
+            ggml_barrier(params->threadpool);
+        }
+    }
+}
 
-                        float src_val;
-                        if (sy < 0 || sy >= src_h || sx < 0 || sx >= src_w) {
-                            src_val = 0.0f;
-                        } else {
-                            const float * src_ptr = (const float *)((const char *)src_base + sx * src->nb[0] + sy * src->nb[1] + ic * src->nb[2]);
-                            src_val               = *src_ptr;
-                        }
+// Winograd F(4x4, 3x3) for 3x3 convolutions with stride 1 and no dilation
+// ref: https://arxiv.org/abs/1509.09308
+//
+// the output is computed in 4x4 tiles from 6x6 input tiles:
+//   Y = A^T [ (G g G^T) . (B^T d B) ] A
+// the element-wise products, summed over the input channels, are 36 GEMMs [tiles, IC] x [OC, IC]^T
+// the kernel transform G g G^T of the weights is computed once and cached, other kernels are transformed at every compute
 
-                        char * element_ptr = dst_row + dst_idx * traits->type_size;
-                        if (kernel_type == GGML_TYPE_F32) {
-                            *(float *) element_ptr = src_val;
-                        } else if (kernel_type == GGML_TYPE_F16) {
-                            *(ggml_fp16_t *) element_ptr = GGML_CPU_FP32_TO_FP16(src_val);
-                        }
-                    }
-                }
-            }
-        }   // patches handled by this thread
+// kernel transform of the rows or columns of a 3x3 kernel: u = G g
+static inline void ggml_winograd_g(const float * g, int64_t sg, float * u, int64_t su) {
+    const float g0 = g[0];
+    const float g1 = g[sg];
+    const float g2 = g[2*sg];
 
-        ggml_barrier(params->threadpool);
+    u[0   ] =  g0/4.0f;
+    u[su  ] = -(g0 + g1 + g2)/6.0f;
+    u[2*su] = -(g0 - g1 + g2)/6.0f;
+    u[3*su] =  g0/24.0f + g1/12.0f + g2/6.0f;
+    u[4*su] =  g0/24.0f - g1/12.0f + g2/6.0f;
+    u[5*su] =  g2;
+}
 
-        float * gemm_output = (float *) ((char *) tmp + patches_per_batch * knl_n * traits->type_size);
+// input transform of 6 values: r = B^T d
+static inline void ggml_winograd_bt(const float * d, int64_t sd, float * r, int64_t sr) {
+    const float d0 = d[0];
+    const float d1 = d[sd];
+    const float d2 = d[2*sd];
+    const float d3 = d[3*sd];
+    const float d4 = d[4*sd];
+    const float d5 = d[5*sd];
 
-        GGML_ASSERT(gemm_output + patch_n * c_out <= (float*)tmp + params->wsize);
+    r[0   ] =  4.0f*d0 - 5.0f*d2 + d4;
+    r[sr  ] = -4.0f*d1 - 4.0f*d2 + d3 + d4;
+    r[2*sr] =  4.0f*d1 - 4.0f*d2 - d3 + d4;
+    r[3*sr] = -2.0f*d1 - d2 + 2.0f*d3 + d4;
+    r[4*sr] =  2.0f*d1 - d2 - 2.0f*d3 + d4;
+    r[5*sr] =  4.0f*d1 - 5.0f*d3 + d5;
+}
 
-        // GEMM: patches[patch_n, knl_n] × kernel[knl_n, c_out] = output[patch_n, c_out]
-        ggml_call_mul_mat(kernel_type, params, patch_n, c_out, knl_n, tmp, knl_data, gemm_output);
+// output transform of 6 values: o = A^T m
+static inline void ggml_winograd_at(const float * m, int64_t sm, float * o, int64_t so) {
+    const float m0 = m[0];
+    const float m1 = m[sm];
+    const float m2 = m[2*sm];
+    const float m3 = m[3*sm];
+    const float m4 = m[4*sm];
+    const float m5 = m[5*sm];
 
-        ggml_barrier(params->threadpool);
+    o[0   ] = m0 + m1 + m2 + m3 + m4;
+    o[so  ] = m1 - m2 + 2.0f*(m3 - m4);
+    o[2*so] = m1 + m2 + 4.0f*(m3 + m4);
+    o[3*so] = m1 - m2 + 8.0f*(m3 - m4) + m5;
+}
 
+// max size of the transformed kernel, larger convolutions use the implicit GEMM
+#define GGML_CONV_2D_WINOGRAD_MAX_U (64*1024*1024)
 
-        //permute back [OC, N, OH, OW] to [N, OC, OH, OW]
-        const int64_t permute_per_thread = (patch_n + params->nth - 1) / params->nth;
-        const int64_t permute_start = params->ith * permute_per_thread;
-        const int64_t permute_end = std::min(permute_start + permute_per_thread, patch_n);
+static bool ggml_conv_2d_use_winograd(const ggml_tensor * dst) {
+    const ggml_tensor * kernel = dst->src[0];
 
-        for (int64_t i = permute_start; i < permute_end; ++i) {
-            const int64_t p       = patch_start_batch + i;
-            const int64_t batch_n = p / (dst_w * dst_h);
-            const int64_t dst_y   = (p / dst_w) % dst_h;
-            const int64_t dst_x   = p % dst_w;
-
-            for (int64_t oc = 0; oc < c_out; ++oc) {
-                const float value = gemm_output[i * c_out + oc];
-                float * dst_ptr = (float *)((char *)dst_data + dst_x * dst->nb[0] + dst_y * dst->nb[1] + oc * dst->nb[2] + batch_n * dst->nb[3]);
-                *dst_ptr = value;
-            }
-        }
+    if (kernel->type != GGML_TYPE_F32 && kernel->type != GGML_TYPE_F16) {
+        return false;
+    }
+    if (kernel->ne[0] != 3 || kernel->ne[1] != 3) {
+        return false;
+    }
+    // stride 1, no dilation
+    if (dst->op_params[0] != 1 || dst->op_params[1] != 1 || dst->op_params[4] != 1 || dst->op_params[5] != 1) {
+        return false;
     }
+    if (36*kernel->ne[2]*kernel->ne[3]*sizeof(float) > GGML_CONV_2D_WINOGRAD_MAX_U) {
+        return false;
+    }
+
+    // the outputs of the 4x4 tiles outside of the image are wasted, skip small images
+    const int64_t n_tiles = ((dst->ne[0] + 3)/4)*((dst->ne[1] + 3)/4);
+
+    return n_tiles >= 16 && 16*n_tiles <= 3*dst->ne[0]*dst->ne[1]/2;
 }
 
-void ggml_compute_forward_conv_2d(
-        const ggml_compute_params * params,
-        ggml_tensor * dst) {
+// transformed kernels of the weights, see ggml_cpu_weight_cache_invalidate()
+//
+// a kernel is cached only if it is in a buffer with GGML_BACKEND_BUFFER_USAGE_WEIGHTS, by buffer, data address, type and shape
+// the tensor itself is not part of the key: the async CPU backend computes copies of the tensors of the graphs
+// an entry is valid for one generation of its buffer: any write to the buffer through the backend API makes it stale,
+// and the entries of a buffer are dropped when it is freed, before another buffer can be allocated at the same address
+// the entries are shared pointers, a graph keeps using its entry while another one invalidates it
 
-    const ggml_tensor * src0 = dst->src[0];
-    const ggml_tensor * src1 = dst->src[1];
+// max total size of the cached transforms, the oldest entries are dropped first
+#define GGML_CPU_WEIGHT_CACHE_MAX (512*1024*1024)
 
-    ggml_compute_forward_conv_2d_impl(params, src0, src1, dst, src0->type);
+struct ggml_cpu_weight_cache_entry {
+    ggml_backend_buffer_t buffer;
+    uint64_t              generation;
+    const void *          data;
+    ggml_type             type;
+    int64_t               ne[GGML_MAX_DIMS];
+
+    std::vector<float>    U;
+};
+
+static std::mutex                                                g_weight_cache_mutex;
+static std::vector<std::shared_ptr<ggml_cpu_weight_cache_entry>> g_weight_cache; // oldest first
+static size_t                                                    g_weight_cache_size = 0;
+
+static bool ggml_cpu_weight_cacheable(const ggml_tensor * tensor) {
+    return tensor->buffer && ggml_backend_buffer_get_usage(tensor->buffer) == GGML_BACKEND_BUFFER_USAGE_WEIGHTS;
 }
 
-// ggml_compute_forward_conv_3d
+static bool ggml_cpu_weight_cache_match(const ggml_cpu_weight_cache_entry & e, const ggml_tensor * tensor) {
+    return e.buffer == tensor->buffer && e.data == tensor->data && e.type == tensor->type && memcmp(e.ne, tensor->ne, sizeof(e.ne)) == 0;
+}
 
-static void ggml_compute_forward_conv_3d_impl(const ggml_compute_params * params,
-                                              const ggml_tensor *         kernel,
-                                              const ggml_tensor *         src,
-                                              ggml_tensor *               dst,
-                                              ggml_type                   kernel_type) {
+// drops the entries for which pred is true, the cache mutex must be held
+template <typename F>
+static void ggml_cpu_weight_cache_erase_if(F && pred) {
+    for (size_t i = 0; i < g_weight_cache.size(); ) {
+        if (pred(*g_weight_cache[i])) {
+            g_weight_cache_size -= g_weight_cache[i]->U.size()*sizeof(float);
+            g_weight_cache.erase(g_weight_cache.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
 
-    GGML_ASSERT(ggml_is_contiguous(kernel));
-    GGML_ASSERT(kernel_type == GGML_TYPE_F16 || kernel_type == GGML_TYPE_F32);
-    GGML_ASSERT(kernel->type == kernel_type);
+static void ggml_cpu_weight_cache_free_hook(ggml_backend_buffer_t buffer) {
+    std::lock_guard<std::mutex> lock(g_weight_cache_mutex);
 
-    const ggml_type_traits * traits = ggml_get_type_traits(kernel_type);
+    ggml_cpu_weight_cache_erase_if([&](const ggml_cpu_weight_cache_entry & e) { return e.buffer == buffer; });
+}
 
-    const int32_t s0 = dst->op_params[0];
-    const int32_t s1 = dst->op_params[1];
-    const int32_t s2 = dst->op_params[2];
-    const int32_t p0 = dst->op_params[3];
-    const int32_t p1 = dst->op_params[4];
-    const int32_t p2 = dst->op_params[5];
-    const int32_t d0 = dst->op_params[6];
-    const int32_t d1 = dst->op_params[7];
-    const int32_t d2 = dst->op_params[8];
-    const int32_t c  = dst->op_params[9];
-    const int32_t n  = dst->op_params[10];
-    const int32_t oc = dst->op_params[11];
+// the free hook is registered with the first entry, and removed when the CPU backend is unloaded
+struct ggml_cpu_weight_cache_hook {
+    ggml_cpu_weight_cache_hook()  { ggml_backend_buffer_add_free_hook   (ggml_cpu_weight_cache_free_hook); }
+    ~ggml_cpu_weight_cache_hook() { ggml_backend_buffer_remove_free_hook(ggml_cpu_weight_cache_free_hook); }
+};
 
-    const int64_t src_w = src->ne[0];
-    const int64_t src_h = src->ne[1];
-    const int64_t src_d = src->ne[2];
-    const int64_t knl_w = kernel->ne[0];
-    const int64_t knl_h = kernel->ne[1];
-    const int64_t knl_d = kernel->ne[2];
-    const int64_t dst_w = dst->ne[0];
-    const int64_t dst_h = dst->ne[1];
-    const int64_t dst_d = dst->ne[2];
+static std::shared_ptr<ggml_cpu_weight_cache_entry> ggml_cpu_weight_cache_get(const ggml_tensor * tensor) {
+    std::lock_guard<std::mutex> lock(g_weight_cache_mutex);
 
-    const float * src_data = (float *) src->data;
-    void  * knl_data       = kernel->data;
-    float * dst_data       = (float *) dst->data;
+    // the buffer was written since these entries were computed
+    const ggml_backend_buffer_t buffer = tensor->buffer;
+    ggml_cpu_weight_cache_erase_if([&](const ggml_cpu_weight_cache_entry & e) {
+        return e.buffer == buffer && e.generation != buffer->generation;
+    });
 
-    const int64_t knl_n_per_channel = knl_w * knl_h * knl_d;
-    const int64_t knl_n_total       = knl_n_per_channel * c;
-    const int64_t patch_total       = n * dst_w * dst_h * dst_d;
+    for (const auto & e : g_weight_cache) {
+        if (ggml_cpu_weight_cache_match(*e, tensor)) {
+            return e;
+        }
+    }
+    return nullptr;
+}
 
-    const int64_t space_per_patch   = knl_n_total * traits->type_size + oc * sizeof(float);
-    const int64_t batch_size        = params->wsize / space_per_patch;
-    const int64_t patches_per_batch = batch_size > 8 ? (batch_size / 8) * 8 : batch_size;
-    const int64_t batch_n           = (patch_total + patches_per_batch - 1) / patches_per_batch;
+// replaces the previous entries of the same data
+static void ggml_cpu_weight_cache_put(const std::shared_ptr<ggml_cpu_weight_cache_entry> & entry) {
+    static ggml_cpu_weight_cache_hook hook;
 
-    GGML_ASSERT(patches_per_batch > 0 && batch_size >= 1);
+    std::lock_guard<std::mutex> lock(g_weight_cache_mutex);
 
-    void * tmp = params->wdata;
+    ggml_cpu_weight_cache_erase_if([&](const ggml_cpu_weight_cache_entry & e) { return e.data == entry->data; });
 
-    for (int64_t batch_i = 0; batch_i < batch_n; ++batch_i) {
-        const int64_t patch_start_batch = batch_i * patches_per_batch;
-        const int64_t patch_end_batch   = std::min(patch_start_batch + patches_per_batch, patch_total);
-        const int64_t patch_n_in_batch  = patch_end_batch - patch_start_batch;
+    // the buffer was written while the transform was computed
+    if (entry->generation != entry->buffer->generation) {
+        return;
+    }
 
-        const int64_t patch_per_thread  = (patch_n_in_batch + params->nth - 1) / params->nth;
-        const int64_t patch_start       = patch_start_batch + params->ith * patch_per_thread;
-        const int64_t patch_end         = std::min(patch_start + patch_per_thread, patch_end_batch);
+    const size_t size = entry->U.size()*sizeof(float);
 
-        for (int64_t p = patch_start; p < patch_end; ++p) {
-            const int64_t p_in_batch = p % (dst_w * dst_h * dst_d);
-            const int64_t p_in_depth = p_in_batch % (dst_w * dst_h);
-            const int64_t batch_idx  = p / (dst_w * dst_h * dst_d);
-            const int64_t dst_z      = p_in_batch / (dst_w * dst_h);
-            const int64_t dst_y      = p_in_depth / dst_w;
-            const int64_t dst_x      = p_in_depth % dst_w;
+    while (!g_weight_cache.empty() && g_weight_cache_size + size > GGML_CPU_WEIGHT_CACHE_MAX) {
+        g_weight_cache_size -= g_weight_cache.front()->U.size()*sizeof(float);
+        g_weight_cache.erase(g_weight_cache.begin());
+    }
 
-            char * dst_row = (char *) tmp + (p % patches_per_batch) * knl_n_total * traits->type_size;
+    if (size <= GGML_CPU_WEIGHT_CACHE_MAX) {
+        g_weight_cache.push_back(entry);
+        g_weight_cache_size += size;
+    }
+}
 
-            for (int64_t ic = 0; ic < c; ++ic) {
-                for (int64_t kz = 0; kz < knl_d; ++kz) {
-                    for (int64_t ky = 0; ky < knl_h; ++ky) {
-                        for (int64_t kx = 0; kx < knl_w; ++kx) {
-                            const int64_t sz = dst_z * s2 + kz * d2 - p2;
-                            const int64_t sy = dst_y * s1 + ky * d1 - p1;
-                            const int64_t sx = dst_x * s0 + kx * d0 - p0;
+void ggml_cpu_weight_cache_invalidate(const struct ggml_tensor * tensor) {
+    std::lock_guard<std::mutex> lock(g_weight_cache_mutex);
 
-                            int64_t dst_idx = ic * knl_n_per_channel + kz * (knl_h * knl_w) + ky * knl_w + kx;
+    ggml_cpu_weight_cache_erase_if([&](const ggml_cpu_weight_cache_entry & e) { return tensor == NULL || e.data == tensor->data; });
+}
 
-                            float src_val;
+// tiles transformed and multiplied at once: about 1 MiB of transformed input and output per thread, at least 64 tiles
+static int64_t ggml_conv_2d_winograd_tile_n(const ggml_tensor * dst, int n_threads) {
+    const int64_t c_in    = dst->src[0]->ne[2];
+    const int64_t c_out   = dst->src[0]->ne[3];
+    const int64_t n_tiles = ((dst->ne[0] + 3)/4)*((dst->ne[1] + 3)/4)*dst->ne[3];
+
+    const int64_t n = (int64_t) n_threads*1024*1024/(36*sizeof(float)*(c_in + c_out));
+
+    return std::min(std::max(n, (int64_t) 64), n_tiles);
+}
+
+size_t ggml_compute_forward_conv_2d_work_size(const ggml_tensor * dst, int n_threads) {
+    const ggml_tensor * kernel = dst->src[0];
+
+    const int64_t c_in  = kernel->ne[2];
+    const int64_t c_out = kernel->ne[3];
+
+    if (ggml_conv_2d_use_winograd(dst)) {
+        const int64_t tile_n = ggml_conv_2d_winograd_tile_n(dst, n_threads);
+
+        // transformed input and output, and the transformed kernel if it is not cached
+        const int64_t n_u = ggml_cpu_weight_cacheable(kernel) ? 0 : c_out*c_in;
+
+        return CACHE_LINE_SIZE + sizeof(float)*36*(n_u + tile_n*c_in + tile_n*c_out);
+    }
+
+    // packed patches of a tile
+    const size_t  row_size = ggml_row_size(kernel->type, kernel->ne[0]*kernel->ne[1]*c_in);
+    const int64_t pix_n    = dst->ne[0]*dst->ne[1];
+
+    return row_size*std::min(ggml_conv_2d_tile_n(row_size, n_threads), pix_n);
+}
+
+static void ggml_compute_forward_conv_2d_winograd(const ggml_compute_params * params, ggml_tensor * dst) {
+    const ggml_tensor * kernel = dst->src[0]; // [3, 3, IC, OC]
+    const ggml_tensor * src    = dst->src[1]; // [W, H, IC, N]
+
+    GGML_ASSERT(ggml_is_contiguous(kernel));
+    GGML_ASSERT(src->type == GGML_TYPE_F32);
+    GGML_ASSERT(dst->nb[0] == sizeof(float));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int32_t pad_x = dst->op_params[2];
+    const int32_t pad_y = dst->op_params[3];
+
+    const int64_t c_in  = kernel->ne[2];
+    const int64_t c_out = kernel->ne[3];
+    GGML_ASSERT(c_in == src->ne[2]);
+
+    const int64_t src_w = src->ne[0];
+    const int64_t src_h = src->ne[1];
+    const int64_t dst_w = dst->ne[0];
+    const int64_t dst_h = dst->ne[1];
+
+    const int64_t tiles_x = (dst_w + 3)/4;
+    const int64_t tiles_y = (dst_h + 3)/4;
+    const int64_t n_tiles = tiles_x*tiles_y*dst->ne[3];
+
+    const int64_t tile_n = ggml_conv_2d_winograd_tile_n(dst, nth);
+
+    const bool cacheable = ggml_cpu_weight_cacheable(kernel);
+
+    GGML_ASSERT(params->wsize >= CACHE_LINE_SIZE + sizeof(float)*36*((cacheable ? 0 : c_out*c_in) + tile_n*c_in + tile_n*c_out));
+
+    // the first thread finds the transformed kernel and shares it with the others in the first cache line of the work buffer
+    struct winograd_kernel {
+        float * U;    // [36, OC, IC] transformed kernel
+        bool    fill; // U has to be computed
+    };
+    winograd_kernel * shared = (winograd_kernel *) params->wdata;
+
+    float * V = (float *) ((char *) params->wdata + CACHE_LINE_SIZE); // [36, nt, IC] transformed input of the current tiles
+    float * M = V + 36*tile_n*c_in;                                    // [36, nt, OC] element-wise products
+
+    // held by the first thread until the other threads are done with U
+    std::shared_ptr<ggml_cpu_weight_cache_entry> entry;
+
+    if (ith == 0) {
+        if (cacheable) {
+            entry = ggml_cpu_weight_cache_get(kernel);
+            shared->fill = entry == nullptr;
+            if (shared->fill) {
+                entry = std::make_shared<ggml_cpu_weight_cache_entry>();
+                entry->buffer     = kernel->buffer;
+                entry->generation = kernel->buffer->generation;
+                entry->data       = kernel->data;
+                entry->type       = kernel->type;
+                memcpy(entry->ne, kernel->ne, sizeof(entry->ne));
+                entry->U.resize(36*c_out*c_in);
+            }
+            shared->U = entry->U.data();
+        } else {
+            shared->U    = M + 36*tile_n*c_out;
+            shared->fill = true;
+        }
+    }
+
+    ggml_barrier(params->threadpool);
+
+    float *    U    = shared->U;
+    const bool fill = shared->fill;
+
+    // kernel transform: U = G g G^T
+    if (fill) {
+        const int64_t n  = c_out*c_in;
+        const int64_t dn = (n + nth - 1)/nth;
+        const int64_t i0 = std::min(ith*dn, n);
+        const int64_t i1 = std::min(i0 + dn, n);
+
+        const ggml_fp16_t * k16 = (const ggml_fp16_t *) kernel->data;
+        const float       * k32 = (const float       *) kernel->data;
+
+        for (int64_t i = i0; i < i1; ++i) {
+            float g[9];
+            for (int j = 0; j < 9; ++j) {
+                g[j] = kernel->type == GGML_TYPE_F16 ? GGML_CPU_FP16_TO_FP32(k16[i*9 + j]) : k32[i*9 + j];
+            }
+
+            float t[6*3]; // G g
+            for (int c = 0; c < 3; ++c) {
+                ggml_winograd_g(g + c, 3, t + c, 3);
+            }
+
+            float u[6*6];
+            for (int r = 0; r < 6; ++r) {
+                ggml_winograd_g(t + r*3, 1, u + r*6, 1);
+            }
+
+            // i = oc*IC + ic
+            for (int xi = 0; xi < 36; ++xi) {
+                U[xi*n + i] = u[xi];
+            }
+        }
+
+        ggml_barrier(params->threadpool);
+
+        if (ith == 0 && cacheable) {
+            ggml_cpu_weight_cache_put(entry);
+        }
+    }
+
+    for (int64_t t0 = 0; t0 < n_tiles; t0 += tile_n) {
+        const int64_t nt = std::min(tile_n, n_tiles - t0);
+
+        // input transform: V = B^T d B
+        {
+            const int64_t n  = nt*c_in;
+            const int64_t dn = (n + nth - 1)/nth;
+            const int64_t i0 = std::min(ith*dn, n);
+            const int64_t i1 = std::min(i0 + dn, n);
+
+            for (int64_t i = i0; i < i1; ++i) {
+                const int64_t it = i/c_in;
+                const int64_t ic = i - it*c_in;
+
+                const int64_t tg = t0 + it;
+                const int64_t in = tg/(tiles_x*tiles_y);
+                const int64_t ty = (tg - in*tiles_x*tiles_y)/tiles_x;
+                const int64_t tx = tg%tiles_x;
+
+                const int64_t sx0 = tx*4 - pad_x;
+                const int64_t sy0 = ty*4 - pad_y;
+
+                const char * src_base = (const char *) src->data + ic*src->nb[2] + in*src->nb[3];
+
+                float d[6*6];
+                for (int r = 0; r < 6; ++r) {
+                    const int64_t sy = sy0 + r;
+                    for (int c = 0; c < 6; ++c) {
+                        const int64_t sx = sx0 + c;
+                        d[r*6 + c] = (sy < 0 || sy >= src_h || sx < 0 || sx >= src_w) ? 0.0f :
+                            *(const float *) (src_base + sx*src->nb[0] + sy*src->nb[1]);
+                    }
+                }
+
+                float t[6*6]; // B^T d
+                for (int c = 0; c < 6; ++c) {
+                    ggml_winograd_bt(d + c, 6, t + c, 6);
+                }
+
+                float v[6*6];
+                for (int r = 0; r < 6; ++r) {
+                    ggml_winograd_bt(t + r*6, 1, v + r*6, 1);
+                }
+
+                for (int xi = 0; xi < 36; ++xi) {
+                    V[(xi*nt + it)*c_in + ic] = v[xi];
+                }
+            }
+        }
+
+        ggml_barrier(params->threadpool);
+
+        // M[xi] = V[xi] x U[xi]^T
+        ggml_call_mul_mat(GGML_TYPE_F32, params, nt, c_out, c_in, V, U, M, c_out, 36);
+
+        ggml_barrier(params->threadpool);
+
+        // output transform: Y = A^T m A
+        {
+            const int64_t n  = nt*c_out;
+            const int64_t dn = (n + nth - 1)/nth;
+            const int64_t i0 = std::min(ith*dn, n);
+            const int64_t i1 = std::min(i0 + dn, n);
+
+            for (int64_t i = i0; i < i1; ++i) {
+                const int64_t it = i/c_out;
+                const int64_t oc = i - it*c_out;
+
+                const int64_t tg = t0 + it;
+                const int64_t in = tg/(tiles_x*tiles_y);
+                const int64_t ty = (tg - in*tiles_x*tiles_y)/tiles_x;
+                const int64_t tx = tg%tiles_x;
+
+                float m[6*6];
+                for (int xi = 0; xi < 36; ++xi) {
+                    m[xi] = M[(xi*nt + it)*c_out + oc];
+                }
+
+                float t[4*6]; // A^T m
+                for (int c = 0; c < 6; ++c) {
+                    ggml_winograd_at(m + c, 6, t + c, 6);
+                }
+
+                float y[4*4];
+                for (int r = 0; r < 4; ++r) {
+                    ggml_winograd_at(t + r*6, 1, y + r*4, 1);
+                }
+
+                char * dst_base = (char *) dst->data + oc*dst->nb[2] + in*dst->nb[3];
+
+                for (int r = 0; r < 4 && ty*4 + r < dst_h; ++r) {
+                    float * dst_row = (float *) (dst_base + (ty*4 + r)*dst->nb[1]) + tx*4;
+                    for (int c = 0; c < 4 && tx*4 + c < dst_w; ++c) {
+                        dst_row[c] = y[r*4 + c];
+                    }
+                }
+            }
+        }
+
+        // M and V are reused by the next tiles
+        ggml_barrier(params->threadpool);
+    }
+}
+
+void ggml_compute_forward_conv_2d(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+    const ggml_tensor * src1 = dst->src[1];
+
+    if (ggml_conv_2d_use_winograd(dst)) {
+        ggml_compute_forward_conv_2d_winograd(params, dst);
+        return;
+    }
+
+    ggml_compute_forward_conv_2d_impl(params, src0, src1, dst, src0->type);
+}
+
+// ggml_compute_forward_conv_3d
+
+static void ggml_compute_forward_conv_3d_impl(const ggml_compute_params * params,
+                                              const ggml_tensor *         kernel,
+                                              const ggml_tensor *         src,
+                                              ggml_tensor *               dst,
+                                              ggml_type                   kernel_type) {
+
+    GGML_ASSERT(ggml_is_contiguous(kernel));
+    GGML_ASSERT(kernel_type == GGML_TYPE_F16 || kernel_type == GGML_TYPE_F32);
+    GGML_ASSERT(kernel->type == kernel_type);
+
+    const ggml_type_traits * traits = ggml_get_type_traits(kernel_type);
+
+    const int32_t s0 = dst->op_params[0];
+    const int32_t s1 = dst->op_params[1];
+    const int32_t s2 = dst->op_params[2];
+    const int32_t p0 = dst->op_params[3];
+    const int32_t p1 = dst->op_params[4];
+    const int32_t p2 = dst->op_params[5];
+    const int32_t d0 = dst->op_params[6];
+    const int32_t d1 = dst->op_params[7];
+    const int32_t d2 = dst->op_params[8];
+    const int32_t c  = dst->op_params[9];
+    const int32_t n  = dst->op_params[10];
+    const int32_t oc = dst->op_params[11];
+
+    const int64_t src_w = src->ne[0];
+    const int64_t src_h = src->ne[1];
+    const int64_t src_d = src->ne[2];
+    const int64_t knl_w = kernel->ne[0];
+    const int64_t knl_h = kernel->ne[1];
+    const int64_t knl_d = kernel->ne[2];
+    const int64_t dst_w = dst->ne[0];
+    const int64_t dst_h = dst->ne[1];
+    const int64_t dst_d = dst->ne[2];
+
+    const float * src_data = (float *) src->data;
+    void  * knl_data       = kernel->data;
+    float * dst_data       = (float *) dst->data;
+
+    const int64_t knl_n_per_channel = knl_w * knl_h * knl_d;
+    const int64_t knl_n_total       = knl_n_per_channel * c;
+    const int64_t patch_total       = n * dst_w * dst_h * dst_d;
+
+    const int64_t space_per_patch   = knl_n_total * traits->type_size + oc * sizeof(float);
+    const int64_t batch_size        = params->wsize / space_per_patch;
+    const int64_t patches_per_batch = batch_size > 8 ? (batch_size / 8) * 8 : batch_size;
+    const int64_t batch_n           = (patch_total + patches_per_batch - 1) / patches_per_batch;
+
+    GGML_ASSERT(patches_per_batch > 0 && batch_size >= 1);
+
+    void * tmp = params->wdata;
+
+    for (int64_t batch_i = 0; batch_i < batch_n; ++batch_i) {
+        const int64_t patch_start_batch = batch_i * patches_per_batch;
+        const int64_t patch_end_batch   = std::min(patch_start_batch + patches_per_batch, patch_total);
+        const int64_t patch_n_in_batch  = patch_end_batch - patch_start_batch;
+
+        const int64_t patch_per_thread  = (patch_n_in_batch + params->nth - 1) / params->nth;
+        const int64_t patch_start       = patch_start_batch + params->ith * patch_per_thread;
+        const int64_t patch_end         = std::min(patch_start + patch_per_thread, patch_end_batch);
+
+        for (int64_t p = patch_start; p < patch_end; ++p) {
+            const int64_t p_in_batch = p % (dst_w * dst_h * dst_d);
+            const int64_t p_in_depth = p_in_batch % (dst_w * dst_h);
+            const int64_t batch_idx  = p / (dst_w * dst_h * dst_d);
+            const int64_t dst_z      = p_in_batch / (dst_w * dst_h);
+            const int64_t dst_y      = p_in_depth / dst_w;
+            const int64_t dst_x      = p_in_depth % dst_w;
+
+            char * dst_row = (char *) tmp + (p % patches_per_batch) * knl_n_total * traits->type_size;
+
+            for (int64_t ic = 0; ic < c; ++ic) {
+                for (int64_t kz = 0; kz < knl_d; ++kz) {
+                    for (int64_t ky = 0; ky < knl_h; ++ky) {
+                        for (int64_t kx = 0; kx < knl_w; ++kx) {
+                            const int64_t sz = dst_z * s2 + kz * d2 - p2;
+                            const int64_t sy = dst_y * s1 + ky * d1 - p1;
+                            const int64_t sx = dst_x * s0 + kx * d0 - p0;
+
+                            int64_t dst_idx = ic * knl_n_per_channel + kz * (knl_h * knl_w) + ky * knl_w + kx;
+
+                            float src_val;
                             if (sz < 0 || sz >= src_d || sy < 0 || sy >= src_h || sx < 0 || sx >= src_w) {
                                 src_val = 0.0f;
                             } else {
@@ -6904,7 +7649,7 @@ static void ggml_compute_forward_conv_3d_impl(const ggml_compute_params * params
         ggml_barrier(params->threadpool);
 
         float * gemm_output = (float *) ((char *) tmp + patches_per_batch * knl_n_total * traits->type_size);
-        ggml_call_mul_mat(kernel_type, params, patch_n_in_batch, oc, knl_n_total, tmp, knl_data, gemm_output);
+        ggml_call_mul_mat(kernel_type, params, patch_n_in_batch, oc, knl_n_total, tmp, knl_data, gemm_output, oc, 1);
 
         ggml_barrier(params->threadpool);
 
@@ -7054,6 +7799,12 @@ struct ggml_conv_2d_dw_params {
     int dilation_y;
 };
 
+// range of kernel taps [k_begin, k_end) that land inside [0, size) for a window starting at base
+static void ggml_conv_2d_dw_tap_range(int64_t base, int64_t dilation, int64_t size, int64_t knl, int64_t & k_begin, int64_t & k_end) {
+    k_begin = base < 0 ? (-base + dilation - 1) / dilation : 0;
+    k_end   = size > base ? MIN(knl, (size - base + dilation - 1) / dilation) : 0;
+}
+
 static void ggml_compute_forward_conv_2d_dw_cwhn(
         const ggml_compute_params * params,
         const ggml_tensor * src,
@@ -7064,68 +7815,85 @@ static void ggml_compute_forward_conv_2d_dw_cwhn(
     const int64_t c = p.channels;
     const float * knl_data = (const float *)kernel->data;
 
-    const int64_t rows_total = p.dst_h * p.batch;
-    const int64_t rows_per_thread = (rows_total + params->nth - 1) / params->nth;
-    const int64_t row_start = params->ith * rows_per_thread;
-    const int64_t row_end = MIN(row_start + rows_per_thread, rows_total);
+    // split by output pixel so that small feature maps still use all threads
+    const int64_t pixels_total = p.dst_w * p.dst_h * p.batch;
+    const int64_t pixels_per_thread = (pixels_total + params->nth - 1) / params->nth;
+    const int64_t pixel_start = params->ith * pixels_per_thread;
+    const int64_t pixel_end = MIN(pixel_start + pixels_per_thread, pixels_total);
 
 #ifdef GGML_SIMD
     const int64_t pkg_size = GGML_F32_EPR;
     const int64_t pkg_count = c / pkg_size;
     const int64_t c_pkg_end = pkg_count * pkg_size;
+    const int64_t c_pkg4_end = (pkg_count / 4) * 4 * pkg_size;
 #else
     const int64_t c_pkg_end = 0;
 #endif
 
-    for (int64_t row = row_start; row < row_end; ++row) {
+    for (int64_t pixel = pixel_start; pixel < pixel_end; ++pixel) {
+        const int64_t row = pixel / p.dst_w;
+        const int64_t dst_x = pixel % p.dst_w;
         const int64_t dst_y = row % p.dst_h;
         const float * src_data = (const float *)src->data + (row / p.dst_h) * p.src_w * p.src_h * c;
-        for (int64_t dst_x = 0; dst_x < p.dst_w; ++dst_x) {
-            float * dst_data = (float *)dst->data + (row * p.dst_w + dst_x) * c;
-            const int64_t src_y_base = dst_y * p.stride_y - p.pad_y;
-            const int64_t src_x_base = dst_x * p.stride_x - p.pad_x;
+        float * dst_data = (float *)dst->data + pixel * c;
+        const int64_t src_y_base = dst_y * p.stride_y - p.pad_y;
+        const int64_t src_x_base = dst_x * p.stride_x - p.pad_x;
+
+        int64_t knl_y0, knl_y1;
+        int64_t knl_x0, knl_x1;
+        ggml_conv_2d_dw_tap_range(src_y_base, p.dilation_y, p.src_h, p.knl_h, knl_y0, knl_y1);
+        ggml_conv_2d_dw_tap_range(src_x_base, p.dilation_x, p.src_w, p.knl_w, knl_x0, knl_x1);
 
 #ifdef GGML_SIMD
-            // Vectorized loop
-            for (int64_t c_i = 0; c_i < c_pkg_end; c_i += pkg_size) {
-                GGML_F32_VEC sum = GGML_F32_VEC_ZERO;
-                for (int64_t knl_y = 0; knl_y < p.knl_h; ++knl_y) {
-                    const int64_t src_y = src_y_base + knl_y * p.dilation_y;
-                    if (src_y < 0 || src_y >= p.src_h) {
-                        continue;
-                    }
-                    for (int64_t knl_x = 0; knl_x < p.knl_w; ++knl_x) {
-                        const int64_t src_x = src_x_base + knl_x * p.dilation_x;
-                        if (src_x < 0 || src_x >= p.src_w) {
-                            continue;
-                        }
-                        GGML_F32_VEC k = GGML_F32_VEC_LOAD(knl_data + (knl_y * p.knl_w + knl_x) * c + c_i);
-                        GGML_F32_VEC s = GGML_F32_VEC_LOAD(src_data + (src_y * p.src_w + src_x) * c + c_i);
-                        sum = GGML_F32_VEC_FMA(sum, k, s);
-                    }
+        // Vectorized loop, four independent accumulators to hide the FMA latency
+        for (int64_t c_i = 0; c_i < c_pkg4_end; c_i += 4*pkg_size) {
+            GGML_F32_VEC sum0 = GGML_F32_VEC_ZERO;
+            GGML_F32_VEC sum1 = GGML_F32_VEC_ZERO;
+            GGML_F32_VEC sum2 = GGML_F32_VEC_ZERO;
+            GGML_F32_VEC sum3 = GGML_F32_VEC_ZERO;
+            for (int64_t knl_y = knl_y0; knl_y < knl_y1; ++knl_y) {
+                const int64_t src_y = src_y_base + knl_y * p.dilation_y;
+                for (int64_t knl_x = knl_x0; knl_x < knl_x1; ++knl_x) {
+                    const int64_t src_x = src_x_base + knl_x * p.dilation_x;
+                    const float * k = knl_data + (knl_y * p.knl_w + knl_x) * c + c_i;
+                    const float * s = src_data + (src_y * p.src_w + src_x) * c + c_i;
+                    sum0 = GGML_F32_VEC_FMA(sum0, GGML_F32_VEC_LOAD(k + 0*pkg_size), GGML_F32_VEC_LOAD(s + 0*pkg_size));
+                    sum1 = GGML_F32_VEC_FMA(sum1, GGML_F32_VEC_LOAD(k + 1*pkg_size), GGML_F32_VEC_LOAD(s + 1*pkg_size));
+                    sum2 = GGML_F32_VEC_FMA(sum2, GGML_F32_VEC_LOAD(k + 2*pkg_size), GGML_F32_VEC_LOAD(s + 2*pkg_size));
+                    sum3 = GGML_F32_VEC_FMA(sum3, GGML_F32_VEC_LOAD(k + 3*pkg_size), GGML_F32_VEC_LOAD(s + 3*pkg_size));
+                }
+            }
+            GGML_F32_VEC_STORE(dst_data + c_i + 0*pkg_size, sum0);
+            GGML_F32_VEC_STORE(dst_data + c_i + 1*pkg_size, sum1);
+            GGML_F32_VEC_STORE(dst_data + c_i + 2*pkg_size, sum2);
+            GGML_F32_VEC_STORE(dst_data + c_i + 3*pkg_size, sum3);
+        }
+        for (int64_t c_i = c_pkg4_end; c_i < c_pkg_end; c_i += pkg_size) {
+            GGML_F32_VEC sum = GGML_F32_VEC_ZERO;
+            for (int64_t knl_y = knl_y0; knl_y < knl_y1; ++knl_y) {
+                const int64_t src_y = src_y_base + knl_y * p.dilation_y;
+                for (int64_t knl_x = knl_x0; knl_x < knl_x1; ++knl_x) {
+                    const int64_t src_x = src_x_base + knl_x * p.dilation_x;
+                    GGML_F32_VEC k = GGML_F32_VEC_LOAD(knl_data + (knl_y * p.knl_w + knl_x) * c + c_i);
+                    GGML_F32_VEC s = GGML_F32_VEC_LOAD(src_data + (src_y * p.src_w + src_x) * c + c_i);
+                    sum = GGML_F32_VEC_FMA(sum, k, s);
                 }
-                GGML_F32_VEC_STORE(dst_data + c_i, sum);
             }
+            GGML_F32_VEC_STORE(dst_data + c_i, sum);
+        }
 #endif
-            // Scalar loop
-            for (int64_t c_i = c_pkg_end; c_i < c; ++c_i) {
-                float sum = 0.0f;
-                for (int64_t knl_y = 0; knl_y < p.knl_h; ++knl_y) {
-                    const int64_t src_y = src_y_base + knl_y * p.dilation_y;
-                    if (src_y < 0 || src_y >= p.src_h) {
-                        continue;
-                    }
-                    for (int64_t knl_x = 0; knl_x < p.knl_w; ++knl_x) {
-                        const int64_t src_x = src_x_base + knl_x * p.dilation_x;
-                        if (src_x < 0 || src_x >= p.src_w) {
-                            continue;
-                        }
-                        sum += knl_data[(knl_y * p.knl_w + knl_x) * c + c_i]
-                             * src_data[(src_y * p.src_w + src_x) * c + c_i];
-                    }
+        // Scalar loop
+        for (int64_t c_i = c_pkg_end; c_i < c; ++c_i) {
+            float sum = 0.0f;
+            for (int64_t knl_y = knl_y0; knl_y < knl_y1; ++knl_y) {
+                const int64_t src_y = src_y_base + knl_y * p.dilation_y;
+                for (int64_t knl_x = knl_x0; knl_x < knl_x1; ++knl_x) {
+                    const int64_t src_x = src_x_base + knl_x * p.dilation_x;
+                    sum += knl_data[(knl_y * p.knl_w + knl_x) * c + c_i]
+                         * src_data[(src_y * p.src_w + src_x) * c + c_i];
                 }
-                dst_data[c_i] = sum;
             }
+            dst_data[c_i] = sum;
         }
     }
 }
@@ -7137,35 +7905,46 @@ static void ggml_compute_forward_conv_2d_dw_whcn(
         ggml_tensor * dst,
         const ggml_conv_2d_dw_params & p) {
 
-    const int64_t n = p.channels * p.batch;
+    // split by output row so that few channels still use all threads
+    const int64_t n = p.channels * p.batch * p.dst_h;
     const int64_t per_thread = (n + params->nth - 1) / params->nth;
     const int64_t start = params->ith * per_thread;
     const int64_t end = MIN(start + per_thread, n);
 
-    for (int64_t i = start; i < end; ++i) {
+    for (int64_t row = start; row < end; ++row) {
+        const int64_t i = row / p.dst_h;
+        const int64_t dst_y = row % p.dst_h;
         const float * knl_data = (const float *)kernel->data + (i % p.channels) * p.knl_w * p.knl_h;
         const float * src_data = (const float *)src->data + i * p.src_w * p.src_h;
-        float * dst_data = (float *)dst->data + i * p.dst_w * p.dst_h;
+        float * dst_data = (float *)dst->data + row * p.dst_w;
 
-        for (int64_t dst_y = 0; dst_y < p.dst_h; ++dst_y) {
-            for (int64_t dst_x = 0; dst_x < p.dst_w; ++dst_x) {
+        ggml_vec_set_f32(p.dst_w, dst_data, 0.0f);
 
-                float sum = 0.0f;
-                for (int64_t knl_y = 0; knl_y < p.knl_h; ++knl_y) {
-                    const int64_t src_y = dst_y * p.stride_y + knl_y * p.dilation_y - p.pad_y;
-                    if (src_y < 0 || src_y >= p.src_h) {
-                        continue;
-                    }
-                    for (int64_t knl_x = 0; knl_x < p.knl_w; ++knl_x) {
-                        const int64_t src_x = dst_x * p.stride_x + knl_x * p.dilation_x - p.pad_x;
-                        if (src_x < 0 || src_x >= p.src_w) {
-                            continue;
-                        }
-                        sum += knl_data[knl_y * p.knl_w + knl_x]
-                             * src_data[src_y * p.src_w + src_x];
+        const int64_t src_y_base = dst_y * p.stride_y - p.pad_y;
+
+        int64_t knl_y0, knl_y1;
+        ggml_conv_2d_dw_tap_range(src_y_base, p.dilation_y, p.src_h, p.knl_h, knl_y0, knl_y1);
+
+        for (int64_t knl_y = knl_y0; knl_y < knl_y1; ++knl_y) {
+            const float * src_row = src_data + (src_y_base + knl_y * p.dilation_y) * p.src_w;
+            for (int64_t knl_x = 0; knl_x < p.knl_w; ++knl_x) {
+                const float k = knl_data[knl_y * p.knl_w + knl_x];
+                const int64_t src_x_off = knl_x * p.dilation_x - p.pad_x;
+
+                // outputs whose tap lands inside the source row
+                const int64_t dst_x0 = src_x_off < 0 ? (-src_x_off + p.stride_x - 1) / p.stride_x : 0;
+                const int64_t dst_x1 = p.src_w > src_x_off ? MIN(p.dst_w, (p.src_w - src_x_off + p.stride_x - 1) / p.stride_x) : 0;
+                if (dst_x0 >= dst_x1) {
+                    continue;
+                }
+
+                if (p.stride_x == 1) {
+                    ggml_vec_mad_f32(dst_x1 - dst_x0, dst_data + dst_x0, src_row + dst_x0 + src_x_off, k);
+                } else {
+                    for (int64_t dst_x = dst_x0; dst_x < dst_x1; ++dst_x) {
+                        dst_data[dst_x] += k * src_row[dst_x * p.stride_x + src_x_off];
                     }
                 }
-                dst_data[dst_y * p.dst_w + dst_x] = sum;
             }
         }
     }
@@ -7207,6 +7986,83 @@ void ggml_compute_forward_conv_2d_dw(
     }
 }
 
+// reduces windows of k values with stride s and padding p along a row of n values
+// windows that are partially outside of the row only see the values inside, the average is still taken over k_div
+static void ggml_pool_row_f32(
+        const ggml_op_pool op,
+        float * dst,
+        const int64_t n_dst,
+        const float * x,
+        const int64_t n,
+        const int k,
+        const int s,
+        const int p,
+        const int k_div) {
+
+    // outputs whose whole window is inside the row
+    const int64_t o_begin = MIN(n_dst, (p + s - 1) / s);
+    const int64_t o_end   = MAX(o_begin, MIN(n_dst, n + p >= k ? (n + p - k) / s + 1 : 0));
+
+    const auto reduce_edge = [&](int64_t o) {
+        const int64_t j0 = MAX(o * s - p, 0);
+        const int64_t j1 = MIN(o * s - p + k, n);
+        float acc = op == GGML_OP_POOL_MAX ? -FLT_MAX : 0.0f;
+        for (int64_t j = j0; j < j1; ++j) {
+            switch (op) {
+                case GGML_OP_POOL_AVG:                   acc += x[j]; break;
+                case GGML_OP_POOL_MAX: if (x[j] > acc)   acc  = x[j]; break;
+                case GGML_OP_POOL_COUNT: GGML_ABORT("fatal error");
+            }
+        }
+        dst[o] = op == GGML_OP_POOL_AVG ? acc / k_div : acc;
+    };
+
+    for (int64_t o = 0; o < o_begin; ++o) {
+        reduce_edge(o);
+    }
+
+    const float * xp = x - p;
+    switch (op) {
+        case GGML_OP_POOL_AVG:
+            {
+                for (int64_t o = o_begin; o < o_end; ++o) {
+                    float acc = 0.0f;
+                    for (int j = 0; j < k; ++j) {
+                        acc += xp[o * s + j];
+                    }
+                    dst[o] = acc / k_div;
+                }
+            } break;
+        case GGML_OP_POOL_MAX:
+            {
+                if (k == 2 && s == 2) {
+                    // the common 2x2 window, written so that the compiler can vectorize it
+                    for (int64_t o = o_begin; o < o_end; ++o) {
+                        const float a = xp[2*o + 0];
+                        const float b = xp[2*o + 1];
+                        dst[o] = MAX(b, MAX(a, -FLT_MAX));
+                    }
+                } else {
+                    for (int64_t o = o_begin; o < o_end; ++o) {
+                        float acc = -FLT_MAX;
+                        for (int j = 0; j < k; ++j) {
+                            acc = MAX(xp[o * s + j], acc);
+                        }
+                        dst[o] = acc;
+                    }
+                }
+            } break;
+        case GGML_OP_POOL_COUNT:
+            {
+                GGML_ABORT("fatal error");
+            }
+    }
+
+    for (int64_t o = o_end; o < n_dst; ++o) {
+        reduce_edge(o);
+    }
+}
+
 // ggml_compute_forward_pool_1d_sk_p0
 
 static void ggml_compute_forward_pool_1d_sk_p0(
@@ -7219,43 +8075,36 @@ static void ggml_compute_forward_pool_1d_sk_p0(
 
     assert(src->type == GGML_TYPE_F32 || src->type == GGML_TYPE_F16);
 
-    if (params->ith != 0) {
-        return;
-    }
+    const int ith = params->ith;
+    const int nth = params->nth;
 
-    const char * cdata = (const char *)src->data;
-    const char * const data_end = cdata + ggml_nbytes(src);
-    float * drow = (float *)dst->data;
+    const int64_t ne00 = src->ne[0];
+    const int64_t ne01 = src->ne[1];
+    const int64_t ne02 = src->ne[2];
 
     const int64_t rs = dst->ne[0];
 
-    while (cdata < data_end) {
-        const void * srow = (const void *)cdata;
-        int j = 0;
-        for (int64_t i = 0; i < rs; ++i) {
-            switch (op) {
-                case GGML_OP_POOL_AVG:   drow[i] = 0;        break;
-                case GGML_OP_POOL_MAX:   drow[i] = -FLT_MAX; break;
-                case GGML_OP_POOL_COUNT: GGML_ABORT("fatal error");
-            }
-            for (int ki = 0; ki < k; ++ki) {
-                const float srow_j = (src->type == GGML_TYPE_F32) ? ((const float*)srow)[j] : GGML_CPU_FP16_TO_FP32(((const ggml_fp16_t*)srow)[j]);
-                switch (op) {
-                    case GGML_OP_POOL_AVG:                         drow[i] += srow_j; break;
-                    case GGML_OP_POOL_MAX:   if (srow_j > drow[i]) drow[i]  = srow_j; break;
-                    case GGML_OP_POOL_COUNT:                       GGML_ABORT("fatal error");
-                }
-                ++j;
-            }
-            switch (op) {
-                case GGML_OP_POOL_AVG:         drow[i] /= k; break;
-                case GGML_OP_POOL_MAX:                       break;
-                case GGML_OP_POOL_COUNT: GGML_ABORT("fatal error");
-            }
+    const int64_t nr  = ggml_nrows(src);
+    const int64_t dr  = (nr + nth - 1)/nth;
+    const int64_t ir0 = dr*ith;
+    const int64_t ir1 = MIN(ir0 + dr, nr);
+
+    float * wdata = (float *) params->wdata + (ne00 + CACHE_LINE_SIZE_F32) * ith;
+
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        const int64_t i3 = ir/(ne02*ne01);
+        const int64_t i2 = (ir - i3*ne02*ne01)/ne01;
+        const int64_t i1 = (ir - i3*ne02*ne01 - i2*ne01);
+
+        const char * srow = (const char *) src->data + i1*src->nb[1] + i2*src->nb[2] + i3*src->nb[3];
+
+        const float * x = (const float *) srow;
+        if (src->type == GGML_TYPE_F16) {
+            ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) srow, wdata, ne00);
+            x = wdata;
         }
 
-        cdata += src->nb[1];
-        drow  += rs;
+        ggml_pool_row_f32(op, (float *) dst->data + ir*rs, rs, x, ne00, k, k, 0, k);
     }
 }
 
@@ -7286,10 +8135,6 @@ void ggml_compute_forward_pool_2d(
 
     assert(src->type == GGML_TYPE_F32 || src->type == GGML_TYPE_F16);
 
-    if (params->ith != 0) {
-        return;
-    }
-
     const int32_t * opts = (const int32_t *)dst->op_params;
     ggml_op_pool op = static_cast<ggml_op_pool>(opts[0]);
     const int k0 = opts[1];
@@ -7298,57 +8143,69 @@ void ggml_compute_forward_pool_2d(
     const int s1 = opts[4];
     const int p0 = opts[5];
     const int p1 = opts[6];
-    const char * cdata = (const char*)src->data;
-    const char * const data_end = cdata + ggml_nbytes(src);
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t iw = src->ne[0];
+    const int64_t ih = src->ne[1];
+    const int64_t nc = src->ne[2];
 
     const int64_t px = dst->ne[0];
     const int64_t py = dst->ne[1];
-    const int64_t pa = px * py;
-
-    float * dplane = (float *)dst->data;
 
     const int ka = k0 * k1;
-    const int offset0 = -p0;
-    const int offset1 = -p1;
 
-    while (cdata < data_end) {
-        for (int oy = 0; oy < py; ++oy) {
-            float * const drow = dplane + oy * px;
-            for (int ox = 0; ox < px; ++ox) {
-                float * const out =  drow + ox;
-                switch (op) {
-                    case GGML_OP_POOL_AVG:     *out = 0;        break;
-                    case GGML_OP_POOL_MAX:     *out = -FLT_MAX; break;
-                    case GGML_OP_POOL_COUNT: GGML_ABORT("fatal error");
-                }
+    // the window is separable: reduce the k1 input rows of an output row first (vectorized over the full width),
+    // then reduce that row horizontally with the k0 window
+    float * acc = (float *) params->wdata + (2*iw + CACHE_LINE_SIZE_F32) * ith;
+    float * cvt = acc + iw;
 
-                const int ix = offset0 + ox * s0;
-                const int iy = offset1 + oy * s1;
+    const int64_t nr  = py * nc * src->ne[3];
+    const int64_t dr  = (nr + nth - 1)/nth;
+    const int64_t ir0 = dr*ith;
+    const int64_t ir1 = MIN(ir0 + dr, nr);
 
-                for (int ky = 0; ky < k1; ++ky) {
-                    if (iy + ky < 0 || iy + ky >= src->ne[1]) continue;
-                    const void * srow = (const void *)(cdata + src->nb[1] * (iy + ky));
-                    for (int kx = 0; kx < k0; ++kx) {
-                        int j = ix + kx;
-                        if (j < 0 || j >= src->ne[0]) continue;
-                        const float srow_j = (src->type == GGML_TYPE_F32) ? ((const float*)srow)[j] : GGML_CPU_FP16_TO_FP32(((const ggml_fp16_t*)srow)[j]);
-                        switch (op) {
-                            case GGML_OP_POOL_AVG:                     *out += srow_j; break;
-                            case GGML_OP_POOL_MAX: if (srow_j > *out)  *out  = srow_j; break;
-                            case GGML_OP_POOL_COUNT:               GGML_ABORT("fatal error");
-                        }
-                    }
-                }
-                switch (op) {
-                    case GGML_OP_POOL_AVG:           *out /= ka; break;
-                    case GGML_OP_POOL_MAX:                       break;
-                    case GGML_OP_POOL_COUNT: GGML_ABORT("fatal error");
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        const int64_t oy    = ir % py;
+        const int64_t plane = ir / py;
+
+        const char * cdata = (const char *) src->data + (plane % nc)*src->nb[2] + (plane / nc)*src->nb[3];
+        float * drow = (float *) dst->data + ir*px;
+
+        const int64_t iy  = oy * s1 - p1;
+        const int64_t iy0 = MAX(iy, 0);
+        const int64_t iy1 = MIN(iy + k1, ih);
+
+        if (iy0 >= iy1) {
+            ggml_vec_set_f32(px, drow, op == GGML_OP_POOL_MAX ? -FLT_MAX : 0.0f);
+            continue;
+        }
+
+        for (int64_t y = iy0; y < iy1; ++y) {
+            const char * srow = cdata + y*src->nb[1];
+
+            const float * x = (const float *) srow;
+            if (src->type == GGML_TYPE_F16) {
+                ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) srow, y == iy0 ? acc : cvt, iw);
+                x = cvt;
+            }
+
+            if (y == iy0) {
+                if (src->type == GGML_TYPE_F32) {
+                    ggml_vec_cpy_f32(iw, acc, x);
                 }
+                continue;
+            }
+
+            switch (op) {
+                case GGML_OP_POOL_AVG:   ggml_vec_acc_f32    (iw, acc, x); break;
+                case GGML_OP_POOL_MAX:   ggml_vec_acc_max_f32(iw, acc, x); break;
+                case GGML_OP_POOL_COUNT: GGML_ABORT("fatal error");
             }
         }
 
-        cdata  += src->nb[2];
-        dplane += pa;
+        ggml_pool_row_f32(op, drow, px, acc, iw, k0, s0, p0, ka);
     }
 }
 
@@ -7850,6 +8707,120 @@ void ggml_compute_forward_timestep_embedding(
 
 // ggml_compute_forward_argsort
 
+// the rows are sorted as (key << 32 | index) pairs: the keys compare as unsigned integers in the same order as
+// the floats (descending order flips all the bits) and equal keys keep the order of their indices
+static inline uint64_t ggml_sort_pack(float x, int64_t j, bool desc) {
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    u = (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+    if (desc) {
+        u = ~u;
+    }
+    return ((uint64_t) u << 32) | (uint64_t) j;
+}
+
+static void ggml_sort_pack_row(uint64_t * dst, const float * x, int64_t j0, int64_t j1, bool desc) {
+    for (int64_t j = j0; j < j1; j++) {
+        dst[j] = ggml_sort_pack(x[j], j, desc);
+    }
+}
+
+// LSD radix sort of the keys: 3 passes of 11 bits
+#define GGML_SORT_RADIX_BITS   11
+#define GGML_SORT_RADIX_SIZE   (1 << GGML_SORT_RADIX_BITS)
+#define GGML_SORT_RADIX_PASSES 3
+
+// rows shorter than this are sorted with std::sort
+#define GGML_SORT_RADIX_MIN 4096
+
+// rows at least this long are sorted by all threads together when there are fewer rows than threads
+#define GGML_SORT_PARALLEL_MIN (1 << 15)
+
+static inline uint32_t ggml_sort_digit(uint64_t v, int pass) {
+    return (uint32_t) (v >> (32 + pass*GGML_SORT_RADIX_BITS)) & (GGML_SORT_RADIX_SIZE - 1);
+}
+
+// sorts the n pairs in a, using b as scratch, returns the buffer that holds the result
+static uint64_t * ggml_sort_radix(uint64_t * a, uint64_t * b, int64_t n) {
+    uint32_t hist[GGML_SORT_RADIX_PASSES][GGML_SORT_RADIX_SIZE] = {};
+
+    for (int64_t j = 0; j < n; j++) {
+        for (int p = 0; p < GGML_SORT_RADIX_PASSES; p++) {
+            hist[p][ggml_sort_digit(a[j], p)]++;
+        }
+    }
+
+    for (int p = 0; p < GGML_SORT_RADIX_PASSES; p++) {
+        uint32_t * h = hist[p];
+
+        // all the keys have the same digit
+        if (h[ggml_sort_digit(a[0], p)] == (uint32_t) n) {
+            continue;
+        }
+
+        uint32_t sum = 0;
+        for (int d = 0; d < GGML_SORT_RADIX_SIZE; d++) {
+            const uint32_t c = h[d];
+            h[d] = sum;
+            sum += c;
+        }
+
+        for (int64_t j = 0; j < n; j++) {
+            b[h[ggml_sort_digit(a[j], p)]++] = a[j];
+        }
+
+        std::swap(a, b);
+    }
+
+    return a;
+}
+
+// sorts the whole row with all the threads: each thread owns a segment of the row and the scatter offsets of
+// every digit are split between the threads in thread order, which keeps the sort stable
+static uint64_t * ggml_sort_radix_parallel(
+        const ggml_compute_params * params, uint64_t * a, uint64_t * b, uint32_t * hist, int64_t n, int64_t j0, int64_t j1) {
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    uint32_t * h = hist + ith*GGML_SORT_RADIX_SIZE;
+
+    for (int p = 0; p < GGML_SORT_RADIX_PASSES; p++) {
+        memset(h, 0, sizeof(uint32_t)*GGML_SORT_RADIX_SIZE);
+        for (int64_t j = j0; j < j1; j++) {
+            h[ggml_sort_digit(a[j], p)]++;
+        }
+
+        ggml_barrier(params->threadpool);
+
+        // the result is the same for all threads, so they all skip the same passes
+        uint32_t offs[GGML_SORT_RADIX_SIZE];
+        uint32_t sum  = 0;
+        bool     skip = false;
+        for (int d = 0; d < GGML_SORT_RADIX_SIZE; d++) {
+            uint32_t c = 0;
+            for (int t = 0; t < nth; t++) {
+                if (t == ith) {
+                    offs[d] = sum + c;
+                }
+                c += hist[t*GGML_SORT_RADIX_SIZE + d];
+            }
+            skip = skip || c == (uint32_t) n;
+            sum += c;
+        }
+
+        if (!skip) {
+            for (int64_t j = j0; j < j1; j++) {
+                b[offs[ggml_sort_digit(a[j], p)]++] = a[j];
+            }
+            std::swap(a, b);
+        }
+
+        ggml_barrier(params->threadpool);
+    }
+
+    return a;
+}
+
 static void ggml_compute_forward_argsort_f32(
     const ggml_compute_params * params,
     ggml_tensor * dst) {
@@ -7858,33 +8829,81 @@ static void ggml_compute_forward_argsort_f32(
 
     GGML_TENSOR_UNARY_OP_LOCALS
 
-    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb00 == sizeof(float));
+    GGML_ASSERT(nb0  == sizeof(int32_t));
 
     const int ith = params->ith;
     const int nth = params->nth;
 
     const int64_t nr = ggml_nrows(src0);
 
-    ggml_sort_order order = (ggml_sort_order) ggml_get_op_params_i32(dst, 0);
+    const bool desc = (ggml_sort_order) ggml_get_op_params_i32(dst, 0) == GGML_SORT_ORDER_DESC;
 
-    for (int64_t i = ith; i < nr; i += nth) {
-        int32_t * dst_data = (int32_t *)((char *) dst->data + i*nb1);
-        const float * src_data = (float *)((char *) src0->data + i*nb01);
+    if (nr < nth && ne00 >= GGML_SORT_PARALLEL_MIN) {
+        // few long rows: sort each of them with all the threads
+        uint64_t * a    = (uint64_t *) params->wdata;
+        uint64_t * b    = a + ne00;
+        uint32_t * hist = (uint32_t *) (b + ne00);
 
-        for (int64_t j = 0; j < ne0; j++) {
-            dst_data[j] = j;
-        }
+        GGML_ASSERT(params->wsize >= sizeof(uint64_t)*2*ne00 + sizeof(uint32_t)*GGML_SORT_RADIX_SIZE*nth);
 
-        // C doesn't have a functional sort, so we do a bubble sort instead
-        for (int64_t j = 0; j < ne0; j++) {
-            for (int64_t k = j + 1; k < ne0; k++) {
-                if ((order == GGML_SORT_ORDER_ASC  && src_data[dst_data[j]] > src_data[dst_data[k]]) ||
-                    (order == GGML_SORT_ORDER_DESC && src_data[dst_data[j]] < src_data[dst_data[k]])) {
-                    int32_t tmp = dst_data[j];
-                    dst_data[j] = dst_data[k];
-                    dst_data[k] = tmp;
-                }
+        const int64_t dj = (ne00 + nth - 1)/nth;
+        const int64_t j0 = MIN(dj*ith, ne00);
+        const int64_t j1 = MIN(j0 + dj, ne00);
+
+        for (int64_t ir = 0; ir < nr; ir++) {
+            const int64_t i3 = ir/(ne02*ne01);
+            const int64_t i2 = (ir - i3*ne02*ne01)/ne01;
+            const int64_t i1 = (ir - i3*ne02*ne01 - i2*ne01);
+
+            const float * x = (const float *) ((const char *) src0->data + i1*nb01 + i2*nb02 + i3*nb03);
+            int32_t     * y = (int32_t     *) ((char       *)  dst->data + i1*nb1  + i2*nb2  + i3*nb3);
+
+            ggml_sort_pack_row(a, x, j0, j1, desc);
+
+            const uint64_t * r = ggml_sort_radix_parallel(params, a, b, hist, ne00, j0, j1);
+
+            for (int64_t j = j0; j < j1; j++) {
+                y[j] = (int32_t) r[j];
             }
+
+            ggml_barrier(params->threadpool);
+        }
+
+        return;
+    }
+
+    // one row per thread at a time
+    if (ith >= nr) {
+        return;
+    }
+
+    const bool radix = ne00 >= GGML_SORT_RADIX_MIN;
+
+    GGML_ASSERT(params->wsize >= sizeof(uint64_t)*2*ne00*MIN(nr, nth));
+
+    uint64_t * a = (uint64_t *) params->wdata + 2*ne00*ith;
+    uint64_t * b = a + ne00;
+
+    for (int64_t ir = ith; ir < nr; ir += nth) {
+        const int64_t i3 = ir/(ne02*ne01);
+        const int64_t i2 = (ir - i3*ne02*ne01)/ne01;
+        const int64_t i1 = (ir - i3*ne02*ne01 - i2*ne01);
+
+        const float * x = (const float *) ((const char *) src0->data + i1*nb01 + i2*nb02 + i3*nb03);
+        int32_t     * y = (int32_t     *) ((char       *)  dst->data + i1*nb1  + i2*nb2  + i3*nb3);
+
+        ggml_sort_pack_row(a, x, 0, ne00, desc);
+
+        const uint64_t * r = a;
+        if (radix) {
+            r = ggml_sort_radix(a, b, ne00);
+        } else {
+            std::sort(a, a + ne00);
+        }
+
+        for (int64_t j = 0; j < ne00; j++) {
+            y[j] = (int32_t) r[j];
         }
     }
 }
@@ -7907,8 +8926,137 @@ void ggml_compute_forward_argsort(
     }
 }
 
+// ggml_compute_forward_top_k
+
+// moves the k smallest pairs of [a, a + n) to the front, the first k are sorted if sorted is set
+static void ggml_top_k_select(uint64_t * a, int64_t n, int64_t k, bool sorted) {
+    if (k < n) {
+        std::nth_element(a, a + k, a + n);
+    }
+    if (sorted) {
+        std::sort(a, a + MIN(k, n));
+    }
+}
+
+static void ggml_compute_forward_top_k_f32(
+    const ggml_compute_params * params,
+    ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+
+    GGML_TENSOR_UNARY_OP_LOCALS
+
+    GGML_ASSERT(nb00 == sizeof(float));
+    GGML_ASSERT(nb0  == sizeof(int32_t));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t nr = ggml_nrows(src0);
+    const int64_t k  = ggml_get_op_params_i32(dst, 0);
+
+    GGML_ASSERT(k == ne0 && k <= ne00);
+
+    if (nr < nth && ne00 >= GGML_SORT_PARALLEL_MIN) {
+        // few long rows: each thread selects the top k of its segment, the first thread merges the candidates
+        uint64_t * a    = (uint64_t *) params->wdata;
+        uint64_t * cand = a + ne00;
+
+        GGML_ASSERT(params->wsize >= sizeof(uint64_t)*(ne00 + k*nth));
+
+        const int64_t dj = (ne00 + nth - 1)/nth;
+        const int64_t j0 = MIN(dj*ith, ne00);
+        const int64_t j1 = MIN(j0 + dj, ne00);
+
+        for (int64_t ir = 0; ir < nr; ir++) {
+            const int64_t i3 = ir/(ne02*ne01);
+            const int64_t i2 = (ir - i3*ne02*ne01)/ne01;
+            const int64_t i1 = (ir - i3*ne02*ne01 - i2*ne01);
+
+            const float * x = (const float *) ((const char *) src0->data + i1*nb01 + i2*nb02 + i3*nb03);
+            int32_t     * y = (int32_t     *) ((char       *)  dst->data + i1*nb1  + i2*nb2  + i3*nb3);
+
+            ggml_sort_pack_row(a, x, j0, j1, true);
+            ggml_top_k_select(a + j0, j1 - j0, k, false);
+
+            // segments shorter than k are padded with pairs that are never selected
+            uint64_t * c = cand + k*ith;
+            const int64_t nc = MIN(k, j1 - j0);
+            memcpy(c, a + j0, sizeof(uint64_t)*nc);
+            std::fill(c + nc, c + k, UINT64_MAX);
+
+            ggml_barrier(params->threadpool);
+
+            if (ith == 0) {
+                ggml_top_k_select(cand, k*nth, k, true);
+                for (int64_t j = 0; j < k; j++) {
+                    y[j] = (int32_t) cand[j];
+                }
+            }
+
+            ggml_barrier(params->threadpool);
+        }
+
+        return;
+    }
+
+    if (ith >= nr) {
+        return;
+    }
+
+    GGML_ASSERT(params->wsize >= sizeof(uint64_t)*2*ne00*MIN(nr, nth));
+
+    uint64_t * a = (uint64_t *) params->wdata + 2*ne00*ith;
+
+    for (int64_t ir = ith; ir < nr; ir += nth) {
+        const int64_t i3 = ir/(ne02*ne01);
+        const int64_t i2 = (ir - i3*ne02*ne01)/ne01;
+        const int64_t i1 = (ir - i3*ne02*ne01 - i2*ne01);
+
+        const float * x = (const float *) ((const char *) src0->data + i1*nb01 + i2*nb02 + i3*nb03);
+        int32_t     * y = (int32_t     *) ((char       *)  dst->data + i1*nb1  + i2*nb2  + i3*nb3);
+
+        ggml_sort_pack_row(a, x, 0, ne00, true);
+        ggml_top_k_select(a, ne00, k, true);
+
+        for (int64_t j = 0; j < k; j++) {
+            y[j] = (int32_t) a[j];
+        }
+    }
+}
+
+void ggml_compute_forward_top_k(
+    const ggml_compute_params * params,
+    ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+
+    switch (src0->type) {
+        case GGML_TYPE_F32:
+            {
+                ggml_compute_forward_top_k_f32(params, dst);
+            } break;
+        default:
+            {
+                GGML_ABORT("fatal error");
+            }
+    }
+}
+
 // ggml_compute_forward_flash_attn_ext
 
+typedef void (*ggml_vec_mad_q_t)(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v);
+
+// V += v*x for the quantized V types that can be dequantized on the fly, nullptr for the others
+static ggml_vec_mad_q_t ggml_fa_v_mad_q(ggml_type type) {
+    switch (type) {
+        case GGML_TYPE_Q4_0: return ggml_vec_mad_q4_0;
+        case GGML_TYPE_Q5_0: return ggml_vec_mad_q5_0;
+        case GGML_TYPE_Q8_0: return ggml_vec_mad_q8_0;
+        default:             return nullptr;
+    }
+}
+
 static void ggml_compute_forward_flash_attn_ext_f16(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -7996,6 +9144,7 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     ggml_from_float_t const q_to_vec_dot   = ggml_get_type_traits_cpu(k_vec_dot_type)->from_float;
     ggml_vec_dot_t    const kq_vec_dot     = ggml_get_type_traits_cpu(k->type)->vec_dot;
     ggml_to_float_t   const v_to_float     = ggml_get_type_traits(v->type)->to_float;
+    ggml_vec_mad_q_t  const v_mad_q        = ggml_fa_v_mad_q(v->type);
 
     GGML_ASSERT((                            q_to_vec_dot) && "fattn: unsupported K-type");
     GGML_ASSERT((v->type == GGML_TYPE_F32 || v_to_float  ) && "fattn: unsupported V-type");
@@ -8013,7 +9162,7 @@ static void ggml_compute_forward_flash_attn_ext_f16(
         float S = 0.0f;      // sum
         float M = -INFINITY; // maximum KQ value
 
-        float       * VKQ32 = (float       *) params->wdata + ith*(1*DK + 2*DV + CACHE_LINE_SIZE_F32); // FP32 VKQ accumulator
+        float       * VKQ32 = (float       *) params->wdata + ith*(GGML_FA_WORK_SIZE(DK, DV) + CACHE_LINE_SIZE_F32); // FP32 VKQ accumulator
         float       * V32   =                 (VKQ32 + 1*DV); // (temporary) FP32 V buffer
         ggml_fp16_t * VKQ16 = (ggml_fp16_t *) (VKQ32 + 1*DV); // (temporary) FP16 VKQ accumulator
         ggml_fp16_t * Q_q   = (ggml_fp16_t *) (VKQ32 + 2*DV); // (temporary) buffer for Q converted to quantized/FP16
@@ -8048,102 +9197,383 @@ static void ggml_compute_forward_flash_attn_ext_f16(
 
             float s; // KQ value
 
-            const char * k_data = (const char *) k->data + ( ic*nbk1 + ik2*nbk2 + ik3*nbk3);
-            kq_vec_dot(DK, &s, 0, k_data, 0, Q_q, 0, 1);
+            const char * k_data = (const char *) k->data + ( ic*nbk1 + ik2*nbk2 + ik3*nbk3);
+            kq_vec_dot(DK, &s, 0, k_data, 0, Q_q, 0, 1);
+
+            s = s*scale; // scale KQ value
+
+            if (logit_softcap != 0.0f) {
+                s = logit_softcap*tanhf(s);
+            }
+
+            s += mv; // apply mask
+
+            const float Mold = M;
+
+            float ms = 1.0f; // upon new higher max val, scale VKQ and KQ sum with this value
+            float vs = 1.0f; // post-softmax KQ value, expf(s - M)
+
+            const char * v_data = ((const char *) v->data + (ic*nbv1 + iv2*nbv2 + iv3*nbv3));
+
+            if (v->type == GGML_TYPE_F16) {
+                if (s > M) {
+                    // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
+                    M = s;
+                    ms = expf(Mold - M);
+
+                    // V = V*expf(Mold - M)
+                    ggml_vec_scale_f16(DV, VKQ16, ms);
+                } else {
+                    // no new maximum, ms == 1.0f, vs != 1.0f
+                    vs = expf(s - M);
+                }
+
+                // V += v*expf(s - M)
+                ggml_vec_mad_f16(DV, VKQ16, (const ggml_fp16_t *) v_data, vs);
+            } else {
+                if (s > M) {
+                    // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
+                    M = s;
+                    ms = expf(Mold - M);
+
+                    // V = V*expf(Mold - M)
+                    ggml_vec_scale_f32(DV, VKQ32, ms);
+                } else {
+                    // no new maximum, ms == 1.0f, vs != 1.0f
+                    vs = expf(s - M);
+                }
+
+                // V += v*expf(s - M)
+                if (v_mad_q) {
+                    // dequantize on the fly, without the V32 round trip
+                    v_mad_q(DV, VKQ32, v_data, vs);
+                } else if (v_to_float) {
+                    v_to_float(v_data, V32, DV);
+                    ggml_vec_mad_f32(DV, VKQ32, V32, vs);
+                } else {
+                    // V is F32
+                    ggml_vec_mad_f32(DV, VKQ32, (const float *) v_data, vs);
+                }
+            }
+
+            S = S*ms + vs; // scale and increment sum with partial sum
+        }
+
+        if (v->type == GGML_TYPE_F16) {
+            for (int64_t d = 0; d < DV; ++d) {
+                VKQ32[d] = GGML_CPU_FP16_TO_FP32(VKQ16[d]);
+            }
+        }
+
+        // sinks
+        if (sinks) {
+            const float s = ((float *)((char *) sinks->data))[h];
+
+            float ms = 1.0f;
+            float vs = 1.0f;
+
+            if (s > M) {
+                ms = expf(M - s);
+                ggml_vec_scale_f32(DV, VKQ32, ms);
+            } else {
+                vs = expf(s - M);
+            }
+
+            S = S*ms + vs;
+        }
+
+        // V /= S
+        const float S_inv = S == 0.0f ? 0.0f : 1.0f/S;
+        ggml_vec_scale_f32(DV, VKQ32, S_inv);
+
+        // dst indices
+        const int i1 = iq1;
+        const int i2 = iq2;
+        const int i3 = iq3;
+
+        // original
+        //memcpy((char *) dst->data + (i1*nb1 + i2*nb2 + i3*nb3), V, nev0*sizeof(float));
+
+        // permute(0, 2, 1, 3)
+        memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ32, nb1);
+    }
+}
+
+// number of query rows processed together by the tiled kernel, 0 to process the rows one at a time
+// the query rows that share a KV head are split in blocks, small enough to give all threads some work
+static int64_t ggml_flash_attn_ext_tile_q(const ggml_tensor * dst, int nth) {
+    const ggml_tensor * q = dst->src[0];
+    const ggml_tensor * k = dst->src[1];
+    const ggml_tensor * v = dst->src[2];
+
+    // K and V have to be grouped the same way
+    if (q->ne[2]/k->ne[2] != q->ne[2]/v->ne[2] || q->ne[3]/k->ne[3] != q->ne[3]/v->ne[3]) {
+        return 0;
+    }
+
+    const int64_t rk2 = q->ne[2]/k->ne[2];
+
+    const int64_t nrg = q->ne[1]*rk2;              // query rows per KV head
+    const int64_t ng  = (q->ne[2]/rk2)*q->ne[3];  // number of KV heads
+
+    const int64_t bq = MIN(MIN(GGML_FA_TILE_Q, nrg), (nrg*ng + nth - 1)/nth);
+
+    return bq >= 2 ? bq : 0;
+}
+
+// query rows x KV rows tiles with online softmax
+// the K and V rows of a tile are read once for all the query rows of the block, which are all the heads that
+// share the KV head (GQA) for consecutive tokens, instead of once per query row
+static void ggml_compute_forward_flash_attn_ext_f16_tiled(
+        const ggml_compute_params * params,
+        ggml_tensor * dst,
+        int64_t BQ) {
+
+    const ggml_tensor * q     = dst->src[0];
+    const ggml_tensor * k     = dst->src[1];
+    const ggml_tensor * v     = dst->src[2];
+    const ggml_tensor * mask  = dst->src[3];
+    const ggml_tensor * sinks = dst->src[4];
+
+    GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nek, k,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbk, k,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nev, v,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbv, v,   nb)
+    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t DK = nek0;
+    const int64_t DV = nev0;
+
+    GGML_ASSERT(BQ >= 1 && BQ <= GGML_FA_TILE_Q);
+
+    // broadcast factors, the same for K and V
+    const int64_t rk2 = neq2/nek2;
+    const int64_t rk3 = neq3/nek3;
+
+    float scale         = 1.0f;
+    float max_bias      = 0.0f;
+    float logit_softcap = 0.0f;
+
+    memcpy(&scale,         (float *) dst->op_params + 0, sizeof(float));
+    memcpy(&max_bias,      (float *) dst->op_params + 1, sizeof(float));
+    memcpy(&logit_softcap, (float *) dst->op_params + 2, sizeof(float));
+
+    if (logit_softcap != 0) {
+        scale /= logit_softcap;
+    }
+
+    const uint32_t n_head      = neq2;
+    const uint32_t n_head_log2 = 1u << (uint32_t) floor(log2(n_head));
+
+    const float m0 = powf(2.0f, -(max_bias       ) / n_head_log2);
+    const float m1 = powf(2.0f, -(max_bias / 2.0f) / n_head_log2);
+
+    ggml_type         const k_vec_dot_type = ggml_get_type_traits_cpu(k->type)->vec_dot_type;
+    ggml_from_float_t const q_to_vec_dot   = ggml_get_type_traits_cpu(k_vec_dot_type)->from_float;
+    ggml_vec_dot_t    const kq_vec_dot     = ggml_get_type_traits_cpu(k->type)->vec_dot;
+    ggml_to_float_t   const v_to_float     = ggml_get_type_traits(v->type)->to_float;
+
+    GGML_ASSERT((                            q_to_vec_dot) && "fattn: unsupported K-type");
+    GGML_ASSERT((v->type == GGML_TYPE_F32 || v_to_float  ) && "fattn: unsupported V-type");
+
+    // F16 K: the dot products of a K row with several query rows are computed at once
+    const bool kq_unroll = k->type == GGML_TYPE_F16;
+
+    const size_t q_row_size = ggml_row_size(k_vec_dot_type, DK);
+    GGML_ASSERT(q_row_size <= DK*sizeof(float));
+
+    float * VKQ32 = (float *) params->wdata + ith*(GGML_FA_WORK_SIZE(DK, DV) + CACHE_LINE_SIZE_F32); // [BQ][DV] FP32 VKQ accumulators
+    float * KQ    = VKQ32 + GGML_FA_TILE_Q*DV;              // [BQ][GGML_FA_TILE_KV] KQ values, then softmax numerators
+    float * M     = KQ    + GGML_FA_TILE_Q*GGML_FA_TILE_KV; // [BQ] maximum KQ value
+    float * S     = M     + GGML_FA_TILE_Q;                 // [BQ] sum
+    float * V32   = S     + GGML_FA_TILE_Q;                 // [DV] (temporary) FP32 V row
+    char  * Q_q   = (char *) (V32 + DV);                    // [BQ][q_row_size] Q converted to the vec_dot type of K
+
+    const int64_t nrg  = neq1*rk2;            // query rows per KV head
+    const int64_t nhkv = neq2/rk2;            // KV heads per sequence
+    const int64_t nblk = (nrg + BQ - 1)/BQ;   // blocks per KV head
+
+    const int64_t n_items = nhkv*neq3*nblk;
+
+    int                 iq1s [GGML_FA_TILE_Q];
+    int                 iq2s [GGML_FA_TILE_Q];
+    float               slope[GGML_FA_TILE_Q];
+    const ggml_fp16_t * mp   [GGML_FA_TILE_Q];
+    int                 act  [GGML_FA_TILE_Q];
+
+    for (int64_t item = ith; item < n_items; item += nth) {
+        const int64_t g   = item/nblk;
+        const int64_t blk = item - g*nblk;
+
+        const int iq3 = g/nhkv;
+        const int ik2 = g - iq3*nhkv;
+        const int ik3 = iq3/rk3;
+
+        const int64_t r0 = blk*BQ;
+        const int     nq = MIN(BQ, nrg - r0);
+
+        // the query rows of the block: consecutive tokens, all the heads of the group for each token
+        for (int i = 0; i < nq; ++i) {
+            const int64_t r = r0 + i;
+
+            iq1s[i] = r/rk2;
+            iq2s[i] = ik2*rk2 + r%rk2;
+
+            const uint32_t h = iq2s[i];
+            slope[i] = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+            mp[i] = mask ? (ggml_fp16_t *)((char *) mask->data + iq1s[i]*mask->nb[1] + (iq2s[i]%mask->ne[2])*mask->nb[2] + (iq3%mask->ne[3])*mask->nb[3]) : NULL;
+
+            const float * pq = (const float *) ((char *) q->data + (iq1s[i]*nbq1 + iq2s[i]*nbq2 + iq3*nbq3));
+            q_to_vec_dot(pq, Q_q + i*q_row_size, DK);
+
+            memset(VKQ32 + i*DV, 0, DV*sizeof(float));
+            M[i] = -INFINITY;
+            S[i] = 0.0f;
+        }
+
+        for (int64_t ic0 = 0; ic0 < nek1; ic0 += GGML_FA_TILE_KV) {
+            const int nc = MIN(GGML_FA_TILE_KV, nek1 - ic0);
+
+            // KQ values of the tile, each K row is used for all the query rows
+            for (int j = 0; j < nc; ++j) {
+                const int64_t ic = ic0 + j;
+
+                int na = 0;
+                for (int i = 0; i < nq; ++i) {
+                    const float mv = mp[i] ? slope[i]*GGML_CPU_FP16_TO_FP32(mp[i][ic]) : 0.0f;
+                    KQ[i*GGML_FA_TILE_KV + j] = mv;
+                    if (mv != -INFINITY) {
+                        act[na++] = i;
+                    }
+                }
+
+                if (na == 0) {
+                    continue;
+                }
 
-            s = s*scale; // scale KQ value
+                char * k_data = (char *) k->data + (ic*nbk1 + ik2*nbk2 + ik3*nbk3);
 
-            if (logit_softcap != 0.0f) {
-                s = logit_softcap*tanhf(s);
-            }
+                for (int a = 0; a < na; ) {
+                    const int i = act[a];
 
-            s += mv; // apply mask
+                    float s[GGML_VEC_DOT_UNROLL];
+                    int   n = 1;
 
-            const float Mold = M;
+                    if (kq_unroll && a + GGML_VEC_DOT_UNROLL <= na && act[a + GGML_VEC_DOT_UNROLL - 1] == i + GGML_VEC_DOT_UNROLL - 1) {
+                        ggml_vec_dot_f16_unroll(DK, q_row_size, s, Q_q + i*q_row_size, (ggml_fp16_t *) k_data);
+                        n = GGML_VEC_DOT_UNROLL;
+                    } else {
+                        kq_vec_dot(DK, s, 0, k_data, 0, Q_q + i*q_row_size, 0, 1);
+                    }
 
-            float ms = 1.0f; // upon new higher max val, scale VKQ and KQ sum with this value
-            float vs = 1.0f; // post-softmax KQ value, expf(s - M)
+                    for (int u = 0; u < n; ++u) {
+                        float su = s[u]*scale;
 
-            const char * v_data = ((const char *) v->data + (ic*nbv1 + iv2*nbv2 + iv3*nbv3));
+                        if (logit_softcap != 0.0f) {
+                            su = logit_softcap*tanhf(su);
+                        }
 
-            if (v->type == GGML_TYPE_F16) {
-                if (s > M) {
-                    // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
-                    M = s;
-                    ms = expf(Mold - M);
+                        KQ[(i + u)*GGML_FA_TILE_KV + j] += su; // apply mask
+                    }
 
-                    // V = V*expf(Mold - M)
-                    ggml_vec_scale_f16(DV, VKQ16, ms);
-                } else {
-                    // no new maximum, ms == 1.0f, vs != 1.0f
-                    vs = expf(s - M);
+                    a += n;
                 }
+            }
 
-                // V += v*expf(s - M)
-                ggml_vec_mad_f16(DV, VKQ16, (const ggml_fp16_t *) v_data, vs);
-            } else {
-                if (s > M) {
-                    // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
-                    M = s;
-                    ms = expf(Mold - M);
+            // online softmax, the KQ values become expf(s - M)
+            for (int i = 0; i < nq; ++i) {
+                float * kq = KQ + i*GGML_FA_TILE_KV;
 
-                    // V = V*expf(Mold - M)
-                    ggml_vec_scale_f32(DV, VKQ32, ms);
-                } else {
-                    // no new maximum, ms == 1.0f, vs != 1.0f
-                    vs = expf(s - M);
+                float Mt = -INFINITY;
+                ggml_vec_max_f32(nc, &Mt, kq);
+
+                if (Mt == -INFINITY) {
+                    // the whole tile is masked for this row
+                    memset(kq, 0, nc*sizeof(float));
+                    continue;
                 }
 
-                // V += v*expf(s - M)
-                if (v_to_float) {
-                    v_to_float(v_data, V32, DV);
-                    ggml_vec_mad_f32(DV, VKQ32, V32, vs);
-                } else {
-                    // V is F32
-                    ggml_vec_mad_f32(DV, VKQ32, (const float *) v_data, vs);
+                const float Mold = M[i];
+                if (Mt > Mold) {
+                    // new maximum, scale VKQ and KQ sum with expf(Mold - M)
+                    M[i] = Mt;
+
+                    const float ms = expf(Mold - Mt);
+                    ggml_vec_scale_f32(DV, VKQ32 + i*DV, ms);
+                    S[i] *= ms;
                 }
+
+                S[i] += (float) ggml_vec_soft_max_f32(nc, kq, kq, M[i]);
             }
 
-            S = S*ms + vs; // scale and increment sum with partial sum
-        }
+            // V += v*expf(s - M), each V row is converted once for all the query rows
+            for (int j = 0; j < nc; ++j) {
+                const int64_t ic = ic0 + j;
 
-        if (v->type == GGML_TYPE_F16) {
-            for (int64_t d = 0; d < DV; ++d) {
-                VKQ32[d] = GGML_CPU_FP16_TO_FP32(VKQ16[d]);
+                const char  * v_data = (const char *) v->data + (ic*nbv1 + ik2*nbv2 + ik3*nbv3);
+                const float * v_row  = NULL;
+
+                for (int i = 0; i < nq; ++i) {
+                    const float vs = KQ[i*GGML_FA_TILE_KV + j];
+                    if (vs == 0.0f) {
+                        continue;
+                    }
+
+                    if (v_row == NULL) {
+                        if (v->type == GGML_TYPE_F16) {
+                            ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) v_data, V32, DV);
+                            v_row = V32;
+                        } else if (v_to_float) {
+                            v_to_float(v_data, V32, DV);
+                            v_row = V32;
+                        } else {
+                            // V is F32
+                            v_row = (const float *) v_data;
+                        }
+                    }
+
+                    ggml_vec_mad_f32(DV, VKQ32 + i*DV, v_row, vs);
+                }
             }
         }
 
-        // sinks
-        if (sinks) {
-            const float s = ((float *)((char *) sinks->data))[h];
+        for (int i = 0; i < nq; ++i) {
+            float * vkq = VKQ32 + i*DV;
 
-            float ms = 1.0f;
-            float vs = 1.0f;
+            const int iq1 = iq1s[i];
+            const int iq2 = iq2s[i];
 
-            if (s > M) {
-                ms = expf(M - s);
-                ggml_vec_scale_f32(DV, VKQ32, ms);
-            } else {
-                vs = expf(s - M);
-            }
+            // sinks
+            if (sinks) {
+                const float s = ((float *)((char *) sinks->data))[iq2];
 
-            S = S*ms + vs;
-        }
+                float ms = 1.0f;
+                float vs = 1.0f;
 
-        // V /= S
-        const float S_inv = S == 0.0f ? 0.0f : 1.0f/S;
-        ggml_vec_scale_f32(DV, VKQ32, S_inv);
+                if (s > M[i]) {
+                    ms = expf(M[i] - s);
+                    ggml_vec_scale_f32(DV, vkq, ms);
+                } else {
+                    vs = expf(s - M[i]);
+                }
 
-        // dst indices
-        const int i1 = iq1;
-        const int i2 = iq2;
-        const int i3 = iq3;
+                S[i] = S[i]*ms + vs;
+            }
 
-        // original
-        //memcpy((char *) dst->data + (i1*nb1 + i2*nb2 + i3*nb3), V, nev0*sizeof(float));
+            // V /= S
+            const float S_inv = S[i] == 0.0f ? 0.0f : 1.0f/S[i];
+            ggml_vec_scale_f32(DV, vkq, S_inv);
 
-        // permute(0, 2, 1, 3)
-        memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ32, nb1);
+            // permute(0, 2, 1, 3)
+            memcpy((char *) dst->data + (iq3*ne2*ne1 + iq2 + iq1*ne1)*nb1, vkq, nb1);
+        }
     }
 }
 
@@ -8155,7 +9585,12 @@ void ggml_compute_forward_flash_attn_ext(
         case GGML_PREC_F32:
             {
                 // uses F32 accumulators
-                ggml_compute_forward_flash_attn_ext_f16(params, dst);
+                const int64_t bq = ggml_flash_attn_ext_tile_q(dst, params->nth);
+                if (bq > 0) {
+                    ggml_compute_forward_flash_attn_ext_f16_tiled(params, dst, bq);
+                } else {
+                    ggml_compute_forward_flash_attn_ext_f16(params, dst);
+                }
             } break;
         default:
             {
@@ -8570,8 +10005,430 @@ void ggml_compute_forward_ssm_conv(
     }
 }
 
+// chunked scans
+//
+// ssm_scan (Mamba-2), rwkv_wkv6 and gla are all linear recurrences with a diagonal decay over a d_k x d_v state:
+//
+//   S_t = diag(g_t) S_{t-1} + k_t^T v_t
+//   o_t = q_t S_t                               (inclusive: gla, ssm_scan)
+//   o_t = q_t S_{t-1} + (q_t . u . k_t) v_t     (exclusive with a bonus u: rwkv_wkv6)
+//
+// for long sequences they are computed chunk by chunk: with P the prefix products of the decays inside a chunk,
+// the outputs are (Q . P) S_0 plus a masked intra-chunk attention A V, and the state at the end of the chunk is
+// diag(P_last) S_0 + K~^T V, all of them small matrix products
+// when there are fewer (sequence, head) pairs than threads, the sequences are also split in segments that are
+// scanned from a zero state and fixed up afterwards with the decayed state at the start of each segment
+
+// tokens per chunk
+#define GGML_SCAN_CHUNK 16
+
+// C[m][n] += A[m][k] B[k][n], all row-major
+static void ggml_scan_gemm(
+        int64_t m, int64_t n, int64_t k,
+        const float * GGML_RESTRICT a, int64_t lda,
+        const float * GGML_RESTRICT b, int64_t ldb,
+              float * GGML_RESTRICT c, int64_t ldc) {
+    int64_t i0 = 0;
+    int64_t n0 = 0;
+#if defined(GGML_SIMD) && !defined(__ARM_FEATURE_SVE) && !defined(__riscv_v_intrinsic)
+    // 4 x 2*EPR register tiles
+    n0 = n & ~(int64_t)(2*GGML_F32_EPR - 1);
+    for (; i0 + 4 <= m; i0 += 4) {
+        for (int64_t j = 0; j < n0; j += 2*GGML_F32_EPR) {
+            GGML_F32_VEC acc[4][2];
+            for (int r = 0; r < 4; ++r) {
+                acc[r][0] = GGML_F32_VEC_LOAD(c + (i0 + r)*ldc + j);
+                acc[r][1] = GGML_F32_VEC_LOAD(c + (i0 + r)*ldc + j + GGML_F32_EPR);
+            }
+            for (int64_t l = 0; l < k; ++l) {
+                const GGML_F32_VEC b0 = GGML_F32_VEC_LOAD(b + l*ldb + j);
+                const GGML_F32_VEC b1 = GGML_F32_VEC_LOAD(b + l*ldb + j + GGML_F32_EPR);
+                for (int r = 0; r < 4; ++r) {
+                    const GGML_F32_VEC av = GGML_F32_VEC_SET1(a[(i0 + r)*lda + l]);
+                    acc[r][0] = GGML_F32_VEC_FMA(acc[r][0], b0, av);
+                    acc[r][1] = GGML_F32_VEC_FMA(acc[r][1], b1, av);
+                }
+            }
+            for (int r = 0; r < 4; ++r) {
+                GGML_F32_VEC_STORE(c + (i0 + r)*ldc + j,                acc[r][0]);
+                GGML_F32_VEC_STORE(c + (i0 + r)*ldc + j + GGML_F32_EPR, acc[r][1]);
+            }
+        }
+    }
+#endif
+    // leftover columns of the tiled rows, then the leftover rows
+    for (int64_t i = 0; i < m; ++i) {
+        const int64_t j0 = i < i0 ? n0 : 0;
+        if (j0 == n) {
+            continue;
+        }
+        for (int64_t l = 0; l < k; ++l) {
+            ggml_vec_mad_f32(n - j0, c + i*ldc + j0, b + l*ldb + j0, a[i*lda + l]);
+        }
+    }
+}
+
+// per-thread scratch of a chunked scan, in floats
+static size_t ggml_scan_scratch_size(int64_t dk, int64_t dv) {
+    const int64_t L = GGML_SCAN_CHUNK;
+    // S + (Q, K, G, P, Q~, K~^T) + (V, O) + A + 2 decay rows, padded to a cache line
+    return GGML_PAD(dk*dv + L*(6*dk + 2*dv) + L*L + 2*dk, CACHE_LINE_SIZE_F32);
+}
+
+struct ggml_scan_scratch {
+    float * S;   // [dk][dv] running state
+    float * Q;   // [L][dk]
+    float * K;   // [L][dk]
+    float * G;   // [L][dk] decays
+    float * P;   // [L][dk] prefix products of the decays
+    float * Qd;  // [L][dk] decayed queries
+    float * KdT; // [dk][L] decayed keys, transposed
+    float * V;   // [L][dv]
+    float * O;   // [L][dv]
+    float * A;   // [L][L] intra-chunk scores
+    float * R;   // [dk]
+    float * D;   // [dk] decay since the start of the segment
+
+    ggml_scan_scratch(float * wdata, int64_t dk, int64_t dv) {
+        const int64_t L = GGML_SCAN_CHUNK;
+        S   = wdata;
+        Q   = S   + dk*dv;
+        K   = Q   + L*dk;
+        G   = K   + L*dk;
+        P   = G   + L*dk;
+        Qd  = P   + L*dk;
+        KdT = Qd  + L*dk;
+        V   = KdT + L*dk;
+        O   = V   + L*dv;
+        A   = O   + L*dv;
+        R   = A   + L*L;
+        D   = R   + dk;
+    }
+};
+
+// prefix products of the decays of the n tokens in w.G, and the decayed queries
+// Qd[t] = Q[t] . D . P[t] (inclusive) or Q[t] . D . P[t-1] (exclusive)
+static void ggml_scan_chunk_decay(const ggml_scan_scratch & w, int64_t n, int64_t dk, bool exclusive) {
+    ggml_vec_cpy_f32(dk, w.P, w.G);
+    for (int64_t t = 1; t < n; ++t) {
+        ggml_vec_mul_f32(dk, w.P + t*dk, w.P + (t - 1)*dk, w.G + t*dk);
+    }
+    for (int64_t t = 0; t < n; ++t) {
+        ggml_vec_mul_f32(dk, w.Qd + t*dk, w.Q + t*dk, w.D);
+        if (!exclusive) {
+            ggml_vec_mul_f32(dk, w.Qd + t*dk, w.Qd + t*dk, w.P + t*dk);
+        } else if (t > 0) {
+            ggml_vec_mul_f32(dk, w.Qd + t*dk, w.Qd + t*dk, w.P + (t - 1)*dk);
+        }
+    }
+}
+
+// intra-chunk scores, A[t][s] = sum_i Q[t][i] K[s][i] prod_{s < u <= t} G[u][i] (inclusive), up to t - 1 (exclusive)
+// the diagonal of the exclusive scans uses the bonus instead of the state
+static void ggml_scan_chunk_scores(const ggml_scan_scratch & w, int64_t n, int64_t dk, const float * bonus) {
+    const int64_t L = GGML_SCAN_CHUNK;
+    const bool exclusive = bonus != nullptr;
+
+    memset(w.A, 0, n*L*sizeof(float));
+    for (int64_t s = 0; s < n; ++s) {
+        if (exclusive) {
+            ggml_vec_mul_f32(dk, w.R, bonus, w.K + s*dk);
+            ggml_vec_dot_f32(dk, w.A + s*L + s, 0, w.Q + s*dk, 0, w.R, 0, 1);
+        } else {
+            ggml_vec_dot_f32(dk, w.A + s*L + s, 0, w.Q + s*dk, 0, w.K + s*dk, 0, 1);
+        }
+        ggml_vec_cpy_f32(dk, w.R, w.K + s*dk);
+
+        int64_t t = s + 1;
+#if defined(GGML_SIMD) && !defined(__ARM_FEATURE_SVE) && !defined(__riscv_v_intrinsic)
+        // decay R and take its dot product with Q[t] in a single pass
+        if (dk % GGML_F32_STEP == 0) {
+            for (; t < n; ++t) {
+                const float * q = w.Q + t*dk;
+                const float * g = exclusive ? w.G + (t - 1)*dk : w.G + t*dk;
+                GGML_F32_VEC sum[GGML_F32_ARR] = { GGML_F32_VEC_ZERO };
+                for (int64_t i = 0; i < dk; i += GGML_F32_STEP) {
+                    for (int64_t j = 0; j < GGML_F32_ARR; ++j) {
+                        const int64_t ij = i + j*GGML_F32_EPR;
+                        GGML_F32_VEC r = GGML_F32_VEC_LOAD(w.R + ij);
+                        // the exclusive scans decay R by the previous token
+                        if (!exclusive || t > s + 1) {
+                            r = GGML_F32_VEC_MUL(r, GGML_F32_VEC_LOAD(g + ij));
+                        }
+                        sum[j] = GGML_F32_VEC_FMA(sum[j], r, GGML_F32_VEC_LOAD(q + ij));
+                        GGML_F32_VEC_STORE(w.R + ij, r);
+                    }
+                }
+                GGML_F32_VEC_REDUCE(w.A[t*L + s], sum);
+            }
+        }
+#endif
+        for (; t < n; ++t) {
+            if (!exclusive || t > s + 1) {
+                ggml_vec_mul_f32(dk, w.R, w.R, w.G + (exclusive ? t - 1 : t)*dk);
+            }
+            ggml_vec_dot_f32(dk, w.A + t*L + s, 0, w.Q + t*dk, 0, w.R, 0, 1);
+        }
+    }
+}
+
+// one chunk of n tokens: writes the outputs to w.O and advances w.S and w.D
+static void ggml_scan_chunk(const ggml_scan_scratch & w, int64_t n, int64_t dk, int64_t dv, const float * bonus) {
+    const int64_t L = GGML_SCAN_CHUNK;
+    const bool exclusive = bonus != nullptr;
+
+    ggml_vec_set_f32(dk, w.D, 1.0f);
+    ggml_scan_chunk_decay(w, n, dk, exclusive);
+
+    // inter-chunk: O = Qd S
+    memset(w.O, 0, n*dv*sizeof(float));
+    ggml_scan_gemm(n, dv, dk, w.Qd, dk, w.S, dv, w.O, dv);
+
+    // intra-chunk: O += A V
+    ggml_scan_chunk_scores(w, n, dk, bonus);
+    ggml_scan_gemm(n, dv, n, w.A, L, w.V, dv, w.O, dv);
+
+    // state: S = diag(P[n-1]) S + Kd^T V, with Kd[s] = K[s] . prod_{s < u < n} G[u]
+    ggml_vec_set_f32(dk, w.R, 1.0f);
+    for (int64_t s = n - 1; s >= 0; --s) {
+        for (int64_t i = 0; i < dk; ++i) {
+            w.KdT[i*L + s] = w.K[s*dk + i]*w.R[i];
+        }
+        ggml_vec_mul_f32(dk, w.R, w.R, w.G + s*dk);
+    }
+    for (int64_t i = 0; i < dk; ++i) {
+        ggml_vec_scale_f32(dv, w.S + i*dv, w.P[(n - 1)*dk + i]);
+    }
+    ggml_scan_gemm(dk, dv, n, w.KdT, L, w.V, dv, w.S, dv);
+}
+
+// scan_t describes n_problems independent (sequence, head) scans of n_tokens each:
+//   void          load(p, t0, n, Q, K, V, G) const  packs n tokens starting at t0
+//   float *       out(p, t) const                   output row of token t
+//   void          state_in(p, S) const              initial state, as [dk][dv]
+//   void          state_out(p, S) const             final state
+//   const float * bonus(p) const                    nullptr for inclusive scans
+template <typename scan_t>
+static void ggml_scan_chunked(
+        const ggml_compute_params * params,
+        const scan_t & scan,
+        int64_t n_problems, int64_t n_tokens, int64_t dk, int64_t dv) {
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t L = GGML_SCAN_CHUNK;
+
+    // split the sequences in segments of whole chunks when there are fewer problems than threads
+    int64_t n_seg = 1;
+    if (n_problems < nth) {
+        n_seg = std::max<int64_t>(1, std::min<int64_t>(nth/n_problems, n_tokens/(2*L)));
+    }
+    const int64_t seg_len = (((n_tokens + n_seg - 1)/n_seg + L - 1)/L)*L;
+    n_seg = (n_tokens + seg_len - 1)/seg_len;
+
+    const int64_t n_units = n_problems*n_seg;
+
+    const ggml_scan_scratch w((float *) params->wdata + ith*ggml_scan_scratch_size(dk, dv), dk, dv);
+
+    // end states and decays of the segments
+    float * seg_S = (float *) params->wdata + nth*ggml_scan_scratch_size(dk, dv);
+    float * seg_D = seg_S + (n_seg > 1 ? n_units*dk*dv : 0);
+
+    for (int64_t u = ith; u < n_units; u += nth) {
+        const int64_t p  = u / n_seg;
+        const int64_t j  = u % n_seg;
+        const int64_t t0 = j*seg_len;
+        const int64_t t1 = std::min(n_tokens, t0 + seg_len);
+
+        const float * bonus = scan.bonus(p);
+
+        float * seg_decay = seg_D + u*dk;
+        if (j == 0) {
+            scan.state_in(p, w.S);
+        } else {
+            memset(w.S, 0, dk*dv*sizeof(float));
+        }
+        if (n_seg > 1) {
+            ggml_vec_set_f32(dk, seg_decay, 1.0f);
+        }
+
+        for (int64_t tc = t0; tc < t1; tc += L) {
+            const int64_t n = std::min(L, t1 - tc);
+            scan.load(p, tc, n, w.Q, w.K, w.V, w.G);
+            ggml_scan_chunk(w, n, dk, dv, bonus);
+            for (int64_t t = 0; t < n; ++t) {
+                ggml_vec_cpy_f32(dv, scan.out(p, tc + t), w.O + t*dv);
+            }
+            if (n_seg > 1) {
+                ggml_vec_mul_f32(dk, seg_decay, seg_decay, w.P + (n - 1)*dk);
+            }
+        }
+
+        if (n_seg == 1) {
+            scan.state_out(p, w.S);
+        } else {
+            memcpy(seg_S + u*dk*dv, w.S, dk*dv*sizeof(float));
+        }
+    }
+
+    if (n_seg == 1) {
+        return;
+    }
+
+    ggml_barrier(params->threadpool);
+
+    // chain the segments: the end state of segment j is diag(D_j) (end state of j - 1) + its own contribution
+    for (int64_t p = ith; p < n_problems; p += nth) {
+        for (int64_t j = 1; j < n_seg; ++j) {
+            const float * S_prev = seg_S + (p*n_seg + j - 1)*dk*dv;
+                  float * S_cur  = seg_S + (p*n_seg + j)*dk*dv;
+            const float * D_cur  = seg_D + (p*n_seg + j)*dk;
+            for (int64_t i = 0; i < dk; ++i) {
+                ggml_vec_mad_f32(dv, S_cur + i*dv, S_prev + i*dv, D_cur[i]);
+            }
+        }
+        scan.state_out(p, seg_S + (p*n_seg + n_seg - 1)*dk*dv);
+    }
+
+    ggml_barrier(params->threadpool);
+
+    // add the contribution of the state at the start of each segment: O[t] += (Q[t] . decay since the start) S_start
+    for (int64_t u = ith; u < n_units; u += nth) {
+        const int64_t p  = u / n_seg;
+        const int64_t j  = u % n_seg;
+        if (j == 0) {
+            continue;
+        }
+        const int64_t t0 = j*seg_len;
+        const int64_t t1 = std::min(n_tokens, t0 + seg_len);
+
+        const float * S_start = seg_S + (u - 1)*dk*dv;
+        const bool exclusive  = scan.bonus(p) != nullptr;
+
+        ggml_vec_set_f32(dk, w.D, 1.0f);
+        for (int64_t tc = t0; tc < t1; tc += L) {
+            const int64_t n = std::min(L, t1 - tc);
+            scan.load(p, tc, n, w.Q, w.K, w.V, w.G);
+            ggml_scan_chunk_decay(w, n, dk, exclusive);
+            memset(w.O, 0, n*dv*sizeof(float));
+            ggml_scan_gemm(n, dv, dk, w.Qd, dk, S_start, dv, w.O, dv);
+            for (int64_t t = 0; t < n; ++t) {
+                ggml_vec_acc_f32(dv, scan.out(p, tc + t), w.O + t*dv);
+            }
+            ggml_vec_mul_f32(dk, w.D, w.D, w.P + (n - 1)*dk);
+        }
+    }
+}
+
+static bool ggml_scan_use_chunked(const ggml_tensor * dst, int64_t & dk, int64_t & dv, int64_t & n_tokens) {
+    switch (dst->op) {
+        case GGML_OP_SSM_SCAN:
+            {
+                // only the scalar decay of Mamba-2
+                if (dst->src[3]->ne[0] != 1) {
+                    return false;
+                }
+                dk       = dst->src[0]->ne[0];
+                dv       = dst->src[0]->ne[1];
+                n_tokens = dst->src[1]->ne[2];
+            } break;
+        case GGML_OP_RWKV_WKV6:
+        case GGML_OP_GATED_LINEAR_ATTN:
+            {
+                const int64_t n_seqs = dst->src[dst->op == GGML_OP_RWKV_WKV6 ? 5 : 4]->ne[1];
+                dk       = dst->ne[0] / dst->src[1]->ne[1];
+                dv       = dk;
+                n_tokens = dst->src[1]->ne[2] / n_seqs;
+            } break;
+        default:
+            return false;
+    }
+    return n_tokens >= GGML_SCAN_CHUNK;
+}
+
+size_t ggml_compute_forward_scan_work_size(const ggml_tensor * dst, int n_threads) {
+    int64_t dk;
+    int64_t dv;
+    int64_t n_tokens;
+    if (!ggml_scan_use_chunked(dst, dk, dv, n_tokens)) {
+        return 0;
+    }
+    // scratch per thread, plus the end state and decay of up to one segment per thread
+    return n_threads*(ggml_scan_scratch_size(dk, dv) + dk*dv + dk)*sizeof(float);
+}
+
 // ggml_compute_forward_ssm_scan
 
+// Mamba-2 as a chunked scan: q = C, k = B, v = x*softplus(dt) and a scalar decay exp(softplus(dt)*A) per head
+// the state is stored as {d_state, dim}, which is the transpose of the [dk][dv] layout of the chunked scan
+struct ggml_ssm_scan_chunked {
+    const ggml_tensor * dst;
+    int64_t nc; // d_state
+    int64_t nr; // dim
+    int64_t nh; // n_head
+    int64_t ng; // n_group
+    int64_t nt; // tokens per sequence
+    size_t  s_off;
+
+    void load(int64_t p, int64_t t0, int64_t n, float * Q, float * K, float * V, float * G) const {
+        const ggml_tensor * src1 = dst->src[1];
+        const ggml_tensor * src2 = dst->src[2];
+        const ggml_tensor * src4 = dst->src[4];
+        const ggml_tensor * src5 = dst->src[5];
+
+        const int64_t i3 = p / nh;
+        const int64_t h  = p % nh;
+        const int64_t g  = h / (nh / ng); // repeat_interleave
+
+        const float A = ((const float *) dst->src[3]->data)[h];
+
+        for (int64_t t = 0; t < n; ++t) {
+            const int64_t i2 = t0 + t;
+            const float * x  = (const float *) ((const char *) src1->data + i2*(src1->nb[2]) + i3*(src1->nb[3]));
+            const float * dt = (const float *) ((const char *) src2->data + i2*(src2->nb[1]) + i3*(src2->nb[2]));
+            const float * B  = (const float *) ((const char *) src4->data + i2*(src4->nb[2]) + i3*(src4->nb[3]));
+            const float * C  = (const float *) ((const char *) src5->data + i2*(src5->nb[2]) + i3*(src5->nb[3]));
+
+            const float dt_soft_plus = ggml_softplus(dt[h]);
+
+            ggml_vec_cpy_f32(nc, Q + t*nc, C + g*nc);
+            ggml_vec_cpy_f32(nc, K + t*nc, B + g*nc);
+            ggml_vec_cpy_f32(nr, V + t*nr, x + h*nr);
+            ggml_vec_scale_f32(nr, V + t*nr, dt_soft_plus);
+            ggml_vec_set_f32(nc, G + t*nc, expf(dt_soft_plus * A));
+        }
+    }
+
+    float * out(int64_t p, int64_t t) const {
+        return (float *) dst->data + (p / nh)*(nt*nh*nr) + t*(nh*nr) + (p % nh)*nr;
+    }
+
+    void state_in(int64_t p, float * S) const {
+        const ggml_tensor * src0 = dst->src[0];
+        const int32_t * ids = (const int32_t *) dst->src[6]->data;
+        const float * s0 = (const float *) ((const char *) src0->data + ids[p / nh]*(src0->nb[3])) + (p % nh)*nr*nc;
+        for (int64_t i1 = 0; i1 < nr; ++i1) {
+            for (int64_t i0 = 0; i0 < nc; ++i0) {
+                S[i0*nr + i1] = s0[i1*nc + i0];
+            }
+        }
+    }
+
+    void state_out(int64_t p, const float * S) const {
+        float * s = (float *) ((char *) dst->data + (p / nh)*(dst->src[0]->nb[3]) + s_off) + (p % nh)*nr*nc;
+        for (int64_t i1 = 0; i1 < nr; ++i1) {
+            for (int64_t i0 = 0; i0 < nc; ++i0) {
+                s[i1*nc + i0] = S[i0*nr + i1];
+            }
+        }
+    }
+
+    const float * bonus(int64_t p) const {
+        GGML_UNUSED(p);
+        return nullptr;
+    }
+};
+
 static void ggml_compute_forward_ssm_scan_f32(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -8606,6 +10463,12 @@ static void ggml_compute_forward_ssm_scan_f32(
     GGML_ASSERT(src6->nb[0] == sizeof(int32_t));
     GGML_ASSERT(nh % ng == 0);
 
+    if (src3->ne[0] == 1 && nt >= GGML_SCAN_CHUNK && params->wsize >= ggml_compute_forward_scan_work_size(dst, nth)) {
+        const ggml_ssm_scan_chunked scan = { dst, nc, nr, nh, ng, nt, (size_t) s_off };
+        ggml_scan_chunked(params, scan, ns*nh, nt, nc, nr);
+        return;
+    }
+
     // heads per thread
     const int dh = (nh + nth - 1)/nth;
 
@@ -9174,6 +11037,55 @@ void ggml_compute_forward_add_rel_pos(
 
 // ggml_compute_forward_rwkv_wkv6
 
+// rwkv_wkv6 and gla as chunked scans, the state of each sequence is stored as [head][i][j]
+// gla scales the queries and has no bonus, rwkv_wkv6 reads the state before the update and adds the bonus u
+struct ggml_wkv_scan_chunked {
+    const float * k;
+    const float * v;
+    const float * q;     // r for rwkv_wkv6
+    const float * g;     // time_decay for rwkv_wkv6
+    const float * u;     // time_faaaa for rwkv_wkv6, nullptr for gla
+    const float * s_in;
+          float * s_out;
+          float * dst;
+    int64_t C;
+    int64_t heads;
+    int64_t head_size;
+    int64_t n_tokens;    // tokens per sequence
+    float   scale;
+
+    void load(int64_t p, int64_t t0, int64_t n, float * Q, float * K, float * V, float * G) const {
+        const int64_t seq = p / heads;
+        const int64_t h   = p % heads;
+        for (int64_t t = 0; t < n; ++t) {
+            const int64_t off = (seq*n_tokens + t0 + t)*C + h*head_size;
+            ggml_vec_cpy_f32(head_size, K + t*head_size, k + off);
+            ggml_vec_cpy_f32(head_size, V + t*head_size, v + off);
+            ggml_vec_cpy_f32(head_size, G + t*head_size, g + off);
+            ggml_vec_cpy_f32(head_size, Q + t*head_size, q + off);
+            if (scale != 1.0f) {
+                ggml_vec_scale_f32(head_size, Q + t*head_size, scale);
+            }
+        }
+    }
+
+    float * out(int64_t p, int64_t t) const {
+        return dst + ((p / heads)*n_tokens + t)*C + (p % heads)*head_size;
+    }
+
+    void state_in(int64_t p, float * S) const {
+        memcpy(S, s_in + (p / heads)*head_size*C + (p % heads)*head_size*head_size, head_size*head_size*sizeof(float));
+    }
+
+    void state_out(int64_t p, const float * S) const {
+        memcpy(s_out + (p / heads)*head_size*C + (p % heads)*head_size*head_size, S, head_size*head_size*sizeof(float));
+    }
+
+    const float * bonus(int64_t p) const {
+        return u ? u + (p % heads)*head_size : nullptr;
+    }
+};
+
 static void ggml_compute_forward_rwkv_wkv6_f32(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -9189,7 +11101,18 @@ static void ggml_compute_forward_rwkv_wkv6_f32(
     const int ith = params->ith;
     const int nth = params->nth;
 
-    if (ith >= HEADS) {
+    float * k =          (float *) dst->src[0]->data;
+    float * v =          (float *) dst->src[1]->data;
+    float * r =          (float *) dst->src[2]->data;
+    float * time_faaaa = (float *) dst->src[3]->data;
+    float * time_decay = (float *) dst->src[4]->data;
+
+    if (T / n_seqs >= GGML_SCAN_CHUNK && params->wsize >= ggml_compute_forward_scan_work_size(dst, nth)) {
+        GGML_ASSERT(C % HEADS == 0); // C must be divisible by HEADS
+        const ggml_wkv_scan_chunked scan = {
+            k, v, r, time_decay, time_faaaa, (const float *) dst->src[5]->data, state, dst_data, C, HEADS, head_size, T / n_seqs, 1.0f,
+        };
+        ggml_scan_chunked(params, scan, n_seqs*HEADS, T / n_seqs, head_size, head_size);
         return;
     }
 
@@ -9197,12 +11120,6 @@ static void ggml_compute_forward_rwkv_wkv6_f32(
     const int h_end = ((HEADS * (ith + 1)) / nth < HEADS) ?
                 (HEADS * (ith + 1)) / nth : HEADS;
 
-    float * k =          (float *) dst->src[0]->data;
-    float * v =          (float *) dst->src[1]->data;
-    float * r =          (float *) dst->src[2]->data;
-    float * time_faaaa = (float *) dst->src[3]->data;
-    float * time_decay = (float *) dst->src[4]->data;
-
     size_t t_stride = HEADS * head_size; // Same to C
 
     size_t h_stride = C / HEADS;
@@ -9406,7 +11323,17 @@ static void ggml_compute_forward_gla_f32(
     const int ith = params->ith;
     const int nth = params->nth;
 
-    if (ith >= HEADS) {
+    float * k = (float *) dst->src[0]->data;
+    float * v = (float *) dst->src[1]->data;
+    float * q = (float *) dst->src[2]->data;
+    float * g = (float *) dst->src[3]->data;
+
+    if (T / n_seqs >= GGML_SCAN_CHUNK && params->wsize >= ggml_compute_forward_scan_work_size(dst, nth)) {
+        GGML_ASSERT(C % HEADS == 0); // C must be divisible by HEADS
+        const ggml_wkv_scan_chunked scan = {
+            k, v, q, g, nullptr, (const float *) dst->src[4]->data, state, dst_data, C, HEADS, head_size, T / n_seqs, scale,
+        };
+        ggml_scan_chunked(params, scan, n_seqs*HEADS, T / n_seqs, head_size, head_size);
         return;
     }
 
@@ -9414,11 +11341,6 @@ static void ggml_compute_forward_gla_f32(
     const int h_end = ((HEADS * (ith + 1)) / nth < HEADS) ?
                 (HEADS * (ith + 1)) / nth : HEADS;
 
-    float * k = (float *) dst->src[0]->data;
-    float * v = (float *) dst->src[1]->data;
-    float * q = (float *) dst->src[2]->data;
-    float * g = (float *) dst->src[3]->data;
-
     size_t t_stride = HEADS * head_size; // Same to C
 
     size_t h_stride = C / HEADS;
@@ -9610,13 +11532,11 @@ static void ggml_compute_forward_rwkv_wkv7_f32(
     const int ith = params->ith;
     const int nth = params->nth;
 
-    if (ith >= HEADS) {
-        return;
-    }
-
-    const int h_start = (HEADS * ith) / nth;
-    const int h_end = ((HEADS * (ith + 1)) / nth < HEADS) ?
-                (HEADS * (ith + 1)) / nth : HEADS;
+    // the rows of the state of a head are independent, split all of them across the threads
+    const int64_t row_start = (HEADS * head_size * ith) / nth;
+    const int64_t row_end = (HEADS * head_size * (ith + 1)) / nth;
+    const int64_t h_start = row_start / head_size;
+    const int64_t h_end = (row_end + head_size - 1) / head_size;
 
     float * r = (float *) dst->src[0]->data;
     float * w = (float *) dst->src[1]->data;
@@ -9645,7 +11565,10 @@ static void ggml_compute_forward_rwkv_wkv7_f32(
                     int64_t t_h_offset = t_offset + h_offset;
                     int64_t h_2d_offset = h * h_stride_2d;
 
-                    for (int64_t i = 0; i < head_size; i++) {
+                    const int64_t i_start = std::max<int64_t>(row_start - h * head_size, 0);
+                    const int64_t i_end = std::min<int64_t>(row_end - h * head_size, head_size);
+
+                    for (int64_t i = i_start; i < i_end; i++) {
                         int64_t t_h_i_offset = t_h_offset + i;
                         int64_t h_2d_i_offset = h_2d_offset + i * h_stride;
 
@@ -9685,7 +11608,10 @@ static void ggml_compute_forward_rwkv_wkv7_f32(
                     int64_t t_h_offset = t_offset + h_offset;
                     int64_t h_2d_offset = h * h_stride_2d;
 
-                    for (int64_t ii = 0; ii < head_size; ii++) {
+                    const int64_t i_start = std::max<int64_t>(row_start - h * head_size, 0);
+                    const int64_t i_end = std::min<int64_t>(row_end - h * head_size, head_size);
+
+                    for (int64_t ii = i_start; ii < i_end; ii++) {
                         int64_t t_h_i_offset = t_h_offset + ii;
                         int64_t h_2d_i_offset = h_2d_offset + ii * h_stride;
 
@@ -9764,7 +11690,10 @@ static void ggml_compute_forward_rwkv_wkv7_f32(
                 int64_t t_h_offset = t_offset + h_offset;
                 int64_t h_2d_offset = h * h_stride_2d;
 
-                for (int64_t i = 0; i < head_size; i++) {
+                const int64_t i_start = std::max<int64_t>(row_start - h * head_size, 0);
+                const int64_t i_end = std::min<int64_t>(row_end - h * head_size, head_size);
+
+                for (int64_t i = i_start; i < i_end; i++) {
                     int64_t t_h_i_offset = t_h_offset + i;
                     int64_t h_2d_i_offset = h_2d_offset + i * h_stride;
 
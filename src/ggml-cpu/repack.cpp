@@ -175,6 +175,56 @@ void ggml_quantize_mat_q8_K_4x8_generic(const float * GGML_RESTRICT x, void * GG
     }
 }
 
+void ggml_quantize_mat_q8_K_4x4_generic(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k) {
+    assert(QK_K == 256);
+    assert(k % QK_K == 0);
+    const int nb = k / QK_K;
+
+    block_q8_Kx4 * GGML_RESTRICT y = (block_q8_Kx4 *) vy;
+
+    // scalar
+    const int blck_size_interleave = 4;
+    float srcv[4][QK_K];
+    float iscale[4];
+
+    for (int i = 0; i < nb; i++) {
+        for (int row_iter = 0; row_iter < 4; row_iter++) {
+            float amax = 0.0f; // absolute max
+            float max = 0;
+
+            for (int j = 0; j < QK_K; j++) {
+                srcv[row_iter][j] = x[row_iter * k + i * QK_K + j];
+                // Update the maximum value of the corresponding super block
+                if(amax < fabsf(srcv[row_iter][j])) {
+                    amax = fabsf(srcv[row_iter][j]);
+                    max = srcv[row_iter][j];
+                }
+            }
+
+            iscale[row_iter] = amax ? -127.f/max : 0;
+
+            y[i].d[row_iter] = amax ? 1/iscale[row_iter] : 0;
+        }
+
+        for (int j = 0; j < QK_K / 4; j++) {
+            y[i].bsums[j] = 0;
+        }
+
+        // Quants values are interleaved in sequence of four bytes from corresponding super blocks
+        // Bsums values are laid out as in ggml_quantize_mat_q8_K_4x8
+        for (int j = 0; j < QK_K * 4; j++) {
+            int src_offset = (j / (4 * blck_size_interleave)) * blck_size_interleave;
+            int src_id     = (j % (4 * blck_size_interleave)) / blck_size_interleave;
+            src_offset += (j % blck_size_interleave);
+            int index = ((src_offset >> 6) << 4) + (src_id << 2) + ((src_offset >> 4) & 3);
+
+            float x0 = srcv[src_id][src_offset] * iscale[src_id];
+            y[i].qs[j] = nearest_int(x0);
+            y[i].bsums[index] += y[i].qs[j];
+        }
+    }
+}
+
 } // extern "C"
 
 template <int64_t INTER_SIZE, ggml_type PARAM_TYPE>
@@ -192,6 +242,12 @@ template <> void ggml_quantize_mat_t<8, GGML_TYPE_Q8_0>(const float * GGML_RESTR
     ggml_quantize_mat_q8_0_4x8(x, vy, n_per_row);
 }
 
+template <> void ggml_quantize_mat_t<4, GGML_TYPE_Q8_K>(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t nrow, int64_t n_per_row) {
+    assert(nrow == 4);
+    UNUSED(nrow);
+    ggml_quantize_mat_q8_K_4x4(x, vy, n_per_row);
+}
+
 template <> void ggml_quantize_mat_t<8, GGML_TYPE_Q8_K>(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t nrow, int64_t n_per_row) {
     assert(nrow == 4);
     UNUSED(nrow);
@@ -562,6 +618,212 @@ void ggml_gemv_iq4_nl_8x8_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs
         for (int j = 0; j < ncols_interleaved; j++) s[x * ncols_interleaved + j] = sumf[j];
     }
 }
+void ggml_gemv_q8_0_8x4_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 4;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    UNUSED(bs);
+    UNUSED(nr);
+
+    float sumf[8];
+    int sumi;
+
+    const block_q8_0 * a_ptr = (const block_q8_0 *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+        for (int j = 0; j < ncols_interleaved; j++) sumf[j] = 0.0;
+        for (int l = 0; l < nb; l++) {
+            for (int j = 0; j < ncols_interleaved; j++) {
+                sumi = 0;
+                for (int k = 0; k < (qk / blocklen); k++) {
+                    for (int i = 0; i < blocklen; ++i) {
+                        sumi += b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] * a_ptr[l].qs[k * blocklen + i];
+                    }
+                }
+                sumf[j] += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j]) * GGML_CPU_FP16_TO_FP32(a_ptr[l].d);
+            }
+        }
+        for (int j = 0; j < ncols_interleaved; j++) s[x * ncols_interleaved + j] = sumf[j];
+    }
+}
+
+void ggml_gemv_q5_K_8x4_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 4;
+    static const uint32_t kmask1 = 0x3f3f3f3f;
+    static const uint32_t kmask2 = 0x0f0f0f0f;
+    static const uint32_t kmask3 = 0x03030303;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    UNUSED(bs);
+    UNUSED(nr);
+
+    float sumf[8];
+    float sum_minf[8];
+    uint32_t utmp[4];
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q5_Kx8 * b_ptr = (const block_q5_Kx8 *) vx + (x * nb);
+
+        for (int j = 0; j < ncols_interleaved; j++) {
+            sumf[j] = 0.0;
+            sum_minf[j] = 0.0;
+        }
+        for (int l = 0; l < nb; l++) {
+            for (int j = 0; j < ncols_interleaved; j++) {
+                for (int w = 0; w < 3; w++) {
+                    memcpy(&utmp[w], &b_ptr[l].scales[(w * ncols_interleaved + j) * 4], sizeof(uint32_t));
+                }
+                utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+                const uint32_t uaux = utmp[1] & kmask1;
+                utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+                utmp[2] = uaux;
+                utmp[0] &= kmask1;
+
+                const uint8_t * scales = (const uint8_t *) utmp;
+                const uint8_t * mins   = scales + 8;
+
+                // the low nibbles of the 32 bytes of quants of each pair of sub-blocks are the first sub-block
+                // the high nibbles the second one, bit 2*p and 2*p+1 of qh are their high bits
+                int sumi = 0;
+                for (int k = 0; k < (qk / (2 * blocklen)); k++) {
+                    const int p = k / 8;
+                    const int c = k % 8;
+                    int sumi1 = 0;
+                    int sumi2 = 0;
+                    for (int i = 0; i < blocklen; ++i) {
+                        const uint8_t q = b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i];
+                        const uint8_t h = b_ptr[l].qh[c * ncols_interleaved * blocklen + j * blocklen + i];
+                        const int v0 = (q & 0xF) | (((h >> (2 * p + 0)) & 1) << 4);
+                        const int v1 = (q >> 4)  | (((h >> (2 * p + 1)) & 1) << 4);
+                        sumi1 += v0 * a_ptr[l].qs[p * 64 + c * blocklen + i];
+                        sumi2 += v1 * a_ptr[l].qs[p * 64 + 32 + c * blocklen + i];
+                    }
+                    sumi += sumi1 * scales[2 * p] + sumi2 * scales[2 * p + 1];
+                }
+
+                int summ = 0;
+                for (int sb = 0; sb < 8; sb++) {
+                    summ += mins[sb] * (a_ptr[l].bsums[2 * sb] + a_ptr[l].bsums[2 * sb + 1]);
+                }
+
+                sumf[j]     += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j])    * a_ptr[l].d;
+                sum_minf[j] += summ * GGML_CPU_FP16_TO_FP32(b_ptr[l].dmin[j]) * a_ptr[l].d;
+            }
+        }
+        for (int j = 0; j < ncols_interleaved; j++) s[x * ncols_interleaved + j] = sumf[j] - sum_minf[j];
+    }
+}
+
+void ggml_gemv_q6_K_8x4_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 4;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    UNUSED(bs);
+    UNUSED(nr);
+
+    float sumf[8];
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+
+        for (int j = 0; j < ncols_interleaved; j++) sumf[j] = 0.0;
+        for (int l = 0; l < nb; l++) {
+            for (int j = 0; j < ncols_interleaved; j++) {
+                // as in block_q6_K, each chunk of qh holds the upper bits of the elements e, e + 32, e + 64 and e + 96
+                // of a half of the super-block, the lower bits of e and e + 64 are in chunk c of ql, of e + 32 and e + 96 in chunk c + 8
+                int sumi = 0;
+                for (int k = 0; k < (qk / (4 * blocklen)); k++) {
+                    const int h = k / 8;
+                    const int c = k % 8;
+                    int sumi_p[4] = { 0, 0, 0, 0 };
+                    for (int i = 0; i < blocklen; ++i) {
+                        const uint8_t q0 = b_ptr[l].ql[(h * 16 + c + 0) * ncols_interleaved * blocklen + j * blocklen + i];
+                        const uint8_t q1 = b_ptr[l].ql[(h * 16 + c + 8) * ncols_interleaved * blocklen + j * blocklen + i];
+                        const uint8_t qh = b_ptr[l].qh[k * ncols_interleaved * blocklen + j * blocklen + i];
+                        const int e = h * 128 + c * blocklen + i;
+                        sumi_p[0] += (((q0 & 0xF) | (((qh >> 0) & 3) << 4)) - 32) * a_ptr[l].qs[e +  0];
+                        sumi_p[1] += (((q1 & 0xF) | (((qh >> 2) & 3) << 4)) - 32) * a_ptr[l].qs[e + 32];
+                        sumi_p[2] += (((q0 >> 4)  | (((qh >> 4) & 3) << 4)) - 32) * a_ptr[l].qs[e + 64];
+                        sumi_p[3] += (((q1 >> 4)  | (((qh >> 6) & 3) << 4)) - 32) * a_ptr[l].qs[e + 96];
+                    }
+                    for (int p = 0; p < 4; p++) {
+                        sumi += sumi_p[p] * b_ptr[l].scales[(h * 8 + 2 * p + c / 4) * ncols_interleaved + j];
+                    }
+                }
+                sumf[j] += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j]) * a_ptr[l].d;
+            }
+        }
+        for (int j = 0; j < ncols_interleaved; j++) s[x * ncols_interleaved + j] = sumf[j];
+    }
+}
+
+void ggml_gemv_iq4_xs_8x4_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 4;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    UNUSED(bs);
+    UNUSED(nr);
+
+    float sumf[8];
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_iq4_xsx8 * b_ptr = (const block_iq4_xsx8 *) vx + (x * nb);
+
+        for (int j = 0; j < ncols_interleaved; j++) sumf[j] = 0.0;
+        for (int l = 0; l < nb; l++) {
+            for (int j = 0; j < ncols_interleaved; j++) {
+                uint32_t scales_l;
+                memcpy(&scales_l, &b_ptr[l].scales_l[j * 4], sizeof(uint32_t));
+                const uint16_t scales_h = b_ptr[l].scales_h[j];
+
+                int sumi = 0;
+                for (int ib = 0; ib < QK_K / 32; ib++) {
+                    const int ls = ((scales_l >> 4 * ib) & 0xf) | (((scales_h >> 2 * ib) & 3) << 4);
+                    int sumi1 = 0;
+                    for (int k = 0; k < (32 / (2 * blocklen)); k++) {
+                        for (int i = 0; i < blocklen; ++i) {
+                            const uint8_t q = b_ptr[l].qs[(ib * 4 + k) * ncols_interleaved * blocklen + j * blocklen + i];
+                            sumi1 += kvalues_iq4nl[q & 0xF] * a_ptr[l].qs[ib * 32 + k * blocklen + i] +
+                                     kvalues_iq4nl[q >> 4]  * a_ptr[l].qs[ib * 32 + k * blocklen + i + 16];
+                        }
+                    }
+                    sumi += sumi1 * (ls - 32);
+                }
+                sumf[j] += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j]) * a_ptr[l].d;
+            }
+        }
+        for (int j = 0; j < ncols_interleaved; j++) s[x * ncols_interleaved + j] = sumf[j];
+    }
+}
+
 
 void ggml_gemm_q4_0_4x4_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
     const int qk = QK8_0;
@@ -1006,59 +1268,283 @@ void ggml_gemm_iq4_nl_8x8_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs
         }
     }
 }
+void ggml_gemm_q8_0_8x4_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 4;
 
-} // extern "C"
-
-static block_q4_0x4 make_block_q4_0x4(block_q4_0 * in, unsigned int blck_size_interleave) {
-    block_q4_0x4 out;
-
-    for (int i = 0; i < 4; i++) {
-        out.d[i] = in[i].d;
-    }
-
-    const int end = QK4_0 * 2 / blck_size_interleave;
-
-    if (blck_size_interleave == 8) {
-        const uint64_t xor_mask = 0x8888888888888888ULL;
-        for (int i = 0; i < end; ++i) {
-            int src_id = i % 4;
-            int src_offset = (i / 4) * blck_size_interleave;
-            int dst_offset = i * blck_size_interleave;
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
 
-            uint64_t elems;
-            // Using memcpy to avoid unaligned memory accesses
-            memcpy(&elems, &in[src_id].qs[src_offset], sizeof(uint64_t));
-            elems ^= xor_mask;
-            memcpy(&out.qs[dst_offset], &elems, sizeof(uint64_t));
-        }
-    } else if (blck_size_interleave == 4) {
-        const uint32_t xor_mask = 0x88888888;
-        for (int i = 0; i < end; ++i) {
-            int src_id = i % 4;
-            int src_offset = (i / 4) * blck_size_interleave;
-            int dst_offset = i * blck_size_interleave;
+    float sumf[4][8];
+    int sumi;
 
-            uint32_t elems;
-            memcpy(&elems, &in[src_id].qs[src_offset], sizeof(uint32_t));
-            elems ^= xor_mask;
-            memcpy(&out.qs[dst_offset], &elems, sizeof(uint32_t));
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_0x4 * a_ptr = (const block_q8_0x4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++) sumf[m][j] = 0.0;
+            }
+            for (int l = 0; l < nb; l++) {
+                for (int m = 0; m < 4; m++) {
+                    for (int j = 0; j < ncols_interleaved; j++) {
+                        sumi = 0;
+                        for (int k = 0; k < (qk / blocklen); k++) {
+                            for (int i = 0; i < blocklen; ++i) {
+                                sumi += b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] * a_ptr[l].qs[k * 4 * blocklen + m * blocklen + i];
+                            }
+                        }
+                        sumf[m][j] += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j]) * GGML_CPU_FP16_TO_FP32(a_ptr[l].d[m]);
+                    }
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++)
+                    s[(y * 4 + m) * bs + x * ncols_interleaved + j] = sumf[m][j];
+            }
         }
-    } else {
-        GGML_ASSERT(false);
     }
-
-    return out;
 }
 
-// interleave 8 block_q4_0s in blocks of blck_size_interleave
-// returns an interleaved block_q4_0x8
-// in the interleaved block_q4_0x8, place deltas for 8 block_q4_0 blocks
-// first, then interleave quants from 8 block_q4_0s in blocks of blck_size_interleave
-static block_q4_0x8 make_block_q4_0x8(block_q4_0 * in, unsigned int blck_size_interleave) {
-    block_q4_0x8 out;
+void ggml_gemm_q5_K_8x4_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 4;
+    static const uint32_t kmask1 = 0x3f3f3f3f;
+    static const uint32_t kmask2 = 0x0f0f0f0f;
+    static const uint32_t kmask3 = 0x03030303;
 
-    for (int i = 0; i < 8; i++) {
-        out.d[i] = in[i].d;
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    float sumf[4][8];
+    float sum_minf[4][8];
+    uint32_t utmp[4];
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q5_Kx8 * b_ptr = (const block_q5_Kx8 *) vx + (x * nb);
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++) {
+                    sumf[m][j] = 0.0;
+                    sum_minf[m][j] = 0.0;
+                }
+            }
+            for (int l = 0; l < nb; l++) {
+                for (int j = 0; j < ncols_interleaved; j++) {
+                    for (int w = 0; w < 3; w++) {
+                        memcpy(&utmp[w], &b_ptr[l].scales[(w * ncols_interleaved + j) * 4], sizeof(uint32_t));
+                    }
+                    utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+                    const uint32_t uaux = utmp[1] & kmask1;
+                    utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+                    utmp[2] = uaux;
+                    utmp[0] &= kmask1;
+
+                    const uint8_t * scales = (const uint8_t *) utmp;
+                    const uint8_t * mins   = scales + 8;
+
+                    for (int m = 0; m < 4; m++) {
+                        int sumi = 0;
+                        for (int k = 0; k < (qk / (2 * blocklen)); k++) {
+                            const int p = k / 8;
+                            const int c = k % 8;
+                            int sumi1 = 0;
+                            int sumi2 = 0;
+                            for (int i = 0; i < blocklen; ++i) {
+                                const uint8_t q = b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i];
+                                const uint8_t h = b_ptr[l].qh[c * ncols_interleaved * blocklen + j * blocklen + i];
+                                const int v0 = (q & 0xF) | (((h >> (2 * p + 0)) & 1) << 4);
+                                const int v1 = (q >> 4)  | (((h >> (2 * p + 1)) & 1) << 4);
+                                sumi1 += v0 * a_ptr[l].qs[(p * 16 + c + 0) * 4 * blocklen + m * blocklen + i];
+                                sumi2 += v1 * a_ptr[l].qs[(p * 16 + c + 8) * 4 * blocklen + m * blocklen + i];
+                            }
+                            sumi += sumi1 * scales[2 * p] + sumi2 * scales[2 * p + 1];
+                        }
+
+                        // bsums of the groups of 16 g and g + 1 of row m
+                        int summ = 0;
+                        for (int sb = 0; sb < 8; sb++) {
+                            const int g = 2 * sb;
+                            summ += mins[sb] * (a_ptr[l].bsums[(g / 4) * 16 + m * 4 + g % 4] + a_ptr[l].bsums[(g / 4) * 16 + m * 4 + g % 4 + 1]);
+                        }
+
+                        sumf[m][j]     += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j])    * a_ptr[l].d[m];
+                        sum_minf[m][j] += summ * GGML_CPU_FP16_TO_FP32(b_ptr[l].dmin[j]) * a_ptr[l].d[m];
+                    }
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++)
+                    s[(y * 4 + m) * bs + x * ncols_interleaved + j] = sumf[m][j] - sum_minf[m][j];
+            }
+        }
+    }
+}
+
+void ggml_gemm_q6_K_8x4_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 4;
+
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    float sumf[4][8];
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++) sumf[m][j] = 0.0;
+            }
+            for (int l = 0; l < nb; l++) {
+                for (int m = 0; m < 4; m++) {
+                    for (int j = 0; j < ncols_interleaved; j++) {
+                        int sumi = 0;
+                        for (int k = 0; k < (qk / (4 * blocklen)); k++) {
+                            const int h = k / 8;
+                            const int c = k % 8;
+                            int sumi_p[4] = { 0, 0, 0, 0 };
+                            for (int i = 0; i < blocklen; ++i) {
+                                const uint8_t q0 = b_ptr[l].ql[(h * 16 + c + 0) * ncols_interleaved * blocklen + j * blocklen + i];
+                                const uint8_t q1 = b_ptr[l].ql[(h * 16 + c + 8) * ncols_interleaved * blocklen + j * blocklen + i];
+                                const uint8_t qh = b_ptr[l].qh[k * ncols_interleaved * blocklen + j * blocklen + i];
+                                const int8_t * a = &a_ptr[l].qs[(h * 32 + c) * 4 * blocklen + m * blocklen + i];
+                                sumi_p[0] += (((q0 & 0xF) | (((qh >> 0) & 3) << 4)) - 32) * a[ 0 * 4 * blocklen];
+                                sumi_p[1] += (((q1 & 0xF) | (((qh >> 2) & 3) << 4)) - 32) * a[ 8 * 4 * blocklen];
+                                sumi_p[2] += (((q0 >> 4)  | (((qh >> 4) & 3) << 4)) - 32) * a[16 * 4 * blocklen];
+                                sumi_p[3] += (((q1 >> 4)  | (((qh >> 6) & 3) << 4)) - 32) * a[24 * 4 * blocklen];
+                            }
+                            for (int p = 0; p < 4; p++) {
+                                sumi += sumi_p[p] * b_ptr[l].scales[(h * 8 + 2 * p + c / 4) * ncols_interleaved + j];
+                            }
+                        }
+                        sumf[m][j] += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j]) * a_ptr[l].d[m];
+                    }
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++)
+                    s[(y * 4 + m) * bs + x * ncols_interleaved + j] = sumf[m][j];
+            }
+        }
+    }
+}
+
+void ggml_gemm_iq4_xs_8x4_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 4;
+
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    float sumf[4][8];
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_iq4_xsx8 * b_ptr = (const block_iq4_xsx8 *) vx + (x * nb);
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++) sumf[m][j] = 0.0;
+            }
+            for (int l = 0; l < nb; l++) {
+                for (int j = 0; j < ncols_interleaved; j++) {
+                    uint32_t scales_l;
+                    memcpy(&scales_l, &b_ptr[l].scales_l[j * 4], sizeof(uint32_t));
+                    const uint16_t scales_h = b_ptr[l].scales_h[j];
+
+                    for (int m = 0; m < 4; m++) {
+                        int sumi = 0;
+                        for (int ib = 0; ib < QK_K / 32; ib++) {
+                            const int ls = ((scales_l >> 4 * ib) & 0xf) | (((scales_h >> 2 * ib) & 3) << 4);
+                            int sumi1 = 0;
+                            for (int k = 0; k < (32 / (2 * blocklen)); k++) {
+                                for (int i = 0; i < blocklen; ++i) {
+                                    const uint8_t q = b_ptr[l].qs[(ib * 4 + k) * ncols_interleaved * blocklen + j * blocklen + i];
+                                    sumi1 += kvalues_iq4nl[q & 0xF] * a_ptr[l].qs[(ib * 8 + k + 0) * 4 * blocklen + m * blocklen + i] +
+                                             kvalues_iq4nl[q >> 4]  * a_ptr[l].qs[(ib * 8 + k + 4) * 4 * blocklen + m * blocklen + i];
+                                }
+                            }
+                            sumi += sumi1 * (ls - 32);
+                        }
+                        sumf[m][j] += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j]) * a_ptr[l].d[m];
+                    }
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++)
+                    s[(y * 4 + m) * bs + x * ncols_interleaved + j] = sumf[m][j];
+            }
+        }
+    }
+}
+
+
+} // extern "C"
+
+static block_q4_0x4 make_block_q4_0x4(block_q4_0 * in, unsigned int blck_size_interleave) {
+    block_q4_0x4 out;
+
+    for (int i = 0; i < 4; i++) {
+        out.d[i] = in[i].d;
+    }
+
+    const int end = QK4_0 * 2 / blck_size_interleave;
+
+    if (blck_size_interleave == 8) {
+        const uint64_t xor_mask = 0x8888888888888888ULL;
+        for (int i = 0; i < end; ++i) {
+            int src_id = i % 4;
+            int src_offset = (i / 4) * blck_size_interleave;
+            int dst_offset = i * blck_size_interleave;
+
+            uint64_t elems;
+            // Using memcpy to avoid unaligned memory accesses
+            memcpy(&elems, &in[src_id].qs[src_offset], sizeof(uint64_t));
+            elems ^= xor_mask;
+            memcpy(&out.qs[dst_offset], &elems, sizeof(uint64_t));
+        }
+    } else if (blck_size_interleave == 4) {
+        const uint32_t xor_mask = 0x88888888;
+        for (int i = 0; i < end; ++i) {
+            int src_id = i % 4;
+            int src_offset = (i / 4) * blck_size_interleave;
+            int dst_offset = i * blck_size_interleave;
+
+            uint32_t elems;
+            memcpy(&elems, &in[src_id].qs[src_offset], sizeof(uint32_t));
+            elems ^= xor_mask;
+            memcpy(&out.qs[dst_offset], &elems, sizeof(uint32_t));
+        }
+    } else {
+        GGML_ASSERT(false);
+    }
+
+    return out;
+}
+
+// interleave 8 block_q4_0s in blocks of blck_size_interleave
+// returns an interleaved block_q4_0x8
+// in the interleaved block_q4_0x8, place deltas for 8 block_q4_0 blocks
+// first, then interleave quants from 8 block_q4_0s in blocks of blck_size_interleave
+static block_q4_0x8 make_block_q4_0x8(block_q4_0 * in, unsigned int blck_size_interleave) {
+    block_q4_0x8 out;
+
+    for (int i = 0; i < 8; i++) {
+        out.d[i] = in[i].d;
     }
 
     const int end = QK4_0 * 4 / blck_size_interleave;
@@ -1445,6 +1931,225 @@ static int repack_iq4_nl_to_iq4_nl_8_bl(struct ggml_tensor * t, int interleave_b
 
     GGML_UNUSED(data_size);
 }
+static block_q8_0x8 make_block_q8_0x8(block_q8_0 * in, unsigned int blck_size_interleave) {
+    block_q8_0x8 out;
+
+    for (int i = 0; i < 8; i++) {
+        out.d[i] = in[i].d;
+    }
+
+    const int end = QK8_0 * 8 / blck_size_interleave;
+
+    for (int i = 0; i < end; ++i) {
+        int src_id = i % 8;
+        int src_offset = (i / 8) * blck_size_interleave;
+        int dst_offset = i * blck_size_interleave;
+
+        memcpy(&out.qs[dst_offset], &in[src_id].qs[src_offset], blck_size_interleave);
+    }
+
+    return out;
+}
+
+static int repack_q8_0_to_q8_0_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q8_0);
+    GGML_ASSERT(interleave_block == 4);
+
+    const block_q8_0 * src = (const block_q8_0 *)data;
+          block_q8_0x8 * dst = (block_q8_0x8 *)t->data;
+
+    block_q8_0 dst_tmp[8];
+
+    int nrow = ggml_nrows(t);
+    int nrows_interleaved = 8;
+    int nblocks = t->ne[0] / QK8_0;
+
+    GGML_ASSERT(data_size == nrow * nblocks * sizeof(block_q8_0));
+
+    if (t->ne[1] % nrows_interleaved != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < nrow; b += nrows_interleaved) {
+        for (int64_t x = 0; x < nblocks; x++) {
+            for (int i = 0; i < nrows_interleaved; i++) {
+                dst_tmp[i] = src[x + i * nblocks];
+            }
+            *dst++ = make_block_q8_0x8(dst_tmp, interleave_block);
+        }
+        src += nrows_interleaved * nblocks;
+    }
+    return 0;
+
+    GGML_UNUSED(data_size);
+}
+
+// the quants of the 8 blocks are interleaved in groups of blck_size_interleave bytes, the scales one 32-bit word at a time
+static block_q5_Kx8 make_block_q5_Kx8(block_q5_K * in, unsigned int blck_size_interleave) {
+    block_q5_Kx8 out;
+
+    for (int i = 0; i < 8; i++) {
+        out.d[i]    = in[i].GGML_COMMON_AGGR_U.GGML_COMMON_AGGR_S.d;
+        out.dmin[i] = in[i].GGML_COMMON_AGGR_U.GGML_COMMON_AGGR_S.dmin;
+    }
+
+    for (int w = 0; w < K_SCALE_SIZE / 4; w++) {
+        for (int i = 0; i < 8; i++) {
+            memcpy(&out.scales[(w * 8 + i) * 4], &in[i].scales[w * 4], sizeof(uint32_t));
+        }
+    }
+
+    for (int i = 0; i < QK_K * 4 / (int) blck_size_interleave; ++i) {
+        memcpy(&out.qs[i * blck_size_interleave], &in[i % 8].qs[(i / 8) * blck_size_interleave], blck_size_interleave);
+    }
+
+    for (int i = 0; i < QK_K / (int) blck_size_interleave; ++i) {
+        memcpy(&out.qh[i * blck_size_interleave], &in[i % 8].qh[(i / 8) * blck_size_interleave], blck_size_interleave);
+    }
+
+    return out;
+}
+
+static int repack_q5_K_to_q5_K_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q5_K);
+    GGML_ASSERT(interleave_block == 4);
+
+    const block_q5_K * src = (const block_q5_K *)data;
+          block_q5_Kx8 * dst = (block_q5_Kx8 *)t->data;
+
+    block_q5_K dst_tmp[8];
+
+    int nrow = ggml_nrows(t);
+    int nrows_interleaved = 8;
+    int nblocks = t->ne[0] / QK_K;
+
+    GGML_ASSERT(data_size == nrow * nblocks * sizeof(block_q5_K));
+
+    if (t->ne[1] % nrows_interleaved != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < nrow; b += nrows_interleaved) {
+        for (int64_t x = 0; x < nblocks; x++) {
+            for (int i = 0; i < nrows_interleaved; i++) {
+                dst_tmp[i] = src[x + i * nblocks];
+            }
+            *dst++ = make_block_q5_Kx8(dst_tmp, interleave_block);
+        }
+        src += nrows_interleaved * nblocks;
+    }
+    return 0;
+
+    GGML_UNUSED(data_size);
+}
+
+// the quants of the 8 blocks are interleaved in groups of blck_size_interleave bytes, the scales of a group of 16 are together
+static block_q6_Kx8 make_block_q6_Kx8(block_q6_K * in, unsigned int blck_size_interleave) {
+    block_q6_Kx8 out;
+
+    for (int i = 0; i < 8; i++) {
+        out.d[i] = in[i].d;
+    }
+
+    for (int sb = 0; sb < QK_K / 16; sb++) {
+        for (int i = 0; i < 8; i++) {
+            out.scales[sb * 8 + i] = in[i].scales[sb];
+        }
+    }
+
+    for (int i = 0; i < QK_K * 4 / (int) blck_size_interleave; ++i) {
+        memcpy(&out.ql[i * blck_size_interleave], &in[i % 8].ql[(i / 8) * blck_size_interleave], blck_size_interleave);
+    }
+
+    for (int i = 0; i < QK_K * 2 / (int) blck_size_interleave; ++i) {
+        memcpy(&out.qh[i * blck_size_interleave], &in[i % 8].qh[(i / 8) * blck_size_interleave], blck_size_interleave);
+    }
+
+    return out;
+}
+
+static int repack_q6_K_to_q6_K_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q6_K);
+    GGML_ASSERT(interleave_block == 4);
+
+    const block_q6_K * src = (const block_q6_K *)data;
+          block_q6_Kx8 * dst = (block_q6_Kx8 *)t->data;
+
+    block_q6_K dst_tmp[8];
+
+    int nrow = ggml_nrows(t);
+    int nrows_interleaved = 8;
+    int nblocks = t->ne[0] / QK_K;
+
+    GGML_ASSERT(data_size == nrow * nblocks * sizeof(block_q6_K));
+
+    if (t->ne[1] % nrows_interleaved != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < nrow; b += nrows_interleaved) {
+        for (int64_t x = 0; x < nblocks; x++) {
+            for (int i = 0; i < nrows_interleaved; i++) {
+                dst_tmp[i] = src[x + i * nblocks];
+            }
+            *dst++ = make_block_q6_Kx8(dst_tmp, interleave_block);
+        }
+        src += nrows_interleaved * nblocks;
+    }
+    return 0;
+
+    GGML_UNUSED(data_size);
+}
+
+static block_iq4_xsx8 make_block_iq4_xsx8(block_iq4_xs * in, unsigned int blck_size_interleave) {
+    block_iq4_xsx8 out;
+
+    for (int i = 0; i < 8; i++) {
+        out.d[i]        = in[i].d;
+        out.scales_h[i] = in[i].scales_h;
+        memcpy(&out.scales_l[i * 4], in[i].scales_l, QK_K / 64);
+    }
+
+    for (int i = 0; i < QK_K * 4 / (int) blck_size_interleave; ++i) {
+        memcpy(&out.qs[i * blck_size_interleave], &in[i % 8].qs[(i / 8) * blck_size_interleave], blck_size_interleave);
+    }
+
+    return out;
+}
+
+static int repack_iq4_xs_to_iq4_xs_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_IQ4_XS);
+    GGML_ASSERT(interleave_block == 4);
+
+    const block_iq4_xs * src = (const block_iq4_xs *)data;
+          block_iq4_xsx8 * dst = (block_iq4_xsx8 *)t->data;
+
+    block_iq4_xs dst_tmp[8];
+
+    int nrow = ggml_nrows(t);
+    int nrows_interleaved = 8;
+    int nblocks = t->ne[0] / QK_K;
+
+    GGML_ASSERT(data_size == nrow * nblocks * sizeof(block_iq4_xs));
+
+    if (t->ne[1] % nrows_interleaved != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < nrow; b += nrows_interleaved) {
+        for (int64_t x = 0; x < nblocks; x++) {
+            for (int i = 0; i < nrows_interleaved; i++) {
+                dst_tmp[i] = src[x + i * nblocks];
+            }
+            *dst++ = make_block_iq4_xsx8(dst_tmp, interleave_block);
+        }
+        src += nrows_interleaved * nblocks;
+    }
+    return 0;
+
+    GGML_UNUSED(data_size);
+}
+
 
 namespace ggml::cpu::repack {
 // repack
@@ -1485,6 +2190,22 @@ template <> int repack<block_iq4_nl, 8, 8>(struct ggml_tensor * t, const void *
     return repack_iq4_nl_to_iq4_nl_8_bl(t, 8, data, data_size);
 }
 
+template <> int repack<block_q8_0, 4, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q8_0_to_q8_0_8_bl(t, 4, data, data_size);
+}
+
+template <> int repack<block_q5_K, 4, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q5_K_to_q5_K_8_bl(t, 4, data, data_size);
+}
+
+template <> int repack<block_q6_K, 4, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q6_K_to_q6_K_8_bl(t, 4, data, data_size);
+}
+
+template <> int repack<block_iq4_xs, 4, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_iq4_xs_to_iq4_xs_8_bl(t, 4, data, data_size);
+}
+
 // gemv
 template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PARAM_TYPE>
 void gemv(int, float *, size_t, const void *, const void *, int, int);
@@ -1517,6 +2238,22 @@ template <> void gemv<block_iq4_nl, 8, 8, GGML_TYPE_Q8_0>(int n, float * s, size
     ggml_gemv_iq4_nl_8x8_q8_0(n, s, bs, vx, vy, nr, nc);
 }
 
+template <> void gemv<block_q8_0, 4, 8, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q8_0_8x4_q8_0(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemv<block_q5_K, 4, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q5_K_8x4_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemv<block_q6_K, 4, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q6_K_8x4_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemv<block_iq4_xs, 4, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_iq4_xs_8x4_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
 // gemm
 template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PARAM_TYPE>
 void gemm(int, float *, size_t, const void *, const void *, int, int);
@@ -1549,6 +2286,22 @@ template <> void gemm<block_iq4_nl, 8, 8, GGML_TYPE_Q8_0>(int n, float * s, size
     ggml_gemm_iq4_nl_8x8_q8_0(n, s, bs, vx, vy, nr, nc);
 }
 
+template <> void gemm<block_q8_0, 4, 8, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q8_0_8x4_q8_0(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemm<block_q5_K, 4, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q5_K_8x4_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemm<block_q6_K, 4, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q6_K_8x4_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemm<block_iq4_xs, 4, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_iq4_xs_8x4_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
 class tensor_traits_base : public ggml::cpu::tensor_traits {
   public:
     virtual int repack(struct ggml_tensor * t, const void * data, size_t data_size) = 0;
@@ -1556,7 +2309,10 @@ class tensor_traits_base : public ggml::cpu::tensor_traits {
 
 template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PARAM_TYPE> class tensor_traits : public tensor_traits_base {
 
-    bool work_size(int /* n_threads */, const struct ggml_tensor * op, size_t & size) override {
+    // rows of src1 computed by one call of gemm in forward_mul_mat_id
+    static constexpr int64_t MMID_GEMM_ROWS = 16;
+
+    bool work_size(int n_threads, const struct ggml_tensor * op, size_t & size) override {
         // not realy a GGML_TYPE_Q8_0 but same size.
         switch (op->op) {
             case GGML_OP_MUL_MAT:
@@ -1566,15 +2322,19 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
                 }
             case GGML_OP_MUL_MAT_ID:
                 {
-                    size = ggml_row_size(PARAM_TYPE, ggml_nelements(op->src[1]));
-                    size = GGML_PAD(size, sizeof(int64_t)); // + padding for next bloc.
+                    const int64_t ne00   = op->src[0]->ne[0];
+                    const int64_t ne01   = op->src[0]->ne[1];
+                    const int64_t ne02   = op->src[0]->ne[2]; // n_as, n_expert
+                    const int64_t n_rows = op->src[2]->ne[0]*op->src[2]->ne[1];
 
-                    const int64_t ne02 = op->src[0]->ne[2]; // n_as, n_expert
-                    const int64_t ne12 = op->src[1]->ne[2]; // n_tokens
+                    // src1 gathered by expert
+                    size = GGML_PAD(n_rows*ggml_row_size(PARAM_TYPE, ne00), sizeof(int64_t));
 
-                    const size_t sizeof_mmid_row_mapping = sizeof(int64_t);
+                    // matrix_row_counts, matrix_row_offs, matrix_rows
+                    size += sizeof(int64_t)*(ne02 + (ne02 + 1) + n_rows);
 
-                    size += sizeof_mmid_row_mapping*ne02*(ne12 + 1);
+                    // per thread: 4 rows of src1 to quantize and MMID_GEMM_ROWS rows of output
+                    size += n_threads*GGML_PAD((4*ne00 + MMID_GEMM_ROWS*ne01)*sizeof(float), 64) + 64;
 
                     return true;
                 }
@@ -1671,6 +2431,8 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
         }
     }
 
+    // the rows of src1 are sorted by expert and quantized into a dense block per expert, in groups of 4 rows
+    // interleaved for gemm, then each expert is computed with gemm on the groups and gemv on the remaining rows
     void forward_mul_mat_id(ggml_compute_params * params, ggml_tensor * op) {
         const ggml_tensor * src0 = op->src[0];
         const ggml_tensor * src1 = op->src[1];
@@ -1704,43 +2466,36 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
         const int n_ids = ids->ne[0]; // n_expert_used
         const int n_as  = ne02;       // n_expert
 
+        const int64_t n_rows = ids->ne[0]*ids->ne[1];
+
         const size_t nbw1 = ggml_row_size(PARAM_TYPE, ne10);
-        const size_t nbw2 = nbw1*ne11;
-        const size_t nbw3 = nbw2*ne12;
 
         struct mmid_row_mapping {
             int32_t i1;
             int32_t i2;
         };
 
-        GGML_ASSERT(params->wsize >=
-                (GGML_PAD(nbw3, sizeof(int64_t)) +
-                 n_as*(ne12 + 1)*sizeof(mmid_row_mapping))
-                );
+        static_assert(sizeof(mmid_row_mapping) == sizeof(int64_t), "mmid_row_mapping must be 64 bits");
 
-        auto * wdata          = (char *)params->wdata;
-        auto * wdata_src1_end = (char *)wdata + GGML_PAD(nbw3, sizeof(int64_t));
+        const size_t tmp_size = GGML_PAD((4*ne10 + MMID_GEMM_ROWS*ne01)*sizeof(float), 64);
 
-        // total of [n_as][ne12 + 1] elemets of type mmid_row_mapping (2*int32_t = int64_t)
-        auto * matrix_row_counts = (int64_t *) (wdata_src1_end);                                        // [n_as]
-        struct mmid_row_mapping * matrix_rows = (struct mmid_row_mapping *) (matrix_row_counts + n_as); // [n_as][ne12]
+        auto * wdata = (char *) params->wdata; // [n_rows] rows of src1 sorted by expert
 
-        // src1: float32 => param type
-        for (int64_t i12 = 0; i12 < ne12; ++i12) {
-            for (int64_t i11 = ith; i11 < ne11; i11 += nth) {
-                from_float((float *)((char *) src1->data + i12 * nb12 + i11 * nb11),
-                           (void *)               (wdata + i12 * nbw2 + i11 * nbw1),
-                           ne10);
-            }
-        }
+        auto * matrix_row_counts = (int64_t *) (wdata + GGML_PAD(n_rows*nbw1, sizeof(int64_t))); // [n_as]
+        auto * matrix_row_offs   = matrix_row_counts + n_as;                                      // [n_as + 1]
+        auto * matrix_rows       = (mmid_row_mapping *) (matrix_row_offs + n_as + 1);             // [n_rows]
+
+        auto * wdata_tmp = (char *) GGML_PAD((uintptr_t) (matrix_rows + n_rows), 64) + ith*tmp_size;
 
-#define MMID_MATRIX_ROW(row_id, i1) matrix_rows[(row_id) * ne12 + (i1)]
+        GGML_ASSERT(params->wsize >= (size_t) (wdata_tmp + tmp_size - (char *) params->wdata));
+
+        float * src1_tmp = (float *) wdata_tmp;      // [4][ne10]
+        float * dst_tmp  = src1_tmp + 4*ne10;        // [MMID_GEMM_ROWS][ne01]
 
         if (ith == 0) {
-            // initialize matrix_row_counts
+            // count the rows of each expert
             memset(matrix_row_counts, 0, n_as * sizeof(int64_t));
 
-            // group rows by src0 matrix
             for (int32_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
                 for (int32_t id = 0; id < n_ids; ++id) {
                     const int32_t i02 =
@@ -1748,57 +2503,118 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
 
                     GGML_ASSERT(i02 >= 0 && i02 < n_as);
 
-                    MMID_MATRIX_ROW(i02, matrix_row_counts[i02]) = { id, iid1 };
                     matrix_row_counts[i02] += 1;
                 }
             }
+
+            matrix_row_offs[0] = 0;
+            for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+                matrix_row_offs[cur_a + 1] = matrix_row_offs[cur_a] + matrix_row_counts[cur_a];
+                matrix_row_counts[cur_a]   = 0;
+            }
+
+            // group rows by src0 matrix
+            for (int32_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
+                for (int32_t id = 0; id < n_ids; ++id) {
+                    const int32_t i02 =
+                        *(const int32_t *) ((const char *) ids->data + iid1 * ids->nb[1] + id * ids->nb[0]);
+
+                    matrix_rows[matrix_row_offs[i02] + matrix_row_counts[i02]++] = { id, iid1 };
+                }
+            }
         }
 
         ggml_barrier(params->threadpool);
 
-        // compute each matrix multiplication in sequence
-        for (int cur_a = 0; cur_a < n_as; ++cur_a) {
-            const int64_t cne1 = matrix_row_counts[cur_a];
+        // src1: float32 => param type, the full groups of 4 rows of each expert are interleaved for gemm
+        {
+            int64_t unit = 0;
 
-            if (cne1 == 0) {
-                continue;
+            for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+                const int64_t row_off = matrix_row_offs[cur_a];
+                const int64_t cne1    = matrix_row_offs[cur_a + 1] - row_off;
+
+                for (int64_t ir1 = 0; ir1 < cne1; unit++) {
+                    const int64_t nrows = cne1 - ir1 >= 4 ? 4 : 1;
+
+                    if (unit % nth == ith) {
+                        for (int64_t r = 0; r < nrows; r++) {
+                            const mmid_row_mapping row_mapping = matrix_rows[row_off + ir1 + r];
+
+                            const float * src1_row = (const float *) ((const char *) src1->data +
+                                    (row_mapping.i1 % ne11) * nb11 + row_mapping.i2 * nb12);
+
+                            if (nrows == 4) {
+                                memcpy(src1_tmp + r*ne10, src1_row, ne10*sizeof(float));
+                            } else {
+                                from_float(src1_row, wdata + (row_off + ir1)*nbw1, ne10);
+                            }
+                        }
+
+                        if (nrows == 4) {
+                            ggml_quantize_mat_t<INTER_SIZE, PARAM_TYPE>(src1_tmp, wdata + (row_off + ir1)*nbw1, 4, ne10);
+                        }
+                    }
+
+                    ir1 += nrows;
+                }
             }
+        }
 
-            const auto * src0_cur = (const char *) src0->data + cur_a*nb02;
+        ggml_barrier(params->threadpool);
 
-            //const int64_t nr0 = ne01; // src0 rows
-            const int64_t nr1 = cne1; // src1 rows
+        // every thread computes the same columns of all the experts, so that each weight is read once
+        // and the work of each thread is proportional to the number of rows of every expert
+        int64_t src0_cur_start = (ith * ne01) / nth;
+        int64_t src0_cur_end   = ((ith + 1) * ne01) / nth;
 
-            int64_t src0_cur_start = (ith * ne01) / nth;
-            int64_t src0_cur_end   = ((ith + 1) * ne01) / nth;
+        src0_cur_start = (src0_cur_start % NB_COLS) ? src0_cur_start + NB_COLS - (src0_cur_start % NB_COLS) : src0_cur_start;
+        src0_cur_end   = (src0_cur_end   % NB_COLS) ? src0_cur_end   + NB_COLS - (src0_cur_end   % NB_COLS) : src0_cur_end;
 
-            src0_cur_start = (src0_cur_start % NB_COLS) ? src0_cur_start + NB_COLS - (src0_cur_start % NB_COLS) : src0_cur_start;
-            src0_cur_end   = (src0_cur_end   % NB_COLS) ? src0_cur_end   + NB_COLS - (src0_cur_end   % NB_COLS) : src0_cur_end;
+        if (src0_cur_start >= src0_cur_end) {
+            return;
+        }
+
+        const int64_t nc = src0_cur_end - src0_cur_start;
 
-            if (src0_cur_start >= src0_cur_end) {
-                return;
+        for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+            const int64_t row_off = matrix_row_offs[cur_a];
+            const int64_t cne1    = matrix_row_offs[cur_a + 1] - row_off;
+
+            if (cne1 == 0) {
+                continue;
             }
 
-            for (int ir1 = 0; ir1 < nr1; ir1++) {
-                struct mmid_row_mapping row_mapping = MMID_MATRIX_ROW(cur_a, ir1);
+            const auto * src0_cur = (const char *) src0->data + cur_a*nb02 + src0_cur_start*nb01;
+            const auto * src1_cur = wdata + row_off*nbw1;
+
+            const mmid_row_mapping * rows = matrix_rows + row_off;
 
-                const int id = row_mapping.i1; // selected expert index
+            // full groups of 4 rows, MMID_GEMM_ROWS at a time
+            const int64_t cne1_gemm = cne1 - cne1 % 4;
 
-                const int64_t i11 = id % ne11;
-                const int64_t i12 = row_mapping.i2; // row index in src1
+            for (int64_t ir1 = 0; ir1 < cne1_gemm; ir1 += MMID_GEMM_ROWS) {
+                const int64_t nr = std::min(MMID_GEMM_ROWS, cne1_gemm - ir1);
 
-                const int64_t i1 = id;  // selected expert index
-                const int64_t i2 = i12; // row
+                gemm<BLOC_TYPE, INTER_SIZE, NB_COLS, PARAM_TYPE>(ne00, dst_tmp, nc, src0_cur, src1_cur + ir1*nbw1, nr, nc);
 
-                const auto * src1_col = (const char *) wdata + (i11 * nbw1 + i12 * nbw2);
+                for (int64_t r = 0; r < nr; r++) {
+                    // i1 is the selected expert index, i2 the row in src1
+                    const mmid_row_mapping row_mapping = rows[ir1 + r];
+
+                    memcpy((float *) ((char *) dst->data + (row_mapping.i1 * nb1 + row_mapping.i2 * nb2)) + src0_cur_start,
+                           dst_tmp + r*nc, nc*sizeof(float));
+                }
+            }
+
+            for (int64_t ir1 = cne1_gemm; ir1 < cne1; ir1++) {
+                const mmid_row_mapping row_mapping = rows[ir1];
 
                 gemv<BLOC_TYPE, INTER_SIZE, NB_COLS, PARAM_TYPE>(ne00,
-                        (float *)((char *) dst->data + (i1 * nb1 + i2 * nb2)) + src0_cur_start, ne01,
-                        src0_cur + src0_cur_start * nb01,
-                        src1_col, 1, src0_cur_end - src0_cur_start);
+                        (float *)((char *) dst->data + (row_mapping.i1 * nb1 + row_mapping.i2 * nb2)) + src0_cur_start, ne01,
+                        src0_cur, src1_cur + ir1*nbw1, 1, nc);
             }
         }
-#undef MMID_MATRIX_ROW
     }
 
     int repack(struct ggml_tensor * t, const void * data, size_t data_size) override {
@@ -1818,12 +2634,22 @@ static const ggml::cpu::tensor_traits * ggml_repack_get_optimal_repack_type(cons
     static const ggml::cpu::repack::tensor_traits<block_q4_0, 8, 8, GGML_TYPE_Q8_0> q4_0_8x8_q8_0;
     static const ggml::cpu::repack::tensor_traits<block_q4_K, 8, 8, GGML_TYPE_Q8_K> q4_K_8x8_q8_K;
 
+    // instance for Q5
+    static const ggml::cpu::repack::tensor_traits<block_q5_K, 4, 8, GGML_TYPE_Q8_K> q5_K_8x4_q8_K;
+
+    // instance for Q6
+    static const ggml::cpu::repack::tensor_traits<block_q6_K, 4, 8, GGML_TYPE_Q8_K> q6_K_8x4_q8_K;
+
+    // instance for Q8
+    static const ggml::cpu::repack::tensor_traits<block_q8_0, 4, 8, GGML_TYPE_Q8_0> q8_0_8x4_q8_0;
+
     // instance for Q2
     static const ggml::cpu::repack::tensor_traits<block_q2_K, 8, 8, GGML_TYPE_Q8_K> q2_K_8x8_q8_K;
 
     // instance for IQ4
     static const ggml::cpu::repack::tensor_traits<block_iq4_nl, 4, 4, GGML_TYPE_Q8_0> iq4_nl_4x4_q8_0;
     static const ggml::cpu::repack::tensor_traits<block_iq4_nl, 8, 8, GGML_TYPE_Q8_0> iq4_nl_8x8_q8_0;
+    static const ggml::cpu::repack::tensor_traits<block_iq4_xs, 4, 8, GGML_TYPE_Q8_K> iq4_xs_8x4_q8_K;
 
     if (cur->type == GGML_TYPE_Q4_0) {
         if (ggml_cpu_has_avx2() || (ggml_cpu_has_sve() && ggml_cpu_has_matmul_int8() && ggml_cpu_get_sve_cnt() == QK8_0)) {
@@ -1847,6 +2673,24 @@ static const ggml::cpu::tensor_traits * ggml_repack_get_optimal_repack_type(cons
                 return &q4_K_8x8_q8_K;
             }
         }
+    } else if (cur->type == GGML_TYPE_Q5_K) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q5_K_8x4_q8_K;
+            }
+        }
+    } else if (cur->type == GGML_TYPE_Q6_K) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q6_K_8x4_q8_K;
+            }
+        }
+    } else if (cur->type == GGML_TYPE_Q8_0) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q8_0_8x4_q8_0;
+            }
+        }
     } else if (cur->type == GGML_TYPE_Q2_K) {
         if (ggml_cpu_has_avx512()) {
             if (cur->ne[1] % 8 == 0) {
@@ -1864,6 +2708,12 @@ static const ggml::cpu::tensor_traits * ggml_repack_get_optimal_repack_type(cons
                 return &iq4_nl_4x4_q8_0;
             }
         }
+    } else if (cur->type == GGML_TYPE_IQ4_XS) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &iq4_xs_8x4_q8_K;
+            }
+        }
     }
 
     return nullptr;
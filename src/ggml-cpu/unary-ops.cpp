@@ -287,3 +287,30 @@ void ggml_compute_forward_xielu(const ggml_compute_params * params, ggml_tensor
     unary_op_functor(params, dst, xielu_op_params);
 }
 
+
+bool ggml_compute_unary_row_f32(const ggml_tensor * dst, int64_t n, float * y, const float * x) {
+    switch (dst->op) {
+        case GGML_OP_SQR:  vec_unary_op<op_sqr>(n, y, x);  return true;
+        case GGML_OP_SQRT: vec_unary_op<op_sqrt>(n, y, x); return true;
+        case GGML_OP_SIN:  vec_unary_op<op_sin>(n, y, x);  return true;
+        case GGML_OP_COS:  vec_unary_op<op_cos>(n, y, x);  return true;
+        case GGML_OP_LOG:  vec_unary_op<op_log>(n, y, x);  return true;
+        case GGML_OP_UNARY:
+            switch (ggml_get_unary_op(dst)) {
+                case GGML_UNARY_OP_ABS:         vec_unary_op<op_abs>(n, y, x);         return true;
+                case GGML_UNARY_OP_SGN:         vec_unary_op<op_sgn>(n, y, x);         return true;
+                case GGML_UNARY_OP_NEG:         vec_unary_op<op_neg>(n, y, x);         return true;
+                case GGML_UNARY_OP_STEP:        vec_unary_op<op_step>(n, y, x);        return true;
+                case GGML_UNARY_OP_TANH:        vec_unary_op<op_tanh>(n, y, x);        return true;
+                case GGML_UNARY_OP_ELU:         vec_unary_op<op_elu>(n, y, x);         return true;
+                case GGML_UNARY_OP_RELU:        vec_unary_op<op_relu>(n, y, x);        return true;
+                case GGML_UNARY_OP_SIGMOID:     vec_unary_op<op_sigmoid>(n, y, x);     return true;
+                case GGML_UNARY_OP_HARDSIGMOID: vec_unary_op<op_hardsigmoid>(n, y, x); return true;
+                case GGML_UNARY_OP_EXP:         vec_unary_op<op_exp>(n, y, x);         return true;
+                case GGML_UNARY_OP_HARDSWISH:   vec_unary_op<op_hardswish>(n, y, x);   return true;
+                default:                        return false;
+            }
+        default:
+            return false;
+    }
+}
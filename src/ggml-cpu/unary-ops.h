@@ -24,6 +24,10 @@ void ggml_compute_forward_cos(const struct ggml_compute_params * params, struct
 void ggml_compute_forward_log(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_xielu(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 
+// one f32 row of the op of dst, for the fused chains of fused-ops.cpp
+// returns false if the op is not implemented in this file, call with n = 0 to check
+bool ggml_compute_unary_row_f32(const struct ggml_tensor * dst, int64_t n, float * y, const float * x);
+
 #ifdef __cplusplus
 }
 #endif
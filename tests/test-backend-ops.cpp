@@ -104,7 +104,7 @@ static void init_tensor_uniform(ggml_tensor * tensor, float min = -1.0f, float m
             };
 
             const size_t min_blocks_per_thread = 1;
-            const size_t n_threads = std::min<size_t>(std::thread::hardware_concurrency()/2,
+            const size_t n_threads = std::min<size_t>(std::max<size_t>(1, std::thread::hardware_concurrency()/2),
                                                       std::max<size_t>(1, n_blocks / min_blocks_per_thread));
             std::vector<std::future<void>> tasks;
             tasks.reserve(n_threads);
@@ -1292,6 +1292,106 @@ struct test_case {
         return test_passed;
     }
 
+    // compare the result of the graph with the matrix of a MUL_MAT or MUL_MAT_ID in buft, an extra buffer type of the
+    // backend that changes the layout of the weights (e.g. CPU_REPACK), with the result of the same graph with the matrix in
+    // the memory of the backend
+    // tested is false if the op does not use the extra buffer type
+    bool eval_extra_buft(ggml_backend_t backend, ggml_backend_buffer_type_t buft, const char * op_names_filter, printer * output_printer, bool & tested) {
+        mode = MODE_TEST;
+        tested = false;
+
+        ggml_init_params params = {
+            /* .mem_size = */ ggml_tensor_overhead()*128 + ggml_graph_overhead(),
+            /* .mem_base = */ NULL,
+            /* .no_alloc = */ true,
+        };
+        ggml_context * ctx = ggml_init(params);
+        GGML_ASSERT(ctx);
+
+        gf = ggml_new_graph(ctx);
+
+        ggml_tensor * out = build_graph(ctx);
+        std::string current_op_name = op_desc(out);
+        if (!matches_filter(out, op_names_filter) || (out->op != GGML_OP_MUL_MAT && out->op != GGML_OP_MUL_MAT_ID) ||
+            out->src[0]->op != GGML_OP_NONE) {
+            ggml_free(ctx);
+            return true;
+        }
+
+        for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != NULL; t = ggml_get_next_tensor(ctx, t)) {
+            if (!ggml_backend_supports_op(backend, t)) {
+                ggml_free(ctx);
+                return true;
+            }
+        }
+
+        ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors(ctx, backend);
+        if (buf == NULL) {
+            printf("failed to allocate tensors [%s] ", ggml_backend_name(backend));
+            ggml_free(ctx);
+            return false;
+        }
+
+        ggml_build_forward_expand(gf, out);
+
+        initialize_tensors(ctx);
+
+        ggml_backend_graph_compute(backend, gf);
+        const std::vector<float> f1 = tensor_to_float(out);
+
+        // move the matrix to the extra buffer, the data is converted to its layout when it is set
+        ggml_tensor * a = out->src[0];
+        std::vector<uint8_t> a_data(ggml_nbytes(a));
+        ggml_backend_tensor_get(a, a_data.data(), 0, a_data.size());
+
+        ggml_backend_buffer_t buf_a = ggml_backend_buft_alloc_buffer(buft, ggml_backend_buft_get_alloc_size(buft, a));
+        a->buffer = NULL;
+        a->data   = NULL;
+
+        bool ok = true;
+        if (buf_a == NULL || ggml_backend_tensor_alloc(buf_a, a, ggml_backend_buffer_get_base(buf_a)) != GGML_STATUS_SUCCESS) {
+            printf("failed to allocate %s in %s ", a->name, ggml_backend_buft_name(buft));
+            ok = false;
+        } else if (ggml_backend_supports_op(backend, out)) {
+            tested = true;
+
+            ggml_backend_tensor_set(a, a_data.data(), 0, a_data.size());
+            ggml_backend_graph_compute(backend, gf);
+            const std::vector<float> f2 = tensor_to_float(out);
+
+            for (size_t i = 0; i < f1.size(); i++) {
+                if (std::isnan(f1[i]) || std::isnan(f2[i])) {
+                    printf("[%s] NaN at index %zu ", ggml_op_desc(out), i);
+                    ok = false;
+                    break;
+                }
+            }
+
+            const double err = nmse(f1.data(), f2.data(), f1.size());
+            if (ok && err > max_nmse_err()) {
+                printf("[%s] NMSE = %.9f > %.9f ", ggml_op_desc(out), err, max_nmse_err());
+                ok = false;
+            }
+        }
+
+        if (buf_a != NULL) {
+            ggml_backend_buffer_free(buf_a);
+        }
+        ggml_backend_buffer_free(buf);
+
+        ggml_free(ctx);
+
+        if (tested || !ok) {
+            test_result result(ggml_backend_buft_name(buft), current_op_name, vars(), "test", true, ok, ok ? "" : "test failed");
+
+            if (output_printer) {
+                output_printer->print_test_result(result);
+            }
+        }
+
+        return ok;
+    }
+
     bool eval_perf(ggml_backend_t backend, const char * op_names_filter, printer * output_printer) {
         mode = MODE_PERF;
 
@@ -3105,6 +3205,100 @@ struct test_rms_norm_mul_add : public test_case {
     }
 };
 
+// chains of elementwise ops that backends may fuse
+enum elementwise_chain {
+    CHAIN_SCALE_ADD_SOFT_MAX, // attention scores without soft_max_ext
+    CHAIN_ADD_GELU,           // bias and activation of an FFN
+    CHAIN_MUL_SILU,
+    CHAIN_BATCH_NORM,         // sub/div/mul/add with per-channel parameters, then leaky_relu
+};
+
+static std::string var_to_str(elementwise_chain chain) {
+    switch (chain) {
+        case CHAIN_SCALE_ADD_SOFT_MAX: return "scale_add_soft_max";
+        case CHAIN_ADD_GELU:           return "add_gelu";
+        case CHAIN_MUL_SILU:           return "mul_silu";
+        case CHAIN_BATCH_NORM:         return "batch_norm";
+    }
+    return "unknown";
+}
+
+struct test_elementwise_chain : public test_case {
+    const elementwise_chain chain;
+    const std::array<int64_t, 4> ne;
+
+    std::string op_desc(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return "ELEMENTWISE_CHAIN";
+    }
+
+    bool run_whole_graph() override { return true; }
+
+    std::string vars() override {
+        return VARS_TO_STR2(chain, ne);
+    }
+
+    test_elementwise_chain(elementwise_chain chain = CHAIN_ADD_GELU,
+            std::array<int64_t, 4> ne = {64, 5, 4, 3})
+        : chain(chain), ne(ne) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * a = ggml_new_tensor(ctx, GGML_TYPE_F32, 4, ne.data());
+        ggml_set_name(a, "a");
+
+        ggml_tensor * out = nullptr;
+
+        switch (chain) {
+            case CHAIN_SCALE_ADD_SOFT_MAX:
+                {
+                    ggml_tensor * mask = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, ne[0], ne[1]);
+                    ggml_set_name(mask, "mask");
+                    out = ggml_soft_max(ctx, ggml_add(ctx, ggml_scale(ctx, a, 0.125f), mask));
+                } break;
+            case CHAIN_ADD_GELU:
+                {
+                    ggml_tensor * b = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, ne[0]);
+                    ggml_set_name(b, "b");
+                    out = ggml_gelu(ctx, ggml_add(ctx, a, b));
+                } break;
+            case CHAIN_MUL_SILU:
+                {
+                    ggml_tensor * b = ggml_new_tensor(ctx, GGML_TYPE_F32, 4, ne.data());
+                    ggml_set_name(b, "b");
+                    out = ggml_silu(ctx, ggml_mul(ctx, a, b));
+                } break;
+            case CHAIN_BATCH_NORM:
+                {
+                    ggml_tensor * p[4];
+                    for (int i = 0; i < 4; i++) {
+                        p[i] = ggml_new_tensor_4d(ctx, GGML_TYPE_F32, 1, 1, ne[2], 1);
+                        ggml_set_name(p[i], (std::string("p") + std::to_string(i)).c_str());
+                    }
+                    out = ggml_sub(ctx, a, p[0]);
+                    out = ggml_div(ctx, out, ggml_sqrt(ctx, p[1]));
+                    out = ggml_mul(ctx, out, p[2]);
+                    out = ggml_add(ctx, out, p[3]);
+                    out = ggml_leaky_relu(ctx, out, 0.1f, true);
+                } break;
+        }
+
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+
+    void initialize_tensors(ggml_context * ctx) override {
+        for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != NULL; t = ggml_get_next_tensor(ctx, t)) {
+            // positive variances for the sqrt of the batch norm
+            if (strcmp(t->name, "p1") == 0) {
+                init_tensor_uniform(t, 0.5f, 2.0f);
+            } else {
+                init_tensor_uniform(t);
+            }
+        }
+    }
+};
+
 // GGML_OP_SSM_CONV
 struct test_ssm_conv : public test_case {
     const ggml_type type;
@@ -3397,6 +3591,66 @@ struct test_mul_mat : public test_case {
     }
 };
 
+// GGML_OP_MUL_MAT with a and b permuted independently, including dim 0 (e.g. a transposed b)
+struct test_mul_mat_permuted : public test_case {
+    const ggml_type type_a;
+    const ggml_type type_b;
+    const int64_t m;
+    const int64_t n;
+    const int64_t k;
+    const std::array<int64_t, 2> bs;    // dims 3 and 4
+    const std::array<int64_t, 2> nr;    // repeat in dims 3 and 4
+    const std::array<int64_t, 4> per_a; // permutation of the dimensions of a
+    const std::array<int64_t, 4> per_b; // permutation of the dimensions of b
+
+    std::string vars() override {
+        return VARS_TO_STR9(type_a, type_b, m, n, k, bs, nr, per_a, per_b);
+    }
+
+    double max_nmse_err() override {
+        return 5e-4;
+    }
+
+    uint64_t op_flops(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return 2 * m * n * k * bs[0] * nr[0] * bs[1] * nr[1];
+    }
+
+    test_mul_mat_permuted(ggml_type type_a = GGML_TYPE_F32, ggml_type type_b = GGML_TYPE_F32,
+            int64_t m = 32, int64_t n = 32, int64_t k = 32,
+            std::array<int64_t, 2> bs = {3, 2},
+            std::array<int64_t, 2> nr = {1, 1},
+            std::array<int64_t, 4> per_a = {0, 1, 2, 3},
+            std::array<int64_t, 4> per_b = {1, 0, 2, 3})
+        : type_a(type_a), type_b(type_b), m(m), n(n), k(k), bs(bs), nr(nr), per_a(per_a), per_b(per_b) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        // the tensors are created with the permuted dimensions, then permuted back to the dimensions given by m,n,k
+        const int64_t ne_a[4] = {k, m, bs[0],       bs[1]};
+        const int64_t ne_b[4] = {k, n, bs[0]*nr[0], bs[1]*nr[1]};
+
+        ggml_tensor * a = ggml_new_tensor_4d(ctx, type_a, ne_a[per_a[0]], ne_a[per_a[1]], ne_a[per_a[2]], ne_a[per_a[3]]);
+        ggml_tensor * b = ggml_new_tensor_4d(ctx, type_b, ne_b[per_b[0]], ne_b[per_b[1]], ne_b[per_b[2]], ne_b[per_b[3]]);
+        ggml_set_name(a, "a");
+        ggml_set_name(b, "b");
+
+        a = ggml_permute(ctx, a, per_a[0], per_a[1], per_a[2], per_a[3]);
+        b = ggml_permute(ctx, b, per_b[0], per_b[1], per_b[2], per_b[3]);
+        ggml_set_name(a, "a_permuted");
+        ggml_set_name(b, "b_permuted");
+
+        ggml_tensor * out = ggml_mul_mat(ctx, a, b);
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+
+    std::string op_desc(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return ggml_op_name(GGML_OP_MUL_MAT);
+    }
+};
+
 // GGML_OP_MUL_MAT_ID
 struct test_mul_mat_id : public test_case {
     const ggml_type type_a;
@@ -4061,6 +4315,35 @@ struct test_pool2d : public test_case {
     }
 };
 
+// GGML_OP_POOL1D
+struct test_pool1d : public test_case {
+    enum ggml_op_pool pool_type;
+    const ggml_type type_input;
+    const std::array<int64_t, 4> ne_input;
+    // kernel size, equal to the stride
+    const int k0;
+
+    std::string vars() override {
+        return VARS_TO_STR4(pool_type, type_input, ne_input, k0);
+    }
+
+    test_pool1d(ggml_op_pool pool_type = GGML_OP_POOL_AVG,
+            ggml_type type_input = GGML_TYPE_F32,
+            std::array<int64_t, 4> ne_input = {10, 3, 2, 1}, // [input_width, rows, channels, 1]
+            int k0 = 2)
+        : pool_type(pool_type), type_input(type_input), ne_input(ne_input), k0(k0) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * input = ggml_new_tensor(ctx, type_input, 4, ne_input.data());
+        ggml_set_name(input, "input");
+
+        ggml_tensor * out = ggml_pool_1d(ctx, input, pool_type, k0, k0, 0);
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+};
+
 // GGML_OP_CONV_TRANSPOSE_1D
 struct test_conv_transpose_1d : public test_case {
     const std::array<int64_t, 4> ne_input;
@@ -4541,6 +4824,48 @@ struct test_argsort : public test_case {
     }
 };
 
+// GGML_OP_TOP_K
+struct test_argsort_top_k : public test_case {
+    const ggml_type type;
+    const std::array<int64_t, 4> ne;
+    const int k;
+
+    std::string vars() override {
+        return VARS_TO_STR3(type, ne, k);
+    }
+
+    test_argsort_top_k(ggml_type type = GGML_TYPE_F32,
+            std::array<int64_t, 4> ne = {16, 10, 10, 10},
+            int k = 4)
+        : type(type), ne(ne), k(k) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * a = ggml_new_tensor(ctx, type, 4, ne.data());
+        ggml_set_name(a, "a");
+
+        ggml_tensor * out = ggml_argsort_top_k(ctx, a, k);
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+
+    void initialize_tensors(ggml_context * ctx) override {
+        std::random_device rd;
+        std::default_random_engine rng(rd());
+        for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != NULL; t = ggml_get_next_tensor(ctx, t)) {
+            // initialize with unique values to avoid ties
+            for (int64_t r = 0; r < ggml_nrows(t); r++) {
+                std::vector<float> data(t->ne[0]);
+                for (int i = 0; i < t->ne[0]; i++) {
+                    data[i] = i;
+                }
+                std::shuffle(data.begin(), data.end(), rng);
+                ggml_backend_tensor_set(t, data.data(), r * t->nb[1], t->ne[0] * sizeof(float));
+            }
+        }
+    }
+};
+
 struct test_topk_moe: public test_case {
     const std::array<int64_t, 4> ne;
     const int n_expert_used;
@@ -5875,6 +6200,9 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
                     }
                 }
             }
+            for (int k0 : {1, 2, 3}) {
+                test_cases.emplace_back(new test_pool1d(pool_type, type_input, {10, 3, 2, 1}, k0));
+            }
         }
     }
 
@@ -6210,6 +6538,13 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
     test_cases.emplace_back(new test_cpy(GGML_TYPE_F32, GGML_TYPE_I32, {256, 2, 3, 4}, {1, 0, 2, 3}));
     test_cases.emplace_back(new test_cpy(GGML_TYPE_I32, GGML_TYPE_F32, {256, 2, 3, 4}));
     test_cases.emplace_back(new test_cpy(GGML_TYPE_I32, GGML_TYPE_F32, {256, 2, 3, 4}, {1, 0, 2, 3}));
+    for (ggml_type type_src : {GGML_TYPE_F16, GGML_TYPE_BF16, GGML_TYPE_F32}) {
+        for (ggml_type type_dst : {GGML_TYPE_F16, GGML_TYPE_BF16, GGML_TYPE_F32}) {
+            test_cases.emplace_back(new test_cpy(type_src, type_dst, {67, 45, 3, 2}, {1, 0, 2, 3})); // tiled transpose
+            test_cases.emplace_back(new test_cpy(type_src, type_dst, {64, 32, 9, 2}, {1, 2, 0, 3}));
+            test_cases.emplace_back(new test_cpy(type_src, type_dst, {48, 48, 3, 2}, {0, 0, 0, 0}, {1, 0, 2, 3}));
+        }
+    }
 
     test_cases.emplace_back(new test_cont());
     test_cases.emplace_back(new test_cont(GGML_TYPE_F32, {2, 1, 1 ,1}));
@@ -6221,6 +6556,8 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
     test_cases.emplace_back(new test_cont(GGML_TYPE_BF16, {2, 1, 1 ,1}));
     test_cases.emplace_back(new test_cont(GGML_TYPE_BF16, {2, 1, 3 ,5}));
     test_cases.emplace_back(new test_cont(GGML_TYPE_BF16, {2, 3, 5 ,7}));
+    test_cases.emplace_back(new test_cont(GGML_TYPE_F32, {67, 45, 3, 2}));
+    test_cases.emplace_back(new test_cont(GGML_TYPE_F16, {67, 45, 3, 2}));
 
     auto add_test_bin_bcast = [&](ggml_type type, std::array<int64_t, 4> ne, std::array<int, 4> nr) {
         for (auto op : {ggml_add, ggml_sub, ggml_mul, ggml_div}) {
@@ -6311,6 +6648,11 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
         }
     }
 
+    for (elementwise_chain chain : {CHAIN_SCALE_ADD_SOFT_MAX, CHAIN_ADD_GELU, CHAIN_MUL_SILU, CHAIN_BATCH_NORM}) {
+        test_cases.emplace_back(new test_elementwise_chain(chain, {64, 5, 4, 3}));
+        test_cases.emplace_back(new test_elementwise_chain(chain, {1500, 7, 3, 1}));
+    }
+
     test_cases.emplace_back(new test_l2_norm(GGML_TYPE_F32, {64, 5, 4, 3}, 1e-12f));
 
     for (int64_t d_conv : {3, 4}) {
@@ -6324,21 +6666,25 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
     test_cases.emplace_back(new test_ssm_scan(GGML_TYPE_F32, 16, 1, 1024, 1, 32, 4)); // Mamba-1
     test_cases.emplace_back(new test_ssm_scan(GGML_TYPE_F32, 128, 64, 16, 2, 32, 4)); // Mamba-2
     test_cases.emplace_back(new test_ssm_scan(GGML_TYPE_F32, 256, 64,  8, 2, 32, 4)); // Falcon-H1
+    test_cases.emplace_back(new test_ssm_scan(GGML_TYPE_F32, 128, 64,  2, 1, 300, 1)); // Mamba-2, long sequence
 
     test_cases.emplace_back(new test_rwkv_wkv6(GGML_TYPE_F32, 32, 64, 1, 1));
     test_cases.emplace_back(new test_rwkv_wkv6(GGML_TYPE_F32, 32, 64, 32, 1));
     test_cases.emplace_back(new test_rwkv_wkv6(GGML_TYPE_F32, 32, 64, 32, 4));
     test_cases.emplace_back(new test_rwkv_wkv6(GGML_TYPE_F32, 32, 64, 128, 4));
+    test_cases.emplace_back(new test_rwkv_wkv6(GGML_TYPE_F32, 2, 64, 300, 1));
 
     test_cases.emplace_back(new test_rwkv_wkv7(GGML_TYPE_F32, 32, 64, 1, 1));
     test_cases.emplace_back(new test_rwkv_wkv7(GGML_TYPE_F32, 32, 64, 32, 1));
     test_cases.emplace_back(new test_rwkv_wkv7(GGML_TYPE_F32, 32, 64, 32, 4));
     test_cases.emplace_back(new test_rwkv_wkv7(GGML_TYPE_F32, 32, 64, 128, 4));
+    test_cases.emplace_back(new test_rwkv_wkv7(GGML_TYPE_F32, 2, 64, 300, 1));
 
     test_cases.emplace_back(new test_gla(GGML_TYPE_F32, 32, 64, 1, 1));
     test_cases.emplace_back(new test_gla(GGML_TYPE_F32, 32, 64, 32, 1));
     test_cases.emplace_back(new test_gla(GGML_TYPE_F32, 32, 64, 32, 4));
     test_cases.emplace_back(new test_gla(GGML_TYPE_F32, 32, 64, 128, 4));
+    test_cases.emplace_back(new test_gla(GGML_TYPE_F32, 2, 64, 300, 1));
 
 #if 0
     // > 4GB A matrix. Too slow to be enabled by default.
@@ -6411,6 +6757,19 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
             test_cases.emplace_back(new test_mul_mat(type_a, type_b, 16, 1, 256, {1,  1}, {1, 1}));
         }
     }
+    // few rows with a long reduction dimension (split-K on the CPU)
+    for (ggml_type type_a : {GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K, GGML_TYPE_Q6_K}) {
+        test_cases.emplace_back(new test_mul_mat(type_a, GGML_TYPE_F32,  5, 1, 8192, {1,  1}, {1, 1}));
+        test_cases.emplace_back(new test_mul_mat(type_a, GGML_TYPE_F32, 33, 1, 5120, {1,  1}, {1, 1}));
+    }
+    // weights that the CPU backend can repack into interleaved rows, with several blocks per row and both the rows
+    // of src1 that are multiplied 4 at a time and the remaining ones
+    for (ggml_type type_a : {GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q2_K, GGML_TYPE_Q4_K, GGML_TYPE_Q5_K, GGML_TYPE_Q6_K, GGML_TYPE_IQ4_NL, GGML_TYPE_IQ4_XS}) {
+        for (int n : {1, 6, 32}) {
+            test_cases.emplace_back(new test_mul_mat(type_a, GGML_TYPE_F32, 64, n, 1024, {1,  1}, {1, 1}));
+        }
+        test_cases.emplace_back(new test_mul_mat_id(type_a, GGML_TYPE_F32, 4, 2, false, 64, 9, 1024));
+    }
 #else
     // m = a rows
     // n = b rows
@@ -6472,6 +6831,23 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
         }
     }
 
+    // transposed or permuted b and permuted a, without ggml_cont
+    for (ggml_type type_a : {GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_BF16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K}) {
+        for (int64_t n : {1, 7, 48}) {
+            for (auto per_b : std::vector<std::array<int64_t, 4>>{{1, 0, 2, 3}, {1, 2, 0, 3}, {2, 0, 1, 3}, {3, 0, 1, 2}}) {
+                test_cases.emplace_back(new test_mul_mat_permuted(type_a, GGML_TYPE_F32, 33, n, 256, {3, 2}, {1, 1}, {0, 1, 2, 3}, per_b));
+            }
+        }
+    }
+    for (ggml_type type_a : {GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_BF16}) {
+        for (auto per_a : std::vector<std::array<int64_t, 4>>{{2, 0, 1, 3}, {3, 0, 1, 2}}) {
+            test_cases.emplace_back(new test_mul_mat_permuted(type_a, GGML_TYPE_F32, 33, 1,  67, {3, 2}, {2, 1}, per_a, {0, 1, 2, 3}));
+            test_cases.emplace_back(new test_mul_mat_permuted(type_a, GGML_TYPE_F32, 33, 20, 67, {3, 2}, {2, 1}, per_a, {0, 1, 2, 3}));
+            test_cases.emplace_back(new test_mul_mat_permuted(type_a, GGML_TYPE_F32, 33, 20, 67, {3, 2}, {1, 1}, per_a, {1, 0, 2, 3}));
+        }
+        test_cases.emplace_back(new test_mul_mat_permuted(type_a, type_a, 16, 9, 64, {3, 1}, {1, 1}, {0, 1, 2, 3}, {1, 0, 2, 3}));
+    }
+
     // sycl backend will limit task global_range < MAX_INT
     // test case for f16-type-convert-to-fp32 kernel with large k under fp32 compute dtype (occurs in stable-diffusion)
     // however this case needs to alloc more memory which may fail in some devices (Intel Arc770, etc.)
@@ -6712,6 +7088,13 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
         test_cases.emplace_back(new test_argsort(GGML_TYPE_F32, {60, 10, 10, 10}, order)); // qwen
         test_cases.emplace_back(new test_argsort(GGML_TYPE_F32, {1024, 1, 1, 1}, order));
         test_cases.emplace_back(new test_argsort(GGML_TYPE_F32, {16384, 1, 1, 1}, order)); // bailingmoe2 (group selection)
+        test_cases.emplace_back(new test_argsort(GGML_TYPE_F32, {65536, 2, 1, 1}, order));
+    }
+
+    for (int k : {1, 4, 8}) {
+        test_cases.emplace_back(new test_argsort_top_k(GGML_TYPE_F32, {16, 10, 10, 10}, k));
+        test_cases.emplace_back(new test_argsort_top_k(GGML_TYPE_F32, {256, 32, 1, 1}, k)); // moe routing
+        test_cases.emplace_back(new test_argsort_top_k(GGML_TYPE_F32, {65536, 2, 1, 1}, k));
     }
 
     for (ggml_scale_mode mode : {GGML_SCALE_MODE_NEAREST, GGML_SCALE_MODE_BILINEAR}) {
@@ -6801,6 +7184,13 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
         }
     }
 
+    // quantized KV cache with q5_0 V, dequantized on the fly
+    for (int kv : { 113, 512, }) {
+        for (int nb : { 1, 3, 32, }) {
+            test_cases.emplace_back(new test_flash_attn_ext(128, 128, 4, {4, 1}, kv, nb, true, false, 0.0f, 0.0f, GGML_PREC_F32, GGML_TYPE_Q5_0));
+        }
+    }
+
     test_cases.emplace_back(new test_cross_entropy_loss     (GGML_TYPE_F32, {   10, 5, 4, 3}));
     test_cases.emplace_back(new test_cross_entropy_loss     (GGML_TYPE_F32, {30000, 1, 1, 1}));
     test_cases.emplace_back(new test_cross_entropy_loss_back(GGML_TYPE_F32, {   10, 5, 4, 3}));
@@ -6877,6 +7267,9 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
     test_cases.emplace_back(new test_cpy(GGML_TYPE_F32,  GGML_TYPE_F16,  {512, 3072, 1, 1}));
     test_cases.emplace_back(new test_cpy(GGML_TYPE_F32,  GGML_TYPE_F32,  {8192, 512, 2, 1}, {0, 2, 1, 3}));
     test_cases.emplace_back(new test_cpy(GGML_TYPE_F32,  GGML_TYPE_F32,  {3072, 512, 2, 1}, {0, 2, 1, 3}));
+    test_cases.emplace_back(new test_cpy(GGML_TYPE_F32,  GGML_TYPE_F32,  {64, 4096, 16, 1}, {1, 0, 2, 3}));
+    test_cases.emplace_back(new test_cpy(GGML_TYPE_F16,  GGML_TYPE_F16,  {128, 512, 32, 1}, {1, 2, 0, 3}));
+    test_cases.emplace_back(new test_cont(GGML_TYPE_F32, {4096, 4096, 1, 1}));
     test_cases.emplace_back(new test_cpy(GGML_TYPE_F32,  GGML_TYPE_Q4_0, {8192, 512, 2, 1}));
     test_cases.emplace_back(new test_cpy(GGML_TYPE_Q4_0, GGML_TYPE_F32,  {8192, 512, 2, 1}));
 
@@ -6902,6 +7295,10 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
     test_cases.emplace_back(new test_mul_mat(GGML_TYPE_F16, GGML_TYPE_F32, 16416, 1, 128, {8,  1}, {4, 1}, {0, 2, 1, 3}));
     test_cases.emplace_back(new test_mul_mat(GGML_TYPE_F16, GGML_TYPE_F32, 128, 1, 16416, {8,  1}, {4, 1}, {0, 1, 2, 3}, true));
 
+    // attention output with a transposed V, as in the mask decoder of examples/sam
+    test_cases.emplace_back(new test_mul_mat_permuted(GGML_TYPE_F32, GGML_TYPE_F32, 1024, 64, 1024, {8, 1}, {1, 1}, {0, 1, 2, 3}, {1, 0, 2, 3}));
+    test_cases.emplace_back(new test_mul_mat_permuted(GGML_TYPE_F32, GGML_TYPE_F32, 1024, 64, 1024, {8, 1}, {1, 1}, {0, 1, 2, 3}, {1, 2, 0, 3}));
+
     for (int bs : {1, 2, 3, 4, 5, 8, 512}) {
         for (ggml_type type_a : all_types) {
             for (ggml_type type_b : {GGML_TYPE_F32}) {
@@ -6910,6 +7307,25 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
         }
     }
 
+    // token generation with few output rows and a long reduction dimension
+    for (ggml_type type_a : {GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K}) {
+        test_cases.emplace_back(new test_mul_mat(type_a, GGML_TYPE_F32, 64, 1, 14336, {1,  1}, {1, 1}));
+    }
+
+    // mixtral-8x7b
+    for (int bs : {1, 4, 32, 512}) {
+        for (ggml_type type_a : {GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K}) {
+            test_cases.emplace_back(new test_mul_mat_id(type_a, GGML_TYPE_F32, 8, 2, false, 14336, bs, 4096, 1));
+        }
+    }
+
+    // deepseek-v2-lite
+    for (int bs : {1, 4, 32, 512}) {
+        for (ggml_type type_a : {GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K}) {
+            test_cases.emplace_back(new test_mul_mat_id(type_a, GGML_TYPE_F32, 64, 6, false, 1408, bs, 2048, 1));
+        }
+    }
+
     // qwen3-30b-a3b
     for (int bs : {1, 4, 8, 32, 64, 128, 256, 512}) {
         for (ggml_type type_a : {GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K, GGML_TYPE_Q6_K, GGML_TYPE_IQ2_XS}) {
@@ -6957,13 +7373,55 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
         }
     }
 
+    // decode over a quantized KV cache
+    for (ggml_type type_KV : { GGML_TYPE_Q8_0, GGML_TYPE_Q4_0, GGML_TYPE_Q5_0, }) {
+        test_cases.emplace_back(new test_flash_attn_ext(128, 128, 8, {4, 1}, 16384, 1, true, false, 0, 0, GGML_PREC_F32, type_KV));
+    }
+
+    // prefill
+    for (int kv : { 1024, 4096, 16384, 32768, }) {
+        for (int hs : { 64, 80, 128, }) {
+            for (int nr : { 1, 4, }) {
+                test_cases.emplace_back(new test_flash_attn_ext(hs, hs, 8, {nr, 1}, kv, 512, true, false, 0, 0, GGML_PREC_F32, GGML_TYPE_F16));
+            }
+        }
+    }
+
+    // norm -> mul -> add chains of gpt-2 and llama prompt processing
+    test_cases.emplace_back(new test_norm_mul_add(GGML_TYPE_F32, {768, 512, 1, 1}, 1e-5f, false));
+    test_cases.emplace_back(new test_rms_norm_mul_add(GGML_TYPE_F32, {4096, 512, 1, 1}, 1e-6f, false));
+
+    test_cases.emplace_back(new test_elementwise_chain(CHAIN_SCALE_ADD_SOFT_MAX, {512, 512, 12, 1}));
+    test_cases.emplace_back(new test_elementwise_chain(CHAIN_ADD_GELU,           {3072, 512, 1, 1}));
+    test_cases.emplace_back(new test_elementwise_chain(CHAIN_MUL_SILU,           {11008, 64, 1, 1}));
+    test_cases.emplace_back(new test_elementwise_chain(CHAIN_BATCH_NORM,         {104, 104, 128, 1}));
+
     test_cases.emplace_back(new test_conv_2d_dw({512, 512, 256, 1}, {3, 3, 1, 256}, 1, 1, 1, false));
     test_cases.emplace_back(new test_conv_2d_dw({512, 512, 256, 1}, {3, 3, 1, 256}, 1, 1, 1, true));
+    // mobile-style backbones: depthwise convolutions and pooling on small feature maps
+    for (bool cwhn : {false, true}) {
+        test_cases.emplace_back(new test_conv_2d_dw({112, 112, 96, 1}, {3, 3, 1, 96},  1, 1, 1, cwhn));
+        test_cases.emplace_back(new test_conv_2d_dw({56, 56, 144, 1},  {3, 3, 1, 144}, 2, 1, 1, cwhn));
+        test_cases.emplace_back(new test_conv_2d_dw({14, 14, 576, 1},  {5, 5, 1, 576}, 1, 2, 1, cwhn));
+    }
+    for (ggml_op_pool pool_type : {GGML_OP_POOL_AVG, GGML_OP_POOL_MAX}) {
+        test_cases.emplace_back(new test_pool2d(pool_type, GGML_TYPE_F32, {208, 208, 64, 1}, 2, 2, 2, 2, 0, 0));
+        test_cases.emplace_back(new test_pool2d(pool_type, GGML_TYPE_F32, {112, 112, 96, 1}, 3, 3, 2, 2, 1, 1));
+        test_cases.emplace_back(new test_pool2d(pool_type, GGML_TYPE_F32, {7, 7, 1280, 1},   7, 7, 7, 7, 0, 0));
+        test_cases.emplace_back(new test_pool1d(pool_type, GGML_TYPE_F32, {4096, 512, 1, 1}, 4));
+    }
 
     test_cases.emplace_back(new test_conv_transpose_2d({256, 256, 256, 1}, {3, 3, 16, 256}, 1));
 
     test_cases.emplace_back(new test_mean(GGML_TYPE_F32, {256, 256, 3, 1}));
 
+    // long sequences of the linear attention scans
+    for (int64_t n_seq_tokens : {512, 4096, 16384}) {
+        test_cases.emplace_back(new test_ssm_scan(GGML_TYPE_F32, 128, 64, 16, 1, n_seq_tokens, 1)); // Mamba-2
+        test_cases.emplace_back(new test_rwkv_wkv6(GGML_TYPE_F32, 16, 64, n_seq_tokens, 1));
+        test_cases.emplace_back(new test_rwkv_wkv7(GGML_TYPE_F32, 16, 64, n_seq_tokens, 1));
+        test_cases.emplace_back(new test_gla(GGML_TYPE_F32, 16, 64, n_seq_tokens, 1));
+    }
 
     for (int n_token : {1, 512}) {
         test_cases.emplace_back(new test_add_id(GGML_TYPE_F32, GGML_TYPE_F32, 2880, 128, 4, n_token));
@@ -6985,25 +7443,58 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
     return test_cases;
 }
 
-static bool test_backend(ggml_backend_t backend, test_mode mode, const char * op_names_filter, const char * params_filter,
-                         printer * output_printer) {
-    auto filter_test_cases = [](std::vector<std::unique_ptr<test_case>> & test_cases, const char * params_filter) {
-        if (params_filter == nullptr) {
-            return;
+static void filter_test_cases(std::vector<std::unique_ptr<test_case>> & test_cases, const char * params_filter) {
+    if (params_filter == nullptr) {
+        return;
+    }
+
+    std::regex params_filter_regex(params_filter);
+
+    for (auto it = test_cases.begin(); it != test_cases.end();) {
+        if (!std::regex_search((*it)->vars(), params_filter_regex)) {
+            it = test_cases.erase(it);
+            continue;
         }
 
-        std::regex params_filter_regex(params_filter);
+        it++;
+    }
+}
+
+// the matrix multiplications with their weights in the extra buffer types of the device of backend, against the backend itself
+static bool test_backend_extra_bufts(ggml_backend_t backend, const char * op_names_filter, const char * params_filter,
+                                     printer * output_printer) {
+    ggml_backend_dev_t dev = ggml_backend_get_device(backend);
+    ggml_backend_reg_t reg = ggml_backend_dev_backend_reg(dev);
 
-        for (auto it = test_cases.begin(); it != test_cases.end();) {
-            if (!std::regex_search((*it)->vars(), params_filter_regex)) {
-                it = test_cases.erase(it);
-                continue;
-            }
+    auto get_extra_bufts_fn = (ggml_backend_dev_get_extra_bufts_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_dev_get_extra_bufts");
+    if (get_extra_bufts_fn == nullptr) {
+        return true;
+    }
+
+    bool ok = true;
+
+    for (ggml_backend_buffer_type_t * buft = get_extra_bufts_fn(dev); buft && *buft; ++buft) {
+        auto test_cases = make_test_cases_eval();
+        filter_test_cases(test_cases, params_filter);
 
-            it++;
+        size_t n_ok     = 0;
+        size_t n_tested = 0;
+        for (auto & test : test_cases) {
+            bool tested;
+            const bool test_ok = test->eval_extra_buft(backend, *buft, op_names_filter, output_printer, tested);
+            n_tested += tested || !test_ok;
+            n_ok     += tested && test_ok;
         }
-    };
+        output_printer->print_summary(test_summary_info(n_ok, n_tested, false));
+
+        ok = ok && n_ok == n_tested;
+    }
+
+    return ok;
+}
 
+static bool test_backend(ggml_backend_t backend, test_mode mode, const char * op_names_filter, const char * params_filter,
+                         printer * output_printer) {
     if (mode == MODE_TEST) {
         auto test_cases = make_test_cases_eval();
         filter_test_cases(test_cases, params_filter);
@@ -7025,7 +7516,12 @@ static bool test_backend(ggml_backend_t backend, test_mode mode, const char * op
 
         ggml_backend_free(backend_cpu);
 
-        return n_ok == test_cases.size();
+        bool ok = n_ok == test_cases.size();
+        if (ggml_backend_dev_type(ggml_backend_get_device(backend)) == GGML_BACKEND_DEVICE_TYPE_CPU) {
+            ok = test_backend_extra_bufts(backend, op_names_filter, params_filter, output_printer) && ok;
+        }
+
+        return ok;
     }
 
     if (mode == MODE_GRAD) {
@@ -7254,7 +7750,21 @@ int main(int argc, char ** argv) {
         if (backend_filter == NULL && ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_CPU && mode != MODE_GRAD) {
             output_printer->print_backend_init(backend_init_info(
                 i, ggml_backend_dev_count(), ggml_backend_dev_name(dev), true, "Skipping CPU backend"));
-            n_ok++;
+
+            // the CPU backend is the reference of the other backends, but its extra buffer types are tested against it
+            bool ok = true;
+            if (mode == MODE_TEST) {
+                ggml_backend_t backend = ggml_backend_dev_init(dev, NULL);
+                GGML_ASSERT(backend != NULL);
+
+                ok = test_backend_extra_bufts(backend, op_names_filter, params_filter, output_printer.get());
+
+                ggml_backend_free(backend);
+            }
+
+            if (ok) {
+                n_ok++;
+            }
             continue;
         }
 
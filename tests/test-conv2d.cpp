@@ -191,6 +191,183 @@ struct ggml_cgraph * compute_graph(const test_model & model, ggml_gallocr_t allo
     return gf;
 }
 
+// normalized mean squared error of a 3x3 stride 1 convolution against a reference computed in double precision
+static double conv2d_nmse(const float * adata, const float * bdata, const float * res,
+                          int IW, int IH, int IC, int OC, int N, int p0, int p1, int OW, int OH) {
+    const int KW = 3, KH = 3;
+
+    double err = 0.0;
+    double ref = 0.0;
+
+    for (int n = 0; n < N; n++) {
+        for (int oc = 0; oc < OC; oc++) {
+            for (int oy = 0; oy < OH; oy++) {
+                for (int ox = 0; ox < OW; ox++) {
+                    double sum = 0.0;
+                    for (int ic = 0; ic < IC; ic++) {
+                        for (int ky = 0; ky < KH; ky++) {
+                            for (int kx = 0; kx < KW; kx++) {
+                                const int iy = oy + ky - p1;
+                                const int ix = ox + kx - p0;
+                                if (iy < 0 || iy >= IH || ix < 0 || ix >= IW) {
+                                    continue;
+                                }
+                                sum += (double) adata[((oc*IC + ic)*KH + ky)*KW + kx] * bdata[((n*IC + ic)*IH + iy)*IW + ix];
+                            }
+                        }
+                    }
+                    const double val = res[((n*OC + oc)*OH + oy)*OW + ox];
+                    err += (val - sum)*(val - sum);
+                    ref += sum*sum;
+                }
+            }
+        }
+    }
+
+    return err/ref;
+}
+
+// compares ggml_conv_2d_direct with a reference computed in double precision
+// 3x3 convolutions with stride 1 over images that are large enough use the Winograd path of the CPU backend
+static bool test_conv2d_direct(ggml_type type_kernel, int IW, int IH, int IC, int OC, int N, int p0, int p1, int n_threads) {
+    const int KW = 3, KH = 3;
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 64*1024*1024,
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ false,
+    };
+
+    struct ggml_context * ctx = ggml_init(params);
+
+    struct ggml_tensor * a = ggml_new_tensor_4d(ctx, type_kernel,   KW, KH, IC, OC);
+    struct ggml_tensor * b = ggml_new_tensor_4d(ctx, GGML_TYPE_F32, IW, IH, IC, N);
+
+    std::vector<float> adata(KW*KH*IC*OC);
+    for (size_t i = 0; i < adata.size(); i++) {
+        adata[i] = (float) ((i*7919) % 201) / 100.0f - 1.0f;
+    }
+    if (type_kernel == GGML_TYPE_F16) {
+        ggml_fp32_to_fp16_row(adata.data(), (ggml_fp16_t *) a->data, adata.size());
+        ggml_fp16_to_fp32_row((ggml_fp16_t *) a->data, adata.data(), adata.size());
+    } else {
+        memcpy(a->data, adata.data(), ggml_nbytes(a));
+    }
+
+    float * bdata = (float *) b->data;
+    for (int64_t i = 0; i < ggml_nelements(b); i++) {
+        bdata[i] = (float) ((i*104729) % 301) / 150.0f - 1.0f;
+    }
+
+    struct ggml_tensor * res = ggml_conv_2d_direct(ctx, a, b, 1, 1, p0, p1, 1, 1);
+
+    struct ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, res);
+    ggml_graph_compute_with_ctx(ctx, gf, n_threads);
+
+    const double nmse = conv2d_nmse(adata.data(), bdata, (const float *) res->data, IW, IH, IC, OC, N, p0, p1, res->ne[0], res->ne[1]);
+    const bool passed = nmse < 1e-10;
+
+    printf("ggml_conv_2d_direct (kernel=%s, %dx%dx%d -> %d, N=%d, p=%d,%d, threads=%d): nmse=%.2e %s\n",
+            ggml_type_name(type_kernel), IW, IH, IC, OC, N, p0, p1, n_threads, nmse, passed ? "\033[32mPASSED\033[0m" : "\033[31mFAILED\033[0m");
+
+    ggml_free(ctx);
+
+    return passed;
+}
+
+// the kernel is a weight: its Winograd transform is cached by the CPU backend, and computed again after an invalidation
+static bool test_conv2d_winograd_cache(ggml_type type_kernel, int n_threads) {
+    const int KW = 3, KH = 3, IW = 32, IH = 24, IC = 8, OC = 12, N = 1, p0 = 1, p1 = 1;
+
+    struct ggml_init_params params_w = {
+        /*.mem_size   =*/ ggml_tensor_overhead(),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true,
+    };
+    struct ggml_context * ctx_w = ggml_init(params_w);
+    struct ggml_context * ctx_b = ggml_init(params_w);
+
+    struct ggml_tensor * a = ggml_new_tensor_4d(ctx_w, type_kernel,   KW, KH, IC, OC);
+    struct ggml_tensor * b = ggml_new_tensor_4d(ctx_b, GGML_TYPE_F32, IW, IH, IC, N);
+
+    ggml_backend_buffer_t buf_w = ggml_backend_alloc_ctx_tensors_from_buft(ctx_w, ggml_backend_cpu_buffer_type());
+    ggml_backend_buffer_t buf_b = ggml_backend_alloc_ctx_tensors_from_buft(ctx_b, ggml_backend_cpu_buffer_type());
+    ggml_backend_buffer_set_usage(buf_w, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
+
+    std::vector<float> bdata(IW*IH*IC*N);
+    for (size_t i = 0; i < bdata.size(); i++) {
+        bdata[i] = (float) ((i*104729) % 301) / 150.0f - 1.0f;
+    }
+    ggml_backend_tensor_set(b, bdata.data(), 0, ggml_nbytes(b));
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 16*1024*1024,
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ false,
+    };
+    struct ggml_context * ctx = ggml_init(params);
+
+    std::vector<float> adata(KW*KH*IC*OC);
+
+    // the kernel is only written through the backend API, the cache must notice the writes by itself
+    auto set_kernel = [&](size_t seed) {
+        for (size_t i = 0; i < adata.size(); i++) {
+            adata[i] = (float) ((i*seed) % 201) / 100.0f - 1.0f;
+        }
+        if (type_kernel == GGML_TYPE_F16) {
+            std::vector<ggml_fp16_t> adata_f16(adata.size());
+            ggml_fp32_to_fp16_row(adata.data(), adata_f16.data(), adata.size());
+            ggml_fp16_to_fp32_row(adata_f16.data(), adata.data(), adata.size());
+            ggml_backend_tensor_set(a, adata_f16.data(), 0, ggml_nbytes(a));
+        } else {
+            ggml_backend_tensor_set(a, adata.data(), 0, ggml_nbytes(a));
+        }
+    };
+
+    bool passed = true;
+
+    // 0: the transform is computed and cached, 1: it is reused, 2: the kernel is overwritten in place,
+    // 3: the weights buffer is freed and other weights of the same shape are loaded in a new one, likely at the same address
+    for (int pass = 0; pass < 4; pass++) {
+        if (pass == 3) {
+            ggml_backend_buffer_free(buf_w);
+            ggml_free(ctx_w);
+
+            ctx_w = ggml_init(params_w);
+            a     = ggml_new_tensor_4d(ctx_w, type_kernel, KW, KH, IC, OC);
+            buf_w = ggml_backend_alloc_ctx_tensors_from_buft(ctx_w, ggml_backend_cpu_buffer_type());
+            ggml_backend_buffer_set_usage(buf_w, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
+        }
+        if (pass != 1) {
+            set_kernel(pass == 0 ? 7919 : pass == 2 ? 6007 : 4001);
+        }
+
+        struct ggml_tensor * res = ggml_conv_2d_direct(ctx, a, b, 1, 1, p0, p1, 1, 1);
+
+        struct ggml_cgraph * gf = ggml_new_graph(ctx);
+        ggml_build_forward_expand(gf, res);
+
+        ggml_graph_compute_with_ctx(ctx, gf, n_threads);
+
+        const double nmse = conv2d_nmse(adata.data(), bdata.data(), (const float *) res->data, IW, IH, IC, OC, N, p0, p1, res->ne[0], res->ne[1]);
+        const bool passed_i = nmse < 1e-10;
+
+        printf("ggml_conv_2d_direct (kernel=%s, weights, pass %d, threads=%d): nmse=%.2e %s\n",
+                ggml_type_name(type_kernel), pass, n_threads, nmse, passed_i ? "\033[32mPASSED\033[0m" : "\033[31mFAILED\033[0m");
+
+        passed = passed && passed_i;
+    }
+
+    ggml_free(ctx);
+    ggml_backend_buffer_free(buf_w);
+    ggml_backend_buffer_free(buf_b);
+    ggml_free(ctx_w);
+    ggml_free(ctx_b);
+
+    return passed;
+}
+
 int main(void)
 {
     ggml_time_init();
@@ -382,10 +559,24 @@ int main(void)
 
     printf("ggml_conv2d (%d): %s\n", (int) ggml_nelements(conv2d_res), passed && (ggml_nelements(conv2d_res) == n_conv2d_test) ? "\033[32mPASSED\033[0m" : "\033[31mFAILED\033[0m");
 
+    bool passed_direct = true;
+    for (ggml_type type_kernel : {GGML_TYPE_F32, GGML_TYPE_F16}) {
+        passed_direct &= test_conv2d_direct(type_kernel, 30, 23, 7, 9, 2, 1, 1, 1);
+        passed_direct &= test_conv2d_direct(type_kernel, 30, 23, 7, 9, 2, 0, 2, 3);
+        passed_direct &= test_conv2d_direct(type_kernel, 64, 48, 16, 24, 1, 1, 1, 4);
+    }
+    // a single output channel, the mul_mat of each tile has a single row and reads its operands from the work buffer
+    // (F32 only: the F16 kernels of this size pack the input as F16)
+    passed_direct &= test_conv2d_direct(GGML_TYPE_F32, 5, 5, 256, 1, 1, 1, 1, 2);
+    passed_direct &= test_conv2d_direct(GGML_TYPE_F32, 5, 5, 256, 1, 1, 1, 1, 4);
+    for (ggml_type type_kernel : {GGML_TYPE_F32, GGML_TYPE_F16}) {
+        passed_direct &= test_conv2d_winograd_cache(type_kernel, 2);
+    }
+
     ggml_free(model.ctx);
 
     ggml_backend_buffer_free(model.buffer);
     ggml_backend_free(model.backend);
     ggml_gallocr_free(allocr);
-    return 0;
+    return passed_direct ? 0 : 1;
 }
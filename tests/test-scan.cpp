@@ -0,0 +1,320 @@
+// the linear recurrences gla, rwkv_wkv6, rwkv_wkv7 and ssm_scan computed by the CPU backend
+// against a double-precision, token by token reference
+//
+// the CPU backend processes sequences of 16 tokens or more in chunks, and splits them into segments
+// scanned by different threads when there are fewer (sequence, head) pairs than threads
+
+#include <ggml.h>
+#include <ggml-cpu.h>
+#include <ggml-alloc.h>
+#include <ggml-backend.h>
+#include <ggml-cpp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+struct scan_shape {
+    int64_t head_count;
+    int64_t head_size;
+    int64_t n_seq_tokens;
+    int64_t n_seqs;
+};
+
+static std::vector<float> uniform(std::mt19937 & rng, size_t n, float min, float max) {
+    std::uniform_real_distribution<float> dist(min, max);
+    std::vector<float> data(n);
+    std::generate(data.begin(), data.end(), [&]() { return dist(rng); });
+    return data;
+}
+
+// decays in (0, 1), down to exp(-e^3) ~ 2e-9 so that their products underflow within a chunk
+static std::vector<float> decays(std::mt19937 & rng, size_t n) {
+    std::vector<float> data = uniform(rng, n, -6.0f, 3.0f);
+    for (auto & x : data) {
+        x = expf(-expf(x));
+    }
+    return data;
+}
+
+// each row of head_size values scaled to unit length
+static std::vector<float> unit_rows(std::mt19937 & rng, size_t n, int64_t head_size) {
+    std::vector<float> data = uniform(rng, n, -1.0f, 1.0f);
+    for (size_t i = 0; i < n; i += head_size) {
+        double sum = 0.0;
+        for (int64_t j = 0; j < head_size; j++) {
+            sum += data[i + j]*data[i + j];
+        }
+        for (int64_t j = 0; j < head_size; j++) {
+            data[i + j] /= (float) sqrt(sum);
+        }
+    }
+    return data;
+}
+
+static ggml_tensor * new_tensor(ggml_context * ctx, std::vector<int64_t> ne) {
+    return ggml_new_tensor(ctx, GGML_TYPE_F32, (int) ne.size(), ne.data());
+}
+
+// the output and the final states of the graph compared with the reference, relative to the largest reference value
+static bool run_and_compare(const char * name, const scan_shape & sh, int n_threads,
+        ggml_context * ctx, ggml_tensor * out, const std::vector<std::pair<ggml_tensor *, const void *>> & inputs,
+        const std::vector<double> & ref) {
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, out);
+
+    ggml_backend_ptr backend_ptr{ggml_backend_cpu_init()};
+    ggml_backend_t backend = backend_ptr.get();
+    ggml_backend_cpu_set_n_threads(backend, n_threads);
+    ggml_backend_buffer_ptr buffer{ggml_backend_alloc_ctx_tensors(ctx, backend)};
+
+    for (const auto & in : inputs) {
+        ggml_backend_tensor_set(in.first, in.second, 0, ggml_nbytes(in.first));
+    }
+
+    ggml_backend_graph_compute(backend, gf);
+
+    std::vector<float> res(ggml_nelements(out));
+    ggml_backend_tensor_get(out, res.data(), 0, ggml_nbytes(out));
+
+    double max_ref = 1.0;
+    double max_err = 0.0;
+    for (size_t i = 0; i < ref.size(); i++) {
+        max_ref = std::max(max_ref, fabs(ref[i]));
+        max_err = std::max(max_err, fabs(res[i] - ref[i]));
+    }
+    const double err = max_err/max_ref;
+    const bool passed = res.size() == ref.size() && std::isfinite(err) && err < 1e-4;
+
+    printf("%-9s (heads=%d, head_size=%d, tokens=%d, seqs=%d, threads=%d): err=%.2e %s\n",
+        name, int(sh.head_count), int(sh.head_size), int(sh.n_seq_tokens), int(sh.n_seqs), n_threads, err,
+        passed ? "\033[32mPASSED\033[0m" : "\033[31mFAILED\033[0m");
+
+    return passed;
+}
+
+static ggml_context * new_context() {
+    ggml_init_params params {
+        /*.mem_size   =*/ 16*ggml_tensor_overhead() + ggml_graph_overhead(),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true
+    };
+    return ggml_init(params);
+}
+
+// gla and rwkv_wkv6 share the same diagonal-decay recurrence over the state S[i][j] of each head (i: key, j: value)
+//   gla:  S = diag(g) S + k^T v,  y = (q*scale) S
+//   wkv6: y = r (S + diag(u) k^T v),  S = diag(w) S + k^T v
+static bool test_gla_wkv6(bool wkv6, const scan_shape & sh, int n_threads) {
+    const int64_t H = sh.head_count, D = sh.head_size, T = sh.n_seq_tokens*sh.n_seqs, C = H*D;
+    const float scale = 1.0f/sqrtf((float) D);
+
+    std::mt19937 rng(42);
+    const std::vector<float> q  = uniform(rng, C*T, -1.0f, 1.0f);
+    const std::vector<float> k  = uniform(rng, C*T, -1.0f, 1.0f);
+    const std::vector<float> v  = uniform(rng, C*T, -1.0f, 1.0f);
+    const std::vector<float> g  = decays(rng, C*T);
+    const std::vector<float> u  = uniform(rng, C, -1.0f, 1.0f);
+    const std::vector<float> s0 = uniform(rng, C*D*sh.n_seqs, -1.0f, 1.0f);
+
+    std::vector<double> ref(C*T + C*D*sh.n_seqs);
+    for (int64_t s = 0; s < sh.n_seqs; s++) {
+        for (int64_t h = 0; h < H; h++) {
+            std::vector<double> S(s0.begin() + s*C*D + h*D*D, s0.begin() + s*C*D + (h + 1)*D*D);
+            for (int64_t t = s*sh.n_seq_tokens; t < (s + 1)*sh.n_seq_tokens; t++) {
+                const int64_t o = t*C + h*D;
+                for (int64_t j = 0; j < D; j++) {
+                    double y = 0.0;
+                    for (int64_t i = 0; i < D; i++) {
+                        const double kv = (double) k[o + i]*v[o + j];
+                        if (wkv6) {
+                            y += q[o + i]*(S[i*D + j] + u[h*D + i]*kv);
+                        } else {
+                            y += q[o + i]*scale*(g[o + i]*S[i*D + j] + kv);
+                        }
+                    }
+                    ref[o + j] = y;
+                }
+                for (int64_t i = 0; i < D; i++) {
+                    for (int64_t j = 0; j < D; j++) {
+                        S[i*D + j] = g[o + i]*S[i*D + j] + (double) k[o + i]*v[o + j];
+                    }
+                }
+            }
+            std::copy(S.begin(), S.end(), ref.begin() + C*T + s*C*D + h*D*D);
+        }
+    }
+
+    ggml_context_ptr ctx_ptr{new_context()};
+    ggml_context * ctx = ctx_ptr.get();
+
+    ggml_tensor * tq = new_tensor(ctx, { D, H, T });
+    ggml_tensor * tk = new_tensor(ctx, { D, H, T });
+    ggml_tensor * tv = new_tensor(ctx, { D, H, T });
+    ggml_tensor * tg = new_tensor(ctx, { D, H, T });
+    ggml_tensor * ts = new_tensor(ctx, { C*D, sh.n_seqs });
+
+    ggml_tensor * out;
+    std::vector<std::pair<ggml_tensor *, const void *>> inputs = { { tq, q.data() }, { tk, k.data() }, { tv, v.data() }, { tg, g.data() }, { ts, s0.data() } };
+    if (wkv6) {
+        ggml_tensor * tu = new_tensor(ctx, { D, H });
+        inputs.push_back({ tu, u.data() });
+        out = ggml_rwkv_wkv6(ctx, tk, tv, tq, tu, tg, ts);
+    } else {
+        out = ggml_gated_linear_attn(ctx, tk, tv, tq, tg, ts, scale);
+    }
+
+    return run_and_compare(wkv6 ? "rwkv_wkv6" : "gla", sh, n_threads, ctx, out, inputs, ref);
+}
+
+// delta-rule state update over the state S[i][j] of each head (i: value, j: key)
+//   S = S diag(w) + v^T k + (S a^T) b,  y = S r^T
+static bool test_wkv7(const scan_shape & sh, int n_threads) {
+    const int64_t H = sh.head_count, D = sh.head_size, T = sh.n_seq_tokens*sh.n_seqs, C = H*D;
+
+    std::mt19937 rng(42);
+    const std::vector<float> r  = uniform(rng, C*T, -1.0f, 1.0f);
+    const std::vector<float> w  = decays(rng, C*T);
+    const std::vector<float> k  = uniform(rng, C*T, -1.0f, 1.0f);
+    const std::vector<float> v  = uniform(rng, C*T, -1.0f, 1.0f);
+    const std::vector<float> kk = unit_rows(rng, C*T, D);
+    const std::vector<float> s0 = uniform(rng, C*D*sh.n_seqs, -1.0f, 1.0f);
+
+    // as in RWKV-7: a = -kk, b = kk*iclr with iclr in (0, 1), the state stays bounded
+    std::vector<float> a(C*T);
+    std::vector<float> b(C*T);
+    const std::vector<float> iclr = uniform(rng, C*T, 0.0f, 1.0f);
+    for (int64_t i = 0; i < C*T; i++) {
+        a[i] = -kk[i];
+        b[i] =  kk[i]*iclr[i];
+    }
+
+    std::vector<double> ref(C*T + C*D*sh.n_seqs);
+    for (int64_t s = 0; s < sh.n_seqs; s++) {
+        for (int64_t h = 0; h < H; h++) {
+            std::vector<double> S(s0.begin() + s*C*D + h*D*D, s0.begin() + s*C*D + (h + 1)*D*D);
+            for (int64_t t = s*sh.n_seq_tokens; t < (s + 1)*sh.n_seq_tokens; t++) {
+                const int64_t o = t*C + h*D;
+                for (int64_t i = 0; i < D; i++) {
+                    double sa = 0.0;
+                    for (int64_t j = 0; j < D; j++) {
+                        sa += a[o + j]*S[i*D + j];
+                    }
+                    double y = 0.0;
+                    for (int64_t j = 0; j < D; j++) {
+                        S[i*D + j] = S[i*D + j]*w[o + j] + (double) v[o + i]*k[o + j] + sa*b[o + j];
+                        y += S[i*D + j]*r[o + j];
+                    }
+                    ref[o + i] = y;
+                }
+            }
+            std::copy(S.begin(), S.end(), ref.begin() + C*T + s*C*D + h*D*D);
+        }
+    }
+
+    ggml_context_ptr ctx_ptr{new_context()};
+    ggml_context * ctx = ctx_ptr.get();
+
+    ggml_tensor * tr = new_tensor(ctx, { D, H, T });
+    ggml_tensor * tw = new_tensor(ctx, { D, H, T });
+    ggml_tensor * tk = new_tensor(ctx, { D, H, T });
+    ggml_tensor * tv = new_tensor(ctx, { D, H, T });
+    ggml_tensor * ta = new_tensor(ctx, { D, H, T });
+    ggml_tensor * tb = new_tensor(ctx, { D, H, T });
+    ggml_tensor * ts = new_tensor(ctx, { C*D, sh.n_seqs });
+
+    ggml_tensor * out = ggml_rwkv_wkv7(ctx, tr, tw, tk, tv, ta, tb, ts);
+
+    return run_and_compare("rwkv_wkv7", sh, n_threads, ctx, out,
+        { { tr, r.data() }, { tw, w.data() }, { tk, k.data() }, { tv, v.data() }, { ta, a.data() }, { tb, b.data() }, { ts, s0.data() } }, ref);
+}
+
+// Mamba-2: scalar decay per head, the initial states are picked by ids
+//   dt' = softplus(dt),  S[p][n] = exp(dt' A) S[p][n] + B[n] x[p] dt',  y[p] = sum_n S[p][n] C[n]
+static bool test_ssm_scan(const scan_shape & sh, int64_t n_group, int n_threads) {
+    const int64_t H = sh.head_count, P = sh.head_size, N = 128, T = sh.n_seq_tokens, NS = sh.n_seqs;
+
+    std::mt19937 rng(42);
+    const std::vector<float> s0 = uniform(rng, N*P*H*NS, -1.0f, 1.0f);
+    const std::vector<float> x  = uniform(rng, P*H*T*NS, -1.0f, 1.0f);
+    const std::vector<float> dt = uniform(rng, H*T*NS, -4.0f, 2.0f);
+    const std::vector<float> A  = uniform(rng, H, -8.0f, -0.5f);
+    const std::vector<float> B  = uniform(rng, N*n_group*T*NS, -1.0f, 1.0f);
+    const std::vector<float> Cm = uniform(rng, N*n_group*T*NS, -1.0f, 1.0f);
+
+    // the sequences start from the states in reverse order
+    std::vector<int32_t> ids(NS);
+    for (int64_t s = 0; s < NS; s++) {
+        ids[s] = (int32_t) (NS - 1 - s);
+    }
+
+    std::vector<double> ref(P*H*T*NS + N*P*H*NS);
+    for (int64_t s = 0; s < NS; s++) {
+        for (int64_t h = 0; h < H; h++) {
+            const int64_t g = h/(H/n_group);
+            std::vector<double> S(s0.begin() + ((ids[s]*H + h)*P)*N, s0.begin() + ((ids[s]*H + h + 1)*P)*N);
+            for (int64_t t = 0; t < T; t++) {
+                const double dtv = dt[(s*T + t)*H + h];
+                const double dts = dtv > 20.0 ? dtv : log1p(exp(dtv));
+                const double dA  = exp(dts*A[h]);
+                const float * Bt = B.data()  + ((s*T + t)*n_group + g)*N;
+                const float * Ct = Cm.data() + ((s*T + t)*n_group + g)*N;
+                for (int64_t p = 0; p < P; p++) {
+                    const double xdt = x[((s*T + t)*H + h)*P + p]*dts;
+                    double y = 0.0;
+                    for (int64_t n = 0; n < N; n++) {
+                        S[p*N + n] = S[p*N + n]*dA + Bt[n]*xdt;
+                        y += S[p*N + n]*Ct[n];
+                    }
+                    ref[((s*T + t)*H + h)*P + p] = y;
+                }
+            }
+            std::copy(S.begin(), S.end(), ref.begin() + P*H*T*NS + ((s*H + h)*P)*N);
+        }
+    }
+
+    ggml_context_ptr ctx_ptr{new_context()};
+    ggml_context * ctx = ctx_ptr.get();
+
+    ggml_tensor * ts   = new_tensor(ctx, { N, P, H, NS });
+    ggml_tensor * tx   = new_tensor(ctx, { P, H, T, NS });
+    ggml_tensor * tdt  = new_tensor(ctx, { H, T, NS });
+    ggml_tensor * tA   = new_tensor(ctx, { 1, H });
+    ggml_tensor * tB   = new_tensor(ctx, { N, n_group, T, NS });
+    ggml_tensor * tC   = new_tensor(ctx, { N, n_group, T, NS });
+    ggml_tensor * tids = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, NS);
+
+    ggml_tensor * out = ggml_ssm_scan(ctx, ts, tx, tdt, tA, tB, tC, tids);
+
+    return run_and_compare("ssm_scan", sh, n_threads, ctx, out,
+        { { ts, s0.data() }, { tx, x.data() }, { tdt, dt.data() }, { tA, A.data() }, { tB, B.data() }, { tC, Cm.data() }, { tids, ids.data() } }, ref);
+}
+
+int main(void) {
+    ggml_time_init();
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    // decode, one chunk, tail chunks, several sequences
+    // note: the SIMD rwkv_wkv7 needs head sizes that are multiples of GGML_F32_STEP
+    const std::vector<scan_shape> shapes = {
+        { 4, 64,   1, 2 },
+        { 4, 64,  16, 1 },
+        { 2, 64, 300, 1 },
+        { 3, 64,  77, 2 },
+    };
+
+    bool passed = true;
+
+    for (int n_threads : { 1, 3, 4, 8 }) {
+        for (const auto & sh : shapes) {
+            passed &= test_gla_wkv6(false, sh, n_threads);
+            passed &= test_gla_wkv6(true,  sh, n_threads);
+            passed &= test_wkv7(sh, n_threads);
+            passed &= test_ssm_scan(sh, sh.head_count % 2 == 0 ? 2 : 1, n_threads);
+        }
+    }
+
+    return passed ? 0 : 1;
+}
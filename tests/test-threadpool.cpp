@@ -0,0 +1,782 @@
+// Check that the CPU threadpool scheduling modes produce the same results as a single thread
+// and report the time per graph for each of them, for increasing numbers of threads
+// Also check that thread groups compute different graphs concurrently on one threadpool,
+// that the autotuned work splits do not change the results,
+// and report the per token time of a decode loop on the CPU backend, which reuses the plan of the previous graph or computes asynchronously
+// Also check that the profiler records every node and writes a valid trace
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct test_model {
+    int n_embd  = 256;
+    int n_ff    = 512;
+    int n_layer = 4;
+    int n_tok   = 1;
+
+    // mul_mat_id
+    int n_expert      = 16;
+    int n_expert_used = 4;
+    int n_tok_moe     = 8;
+
+    ggml_context * ctx_w = nullptr;
+    ggml_backend_buffer_t buf_w = nullptr;
+
+    ggml_tensor * inp = nullptr;
+    std::vector<ggml_tensor *> weights;
+
+    ggml_tensor * mm_w   = nullptr;
+    ggml_tensor * mm_inp = nullptr;
+
+    ggml_tensor * inp_t = nullptr;
+
+    ggml_tensor * moe_w   = nullptr;
+    ggml_tensor * moe_inp = nullptr;
+    ggml_tensor * moe_ids = nullptr;
+};
+
+static void test_model_init(test_model & model) {
+    ggml_init_params params = {
+        /*.mem_size   =*/ ggml_tensor_overhead()*(7 + 8*model.n_layer),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true,
+    };
+    model.ctx_w = ggml_init(params);
+
+    model.inp = ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F32, model.n_embd, model.n_tok);
+    for (int il = 0; il < model.n_layer; il++) {
+        model.weights.push_back(ggml_new_tensor_1d(model.ctx_w, GGML_TYPE_F32, model.n_embd));                // attn_norm
+        model.weights.push_back(ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F32, model.n_embd, model.n_embd)); // wq
+        model.weights.push_back(ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F32, model.n_embd, model.n_embd)); // wk
+        model.weights.push_back(ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F32, model.n_embd, model.n_embd)); // wv
+        model.weights.push_back(ggml_new_tensor_1d(model.ctx_w, GGML_TYPE_F32, model.n_embd));                // ffn_norm
+        model.weights.push_back(ggml_new_tensor_1d(model.ctx_w, GGML_TYPE_F32, model.n_embd));                // ffn_bias
+        model.weights.push_back(ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F32, model.n_embd, model.n_ff));   // ffn_up
+        model.weights.push_back(ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F32, model.n_ff,   model.n_embd)); // ffn_down
+    }
+
+    // F16 weights, so that src1 is converted into the work buffer
+    model.mm_w   = ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F16, 4*model.n_embd, 4*model.n_embd);
+    model.mm_inp = ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F32, 4*model.n_embd, 8);
+
+    // a transposed input, its columns are contiguous
+    model.inp_t = ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_F32, model.n_embd, model.n_embd);
+    std::swap(model.inp_t->nb[0], model.inp_t->nb[1]);
+
+    model.moe_w   = ggml_new_tensor_3d(model.ctx_w, GGML_TYPE_F16, model.n_embd, model.n_ff, model.n_expert);
+    model.moe_inp = ggml_new_tensor_3d(model.ctx_w, GGML_TYPE_F32, model.n_embd, 1, model.n_tok_moe);
+    model.moe_ids = ggml_new_tensor_2d(model.ctx_w, GGML_TYPE_I32, model.n_expert_used, model.n_tok_moe);
+
+    model.buf_w = ggml_backend_alloc_ctx_tensors_from_buft(model.ctx_w, ggml_backend_cpu_buffer_type());
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-0.1f, 0.1f);
+
+    for (ggml_tensor * t = ggml_get_first_tensor(model.ctx_w); t != NULL; t = ggml_get_next_tensor(model.ctx_w, t)) {
+        const int64_t n = ggml_nelements(t);
+
+        if (t->type == GGML_TYPE_I32) {
+            // distinct experts for each token
+            std::vector<int32_t> ids(n);
+            std::vector<int32_t> perm(model.n_expert);
+            for (int64_t i = 0; i < t->ne[1]; i++) {
+                std::iota(perm.begin(), perm.end(), 0);
+                std::shuffle(perm.begin(), perm.end(), rng);
+                std::copy(perm.begin(), perm.begin() + t->ne[0], ids.begin() + i*t->ne[0]);
+            }
+            ggml_backend_tensor_set(t, ids.data(), 0, ggml_nbytes(t));
+            continue;
+        }
+
+        std::vector<float> data(n);
+        for (auto & v : data) {
+            v = dist(rng);
+        }
+
+        if (t->type == GGML_TYPE_F16) {
+            std::vector<ggml_fp16_t> data_f16(n);
+            ggml_fp32_to_fp16_row(data.data(), data_f16.data(), n);
+            ggml_backend_tensor_set(t, data_f16.data(), 0, ggml_nbytes(t));
+        } else {
+            ggml_backend_tensor_set(t, data.data(), 0, ggml_nbytes(t));
+        }
+    }
+}
+
+static void test_model_free(test_model & model) {
+    ggml_backend_buffer_free(model.buf_w);
+    ggml_free(model.ctx_w);
+}
+
+// a decode-like graph with many small nodes - norms, weight multiplications, views and residuals
+static ggml_cgraph * build_graph_decode(const test_model & model, ggml_context * ctx) {
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * cur = model.inp;
+
+    for (int il = 0; il < model.n_layer; il++) {
+        ggml_tensor * const * w = model.weights.data() + 8*il;
+
+        ggml_tensor * inpL = cur;
+
+        cur = ggml_rms_norm(ctx, cur, 1e-6f);
+        cur = ggml_mul(ctx, cur, w[0]);
+
+        ggml_tensor * q = ggml_mul_mat(ctx, w[1], cur);
+        ggml_tensor * k = ggml_mul_mat(ctx, w[2], cur);
+        ggml_tensor * v = ggml_mul_mat(ctx, w[3], cur);
+
+        q = ggml_scale(ctx, q, 0.125f);
+        k = ggml_gelu(ctx, k);
+        v = ggml_silu(ctx, v);
+
+        ggml_tensor * q0 = ggml_view_2d(ctx, q, model.n_embd/2, model.n_tok, q->nb[1], 0);
+        ggml_tensor * k0 = ggml_view_2d(ctx, k, model.n_embd/2, model.n_tok, k->nb[1], 0);
+        ggml_tensor * qk = ggml_cont(ctx, ggml_mul(ctx, q0, k0));
+
+        cur = ggml_add(ctx, ggml_add(ctx, q, k), v);
+        cur = ggml_add(ctx, cur, ggml_sum_rows(ctx, qk));
+        cur = ggml_add(ctx, cur, inpL);
+
+        ggml_tensor * ffn_inp = cur;
+
+        cur = ggml_rms_norm(ctx, cur, 1e-6f);
+        cur = ggml_mul(ctx, cur, w[4]);
+        cur = ggml_add(ctx, cur, w[5]);
+        cur = ggml_mul_mat(ctx, w[6], cur);
+        cur = ggml_gelu(ctx, cur);
+        cur = ggml_mul_mat(ctx, w[7], cur);
+        cur = ggml_add(ctx, cur, ffn_inp);
+    }
+
+    ggml_set_output(cur);
+    ggml_build_forward_expand(gf, cur);
+
+    return gf;
+}
+
+static ggml_cgraph * build_graph_mul_mat(const test_model & model, ggml_context * ctx) {
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * cur = ggml_mul_mat(ctx, model.mm_w, model.mm_inp);
+
+    ggml_set_output(cur);
+    ggml_build_forward_expand(gf, cur);
+
+    return gf;
+}
+
+static ggml_cgraph * build_graph_mul_mat_id(const test_model & model, ggml_context * ctx) {
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * cur = ggml_mul_mat_id(ctx, model.moe_w, model.moe_inp, model.moe_ids);
+
+    ggml_set_output(cur);
+    ggml_build_forward_expand(gf, cur);
+
+    return gf;
+}
+
+// a mul_mat next to an independent soft_max - both use the work buffer
+static ggml_cgraph * build_graph_wdata(const test_model & model, ggml_context * ctx) {
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * sm = ggml_soft_max_ext(ctx, model.mm_inp, NULL, 1.0f, 0.0f);
+    ggml_tensor * mm = ggml_mul_mat(ctx, model.mm_w, model.mm_inp);
+
+    ggml_tensor * cur = ggml_add(ctx, mm, sm);
+
+    ggml_set_output(cur);
+    ggml_build_forward_expand(gf, cur);
+
+    return gf;
+}
+
+// F32 weights: a contiguous src1 is used in place, a transposed one is gathered in the work buffer
+static ggml_cgraph * build_graph_mul_mat_f32(const test_model & model, ggml_context * ctx) {
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * cur = ggml_mul_mat(ctx, model.weights[1], model.weights[2]);
+
+    ggml_set_output(cur);
+    ggml_build_forward_expand(gf, cur);
+
+    return gf;
+}
+
+static ggml_cgraph * build_graph_mul_mat_f32_t(const test_model & model, ggml_context * ctx) {
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * cur = ggml_mul_mat(ctx, model.weights[1], model.inp_t);
+
+    ggml_set_output(cur);
+    ggml_build_forward_expand(gf, cur);
+
+    return gf;
+}
+
+// a chain of tiny dependent nodes - the time per node is dominated by the barrier between the nodes
+static ggml_cgraph * build_graph_barrier(const test_model & model, ggml_context * ctx) {
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * cur = ggml_view_1d(ctx, model.inp, 4, 0);
+
+    for (int i = 0; i < 256; i++) {
+        cur = ggml_cont(ctx, cur);
+    }
+
+    ggml_set_output(cur);
+    ggml_build_forward_expand(gf, cur);
+
+    return gf;
+}
+
+typedef ggml_cgraph * (*build_graph_t)(const test_model & model, ggml_context * ctx);
+
+struct test_result {
+    std::vector<float> out;
+    double us_per_graph = 0.0;
+    int    n_nodes      = 0;
+
+    ggml_threadpool_stats stats = {};
+};
+
+static test_result run(const test_model & model, build_graph_t build_graph, ggml_threadpool * threadpool, int n_threads, int n_iter,
+        ggml_cpu_profile * profile = nullptr) {
+    ggml_init_params params = {
+        /*.mem_size   =*/ ggml_tensor_overhead()*GGML_DEFAULT_GRAPH_SIZE + ggml_graph_overhead(),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true,
+    };
+    ggml_context * ctx = ggml_init(params);
+
+    ggml_cgraph * gf = build_graph(model, ctx);
+
+    // the allocator reuses memory between nodes, which exercises the write-after-read checks
+    ggml_gallocr_t galloc = ggml_gallocr_new(ggml_backend_cpu_buffer_type());
+    ggml_gallocr_alloc_graph(galloc, gf);
+
+    ggml_cplan cplan = ggml_graph_plan(gf, n_threads, threadpool);
+    std::vector<uint8_t> work_data(cplan.work_size);
+    cplan.work_data = work_data.data();
+    cplan.profile   = profile;
+
+    // warmup
+    GGML_ASSERT(ggml_graph_compute(gf, &cplan) == GGML_STATUS_SUCCESS);
+    ggml_threadpool_reset_stats(threadpool);
+
+    const int64_t t_start = ggml_time_us();
+    for (int i = 0; i < n_iter; i++) {
+        GGML_ASSERT(ggml_graph_compute(gf, &cplan) == GGML_STATUS_SUCCESS);
+    }
+    const int64_t t_end = ggml_time_us();
+
+    test_result res;
+    res.us_per_graph = double(t_end - t_start)/n_iter;
+    res.n_nodes      = ggml_graph_n_nodes(gf);
+    ggml_threadpool_get_stats(threadpool, &res.stats);
+
+    ggml_tensor * out = ggml_graph_node(gf, -1);
+    res.out.resize(ggml_nelements(out));
+    ggml_backend_tensor_get(out, res.out.data(), 0, ggml_nbytes(out));
+
+    ggml_gallocr_free(galloc);
+    ggml_free(ctx);
+
+    return res;
+}
+
+static test_result run(const test_model & model, build_graph_t build_graph, ggml_threadpool_params tpp, int n_iter) {
+    ggml_threadpool * threadpool = ggml_threadpool_new(&tpp);
+
+    test_result res = run(model, build_graph, threadpool, tpp.n_threads, n_iter);
+
+    ggml_threadpool_free(threadpool);
+
+    return res;
+}
+
+static bool check_equal(const std::vector<float> & a, const std::vector<float> & b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] != b[i] || std::isnan(a[i])) {
+            printf("mismatch at %zu: %f != %f\n", i, a[i], b[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+struct test_mode {
+    const char * name;
+    std::function<void(ggml_threadpool_params &)> set;
+};
+
+struct test_graph {
+    const char * name;
+    build_graph_t build;
+};
+
+// compute each graph on its own group of n_threads threads of one threadpool, all at the same time
+static bool test_groups(const test_model & model, const std::vector<test_graph> & graphs, const std::vector<test_result> & refs,
+        int n_threads, int n_iter) {
+    const int n_groups = (int) graphs.size();
+
+    ggml_threadpool_params tpp = ggml_threadpool_params_default(1 + n_groups*n_threads);
+    ggml_threadpool * threadpool = ggml_threadpool_new(&tpp);
+
+    std::vector<ggml_threadpool *> groups(n_groups);
+    for (int i = 0; i < n_groups; i++) {
+        ggml_threadpool_params gpp = ggml_threadpool_params_default(n_threads);
+        groups[i] = ggml_threadpool_new_group(threadpool, &gpp);
+        GGML_ASSERT(groups[i] != nullptr);
+    }
+
+    // all the workers are taken
+    ggml_threadpool_params gpp = ggml_threadpool_params_default(n_threads);
+    GGML_ASSERT(ggml_threadpool_new_group(threadpool, &gpp) == nullptr);
+
+    std::vector<test_result> res(n_groups);
+    std::vector<std::thread> threads;
+    const int64_t t_start = ggml_time_us();
+    for (int i = 0; i < n_groups; i++) {
+        threads.emplace_back([&, i]() {
+            res[i] = run(model, graphs[i].build, groups[i], n_threads, n_iter);
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    const int64_t t_end = ggml_time_us();
+
+    bool ok = true;
+    for (int i = 0; i < n_groups; i++) {
+        const bool ok_i = check_equal(refs[i].out, res[i].out);
+        printf("%-10s n_threads = %3d, %-16s: %10.2f us/graph %s\n", graphs[i].name, n_threads, "group", res[i].us_per_graph, ok_i ? "OK" : "FAIL");
+        ok = ok && ok_i;
+    }
+    printf("%-10s n_threads = %3d, %-16s: %10.2f us total\n", "groups", n_groups*n_threads, "concurrent", double(t_end - t_start));
+
+    // resize: give the workers of all the groups to a single group, and back to the threadpool
+    for (auto * group : groups) {
+        ggml_threadpool_free(group);
+    }
+
+    gpp = ggml_threadpool_params_default(n_groups*n_threads);
+    ggml_threadpool * group = ggml_threadpool_new_group(threadpool, &gpp);
+    GGML_ASSERT(group != nullptr);
+
+    const test_result res_all = run(model, graphs[0].build, group, n_groups*n_threads, 1);
+    ok = check_equal(refs[0].out, res_all.out) && ok;
+
+    ggml_threadpool_free(group);
+
+    const test_result res_tp = run(model, graphs[0].build, threadpool, tpp.n_threads, 1);
+    ok = check_equal(refs[0].out, res_tp.out) && ok;
+
+    printf("%-10s n_threads = %3d, %-16s: %s\n", "groups", n_groups*n_threads, "resize", ok ? "OK" : "FAIL");
+
+    ggml_threadpool_free(threadpool);
+
+    return ok;
+}
+
+// the results must not change while the work splits are searched, nor with the tuned splits loaded from the file
+static bool test_tune(const test_model & model, const std::vector<test_graph> & graphs, const std::vector<test_result> & refs,
+        int n_threads, int n_iter) {
+    const char * path = "test-threadpool-tune.txt";
+    std::remove(path);
+
+    bool ok = true;
+
+    for (int pass = 0; pass < 2; pass++) {
+        // the second pass starts with the settings tuned by the first one
+        ok = ggml_cpu_tune_init(path) && ok;
+
+        for (size_t i = 0; i < graphs.size(); i++) {
+            // enough graphs to time all the candidates
+            const test_result res = run(model, graphs[i].build, ggml_threadpool_params_default(n_threads), pass == 0 ? std::max(n_iter, 32) : n_iter);
+            const bool ok_i = check_equal(refs[i].out, res.out);
+
+            printf("%-10s n_threads = %3d, %-16s: %10.2f us/graph %s\n", graphs[i].name, n_threads, pass == 0 ? "autotune" : "autotune (load)",
+                    res.us_per_graph, ok_i ? "OK" : "FAIL");
+
+            ok = ok && ok_i;
+        }
+
+        if (pass == 0) {
+            ok = ggml_cpu_tune_save() && ok;
+        }
+
+        ggml_cpu_tune_free();
+    }
+
+    // all the tuned keys are saved
+    int n_lines = 0;
+    if (FILE * f = fopen(path, "r")) {
+        for (int c; (c = fgetc(f)) != EOF; ) {
+            n_lines += c == '\n';
+        }
+        fclose(f);
+    }
+    // nothing is tuned with a single thread
+    const bool ok_save = n_threads < 2 || n_lines > 1;
+    printf("%-10s n_threads = %3d, %-16s: %d tuned keys %s\n", "autotune", n_threads, "save", std::max(n_lines - 1, 0), ok_save ? "OK" : "FAIL");
+    ok = ok && ok_save;
+
+    std::remove(path);
+
+    return ok;
+}
+
+// every thread records every node of every graph, the barrier wait is part of the trace
+static bool test_profile(const test_model & model, const test_graph & graph, const test_result & ref, int n_threads, int n_iter) {
+    const char * path = "test-threadpool-trace.json";
+
+    ggml_cpu_profile * profile = ggml_cpu_profile_new();
+
+    ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+    ggml_threadpool * threadpool = ggml_threadpool_new(&tpp);
+
+    const test_result res = run(model, graph.build, threadpool, n_threads, n_iter, profile);
+    bool ok = check_equal(ref.out, res.out);
+
+    ggml_threadpool_free(threadpool);
+
+    ok = ggml_cpu_profile_write_trace(profile, path) && ok;
+    fflush(stdout);
+    ggml_cpu_profile_print(profile);
+    ggml_cpu_profile_free(profile);
+
+    std::string trace;
+    if (FILE * f = fopen(path, "r")) {
+        for (int c; (c = fgetc(f)) != EOF; ) {
+            trace += (char) c;
+        }
+        fclose(f);
+    }
+    std::remove(path);
+
+    // the warmup is profiled too
+    const std::string cat = "\"cat\":\"compute\"";
+    int n_events = 0;
+    for (size_t pos = trace.find(cat); pos != std::string::npos; pos = trace.find(cat, pos + 1)) {
+        n_events++;
+    }
+    const int n_events_min = res.n_nodes*(n_iter + 1);
+
+    ok = ok && trace.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0) == 0 && trace.find("]}") != std::string::npos;
+    ok = ok && n_events >= n_events_min;
+
+    printf("%-10s n_threads = %3d, %-16s: %10.2f us/graph, %d events (min %d) %s\n", graph.name, n_threads, "profile",
+            res.us_per_graph, n_events, n_events_min, ok ? "OK" : "FAIL");
+
+    return ok;
+}
+
+enum decode_loop_mode {
+    DECODE_LOOP_PLAN,        // ggml_graph_plan() for every token
+    DECODE_LOOP_BACKEND,     // ggml_backend_graph_compute(), the backend reuses the plan of the previous token
+    DECODE_LOOP_PLAN_UPDATE, // ggml_backend_graph_plan_update() of the plan of the first token
+    DECODE_LOOP_ASYNC,       // async backend, the next graph is built while the previous one is computed
+};
+
+// the graph is built and allocated again for every token, like in llama.cpp
+static bool test_decode_loop(const test_model & model, const test_graph & graph, const test_result & ref, int n_threads, int n_iter) {
+    const char * names[] = { "graph_plan", "backend", "plan_update", "async" };
+
+    ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+    ggml_threadpool * threadpool = ggml_threadpool_new(&tpp);
+
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    ggml_backend_cpu_set_n_threads(backend, n_threads);
+    ggml_backend_cpu_set_threadpool(backend, threadpool);
+
+    std::vector<uint8_t> buf(ggml_tensor_overhead()*GGML_DEFAULT_GRAPH_SIZE + ggml_graph_overhead());
+
+    bool ok = true;
+
+    ggml_backend_event_t event = ggml_backend_event_new(ggml_backend_get_device(backend));
+    GGML_ASSERT(event != nullptr);
+
+    for (int mode = DECODE_LOOP_PLAN; mode <= DECODE_LOOP_ASYNC; mode++) {
+        ggml_gallocr_t galloc = ggml_gallocr_new(ggml_backend_cpu_buffer_type());
+
+        ggml_backend_cpu_set_async(backend, mode == DECODE_LOOP_ASYNC);
+
+        ggml_backend_graph_plan_t plan = nullptr;
+        std::vector<uint8_t> work_data;
+        std::vector<float> out;
+
+        int64_t t_start = 0;
+
+        // the first token is the warmup
+        for (int i = 0; i <= n_iter; i++) {
+            if (i == 1) {
+                t_start = ggml_time_us();
+            }
+
+            ggml_init_params params = {
+                /*.mem_size   =*/ buf.size(),
+                /*.mem_buffer =*/ buf.data(),
+                /*.no_alloc   =*/ true,
+            };
+            ggml_context * ctx = ggml_init(params);
+
+            ggml_cgraph * gf = graph.build(model, ctx);
+            ggml_gallocr_alloc_graph(galloc, gf);
+
+            switch (mode) {
+                case DECODE_LOOP_PLAN:
+                    {
+                        ggml_cplan cplan = ggml_graph_plan(gf, n_threads, threadpool);
+                        work_data.resize(cplan.work_size);
+                        cplan.work_data = work_data.data();
+                        GGML_ASSERT(ggml_graph_compute(gf, &cplan) == GGML_STATUS_SUCCESS);
+                    } break;
+                case DECODE_LOOP_BACKEND:
+                    {
+                        GGML_ASSERT(ggml_backend_graph_compute(backend, gf) == GGML_STATUS_SUCCESS);
+                    } break;
+                case DECODE_LOOP_PLAN_UPDATE:
+                    {
+                        if (plan == nullptr) {
+                            plan = ggml_backend_graph_plan_create(backend, gf);
+                        } else {
+                            ggml_backend_graph_plan_update(backend, plan, gf);
+                        }
+                        GGML_ASSERT(ggml_backend_graph_plan_compute(backend, plan) == GGML_STATUS_SUCCESS);
+                    } break;
+                case DECODE_LOOP_ASYNC:
+                    {
+                        GGML_ASSERT(ggml_backend_graph_compute_async(backend, gf) == GGML_STATUS_SUCCESS);
+                        ggml_backend_event_record(event, backend);
+                    } break;
+            }
+
+            if (i == n_iter) {
+                if (mode == DECODE_LOOP_ASYNC) {
+                    ggml_backend_event_synchronize(event);
+                }
+
+                ggml_tensor * t = ggml_graph_node(gf, -1);
+                out.resize(ggml_nelements(t));
+                ggml_backend_tensor_get(t, out.data(), 0, ggml_nbytes(t));
+            }
+
+            ggml_free(ctx);
+        }
+
+        const int64_t t_end = ggml_time_us();
+
+        ggml_backend_cpu_set_async(backend, false);
+
+        if (plan) {
+            ggml_backend_graph_plan_free(backend, plan);
+        }
+        ggml_gallocr_free(galloc);
+
+        const bool ok_i = check_equal(ref.out, out);
+        printf("%-10s n_threads = %3d, %-16s: %10.2f us/token %s\n", graph.name, n_threads, names[mode],
+                double(t_end - t_start)/std::max(n_iter, 1), ok_i ? "OK" : "FAIL");
+        ok = ok && ok_i;
+    }
+
+    ggml_backend_event_free(event);
+    ggml_backend_free(backend);
+    ggml_threadpool_free(threadpool);
+
+    return ok;
+}
+
+// the same shapes with different strides must not reuse the plan of the backend, the work size depends on the strides
+static bool test_plan_strides(const test_model & model, int n_threads) {
+    const test_result ref = run(model, build_graph_mul_mat_f32_t, ggml_threadpool_params_default(1), 1);
+
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    ggml_backend_cpu_set_n_threads(backend, n_threads);
+
+    std::vector<uint8_t> buf(ggml_tensor_overhead()*GGML_DEFAULT_GRAPH_SIZE + ggml_graph_overhead());
+
+    bool ok = true;
+
+    for (int mode : { DECODE_LOOP_BACKEND, DECODE_LOOP_PLAN_UPDATE }) {
+        ggml_gallocr_t galloc = ggml_gallocr_new(ggml_backend_cpu_buffer_type());
+        ggml_backend_graph_plan_t plan = nullptr;
+        std::vector<float> out;
+
+        for (build_graph_t build : { build_graph_mul_mat_f32, build_graph_mul_mat_f32_t }) {
+            ggml_init_params params = {
+                /*.mem_size   =*/ buf.size(),
+                /*.mem_buffer =*/ buf.data(),
+                /*.no_alloc   =*/ true,
+            };
+            ggml_context * ctx = ggml_init(params);
+
+            ggml_cgraph * gf = build(model, ctx);
+            ggml_gallocr_alloc_graph(galloc, gf);
+
+            if (mode == DECODE_LOOP_BACKEND) {
+                GGML_ASSERT(ggml_backend_graph_compute(backend, gf) == GGML_STATUS_SUCCESS);
+            } else {
+                if (plan == nullptr) {
+                    plan = ggml_backend_graph_plan_create(backend, gf);
+                } else {
+                    ggml_backend_graph_plan_update(backend, plan, gf);
+                }
+                GGML_ASSERT(ggml_backend_graph_plan_compute(backend, plan) == GGML_STATUS_SUCCESS);
+            }
+
+            ggml_tensor * t = ggml_graph_node(gf, -1);
+            out.resize(ggml_nelements(t));
+            ggml_backend_tensor_get(t, out.data(), 0, ggml_nbytes(t));
+
+            ggml_free(ctx);
+        }
+
+        if (plan) {
+            ggml_backend_graph_plan_free(backend, plan);
+        }
+        ggml_gallocr_free(galloc);
+
+        const bool ok_i = check_equal(ref.out, out);
+        printf("%-10s n_threads = %3d, %-16s: %s\n", "strides", n_threads, mode == DECODE_LOOP_BACKEND ? "backend" : "plan_update",
+                ok_i ? "OK" : "FAIL");
+        ok = ok && ok_i;
+    }
+
+    ggml_backend_free(backend);
+
+    return ok;
+}
+
+// one dep_sched threadpool alternating between the graphs on all of its threads and on a single thread
+// the barriers computed for a graph must not be used by the single-threaded computes of the others (run with ASan)
+static bool test_dep_sched_1t(const test_model & model, const std::vector<test_graph> & graphs, const std::vector<test_result> & refs,
+        int n_threads) {
+    ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+    tpp.dep_sched = true;
+    ggml_threadpool * threadpool = ggml_threadpool_new(&tpp);
+
+    bool ok = true;
+    for (size_t i = 0; i < graphs.size(); i++) {
+        run(model, graphs[i].build, threadpool, n_threads, 1);
+
+        for (size_t j = 0; j < graphs.size(); j++) {
+            const test_result res = run(model, graphs[j].build, threadpool, 1, 1);
+            ok = ok && check_equal(refs[j].out, res.out);
+        }
+    }
+    printf("%-10s n_threads = %3d, %-16s: %s\n", "dep_sched", n_threads, "then 1 thread", ok ? "OK" : "FAIL");
+
+    ggml_threadpool_free(threadpool);
+
+    return ok;
+}
+
+int main(int argc, char ** argv) {
+    int n_threads = std::min(4, std::max(2, (int) std::thread::hardware_concurrency()));
+    int n_iter    = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            n_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            n_iter = atoi(argv[++i]);
+        } else {
+            printf("usage: %s [-t n_threads] [-i n_iter]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    ggml_cpu_init();
+
+    test_model model;
+    test_model_init(model);
+
+    const std::vector<test_graph> graphs = {
+        { "decode",     build_graph_decode     },
+        { "mul_mat",    build_graph_mul_mat    },
+        { "mul_mat_id", build_graph_mul_mat_id },
+        { "barrier",    build_graph_barrier    },
+        { "wdata",      build_graph_wdata      },
+    };
+
+    const std::vector<test_mode> modes = {
+        { "dep_sched",    [](ggml_threadpool_params & p) { p.dep_sched = true; } },
+        // note: OpenMP builds always use the OpenMP barrier
+        { "tree_barrier", [](ggml_threadpool_params & p) { p.barrier = GGML_BARRIER_TREE; } },
+        // idle workers sleep right away, every graph has to wake them up
+        { "no_poll",      [](ggml_threadpool_params & p) { p.poll = 0; } },
+        // threads bound to the CPUs from the topology, the barrier tree and the mul_mat chunks follow the cache domains
+        { "place_cores",  [](ggml_threadpool_params & p) { p.placement = GGML_CPU_PLACEMENT_CORES; p.barrier = GGML_BARRIER_TREE; } },
+        { "place_spread", [](ggml_threadpool_params & p) { p.placement = GGML_CPU_PLACEMENT_SPREAD; } },
+    };
+
+    int n_fail = 0;
+
+    std::vector<test_result> refs;
+
+    for (const auto & graph : graphs) {
+        // single-threaded reference, the thread scaling is reported relative to it
+        const test_result ref = run(model, graph.build, ggml_threadpool_params_default(1), n_iter);
+        refs.push_back(ref);
+
+        for (int nt = 1; nt <= n_threads; nt *= 2) {
+            const ggml_threadpool_params tpp_def = ggml_threadpool_params_default(nt);
+
+            for (size_t im = 0; im <= modes.size(); im++) {
+                ggml_threadpool_params tpp = tpp_def;
+                if (im > 0) {
+                    modes[im - 1].set(tpp);
+                }
+
+                const test_result res = run(model, graph.build, tpp, n_iter);
+                const bool ok = check_equal(ref.out, res.out);
+
+                printf("%-10s n_threads = %3d, %-16s: %10.2f us/graph %7.3f us/node (%5.2fx) %s\n",
+                        graph.name, nt, im > 0 ? modes[im - 1].name : "default",
+                        res.us_per_graph, res.us_per_graph/res.n_nodes, ref.us_per_graph/res.us_per_graph, ok ? "OK" : "FAIL");
+
+                if (res.stats.n_spin + res.stats.n_sleep > 0) {
+                    printf("%-10s %16s  wakeups: %5llu spin, %5llu sleep, %8.2f us/wakeup, spin limit %d us\n", "", "",
+                            (unsigned long long) res.stats.n_spin, (unsigned long long) res.stats.n_sleep,
+                            res.stats.n_sleep > 0 ? double(res.stats.t_wake_us)/res.stats.n_sleep : 0.0, res.stats.spin_us);
+                }
+
+                n_fail += ok ? 0 : 1;
+            }
+        }
+    }
+
+    n_fail += test_groups(model, graphs, refs, 2, n_iter) ? 0 : 1;
+    n_fail += test_tune(model, graphs, refs, n_threads, n_iter) ? 0 : 1;
+
+    for (int nt = 1; nt <= n_threads; nt *= 2) {
+        n_fail += test_decode_loop(model, graphs[0], refs[0], nt, n_iter) ? 0 : 1;
+    }
+
+    n_fail += test_profile(model, graphs[0], refs[0], n_threads, n_iter) ? 0 : 1;
+    n_fail += test_plan_strides(model, n_threads) ? 0 : 1;
+    n_fail += test_dep_sched_1t(model, graphs, refs, n_threads) ? 0 : 1;
+
+    test_model_free(model);
+
+    return n_fail == 0 ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include <ggml.h>
+#include <ggml-cpu.h>
+#include <ggml-alloc.h>
+#include <ggml-backend.h>
+#include <ggml-cpp.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+// indices of the k largest values of each row, in descending order, ties by ascending index
+static std::vector<int32_t> top_k_reference(const std::vector<float> & src, int64_t ne0, int64_t nr, int k) {
+    std::vector<int32_t> dst(k*nr);
+    std::vector<int32_t> idx(ne0);
+
+    for (int64_t r = 0; r < nr; r++) {
+        const float * x = src.data() + r*ne0;
+
+        std::iota(idx.begin(), idx.end(), 0);
+        std::stable_sort(idx.begin(), idx.end(), [&](int32_t a, int32_t b) { return x[a] > x[b]; });
+        std::copy(idx.begin(), idx.begin() + k, dst.begin() + r*k);
+    }
+    return dst;
+}
+
+static bool check_equal(const std::vector<int32_t> & result, const std::vector<int32_t> & expected) {
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (result[i] != expected[i]) {
+            printf("result[%d] %d != %d expected\n", (int) i, result[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// GGML_OP_TOP_K and the view of a descending GGML_OP_ARGSORT computed by the CPU backend
+// rows of values in a small range have many ties, rows of shuffled distinct values have none
+static bool test_top_k(std::array<int64_t, 4> ne, int k, int n_threads, bool ties) {
+    ggml_init_params params {
+        /*.mem_size   =*/ 16*ggml_tensor_overhead() + ggml_graph_overhead(),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true
+    };
+
+    ggml_context_ptr ctx_ptr{ggml_init(params)};
+    ggml_context * ctx = ctx_ptr.get();
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * src = ggml_new_tensor(ctx, GGML_TYPE_F32, 4, ne.data());
+    ggml_tensor * res_top_k   = ggml_argsort_top_k(ctx, src, k);
+    ggml_tensor * res_argsort = ggml_cont(ctx, ggml_top_k(ctx, src, k));
+    ggml_build_forward_expand(gf, res_top_k);
+    ggml_build_forward_expand(gf, res_argsort);
+
+    ggml_backend_ptr backend_ptr{ggml_backend_cpu_init()};
+    ggml_backend_t backend = backend_ptr.get();
+    ggml_backend_cpu_set_n_threads(backend, n_threads);
+    ggml_backend_buffer_ptr buffer{ggml_backend_alloc_ctx_tensors(ctx, backend)};
+
+    const int64_t nr = ggml_nrows(src);
+
+    std::mt19937 rng(1234);
+    std::vector<float> src_values(ggml_nelements(src));
+    for (int64_t r = 0; r < nr; r++) {
+        float * x = src_values.data() + r*ne[0];
+        if (ties) {
+            std::uniform_int_distribution<int> dist(-32, 32);
+            std::generate(x, x + ne[0], [&]() { return (float) dist(rng); });
+        } else {
+            std::iota(x, x + ne[0], -0.5f*ne[0]);
+            std::shuffle(x, x + ne[0], rng);
+        }
+    }
+    ggml_backend_tensor_set(src, src_values.data(), 0, ggml_nbytes(src));
+
+    ggml_backend_graph_compute(backend, gf);
+
+    const std::vector<int32_t> expected = top_k_reference(src_values, ne[0], nr, k);
+
+    std::vector<int32_t> values(k*nr);
+    ggml_backend_tensor_get(res_top_k, values.data(), 0, ggml_nbytes(res_top_k));
+    const bool passed_top_k = check_equal(values, expected);
+
+    ggml_backend_tensor_get(res_argsort, values.data(), 0, ggml_nbytes(res_argsort));
+    const bool passed_argsort = check_equal(values, expected);
+
+    printf("top_k([%d, %d, %d, %d], k=%d, threads=%d, %s): argsort_top_k %s, top_k %s\n",
+        int(ne[0]), int(ne[1]), int(ne[2]), int(ne[3]), k, n_threads, ties ? "ties" : "distinct",
+        passed_top_k   ? "\033[32mPASSED\033[0m" : "\033[31mFAILED\033[0m",
+        passed_argsort ? "\033[32mPASSED\033[0m" : "\033[31mFAILED\033[0m");
+
+    return passed_top_k && passed_argsort;
+}
+
+int main(void) {
+    ggml_time_init();
+
+    bool passed = true;
+
+    for (bool ties : { false, true }) {
+        for (int n_threads : { 1, 4 }) {
+            // rows sorted with std::sort
+            passed &= test_top_k({ 16, 10, 10, 10 }, 1,  n_threads, ties);
+            passed &= test_top_k({ 16, 10, 10, 10 }, 16, n_threads, ties);
+            passed &= test_top_k({ 256, 32, 1, 1 },  8,  n_threads, ties); // moe routing
+            // rows sorted with the radix sort
+            passed &= test_top_k({ 8192, 3, 1, 1 },  40, n_threads, ties);
+            // few long rows, shared by all the threads
+            passed &= test_top_k({ 65536, 2, 1, 1 }, 40, n_threads, ties);
+            // segments of the threads shorter than k
+            passed &= test_top_k({ 40000, 1, 1, 1 }, 12000, n_threads, ties);
+        }
+    }
+
+    return passed ? 0 : 1;
+}